@@ -0,0 +1,300 @@
+﻿#include "admission.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+using Clock = std::chrono::steady_clock;
+
+// ---------------- latency histogram ----------------
+// Microseconds in quarter-octave buckets: 4 sub-buckets per power of two,
+// so a percentile is off by at most 25 %.
+struct LatencyHistogram {
+    static constexpr int kBuckets = 128;
+    std::array<uint64_t, kBuckets> counts{};
+    uint64_t total = 0;
+
+    static int BucketOf(uint64_t us) {
+        if (us < 4) return static_cast<int>(us);
+        int b = 2;
+        while (us >> (b + 1)) ++b;
+        int sub = static_cast<int>((us >> (b - 2)) & 3);
+        return std::min(kBuckets - 1, b * 4 + sub);
+    }
+    static double UpperMs(int i) {
+        if (i < 4) return (i + 1) / 1000.0;
+        int b = i / 4, sub = i % 4;
+        return static_cast<double>((4ull + sub + 1) << (b - 2)) / 1000.0;
+    }
+
+    void Add(uint64_t us) { ++counts[BucketOf(us)]; ++total; }
+    double Percentile(double p) const {
+        if (!total) return 0;
+        const uint64_t rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += counts[i];
+            if (seen >= rank) return UpperMs(i);
+        }
+        return UpperMs(kBuckets - 1);
+    }
+};
+
+// ---------------- state ----------------
+// One lane per class. A request that has to wait is parked
+// (crow::response::defer) in the lane's queue; the head is admitted when a
+// slot frees and resumed on its own io thread, so the queue is served in
+// arrival order and holds no thread meanwhile.
+struct Waiter {
+    asio::io_context& io;
+    crow::response& res;
+    AdmissionMiddleware::context& ctx;
+    asio::steady_timer timer;           // max_wait
+    Waiter(asio::io_context& io, crow::response& res, AdmissionMiddleware::context& ctx)
+        : io(io), res(res), ctx(ctx), timer(io) {}
+};
+
+struct Lane {
+    AdmissionMiddleware::Class cfg;
+    std::mutex mtx;
+    unsigned running = 0;
+    std::deque<std::shared_ptr<Waiter>> waiting;
+
+    uint64_t admitted = 0, waited = 0, shed_full = 0, shed_timeout = 0, throttled = 0;
+    uint64_t completed = 0;
+    double   service_ms = 0;
+    LatencyHistogram latency;
+
+    // seconds until a request arriving now would likely get a slot
+    unsigned RetryAfter() const {
+        const double slots = std::max(1u, cfg.max_running);
+        const double s = (static_cast<double>(waiting.size()) + running) * service_ms / slots / 1000.0;
+        return static_cast<unsigned>(std::max(1.0, std::ceil(s)));
+    }
+};
+
+struct AdmissionMiddleware::State {
+    std::vector<std::unique_ptr<Lane>> lanes;
+    int fallback = -1;                  // lane of the class without prefixes
+
+    struct Bucket {
+        double tokens;
+        Clock::time_point last;
+    };
+    static constexpr size_t kMaxClients = 4096;
+    std::mutex bucket_mtx;
+    std::unordered_map<std::string, Bucket> buckets;
+
+    int Classify(const crow::request& req) const {
+        const std::string& url = req.url;
+        int best = fallback;
+        size_t best_len = 0;
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            const auto& methods = lanes[i]->cfg.methods;
+            if (!methods.empty() && std::find(methods.begin(), methods.end(), req.method) == methods.end()) continue;
+            for (const auto& p : lanes[i]->cfg.prefixes) {
+                // on a tie a class limited to some methods is the closer match
+                const bool longer = p.size() > best_len || (p.size() == best_len && best_len && !methods.empty());
+                if (longer && url.compare(0, p.size(), p) == 0) {
+                    best = static_cast<int>(i);
+                    best_len = p.size();
+                }
+            }
+        }
+        return best;
+    }
+
+    // Takes `cost` tokens from the client's bucket; otherwise sets `retry`
+    // to the seconds until it holds that many.
+    bool Take(const std::string& client, double cost, double rate, double burst, unsigned& retry) {
+        const auto now = Clock::now();
+        std::lock_guard<std::mutex> lk(bucket_mtx);
+        auto it = buckets.find(client);
+        if (it == buckets.end()) {
+            if (buckets.size() >= kMaxClients) {
+                // forget clients whose buckets have refilled; they lose nothing
+                for (auto b = buckets.begin(); b != buckets.end();) {
+                    const double idle = std::chrono::duration<double>(now - b->second.last).count();
+                    if (b->second.tokens + idle * rate >= burst) b = buckets.erase(b);
+                    else ++b;
+                }
+            }
+            it = buckets.emplace(client, Bucket{ burst, now }).first;
+        }
+        Bucket& b = it->second;
+        const double idle = std::chrono::duration<double>(now - b.last).count();
+        b.tokens = std::min(burst, b.tokens + idle * rate);
+        b.last = now;
+        if (b.tokens >= cost) {
+            b.tokens -= cost;
+            return true;
+        }
+        retry = static_cast<unsigned>(std::max(1.0, std::ceil((cost - b.tokens) / rate)));
+        return false;
+    }
+};
+
+static void reject(crow::response& res, int code, unsigned retry_after) {
+    res.code = code;
+    res.set_header("Retry-After", std::to_string(retry_after));
+    res.set_header("Cache-Control", "no-store");
+    res.set_header("Content-Type", "text/plain; charset=utf-8");
+    res.body = code == 429 ? "Too many requests from this client, retry later\n" : "Server busy, retry later\n";
+    res.end();
+}
+
+// ---------------- middleware ----------------
+AdmissionMiddleware::AdmissionMiddleware() : state_(new State) {}
+AdmissionMiddleware::~AdmissionMiddleware() = default;
+AdmissionMiddleware::AdmissionMiddleware(AdmissionMiddleware&&) noexcept = default;
+
+void AdmissionMiddleware::AddClass(Class c) {
+    if (c.prefixes.empty()) state_->fallback = static_cast<int>(state_->lanes.size());
+    auto lane = std::unique_ptr<Lane>(new Lane);
+    lane->cfg = std::move(c);
+    state_->lanes.push_back(std::move(lane));
+}
+
+void AdmissionMiddleware::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    // websocket upgrades never reach after_handle
+    if (req.upgrade) return;
+    ctx.arrived = Clock::now();
+    ctx.cls = state_->Classify(req);
+    if (ctx.cls < 0) return;
+    Lane& lane = *state_->lanes[ctx.cls];
+
+    if (client_rate > 0 && lane.cfg.cost > 0) {
+        unsigned retry = 1;
+        if (!state_->Take(req.remote_ip_address, lane.cfg.cost, client_rate, std::max(client_burst, lane.cfg.cost), retry)) {
+            {
+                std::lock_guard<std::mutex> lk(lane.mtx);
+                ++lane.throttled;
+            }
+            reject(res, 429, retry);
+            return;
+        }
+    }
+
+    std::unique_lock<std::mutex> lk(lane.mtx);
+    const unsigned limit = lane.cfg.max_running;
+    if (limit == 0 || (lane.running < limit && lane.waiting.empty())) {
+        ++lane.running;
+        ++lane.admitted;
+        ctx.admitted = true;
+        ctx.started = Clock::now();
+        return;
+    }
+    if (lane.waiting.size() >= lane.cfg.max_queued) {
+        ++lane.shed_full;
+        const unsigned retry = lane.RetryAfter();
+        lk.unlock();
+        reject(res, 503, retry);
+        return;
+    }
+
+    auto waiter = std::make_shared<Waiter>(*req.io_context, res, ctx);
+    lane.waiting.push_back(waiter);
+    res.defer();
+    waiter->timer.expires_at(ctx.arrived + lane.cfg.max_wait);
+    lk.unlock();
+    Lane* lp = &lane;
+    waiter->timer.async_wait([lp, waiter](const asio::error_code& ec) {
+        if (ec) return;
+        std::unique_lock<std::mutex> lk(lp->mtx);
+        // admitted meanwhile: its resume is already on the way
+        auto it = std::find(lp->waiting.begin(), lp->waiting.end(), waiter);
+        if (it == lp->waiting.end()) return;
+        lp->waiting.erase(it);
+        ++lp->shed_timeout;
+        const unsigned retry = lp->RetryAfter();
+        lk.unlock();
+        reject(waiter->res, 503, retry);
+    });
+}
+
+// Frees a slot of `lane` and hands it to the head of the queue. `started` and
+// `arrived` are copies: a streamed response releases after its context is gone.
+static void release(Lane& lane, Clock::time_point arrived, Clock::time_point started) {
+    const auto now = Clock::now();
+    const double service = std::chrono::duration<double, std::milli>(now - started).count();
+    const auto total_us = std::chrono::duration_cast<std::chrono::microseconds>(now - arrived).count();
+    std::vector<std::shared_ptr<Waiter>> next;
+    {
+        std::lock_guard<std::mutex> lk(lane.mtx);
+        --lane.running;
+        lane.service_ms = ++lane.completed == 1 ? service : lane.service_ms * 0.9 + service * 0.1;
+        lane.latency.Add(static_cast<uint64_t>(std::max<int64_t>(0, total_us)));
+        // the freed slot goes to the head of the queue
+        while (!lane.waiting.empty() && lane.running < lane.cfg.max_running) {
+            auto w = std::move(lane.waiting.front());
+            lane.waiting.pop_front();
+            ++lane.running;
+            ++lane.admitted;
+            ++lane.waited;
+            w->ctx.admitted = true;
+            next.push_back(std::move(w));
+        }
+    }
+    // this may run on the pool: each resumes on its own io thread
+    for (auto& w : next) {
+        asio::post(w->io, [w] {
+            w->timer.cancel();
+            w->ctx.started = Clock::now();
+            w->res.resume();
+        });
+    }
+}
+
+// A slot held by a streamed body, released with the last copy of the source:
+// when the stream ends, fails or is dropped for a gone client.
+struct StreamSlot {
+    Lane& lane;
+    Clock::time_point arrived, started;
+    StreamSlot(Lane& lane, Clock::time_point arrived, Clock::time_point started)
+        : lane(lane), arrived(arrived), started(started) {}
+    ~StreamSlot() { release(lane, arrived, started); }
+};
+
+void AdmissionMiddleware::after_handle(crow::request& /*req*/, crow::response& res, context& ctx) {
+    if (!ctx.admitted) return;
+    ctx.admitted = false;
+    Lane& lane = *state_->lanes[ctx.cls];
+    if (!res.body_source) {
+        release(lane, ctx.arrived, ctx.started);
+        return;
+    }
+    // the body is encoded (and compressed) as it is pulled: that work
+    // still counts against the class
+    auto slot = std::make_shared<StreamSlot>(lane, ctx.arrived, ctx.started);
+    res.body_source = [src = std::move(res.body_source), slot](std::string& chunk) { return src(chunk); };
+}
+
+AdmissionMiddleware::Stats AdmissionMiddleware::GetStats(bool reset) {
+    Stats out;
+    for (const auto& lp : state_->lanes) {
+        Lane& lane = *lp;
+        std::lock_guard<std::mutex> lk(lane.mtx);
+        ClassStats cs;
+        cs.name = lane.cfg.name;
+        cs.running = lane.running;
+        cs.queued = static_cast<unsigned>(lane.waiting.size());
+        cs.max_running = lane.cfg.max_running;
+        cs.max_queued = lane.cfg.max_queued;
+        cs.admitted = lane.admitted;
+        cs.waited = lane.waited;
+        cs.shed_full = lane.shed_full;
+        cs.shed_timeout = lane.shed_timeout;
+        cs.throttled = lane.throttled;
+        cs.service_ms = lane.service_ms;
+        cs.p50_ms = lane.latency.Percentile(0.50);
+        cs.p99_ms = lane.latency.Percentile(0.99);
+        if (reset) lane.latency = LatencyHistogram();
+        out.classes.push_back(std::move(cs));
+    }
+    std::lock_guard<std::mutex> lk(state_->bucket_mtx);
+    out.clients = state_->buckets.size();
+    return out;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "crow/http_request.h"
+#include "crow/http_response.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Crow middleware: admission control by request class.
+//  - every request belongs to the class with the longest matching URL
+//    prefix (among the classes taking its method, and preferring one
+//    limited to some methods on a tie); a class without prefixes takes
+//    whatever matches nothing else
+//  - a class runs at most max_running requests at once; beyond that up to
+//    max_queued wait (first come, first served) for at most max_wait, and
+//    the rest are shed at once with 503 and a Retry-After estimated from
+//    the class's recent service times
+//  - optional per-client token buckets (client_rate tokens per second,
+//    client_burst deep, keyed by peer address); each request takes its
+//    class's cost, and an empty bucket answers 429 with Retry-After
+// A queued request is parked (crow::response::defer) and resumed on its io
+// thread when admitted, so it holds no thread while it waits; a running one
+// holds its io thread unless its handler renders elsewhere, and a streamed
+// response keeps its slot until the body has been pulled. Register after
+// ResponseCacheMiddleware so cache hits and coalesced requests are never
+// counted against a class.
+struct AdmissionMiddleware {
+    struct Class {
+        std::string name;
+        std::vector<std::string> prefixes;
+        unsigned max_running = 0;                       // 0 = unlimited
+        unsigned max_queued = 0;
+        std::chrono::milliseconds max_wait{ 250 };
+        double   cost = 1;                              // tokens per request
+        std::vector<crow::HTTPMethod> methods;          // only these; empty = any
+    };
+
+    struct context {
+        int  cls = -1;
+        bool admitted = false;                          // holds a slot of cls
+        std::chrono::steady_clock::time_point arrived;
+        std::chrono::steady_clock::time_point started;  // admitted
+    };
+
+    struct ClassStats {
+        std::string name;
+        unsigned running = 0;
+        unsigned queued = 0;
+        unsigned max_running = 0;
+        unsigned max_queued = 0;
+        uint64_t admitted = 0;
+        uint64_t waited = 0;            // admitted after queueing
+        uint64_t shed_full = 0;         // 503: queue full
+        uint64_t shed_timeout = 0;      // 503: waited max_wait
+        uint64_t throttled = 0;         // 429: client out of tokens
+        double   service_ms = 0;        // moving average, handler only
+        double   p50_ms = 0;            // arrival to response, admitted requests
+        double   p99_ms = 0;
+    };
+
+    struct Stats {
+        std::vector<ClassStats> classes;
+        size_t clients = 0;             // token buckets tracked
+    };
+
+    double client_rate = 0;             // tokens per second; 0 = no per-client limit
+    double client_burst = 20;
+
+    AdmissionMiddleware();
+    ~AdmissionMiddleware();
+    AdmissionMiddleware(AdmissionMiddleware&&) noexcept;
+
+    // Configure before app.run().
+    void AddClass(Class c);
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+
+    // reset: start the latency percentiles afresh
+    Stats GetStats(bool reset = false);
+
+    struct State;
+
+private:
+    std::unique_ptr<State> state_;
+};
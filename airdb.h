@@ -4,6 +4,17 @@
 #include <unordered_map>
 #include <memory>
 #include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <array>
+#include <functional>
+
+#include "bitmap.h"
+#include "encode.h"
+#include "snapshot_memory.h"
+
+class ComputePool;
+class Deadline;
 
 namespace crow { namespace json { struct wvalue; } }
 
@@ -18,6 +29,7 @@ struct Airline {
     std::string active; // "Y"/"N"
 
     crow::json::wvalue toJSON() const;
+    static const RowSchema<Airline>& Schema(); // same fields as toJSON()
 };
 
 struct Airport {
@@ -37,6 +49,7 @@ struct Airport {
     std::string source;
 
     crow::json::wvalue toJSON() const;
+    static const RowSchema<Airport>& Schema();
 };
 
 struct Route {
@@ -49,10 +62,117 @@ struct Route {
     std::string codeshare; // "Y" or ""
     int         stops = 0;
     std::string equipment;
+    std::vector<uint16_t> equipment_ids; // dictionary-encoded `equipment` tokens
+
+    crow::json::wvalue toJSON() const;
+    static const RowSchema<Route>& Schema();
+};
+
+// A one-stop connection over two nonstop routes (indices into GetAllRoutes()).
+struct OneHopMatch {
+    uint32_t leg1 = 0;
+    uint32_t leg2 = 0;
+    int      total_miles = 0; // great-circle src -> via -> dst
+};
+
+// The row /onehop returns for a match.
+struct OneHopRoute {
+    std::string src;
+    std::string via;
+    std::string dst;
+    std::string leg1_airline;
+    std::string leg2_airline;
+    int         total_miles = 0;
+
+    void Assign(const OneHopMatch& m, const std::vector<Route>& routes);
+    static const RowSchema<OneHopRoute>& Schema();
+};
+
+// One entry of a batch lookup (/api/batch).
+struct BatchLookup {
+    enum class Kind : uint8_t { Airport, Airline, RoutePair };
+    Kind        kind = Kind::Airport;
+    std::string code;   // IATA, ICAO or decimal id; the source IATA of a route pair
+    std::string dst;    // route pairs only
+};
+
+// What a BatchLookup resolved to; empty when nothing matched.
+struct BatchHit {
+    std::shared_ptr<Airport> airport;
+    std::shared_ptr<Airline> airline;
+    std::vector<uint32_t>    routes;  // indices into GetAllRoutes(), ascending
+};
+
+// Route-distance summary; histogram buckets end at kBucketKm (last is open).
+struct DistanceStats {
+    static constexpr std::array<int, 6> kBucketKm = { 500, 1000, 2000, 4000, 8000, 0 };
+    uint32_t routes = 0;
+    double   min_km = 0.0;
+    double   max_km = 0.0;
+    double   mean_km = 0.0;
+    std::array<uint32_t, 6> histogram{};
+
+    void Add(double km);
+    crow::json::wvalue toJSON() const;
+};
+
+// Precomputed per-aircraft-type summary.
+struct EquipmentStats {
+    std::string type;
+    std::vector<std::pair<std::string, uint32_t>> airlines; // (iata, routes), busiest first
+    DistanceStats distance;
+
+    crow::json::wvalue toJSON() const;
+};
+
+// Precomputed per-airline fleet summary.
+struct AirlineFleet {
+    std::string airline_iata;
+    std::vector<std::pair<std::string, uint32_t>> types;    // (type, routes), busiest first
+    DistanceStats distance;
+
+    crow::json::wvalue toJSON() const;
+};
+
+// A group of airports serving one city (LHR/LGW/STN/LCY/LTN -> London).
+// Each metro area is a supernode in the route graph so that place-to-place
+// searches run as a single multi-source / multi-target pass.
+struct MetroArea {
+    int         id = -1;
+    std::string name;     // "London, United Kingdom"
+    std::string city;
+    std::string country;
+    std::vector<std::string> airports; // member IATA codes, busiest first
 
     crow::json::wvalue toJSON() const;
 };
 
+struct PathLeg {
+    std::string src_iata;
+    std::string dst_iata;
+    int         distance_km = 0;
+    std::vector<std::string> airlines;
+};
+
+struct PathResult {
+    bool found = false;
+    int  total_km = 0;
+    std::vector<PathLeg> legs;
+};
+
+// Attribute filter for QueryRoutes. Values inside one list are OR-ed, the
+// lists themselves are AND-ed; an empty list does not constrain.
+struct RouteFilter {
+    std::vector<std::string> airlines;
+    std::vector<std::string> src;
+    std::vector<std::string> dst;
+    std::vector<std::string> src_countries;
+    std::vector<std::string> dst_countries;
+    std::vector<std::string> equipment;   // individual types, e.g. "738"
+    std::vector<int>         stops;
+    int codeshare = -1;                   // -1 any, 0 exclude codeshares, 1 only codeshares
+};
+
 class AirTravelDB {
 public:
     // Bulk access (used for suggestions / name contains)
@@ -68,25 +188,136 @@ public:
     std::shared_ptr<Airport> GetAirportByICAO(const std::string& icao) const;
     std::shared_ptr<Airport> GetAirportByID(int id) const;
 
+    // Dataset version; changes whenever a loader or index build modifies the
+    // data. Values are unique across AirTravelDB instances in this process.
+    uint64_t Epoch() const { return epoch_.load(std::memory_order_acquire); }
+
+    // Intra-query parallelism: a scan, aggregation or distance pass worth
+    // more than 2 * grain work units (rows times a per-row cost) is split
+    // into chunks run on `pool`, the calling thread included. Without a
+    // pool, or with grain 0, everything runs inline. Set before loading.
+    void SetParallelism(ComputePool* pool, size_t grain = 16384);
+    // Chunks a pass over `rows` rows of `row_cost` units each splits into
+    // (1 = run inline)
+    size_t ParallelChunks(size_t rows, size_t row_cost = 1) const;
+    // Runs body(chunk, begin, end) over `chunks` contiguous slices of
+    // [0, rows), in ascending order, and returns when all have run; merging
+    // per-chunk partial results in chunk order keeps table order.
+    void ParallelFor(size_t rows, size_t chunks,
+        const std::function<void(size_t, size_t, size_t)>& body) const;
+
     // Loaders
     bool LoadAirlinesCSV(const std::string& path);
     bool LoadAirportsCSV(const std::string& path);
     bool LoadRoutesCSV(const std::string& path);
+    // The loaders in two steps, for datasets built from rows held in memory
+    // (LiveDataset): Read* parse a file in file order, Add* index the rows.
+    static bool ReadAirlinesCSV(const std::string& path, std::vector<Airline>& out);
+    static bool ReadAirportsCSV(const std::string& path, std::vector<Airport>& out);
+    static bool ReadRoutesCSV(const std::string& path, std::vector<Route>& out);
+    void AddAirlines(const std::vector<Airline>& rows);
+    void AddAirports(const std::vector<Airport>& rows);
+    void AddRoutes(const std::vector<Route>& rows);   // equipment_ids are recomputed
+
+    // Incremental versions (LiveDataset). CopyFrom takes over the rows and
+    // derived indexes of a built database, under a new epoch (not its
+    // snapshot placement or parallelism). The upserts then replace the row
+    // with the same id, or add one, along with its lookup keys. Nothing is
+    // derived from an airline row; UpsertAirport returns true when the
+    // route graph and bitmaps depend on what changed (a new airport, or its
+    // code, position, city or country), and BuildIndexes has to run again.
+    // ReplaceRoutes swaps in a new route table, keeping the equipment ids of
+    // rows that have them (rows taken from this database); BuildIndexes
+    // after it.
+    void CopyFrom(const AirTravelDB& other);
+    void UpsertAirline(const Airline& row);
+    bool UpsertAirport(const Airport& row);
+    void ReplaceRoutes(std::vector<Route> rows);
 
     // Routes
     std::vector<Route> GetRoutesFromTo(const std::string& src_iata,
         const std::string& dst_iata) const;
-    std::vector<Route> SearchRoutes(const std::string& token) const;
+    // Indices of the same routes from index `start` on, at most `limit` (0 = all)
+    std::vector<uint32_t> GetRouteIdsFromTo(const std::string& src_iata,
+        const std::string& dst_iata, uint32_t start = 0, size_t limit = 0) const;
+    // Resolves every lookup under one acquisition of the lock, so the batch
+    // sees a single dataset version (written to `epoch`). Airports try the
+    // id, IATA, then ICAO like /airport/<term>, airlines IATA, ICAO, then
+    // the id; neither falls back to a name search. Route pairs list the rows
+    // GetRouteIdsFromTo would, found by intersecting the route bitmaps.
+    std::vector<BatchHit> LookupBatch(const std::vector<BatchLookup>& items,
+        uint64_t* epoch = nullptr) const;
+    // Every src -> via -> dst connection over two nonstop routes, in
+    // discovery order (first legs in table order, then second legs). When
+    // `deadline` fires, the connections found so far (deadline->Fired()).
+    std::vector<OneHopMatch> FindOneHop(const std::string& src_iata,
+        const std::string& dst_iata, Deadline* deadline = nullptr) const;
+    // Indices (into GetAllRoutes()) of routes whose airline, source or
+    // destination code contains `token`, case-insensitively, in table order.
+    std::vector<uint32_t> SearchRoutes(const std::string& token) const;
 
     // Geo
     double CalculateDistanceKm(double lat1, double lon1,
         double lat2, double lon2) const;
+    // Airports within radius_km of (lat, lon) with their rounded distance, by id
     std::vector<std::pair<std::shared_ptr<Airport>, int>>
         GetAirportsWithinRadiusKm(double lat, double lon, double radius_km) const;
 
     // Routes
     const std::vector<Route>& GetAllRoutes() const;
 
+    // Route graph + metro areas (call once after all loaders have run).
+    // Airports with routes in the same city/country are grouped, and a lone
+    // airport within metro_radius_km of a group joins it (EWR -> New York).
+    void BuildRouteGraph(double metro_radius_km = 50.0);
+    std::vector<MetroArea> GetMetroAreas() const;
+    std::shared_ptr<MetroArea> GetMetroArea(const std::string& term) const;
+
+    // Resolves an IATA code, a comma separated code list, a metro/city name
+    // ("London" or "London, United Kingdom") to the IATA codes it covers.
+    std::vector<std::string> ResolvePlace(const std::string& term) const;
+
+    // Itinerary with the fewest legs, then the shortest great-circle
+    // distance, from any source to any target, computed in one Dijkstra pass
+    // over the graph. A search cut short by
+    // `deadline` has not settled a target yet, so it reports no path.
+    PathResult FindShortestPath(const std::string& from, const std::string& to,
+        Deadline* deadline = nullptr) const;
+
+    // Builds every derived index; equivalent to BuildRouteGraph,
+    // BuildEquipmentIndex and BuildRouteBitmaps in that order, then places
+    // the snapshot arrays again if a placement is set.
+    void BuildIndexes(double metro_radius_km = 50.0);
+
+    // Copies the arrays SearchRoutes and FindShortestPath scan (route code
+    // columns, route graph) as `placement` says; queries then read the copy
+    // of the node they run on. Loading routes or rebuilding the graph drops
+    // the copies until the next BuildIndexes.
+    void PlaceSnapshot(const SnapshotPlacement& placement);
+    // name -> copies, for the startup report
+    std::vector<std::pair<std::string, const ReplicatedArray*>> SnapshotArrays() const;
+
+    // Bitmap indexes over route attributes (call once after loading).
+    void BuildRouteBitmaps();
+    // Evaluates the filter with bitmap AND/OR and copies out at most `limit`
+    // matching rows (0 = all). `total` receives the full match count.
+    std::vector<Route> QueryRoutes(const RouteFilter& filter, size_t limit = 0,
+        size_t* total = nullptr) const;
+    // Same, as indices into GetAllRoutes() (4 bytes per match, for streaming),
+    // skipping matches below index `start` (keyset pagination)
+    std::vector<uint32_t> QueryRouteIds(const RouteFilter& filter, size_t limit = 0,
+        size_t* total = nullptr, uint32_t start = 0) const;
+
+    // Equipment (aircraft type) postings and fleet analytics
+    void BuildEquipmentIndex();
+    std::vector<EquipmentStats> GetEquipmentTypes() const;
+    std::shared_ptr<EquipmentStats> GetEquipmentStats(const std::string& type) const;
+    std::vector<Route> GetRoutesByEquipment(const std::string& type, size_t limit = 0) const;
+    std::vector<uint32_t> GetRouteIdsByEquipment(const std::string& type, size_t limit = 0,
+        uint32_t start = 0) const;
+    std::shared_ptr<AirlineFleet> GetAirlineFleet(const std::string& airline_iata) const;
+    const std::string& EquipmentCode(uint16_t id) const;
+
 private:
     // parsing helpers used by loaders
     static std::vector<std::string> parseCSVLine(const std::string& line);
@@ -100,8 +331,70 @@ private:
     std::unordered_map<std::string, std::shared_ptr<Airport>> airports_by_iata_;
     std::unordered_map<int, std::shared_ptr<Airport>>         airports_by_id_;
     std::unordered_map<std::string, std::shared_ptr<Airport>> airports_by_icao_;
+    std::vector<std::shared_ptr<Airport>>                     airports_; // by id, for scans
 
     std::vector<Route> routes_;
+
+    // pre-uppercased codes packed 4 bytes per row, parallel to routes_;
+    // rows with a code PackCode refuses (longer, or holding a NUL) are listed
+    // in long_code_rows_ and checked scalar
+    std::vector<uint32_t> code_airline_, code_src_, code_dst_;
+    std::vector<uint32_t> long_code_rows_;
+
+    // route graph: airport nodes [0, N) followed by metro supernodes [N, N+M).
+    // Airport out-edges are stored CSR style; every edge owns a slice of
+    // edge_routes_ (indices into routes_) listing the operating carriers.
+    struct GraphEdge {
+        uint32_t to;
+        uint32_t distance_km;
+        uint32_t routes_begin;
+        uint32_t routes_end;
+    };
+    std::vector<std::shared_ptr<Airport>>     nodes_;
+    std::unordered_map<std::string, uint32_t> node_by_iata_;
+    std::vector<uint32_t>  edge_offsets_;
+    std::vector<GraphEdge> edges_;
+    std::vector<uint32_t>  edge_routes_;
+    std::vector<std::shared_ptr<MetroArea>>   metros_;
+    std::unordered_map<std::string, std::vector<uint32_t>> metros_by_city_; // lowercase city -> metro ids
+    std::vector<int>       metro_of_node_;
+
+    std::vector<uint32_t> resolveNodes(const std::string& term) const; // requires mtx_
+
+    // placed copies of the arrays above (see PlaceSnapshot); guarded by mtx_
+    struct Snapshot {
+        Replicated<uint32_t>  code_airline, code_src, code_dst;
+        Replicated<uint32_t>  edge_offsets;
+        Replicated<GraphEdge> edges;
+    } snapshot_;
+    SnapshotPlacement placement_;
+    void placeSnapshot();   // requires mtx_
+    void dropSnapshot();    // requires mtx_
+
+    // equipment dictionary (filled by LoadRoutesCSV) and postings
+    std::vector<std::string>                  equipment_codes_;
+    std::unordered_map<std::string, uint16_t> equipment_by_code_;
+    std::vector<std::vector<uint32_t>>        equipment_routes_; // type id -> route indices
+    std::vector<std::shared_ptr<EquipmentStats>> equipment_stats_;
+    std::unordered_map<std::string, std::shared_ptr<AirlineFleet>> fleets_;
+
+    // route bitmaps; string keys are upper-case codes / lower-case countries
+    struct RouteBitmaps {
+        std::unordered_map<std::string, Bitmap> airline, src, dst;
+        std::unordered_map<std::string, Bitmap> src_country, dst_country;
+        std::unordered_map<std::string, Bitmap> equipment;
+        std::unordered_map<int, Bitmap>         stops;
+        Bitmap codeshare;
+        Bitmap all;
+    } bitmaps_;
+
+    ComputePool* pool_ = nullptr;
+    size_t       grain_ = 0;
+
+    void addRoutesLocked(std::vector<Route> rows);   // requires mtx_
+    void bumpEpoch();
+    std::atomic<uint64_t> epoch_{ 0 };
+
     mutable std::mutex mtx_;
 };
 
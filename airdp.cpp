@@ -2,12 +2,18 @@
 #include <cmath>
 
 #include "airdb.h"
+#include "codescan.h"
+#include "compute_pool.h"
+#include "deadline.h"
 #include "crow/json.h"
 
 #include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <queue>
+#include <limits>
+#include <iterator>
 
 using crow::json::wvalue;
 
@@ -58,6 +64,148 @@ wvalue Route::toJSON() const {
     return j;
 }
 
+// ---------------- Row schemas ----------------
+const RowSchema<Airline>& Airline::Schema() {
+    static constexpr FieldDesc<Airline> kFields[] = {
+        IntField("id", &Airline::id),
+        StrField("name", &Airline::name),
+        StrField("alias", &Airline::alias),
+        StrField("iata", &Airline::iata),
+        StrField("icao", &Airline::icao),
+        StrField("callsign", &Airline::callsign),
+        StrField("country", &Airline::country),
+        StrField("active", &Airline::active),
+    };
+    // the order /airline/<term> has always answered in (toJSON().dump() of
+    // one airline; selftest checks it)
+    static const RowSchema<Airline> schema(kFields,
+        { "active", "callsign", "icao", "iata", "alias", "country", "name", "id" });
+    return schema;
+}
+
+const RowSchema<Airport>& Airport::Schema() {
+    static constexpr FieldDesc<Airport> kFields[] = {
+        IntField("id", &Airport::id),
+        StrField("name", &Airport::name),
+        StrField("city", &Airport::city),
+        StrField("country", &Airport::country),
+        StrField("iata", &Airport::iata),
+        StrField("icao", &Airport::icao),
+        DblField("latitude", &Airport::latitude),
+        DblField("longitude", &Airport::longitude),
+        IntField("altitude_ft", &Airport::altitude_ft),
+        DblField("tz_offset", &Airport::tz_offset),
+        StrField("dst", &Airport::dst),
+        StrField("tz_db", &Airport::tz_db),
+        StrField("type", &Airport::type),
+        StrField("source", &Airport::source),
+    };
+    // the order /airport/<term> has always answered in, like Airline's
+    static const RowSchema<Airport> schema(kFields,
+        { "source", "id", "longitude", "name", "country", "tz_db", "type", "iata", "icao", "city",
+          "altitude_ft", "latitude", "tz_offset", "dst" });
+    return schema;
+}
+
+const RowSchema<Route>& Route::Schema() {
+    static constexpr FieldDesc<Route> kFields[] = {
+        StrField("airline_iata", &Route::airline_iata),
+        IntField("airline_id", &Route::airline_id),
+        StrField("src_iata", &Route::src_iata),
+        IntField("src_id", &Route::src_id),
+        StrField("dst_iata", &Route::dst_iata),
+        IntField("dst_id", &Route::dst_id),
+        StrField("codeshare", &Route::codeshare),
+        IntField("stops", &Route::stops),
+        StrField("equipment", &Route::equipment),
+    };
+    static const RowSchema<Route> schema(kFields);
+    return schema;
+}
+
+const RowSchema<OneHopRoute>& OneHopRoute::Schema() {
+    static constexpr FieldDesc<OneHopRoute> kFields[] = {
+        StrField("src", &OneHopRoute::src),
+        StrField("via", &OneHopRoute::via),
+        StrField("dst", &OneHopRoute::dst),
+        StrField("leg1_airline", &OneHopRoute::leg1_airline),
+        StrField("leg2_airline", &OneHopRoute::leg2_airline),
+        IntField("total_miles", &OneHopRoute::total_miles),
+    };
+    static const RowSchema<OneHopRoute> schema(kFields);
+    return schema;
+}
+
+wvalue MetroArea::toJSON() const {
+    wvalue j;
+    j["id"] = id;
+    j["name"] = name;
+    j["city"] = city;
+    j["country"] = country;
+    j["airports"] = wvalue::list();
+    for (size_t i = 0; i < airports.size(); ++i) j["airports"][i] = airports[i];
+    return j;
+}
+
+void DistanceStats::Add(double km) {
+    if (routes == 0 || km < min_km) min_km = km;
+    if (routes == 0 || km > max_km) max_km = km;
+    mean_km += (km - mean_km) / (routes + 1);
+    ++routes;
+    size_t b = 0;
+    while (b + 1 < kBucketKm.size() && km >= kBucketKm[b]) ++b;
+    ++histogram[b];
+}
+
+wvalue DistanceStats::toJSON() const {
+    wvalue j;
+    j["routes"] = routes;
+    j["min_km"] = static_cast<int>(std::lround(min_km));
+    j["max_km"] = static_cast<int>(std::lround(max_km));
+    j["mean_km"] = static_cast<int>(std::lround(mean_km));
+    j["histogram"] = wvalue::list();
+    for (size_t b = 0; b < histogram.size(); ++b) {
+        wvalue h;
+        h["from_km"] = b == 0 ? 0 : kBucketKm[b - 1];
+        if (kBucketKm[b]) h["to_km"] = kBucketKm[b];
+        h["routes"] = histogram[b];
+        j["histogram"][b] = std::move(h);
+    }
+    return j;
+}
+
+wvalue EquipmentStats::toJSON() const {
+    wvalue j;
+    j["type"] = type;
+    j["routes"] = distance.routes;
+    j["airline_count"] = static_cast<uint64_t>(airlines.size());
+    j["airlines"] = wvalue::list();
+    for (size_t i = 0; i < airlines.size(); ++i) {
+        wvalue a;
+        a["airline_iata"] = airlines[i].first;
+        a["routes"] = airlines[i].second;
+        j["airlines"][i] = std::move(a);
+    }
+    j["distance"] = distance.toJSON();
+    return j;
+}
+
+wvalue AirlineFleet::toJSON() const {
+    wvalue j;
+    j["airline_iata"] = airline_iata;
+    j["routes"] = distance.routes;
+    j["type_count"] = static_cast<uint64_t>(types.size());
+    j["types"] = wvalue::list();
+    for (size_t i = 0; i < types.size(); ++i) {
+        wvalue t;
+        t["type"] = types[i].first;
+        t["routes"] = types[i].second;
+        j["types"][i] = std::move(t);
+    }
+    j["distance"] = distance.toJSON();
+    return j;
+}
+
 // ---------------- CSV helpers ----------------
 std::string AirTravelDB::cleanField(const std::string& s) {
     if (s.size() >= 2 && s.front() == '"' && s.back() == '"') {
@@ -108,75 +256,64 @@ static inline double toDouble(const std::string& s) {
     catch (...) { return 0.0; }
 }
 
-bool AirTravelDB::LoadAirlinesCSV(const std::string& path) {
+bool AirTravelDB::ReadAirlinesCSV(const std::string& path, std::vector<Airline>& out) {
     std::ifstream f(path);
     if (!f) { std::cerr << "Failed to open " << path << "\n"; return false; }
-    std::string line; size_t cnt = 0;
+    std::string line;
     while (std::getline(f, line)) {
         if (line.empty()) continue;
         auto fields = parseCSVLine(line);
         // OpenFlights airlines.dat format (no header)
         // id, name, alias, IATA, ICAO, callsign, country, active
         if (fields.size() < 8) continue;
-        auto a = std::make_shared<Airline>();
-        a->id = toInt(fields[0]);
-        a->name = fields[1];
-        a->alias = fields[2];
-        a->iata = fields[3];
-        a->icao = fields[4];
-        a->callsign = fields[5];
-        a->country = fields[6];
-        a->active = fields[7];
-        std::lock_guard<std::mutex> lk(mtx_);
-        if (!a->iata.empty() && a->iata != "\\N") airlines_by_iata_[a->iata] = a;
-        // NEW: index by ICAO too
-        if (!a->icao.empty() && a->icao != "\\N") airlines_by_icao_[a->icao] = a;
-        airlines_by_id_[a->id] = a;
-        ++cnt;
+        Airline a;
+        a.id = toInt(fields[0]);
+        a.name = fields[1];
+        a.alias = fields[2];
+        a.iata = fields[3];
+        a.icao = fields[4];
+        a.callsign = fields[5];
+        a.country = fields[6];
+        a.active = fields[7];
+        out.push_back(std::move(a));
     }
-    std::cout << "Loaded " << cnt << " airlines\n";
     return true;
 }
 
-bool AirTravelDB::LoadAirportsCSV(const std::string& path) {
+bool AirTravelDB::ReadAirportsCSV(const std::string& path, std::vector<Airport>& out) {
     std::ifstream f(path);
     if (!f) { std::cerr << "Failed to open " << path << "\n"; return false; }
-    std::string line; size_t cnt = 0;
+    std::string line;
     while (std::getline(f, line)) {
         if (line.empty()) continue;
         auto fields = parseCSVLine(line);
         // OpenFlights airports.dat (no header)
         // id, name, city, country, IATA, ICAO, lat, lon, alt, tz, dst, tzdb, type, source
         if (fields.size() < 14) continue;
-        auto ap = std::make_shared<Airport>();
-        ap->id = toInt(fields[0]);
-        ap->name = fields[1];
-        ap->city = fields[2];
-        ap->country = fields[3];
-        ap->iata = fields[4];
-        ap->icao = fields[5];
-        ap->latitude = toDouble(fields[6]);
-        ap->longitude = toDouble(fields[7]);
-        ap->altitude_ft = toInt(fields[8]);
-        ap->tz_offset = toDouble(fields[9]);
-        ap->dst = fields[10];
-        ap->tz_db = fields[11];
-        ap->type = fields[12];
-        ap->source = fields[13];
-        std::lock_guard<std::mutex> lk(mtx_);
-        if (!ap->iata.empty() && ap->iata != "\\N") airports_by_iata_[ap->iata] = ap;
-        if (!ap->icao.empty()) airports_by_icao_[ap->icao] = ap;
-        airports_by_id_[ap->id] = ap;
-        ++cnt;
+        Airport ap;
+        ap.id = toInt(fields[0]);
+        ap.name = fields[1];
+        ap.city = fields[2];
+        ap.country = fields[3];
+        ap.iata = fields[4];
+        ap.icao = fields[5];
+        ap.latitude = toDouble(fields[6]);
+        ap.longitude = toDouble(fields[7]);
+        ap.altitude_ft = toInt(fields[8]);
+        ap.tz_offset = toDouble(fields[9]);
+        ap.dst = fields[10];
+        ap.tz_db = fields[11];
+        ap.type = fields[12];
+        ap.source = fields[13];
+        out.push_back(std::move(ap));
     }
-    std::cout << "Loaded " << cnt << " airports\n";
     return true;
 }
 
-bool AirTravelDB::LoadRoutesCSV(const std::string& path) {
+bool AirTravelDB::ReadRoutesCSV(const std::string& path, std::vector<Route>& out) {
     std::ifstream f(path);
     if (!f) { std::cerr << "Failed to open " << path << "\n"; return false; }
-    std::string line; size_t cnt = 0;
+    std::string line;
     while (std::getline(f, line)) {
         if (line.empty()) continue;
         auto fields = parseCSVLine(line);
@@ -193,14 +330,235 @@ bool AirTravelDB::LoadRoutesCSV(const std::string& path) {
         r.codeshare = fields[6];
         r.stops = toInt(fields[7]);
         r.equipment = fields[8];
+        out.push_back(std::move(r));
+    }
+    return true;
+}
+
+void AirTravelDB::AddAirlines(const std::vector<Airline>& rows) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        for (const auto& row : rows) {
+            auto a = std::make_shared<Airline>(row);
+            if (!a->iata.empty() && a->iata != "\\N") airlines_by_iata_[a->iata] = a;
+            // NEW: index by ICAO too
+            if (!a->icao.empty() && a->icao != "\\N") airlines_by_icao_[a->icao] = a;
+            airlines_by_id_[a->id] = a;
+        }
+    }
+    std::cout << "Loaded " << rows.size() << " airlines\n";
+    bumpEpoch();
+}
+
+void AirTravelDB::AddAirports(const std::vector<Airport>& rows) {
+    {
         std::lock_guard<std::mutex> lk(mtx_);
+        for (const auto& row : rows) {
+            auto ap = std::make_shared<Airport>(row);
+            if (!ap->iata.empty() && ap->iata != "\\N") airports_by_iata_[ap->iata] = ap;
+            if (!ap->icao.empty()) airports_by_icao_[ap->icao] = ap;
+            airports_by_id_[ap->id] = ap;
+        }
+        airports_.clear();
+        airports_.reserve(airports_by_id_.size());
+        for (const auto& kv : airports_by_id_) airports_.push_back(kv.second);
+        std::sort(airports_.begin(), airports_.end(),
+            [](const std::shared_ptr<Airport>& a, const std::shared_ptr<Airport>& b) { return a->id < b->id; });
+    }
+    std::cout << "Loaded " << rows.size() << " airports\n";
+    bumpEpoch();
+}
+
+void AirTravelDB::AddRoutes(const std::vector<Route>& rows) {
+    std::vector<Route> copy(rows);
+    for (auto& r : copy) r.equipment_ids.clear();
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        addRoutesLocked(std::move(copy));
+    }
+    std::cout << "Loaded " << rows.size() << " routes\n";
+    bumpEpoch();
+}
+
+void AirTravelDB::addRoutesLocked(std::vector<Route> rows) {
+    // the code columns grow; queries read them directly until re-placed
+    dropSnapshot();
+    routes_.reserve(routes_.size() + rows.size());
+    for (auto& r : rows) {
+        // "320 738 77W" -> dictionary ids, unless the row brings them
+        std::stringstream ss(r.equipment_ids.empty() ? r.equipment : std::string());
+        std::string type;
+        while (ss >> type) {
+            std::transform(type.begin(), type.end(), type.begin(), ::toupper);
+            auto it = equipment_by_code_.find(type);
+            if (it == equipment_by_code_.end()) {
+                it = equipment_by_code_.emplace(type, static_cast<uint16_t>(equipment_codes_.size())).first;
+                equipment_codes_.push_back(type);
+            }
+            if (std::find(r.equipment_ids.begin(), r.equipment_ids.end(), it->second) == r.equipment_ids.end())
+                r.equipment_ids.push_back(it->second);
+        }
+        uint32_t a = 0, s = 0, d = 0;
+        bool fits = PackCode(r.airline_iata, a);
+        fits = PackCode(r.src_iata, s) && fits;
+        fits = PackCode(r.dst_iata, d) && fits;
+        if (!fits) long_code_rows_.push_back(static_cast<uint32_t>(routes_.size()));
+        code_airline_.push_back(a);
+        code_src_.push_back(s);
+        code_dst_.push_back(d);
         routes_.push_back(std::move(r));
-        ++cnt;
     }
-    std::cout << "Loaded " << cnt << " routes\n";
+}
+
+// ---------------- Incremental versions ----------------
+void AirTravelDB::CopyFrom(const AirTravelDB& other) {
+    {
+        std::lock_guard<std::mutex> theirs(other.mtx_);
+        std::lock_guard<std::mutex> lk(mtx_);
+        dropSnapshot();
+        airlines_by_iata_ = other.airlines_by_iata_;
+        airlines_by_id_ = other.airlines_by_id_;
+        airlines_by_icao_ = other.airlines_by_icao_;
+        airports_by_iata_ = other.airports_by_iata_;
+        airports_by_id_ = other.airports_by_id_;
+        airports_by_icao_ = other.airports_by_icao_;
+        airports_ = other.airports_;
+        routes_ = other.routes_;
+        code_airline_ = other.code_airline_;
+        code_src_ = other.code_src_;
+        code_dst_ = other.code_dst_;
+        long_code_rows_ = other.long_code_rows_;
+        nodes_ = other.nodes_;
+        node_by_iata_ = other.node_by_iata_;
+        edge_offsets_ = other.edge_offsets_;
+        edges_ = other.edges_;
+        edge_routes_ = other.edge_routes_;
+        metros_ = other.metros_;
+        metros_by_city_ = other.metros_by_city_;
+        metro_of_node_ = other.metro_of_node_;
+        equipment_codes_ = other.equipment_codes_;
+        equipment_by_code_ = other.equipment_by_code_;
+        equipment_routes_ = other.equipment_routes_;
+        equipment_stats_ = other.equipment_stats_;
+        fleets_ = other.fleets_;
+        bitmaps_ = other.bitmaps_;
+    }
+    bumpEpoch();
+}
+
+// Drops `key` from `index` if it still names `row`
+template <class Map, class Row>
+static void dropKey(Map& index, const std::string& key, const std::shared_ptr<Row>& row) {
+    auto it = index.find(key);
+    if (it != index.end() && it->second == row) index.erase(it);
+}
+
+void AirTravelDB::UpsertAirline(const Airline& row) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto a = std::make_shared<Airline>(row);
+        auto old = airlines_by_id_.find(row.id);
+        if (old != airlines_by_id_.end()) {
+            dropKey(airlines_by_iata_, old->second->iata, old->second);
+            dropKey(airlines_by_icao_, old->second->icao, old->second);
+        }
+        if (!a->iata.empty() && a->iata != "\\N") airlines_by_iata_[a->iata] = a;
+        if (!a->icao.empty() && a->icao != "\\N") airlines_by_icao_[a->icao] = a;
+        airlines_by_id_[a->id] = a;
+    }
+    bumpEpoch();
+}
+
+bool AirTravelDB::UpsertAirport(const Airport& row) {
+    bool reindex = true;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto ap = std::make_shared<Airport>(row);
+        auto old = airports_by_id_.find(row.id);
+        if (old != airports_by_id_.end()) {
+            const Airport& was = *old->second;
+            reindex = was.iata != row.iata || was.latitude != row.latitude || was.longitude != row.longitude ||
+                was.city != row.city || was.country != row.country;
+            dropKey(airports_by_iata_, was.iata, old->second);
+            dropKey(airports_by_icao_, was.icao, old->second);
+        }
+        if (!ap->iata.empty() && ap->iata != "\\N") airports_by_iata_[ap->iata] = ap;
+        if (!ap->icao.empty()) airports_by_icao_[ap->icao] = ap;
+        airports_by_id_[ap->id] = ap;
+        auto pos = std::lower_bound(airports_.begin(), airports_.end(), row.id,
+            [](const std::shared_ptr<Airport>& a, int id) { return a->id < id; });
+        if (pos != airports_.end() && (*pos)->id == row.id) *pos = ap;
+        else airports_.insert(pos, ap);
+        // same code and place: the graph keeps its node, with the new row
+        auto node = node_by_iata_.find(ap->iata);
+        if (!reindex && node != node_by_iata_.end()) nodes_[node->second] = ap;
+    }
+    bumpEpoch();
+    return reindex;
+}
+
+void AirTravelDB::ReplaceRoutes(std::vector<Route> rows) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        routes_.clear();
+        code_airline_.clear();
+        code_src_.clear();
+        code_dst_.clear();
+        long_code_rows_.clear();
+        addRoutesLocked(std::move(rows));
+    }
+    bumpEpoch();
+}
+
+bool AirTravelDB::LoadAirlinesCSV(const std::string& path) {
+    std::vector<Airline> rows;
+    if (!ReadAirlinesCSV(path, rows)) return false;
+    AddAirlines(rows);
+    return true;
+}
+
+bool AirTravelDB::LoadAirportsCSV(const std::string& path) {
+    std::vector<Airport> rows;
+    if (!ReadAirportsCSV(path, rows)) return false;
+    AddAirports(rows);
+    return true;
+}
+
+bool AirTravelDB::LoadRoutesCSV(const std::string& path) {
+    std::vector<Route> rows;
+    if (!ReadRoutesCSV(path, rows)) return false;
+    AddRoutes(rows);
     return true;
 }
 
+void AirTravelDB::bumpEpoch() {
+    static std::atomic<uint64_t> next_epoch{ 0 };
+    epoch_.store(next_epoch.fetch_add(1) + 1, std::memory_order_release);
+}
+
+// ---------------- Parallelism ----------------
+void AirTravelDB::SetParallelism(ComputePool* pool, size_t grain) {
+    pool_ = pool;
+    grain_ = grain;
+}
+
+size_t AirTravelDB::ParallelChunks(size_t rows, size_t row_cost) const {
+    if (!pool_ || grain_ == 0) return 1;
+    const size_t work = rows * std::max<size_t>(1, row_cost);
+    if (work < 2 * grain_) return 1;
+    return std::min<size_t>(work / grain_, pool_->Size() + 1);
+}
+
+void AirTravelDB::ParallelFor(size_t rows, size_t chunks,
+    const std::function<void(size_t, size_t, size_t)>& body) const {
+    chunks = std::max<size_t>(1, std::min(chunks, rows));
+    if (chunks == 1 || !pool_) {
+        if (rows) body(0, 0, rows);
+        return;
+    }
+    pool_->ParallelFor(chunks, [&](size_t c) { body(c, rows * c / chunks, rows * (c + 1) / chunks); });
+}
+
 // ---------------- Queries ----------------
 std::shared_ptr<Airline> AirTravelDB::GetAirlineByIATA(const std::string& iata) const {
     std::lock_guard<std::mutex> lk(mtx_);
@@ -234,18 +592,173 @@ std::vector<Route> AirTravelDB::GetRoutesFromTo(const std::string& src_iata,
     return out;
 }
 
-std::vector<Route> AirTravelDB::SearchRoutes(const std::string& token) const {
-    std::vector<Route> out;
+std::vector<uint32_t> AirTravelDB::GetRouteIdsFromTo(const std::string& src_iata,
+    const std::string& dst_iata, uint32_t start, size_t limit) const {
+    std::vector<uint32_t> out;
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (size_t i = start; i < routes_.size(); ++i) {
+        const auto& r = routes_[i];
+        if (r.src_iata != src_iata || r.dst_iata != dst_iata) continue;
+        out.push_back(static_cast<uint32_t>(i));
+        if (limit && out.size() >= limit) break;
+    }
+    return out;
+}
+
+std::vector<BatchHit> AirTravelDB::LookupBatch(const std::vector<BatchLookup>& items,
+    uint64_t* epoch) const {
+    std::vector<BatchHit> out(items.size());
+    auto find = [](const auto& index, const auto& key) {
+        auto it = index.find(key);
+        return it == index.end() ? nullptr : it->second;
+    };
+    auto as_id = [](const std::string& s, int& id) {
+        if (s.empty() || s.size() > 9 || !std::all_of(s.begin(), s.end(), ::isdigit)) return false;
+        id = std::stoi(s);
+        return true;
+    };
+    auto upper = [](std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+        return s;
+    };
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (epoch) *epoch = Epoch();
+    for (size_t i = 0; i < items.size(); ++i) {
+        const auto& q = items[i];
+        auto& hit = out[i];
+        int id = 0;
+        switch (q.kind) {
+        case BatchLookup::Kind::Airport:
+            if (as_id(q.code, id)) hit.airport = find(airports_by_id_, id);
+            if (!hit.airport) hit.airport = find(airports_by_iata_, q.code);
+            if (!hit.airport && q.code.size() == 4) hit.airport = find(airports_by_icao_, q.code);
+            break;
+        case BatchLookup::Kind::Airline:
+            hit.airline = find(airlines_by_iata_, q.code);
+            if (!hit.airline && q.code.size() == 3) hit.airline = find(airlines_by_icao_, q.code);
+            if (!hit.airline && as_id(q.code, id)) hit.airline = find(airlines_by_id_, id);
+            break;
+        case BatchLookup::Kind::RoutePair: {
+            // bitmap keys are upper-cased; the exact compare keeps the
+            // case-sensitive match of GetRouteIdsFromTo
+            auto keep = [&](uint32_t r) {
+                if (routes_[r].src_iata == q.code && routes_[r].dst_iata == q.dst) hit.routes.push_back(r);
+                return true;
+            };
+            auto s = bitmaps_.src.find(upper(q.code));
+            auto d = bitmaps_.dst.find(upper(q.dst));
+            if (bitmaps_.all.Empty()) {
+                for (uint32_t r = 0; r < routes_.size(); ++r) keep(r);
+            }
+            else if (s != bitmaps_.src.end() && d != bitmaps_.dst.end()) {
+                Bitmap::And(s->second, d->second).ForEach(keep);
+            }
+            break;
+        }
+        }
+    }
+    return out;
+}
+
+std::vector<OneHopMatch> AirTravelDB::FindOneHop(const std::string& src_iata,
+    const std::string& dst_iata, Deadline* deadline) const {
+    std::vector<OneHopMatch> out;
+    auto src_ap = GetAirportByIATA(src_iata);
+    auto dst_ap = GetAirportByIATA(dst_iata);
+    if (!src_ap || !dst_ap || src_iata == dst_iata) return out;
+
+    // nonstop second legs into dst, grouped by their origin, in table order
+    std::unordered_map<std::string, std::vector<uint32_t>> into_dst;
+    for (uint32_t i : SearchRoutes(dst_iata)) {
+        const auto& r = routes_[i];
+        if (r.dst_iata == dst_iata && r.stops == 0) into_dst[r.src_iata].push_back(i);
+    }
+
+    // first legs fan out over chunks; each keeps its own matches
+    const std::vector<uint32_t> firsts = SearchRoutes(src_iata);
+    std::vector<std::vector<OneHopMatch>> parts(ParallelChunks(firsts.size(), 64));
+    ParallelFor(firsts.size(), parts.size(), [&](size_t c, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            if (deadline && deadline->Expired()) break;
+            const uint32_t i = firsts[k];
+            const auto& leg1 = routes_[i];
+            if (leg1.src_iata != src_iata || leg1.dst_iata == dst_iata || leg1.stops != 0) continue;
+            auto legs2 = into_dst.find(leg1.dst_iata);
+            if (legs2 == into_dst.end()) continue;
+            auto via_ap = GetAirportByIATA(leg1.dst_iata);
+            if (!via_ap) continue;
+
+            double d1_km = CalculateDistanceKm(src_ap->latitude, src_ap->longitude,
+                via_ap->latitude, via_ap->longitude);
+            double d2_km = CalculateDistanceKm(via_ap->latitude, via_ap->longitude,
+                dst_ap->latitude, dst_ap->longitude);
+            int miles = static_cast<int>(std::lround((d1_km + d2_km) * 0.621371));
+            for (uint32_t j : legs2->second) parts[c].push_back({ i, j, miles });
+        }
+        });
+    if (parts.size() == 1) return std::move(parts.front());
+    for (auto& p : parts) out.insert(out.end(), p.begin(), p.end());
+    return out;
+}
+
+void OneHopRoute::Assign(const OneHopMatch& m, const std::vector<Route>& routes) {
+    const auto& leg1 = routes[m.leg1];
+    const auto& leg2 = routes[m.leg2];
+    src = leg1.src_iata;
+    via = leg1.dst_iata;
+    dst = leg2.dst_iata;
+    leg1_airline = leg1.airline_iata;
+    leg2_airline = leg2.airline_iata;
+    total_miles = m.total_miles;
+}
+
+std::vector<uint32_t> AirTravelDB::SearchRoutes(const std::string& token) const {
+    std::vector<uint32_t> out;
     std::string t = token;
     std::transform(t.begin(), t.end(), t.begin(), ::toupper);
     std::lock_guard<std::mutex> lk(mtx_);
-    for (const auto& r : routes_) {
+    if (t.empty()) {
+        out.resize(routes_.size());
+        for (uint32_t i = 0; i < out.size(); ++i) out[i] = i;
+        return out;
+    }
+
+    uint32_t packed = 0;
+    if (PackCode(t, packed)) {
+        // each chunk scans its slice of the columns; slices are in row order
+        std::vector<std::vector<uint32_t>> parts(ParallelChunks(routes_.size()));
+        ParallelFor(routes_.size(), parts.size(), [&](size_t c, size_t begin, size_t end) {
+            // this thread's node's copy of the columns
+            const std::vector<const uint32_t*> cols = {
+                snapshot_.code_airline.Local(code_airline_) + begin,
+                snapshot_.code_src.Local(code_src_) + begin,
+                snapshot_.code_dst.Local(code_dst_) + begin };
+            ScanCodeColumns(cols, end - begin, packed, static_cast<unsigned>(t.size()), parts[c]);
+            if (begin) for (uint32_t& i : parts[c]) i += static_cast<uint32_t>(begin);
+            });
+        if (parts.size() == 1) out.swap(parts.front());
+        else for (const auto& p : parts) out.insert(out.end(), p.begin(), p.end());
+    }
+
+    // rows whose codes did not fit the packed columns take the string path;
+    // a token that does not fit them either (over 4 bytes, or holding a NUL)
+    // can only occur in those rows
+    std::vector<uint32_t> extra;
+    for (uint32_t i : long_code_rows_) {
+        const auto& r = routes_[i];
         std::string a = r.airline_iata, s = r.src_iata, d = r.dst_iata;
         std::transform(a.begin(), a.end(), a.begin(), ::toupper);
         std::transform(s.begin(), s.end(), s.begin(), ::toupper);
         std::transform(d.begin(), d.end(), d.begin(), ::toupper);
         if (a.find(t) != std::string::npos || s.find(t) != std::string::npos || d.find(t) != std::string::npos)
-            out.push_back(r);
+            extra.push_back(i);
+    }
+    if (!extra.empty()) {
+        std::vector<uint32_t> merged;
+        merged.reserve(out.size() + extra.size());
+        std::set_union(out.begin(), out.end(), extra.begin(), extra.end(), std::back_inserter(merged));
+        out.swap(merged);
     }
     return out;
 }
@@ -268,12 +781,19 @@ std::vector<std::pair<std::shared_ptr<Airport>, int>>
 AirTravelDB::GetAirportsWithinRadiusKm(double lat, double lon, double radius_km) const {
     std::vector<std::pair<std::shared_ptr<Airport>, int>> out;
     std::lock_guard<std::mutex> lk(mtx_);
-    for (const auto& kv : airports_by_id_) {
-        const auto& ap = kv.second;
-        double dist = CalculateDistanceKm(lat, lon, ap->latitude, ap->longitude);
-        if (dist <= radius_km) {
-            out.emplace_back(ap, static_cast<int>(std::lround(dist)));
+    std::vector<std::vector<std::pair<std::shared_ptr<Airport>, int>>> parts(ParallelChunks(airports_.size(), 16));
+    ParallelFor(airports_.size(), parts.size(), [&](size_t c, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const auto& ap = airports_[i];
+            double dist = CalculateDistanceKm(lat, lon, ap->latitude, ap->longitude);
+            if (dist <= radius_km) {
+                parts[c].emplace_back(ap, static_cast<int>(std::lround(dist)));
+            }
         }
+        });
+    for (auto& p : parts) {
+        if (out.empty()) out.swap(p);
+        else out.insert(out.end(), p.begin(), p.end());
     }
     return out;
 }
@@ -319,3 +839,569 @@ std::vector<Airport> AirTravelDB::GetAllAirports() const {
 }
 
 const std::vector<Route>& AirTravelDB::GetAllRoutes() const { return routes_; }
+
+// ---------------- Route graph / metro areas ----------------
+static std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+static std::string trimmed(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return {};
+    size_t e = s.find_last_not_of(" \t");
+    return s.substr(b, e - b + 1);
+}
+
+void AirTravelDB::BuildRouteGraph(double metro_radius_km) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    dropSnapshot();
+
+    // dense node ids for every airport that has an IATA code, ordered by id
+    nodes_.clear(); node_by_iata_.clear();
+    for (const auto& kv : airports_by_iata_) nodes_.push_back(kv.second);
+    std::sort(nodes_.begin(), nodes_.end(),
+        [](const std::shared_ptr<Airport>& a, const std::shared_ptr<Airport>& b) { return a->id < b->id; });
+    for (uint32_t i = 0; i < nodes_.size(); ++i) node_by_iata_[nodes_[i]->iata] = i;
+    const uint32_t n = static_cast<uint32_t>(nodes_.size());
+
+    // group route indices by (src, dst) node pair
+    struct Keyed { uint32_t src, dst, route; };
+    std::vector<Keyed> keyed;
+    keyed.reserve(routes_.size());
+    for (uint32_t i = 0; i < routes_.size(); ++i) {
+        auto s = node_by_iata_.find(routes_[i].src_iata);
+        auto d = node_by_iata_.find(routes_[i].dst_iata);
+        if (s == node_by_iata_.end() || d == node_by_iata_.end() || s->second == d->second) continue;
+        keyed.push_back({ s->second, d->second, i });
+    }
+    std::sort(keyed.begin(), keyed.end(), [](const Keyed& a, const Keyed& b) {
+        if (a.src != b.src) return a.src < b.src;
+        if (a.dst != b.dst) return a.dst < b.dst;
+        return a.route < b.route;
+        });
+
+    edge_offsets_.assign(n + 1, 0);
+    edges_.clear(); edge_routes_.clear();
+    edge_routes_.reserve(keyed.size());
+    for (size_t i = 0; i < keyed.size();) {
+        size_t j = i;
+        GraphEdge e{};
+        e.to = keyed[i].dst;
+        e.routes_begin = static_cast<uint32_t>(edge_routes_.size());
+        while (j < keyed.size() && keyed[j].src == keyed[i].src && keyed[j].dst == keyed[i].dst) {
+            edge_routes_.push_back(keyed[j].route);
+            ++j;
+        }
+        e.routes_end = static_cast<uint32_t>(edge_routes_.size());
+        edges_.push_back(e);
+        ++edge_offsets_[keyed[i].src + 1];
+        i = j;
+    }
+    for (uint32_t i = 0; i < n; ++i) edge_offsets_[i + 1] += edge_offsets_[i];
+
+    // edge lengths, one slice of source nodes per chunk
+    const size_t edge_cost = 16 * edges_.size() / std::max(1u, n) + 1;  // per node
+    ParallelFor(n, ParallelChunks(n, edge_cost), [&](size_t, size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            const auto& a = *nodes_[s];
+            for (uint32_t k = edge_offsets_[s]; k < edge_offsets_[s + 1]; ++k) {
+                const auto& b = *nodes_[edges_[k].to];
+                edges_[k].distance_km = static_cast<uint32_t>(std::lround(
+                    CalculateDistanceKm(a.latitude, a.longitude, b.latitude, b.longitude)));
+            }
+        }
+        });
+
+    // degree (routes in + out) decides which airports take part in metros
+    std::vector<uint32_t> degree(n, 0);
+    for (const auto& k : keyed) { ++degree[k.src]; ++degree[k.dst]; }
+
+    // seed groups by (city, country)
+    std::unordered_map<std::string, std::vector<uint32_t>> by_city;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (degree[i] == 0 || nodes_[i]->city.empty()) continue;
+        by_city[toLower(nodes_[i]->city) + "|" + toLower(nodes_[i]->country)].push_back(i);
+    }
+    std::vector<std::vector<uint32_t>> groups;
+    std::vector<uint32_t> loners;
+    for (auto& kv : by_city) {
+        if (kv.second.size() >= 2) groups.push_back(std::move(kv.second));
+        else loners.push_back(kv.second.front());
+    }
+
+    // attach single-airport cities to the nearest multi-airport group in range;
+    // loners never merge with each other so groups cannot chain across a region
+    // (a loner x group-member distance matrix, split by loner)
+    size_t grouped = 0;
+    for (const auto& g : groups) grouped += g.size();
+    std::vector<int> nearest(loners.size(), -1);
+    ParallelFor(loners.size(), ParallelChunks(loners.size(), 16 * grouped), [&](size_t, size_t begin, size_t end) {
+        for (size_t l = begin; l < end; ++l) {
+            const auto& ap = *nodes_[loners[l]];
+            double best = metro_radius_km;
+            for (size_t g = 0; g < groups.size(); ++g) {
+                for (uint32_t m : groups[g]) {
+                    const auto& other = *nodes_[m];
+                    if (other.country != ap.country) continue;
+                    double d = CalculateDistanceKm(ap.latitude, ap.longitude, other.latitude, other.longitude);
+                    if (d <= best) { best = d; nearest[l] = static_cast<int>(g); }
+                }
+            }
+        }
+        });
+    std::vector<std::vector<uint32_t>> joined(groups.size());
+    for (size_t l = 0; l < loners.size(); ++l)
+        if (nearest[l] >= 0) joined[nearest[l]].push_back(loners[l]);
+
+    metros_.clear(); metros_by_city_.clear();
+    metro_of_node_.assign(n, -1);
+    std::vector<std::vector<uint32_t>> members(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g) {
+        members[g] = groups[g];
+        members[g].insert(members[g].end(), joined[g].begin(), joined[g].end());
+        std::sort(members[g].begin(), members[g].end(), [&](uint32_t a, uint32_t b) {
+            if (degree[a] != degree[b]) return degree[a] > degree[b];
+            return nodes_[a]->iata < nodes_[b]->iata;
+            });
+    }
+    // stable metro ids: order groups by their busiest airport's code
+    std::vector<size_t> order(groups.size());
+    for (size_t g = 0; g < order.size(); ++g) order[g] = g;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return nodes_[members[a].front()]->iata < nodes_[members[b].front()]->iata;
+        });
+    for (size_t g : order) {
+        auto m = std::make_shared<MetroArea>();
+        m->id = static_cast<int>(metros_.size());
+        const auto& seed = *nodes_[groups[g].front()];
+        m->city = seed.city;
+        m->country = seed.country;
+        m->name = seed.city + ", " + seed.country;
+        for (uint32_t node : members[g]) {
+            m->airports.push_back(nodes_[node]->iata);
+            metro_of_node_[node] = m->id;
+        }
+        metros_by_city_[toLower(m->city)].push_back(static_cast<uint32_t>(m->id));
+        metros_.push_back(std::move(m));
+    }
+
+    std::cout << "Route graph: " << n << " airports, " << edges_.size() << " edges, "
+        << metros_.size() << " metro areas\n";
+}
+
+std::vector<MetroArea> AirTravelDB::GetMetroAreas() const {
+    std::vector<MetroArea> out;
+    std::lock_guard<std::mutex> lk(mtx_);
+    out.reserve(metros_.size());
+    for (const auto& m : metros_) out.push_back(*m);
+    return out;
+}
+
+std::shared_ptr<MetroArea> AirTravelDB::GetMetroArea(const std::string& term) const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto nodes = resolveNodes(term);
+    if (nodes.size() != 1) return nullptr;
+    // an airport code resolves to the metro it belongs to
+    if (nodes[0] < nodes_.size()) {
+        int metro = metro_of_node_[nodes[0]];
+        return metro < 0 ? nullptr : metros_[metro];
+    }
+    return metros_[nodes[0] - nodes_.size()];
+}
+
+// Resolution order: exact IATA code, code list, metro area, airports by city.
+// Metro areas resolve to their supernode id (>= nodes_.size()).
+std::vector<uint32_t> AirTravelDB::resolveNodes(const std::string& raw) const {
+    std::string term = trimmed(raw);
+    std::vector<uint32_t> out;
+    if (term.empty()) return out;
+
+    if (term.find(',') != std::string::npos) {
+        std::stringstream ss(term);
+        std::string part;
+        bool all_codes = true;
+        while (std::getline(ss, part, ',')) {
+            auto it = node_by_iata_.find(trimmed(part));
+            if (it == node_by_iata_.end()) { all_codes = false; break; }
+            out.push_back(it->second);
+        }
+        if (all_codes) return out;
+        out.clear();
+    }
+    auto it = node_by_iata_.find(term);
+    if (it != node_by_iata_.end()) { out.push_back(it->second); return out; }
+
+    std::string city = toLower(term), country;
+    auto comma = city.find(',');
+    if (comma != std::string::npos) {
+        country = trimmed(city.substr(comma + 1));
+        city = trimmed(city.substr(0, comma));
+    }
+    auto mit = metros_by_city_.find(city);
+    if (mit != metros_by_city_.end()) {
+        int best = -1;
+        for (uint32_t id : mit->second) {
+            const auto& m = metros_[id];
+            if (!country.empty() && toLower(m->country) != country) continue;
+            if (best < 0 || m->airports.size() > metros_[best]->airports.size()) best = static_cast<int>(id);
+        }
+        if (best >= 0) { out.push_back(static_cast<uint32_t>(nodes_.size() + best)); return out; }
+    }
+    for (uint32_t i = 0; i < nodes_.size(); ++i) {
+        if (toLower(nodes_[i]->city) != city) continue;
+        if (!country.empty() && toLower(nodes_[i]->country) != country) continue;
+        if (edge_offsets_[i] == edge_offsets_[i + 1]) continue;
+        out.push_back(i);
+    }
+    return out;
+}
+
+std::vector<std::string> AirTravelDB::ResolvePlace(const std::string& term) const {
+    std::vector<std::string> out;
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (uint32_t node : resolveNodes(term)) {
+        if (node < nodes_.size()) out.push_back(nodes_[node]->iata);
+        else {
+            const auto& m = metros_[node - nodes_.size()];
+            out.insert(out.end(), m->airports.begin(), m->airports.end());
+        }
+    }
+    return out;
+}
+
+PathResult AirTravelDB::FindShortestPath(const std::string& from, const std::string& to,
+    Deadline* deadline) const {
+    PathResult result;
+    std::lock_guard<std::mutex> lk(mtx_);
+    const uint32_t n = static_cast<uint32_t>(nodes_.size());
+    if (n == 0 || edge_offsets_.size() != n + 1) return result;
+
+    auto sources = resolveNodes(from);
+    auto targets = resolveNodes(to);
+    if (sources.empty() || targets.empty()) return result;
+
+    // Supernode edges: a source metro fans out to its members at zero cost and
+    // members of a target metro reach it at zero cost. Supernodes are never
+    // expanded mid-path, so a metro does not act as a free ground transfer.
+    const uint32_t total = n + static_cast<uint32_t>(metros_.size());
+    std::vector<char> is_target(total, 0);
+    for (uint32_t t : targets) is_target[t] = 1;
+
+    // Cost is (legs, km) packed into one key, so the search takes the fewest
+    // legs first and the shortest distance among those: a direct flight
+    // beats any chain of shorter hops.
+    constexpr uint64_t kLeg = uint64_t(1) << 32;
+    constexpr uint64_t kInf = std::numeric_limits<uint64_t>::max();
+    constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+    std::vector<uint64_t> dist(total, kInf);
+    std::vector<uint32_t> prev(total, kNone);
+    std::vector<uint32_t> prev_edge(total, kNone);
+    using Item = std::pair<uint64_t, uint32_t>; // (cost, node)
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> pq;
+
+    for (uint32_t s : sources) {
+        if (s < n) { dist[s] = 0; pq.push({ 0, s }); continue; }
+        for (const auto& code : metros_[s - n]->airports) {
+            uint32_t m = node_by_iata_.at(code);
+            if (dist[m] == 0) continue;
+            dist[m] = 0; prev[m] = kNone;
+            pq.push({ 0, m });
+        }
+    }
+
+    const uint32_t* offsets = snapshot_.edge_offsets.Local(edge_offsets_);
+    const GraphEdge* edges = snapshot_.edges.Local(edges_);
+    uint32_t reached = kNone;
+    while (!pq.empty()) {
+        if (deadline && deadline->Expired()) break;
+        auto [d, u] = pq.top(); pq.pop();
+        if (d != dist[u]) continue;
+        if (is_target[u]) { reached = u; break; }
+        if (u >= n) continue;
+        // airport -> its target metro supernode (zero cost)
+        int metro = metro_of_node_[u];
+        if (metro >= 0 && is_target[n + metro] && d < dist[n + metro]) {
+            dist[n + metro] = d; prev[n + metro] = u; prev_edge[n + metro] = kNone;
+            pq.push({ d, n + metro });
+        }
+        for (uint32_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+            const auto& edge = edges[e];
+            uint64_t nd = d + kLeg + edge.distance_km;
+            if (nd < dist[edge.to]) {
+                dist[edge.to] = nd; prev[edge.to] = u; prev_edge[edge.to] = e;
+                pq.push({ nd, edge.to });
+            }
+        }
+    }
+    if (reached == kNone) return result;
+
+    uint32_t cur = reached >= n ? prev[reached] : reached;
+    while (prev[cur] != kNone) {
+        const auto& edge = edges_[prev_edge[cur]];
+        PathLeg leg;
+        leg.src_iata = nodes_[prev[cur]]->iata;
+        leg.dst_iata = nodes_[cur]->iata;
+        leg.distance_km = static_cast<int>(edge.distance_km);
+        for (uint32_t i = edge.routes_begin; i < edge.routes_end; ++i) {
+            const auto& code = routes_[edge_routes_[i]].airline_iata;
+            if (std::find(leg.airlines.begin(), leg.airlines.end(), code) == leg.airlines.end())
+                leg.airlines.push_back(code);
+        }
+        result.legs.push_back(std::move(leg));
+        cur = prev[cur];
+    }
+    std::reverse(result.legs.begin(), result.legs.end());
+    result.found = true;
+    result.total_km = static_cast<int>(dist[reached] % kLeg);
+    return result;
+}
+
+// ---------------- Route bitmaps ----------------
+void AirTravelDB::BuildRouteBitmaps() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    bitmaps_ = RouteBitmaps{};
+    auto upper = [](std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+        return s;
+    };
+    for (uint32_t i = 0; i < routes_.size(); ++i) {
+        const auto& r = routes_[i];
+        bitmaps_.airline[upper(r.airline_iata)].Add(i);
+        bitmaps_.src[upper(r.src_iata)].Add(i);
+        bitmaps_.dst[upper(r.dst_iata)].Add(i);
+        auto s = airports_by_iata_.find(r.src_iata);
+        if (s != airports_by_iata_.end()) bitmaps_.src_country[toLower(s->second->country)].Add(i);
+        auto d = airports_by_iata_.find(r.dst_iata);
+        if (d != airports_by_iata_.end()) bitmaps_.dst_country[toLower(d->second->country)].Add(i);
+        bitmaps_.stops[r.stops].Add(i);
+        if (r.codeshare == "Y") bitmaps_.codeshare.Add(i);
+        for (uint16_t id : r.equipment_ids) bitmaps_.equipment[equipment_codes_[id]].Add(i);
+    }
+    bitmaps_.all = Bitmap::Range(static_cast<uint32_t>(routes_.size()));
+
+    size_t bytes = bitmaps_.codeshare.MemoryBytes() + bitmaps_.all.MemoryBytes(), keys = 0;
+    for (const auto* m : { &bitmaps_.airline, &bitmaps_.src, &bitmaps_.dst,
+                           &bitmaps_.src_country, &bitmaps_.dst_country, &bitmaps_.equipment }) {
+        for (const auto& kv : *m) bytes += kv.second.MemoryBytes();
+        keys += m->size();
+    }
+    for (const auto& kv : bitmaps_.stops) bytes += kv.second.MemoryBytes();
+    keys += bitmaps_.stops.size();
+    std::cout << "Route bitmaps: " << keys << " keys, " << bytes / 1024 << " KiB\n";
+}
+
+std::vector<Route> AirTravelDB::QueryRoutes(const RouteFilter& filter, size_t limit, size_t* total) const {
+    std::vector<Route> out;
+    for (uint32_t i : QueryRouteIds(filter, limit, total)) out.push_back(routes_[i]);
+    return out;
+}
+
+std::vector<uint32_t> AirTravelDB::QueryRouteIds(const RouteFilter& filter, size_t limit, size_t* total,
+    uint32_t start) const {
+    std::vector<uint32_t> out;
+    std::lock_guard<std::mutex> lk(mtx_);
+
+    // OR together the bitmaps for one attribute's values
+    auto unite = [](const std::unordered_map<std::string, Bitmap>& index,
+                    const std::vector<std::string>& values, bool lower) {
+        Bitmap acc;
+        for (auto v : values) {
+            std::transform(v.begin(), v.end(), v.begin(), lower ? ::tolower : ::toupper);
+            auto it = index.find(v);
+            if (it != index.end()) acc = Bitmap::Or(acc, it->second);
+        }
+        return acc;
+    };
+
+    std::vector<Bitmap> terms;
+    if (!filter.airlines.empty())      terms.push_back(unite(bitmaps_.airline, filter.airlines, false));
+    if (!filter.src.empty())           terms.push_back(unite(bitmaps_.src, filter.src, false));
+    if (!filter.dst.empty())           terms.push_back(unite(bitmaps_.dst, filter.dst, false));
+    if (!filter.src_countries.empty()) terms.push_back(unite(bitmaps_.src_country, filter.src_countries, true));
+    if (!filter.dst_countries.empty()) terms.push_back(unite(bitmaps_.dst_country, filter.dst_countries, true));
+    if (!filter.equipment.empty())     terms.push_back(unite(bitmaps_.equipment, filter.equipment, false));
+    if (!filter.stops.empty()) {
+        Bitmap acc;
+        for (int s : filter.stops) {
+            auto it = bitmaps_.stops.find(s);
+            if (it != bitmaps_.stops.end()) acc = Bitmap::Or(acc, it->second);
+        }
+        terms.push_back(std::move(acc));
+    }
+    if (filter.codeshare == 1) terms.push_back(bitmaps_.codeshare);
+
+    // intersect smallest first so intermediate results stay small
+    std::sort(terms.begin(), terms.end(), [](const Bitmap& a, const Bitmap& b) {
+        return a.Cardinality() < b.Cardinality();
+        });
+    Bitmap result = terms.empty() ? bitmaps_.all : terms.front();
+    for (size_t i = 1; i < terms.size() && !result.Empty(); ++i) result = Bitmap::And(result, terms[i]);
+    if (filter.codeshare == 0) result = Bitmap::AndNot(result, bitmaps_.codeshare);
+
+    if (total) *total = result.Cardinality();
+    result.ForEachFrom(start, [&](uint32_t i) {
+        if (limit && out.size() >= limit) return false;
+        out.push_back(i);
+        return true;
+        });
+    return out;
+}
+
+// ---------------- Equipment index ----------------
+void AirTravelDB::BuildIndexes(double metro_radius_km) {
+    BuildRouteGraph(metro_radius_km);
+    BuildEquipmentIndex();
+    BuildRouteBitmaps();
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        placeSnapshot();
+    }
+    bumpEpoch();
+}
+
+// ---------------- Snapshot placement ----------------
+void AirTravelDB::PlaceSnapshot(const SnapshotPlacement& placement) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    placement_ = placement;
+    placeSnapshot();
+}
+
+void AirTravelDB::placeSnapshot() {
+    dropSnapshot();
+    if (!placement_.Enabled()) return;
+    snapshot_.code_airline.Place(code_airline_, placement_);
+    snapshot_.code_src.Place(code_src_, placement_);
+    snapshot_.code_dst.Place(code_dst_, placement_);
+    snapshot_.edge_offsets.Place(edge_offsets_, placement_);
+    snapshot_.edges.Place(edges_, placement_);
+}
+
+void AirTravelDB::dropSnapshot() {
+    snapshot_.code_airline.Clear();
+    snapshot_.code_src.Clear();
+    snapshot_.code_dst.Clear();
+    snapshot_.edge_offsets.Clear();
+    snapshot_.edges.Clear();
+}
+
+std::vector<std::pair<std::string, const ReplicatedArray*>> AirTravelDB::SnapshotArrays() const {
+    return {
+        { "route code columns (airline)", &snapshot_.code_airline },
+        { "route code columns (src)", &snapshot_.code_src },
+        { "route code columns (dst)", &snapshot_.code_dst },
+        { "route graph offsets", &snapshot_.edge_offsets },
+        { "route graph edges", &snapshot_.edges },
+    };
+}
+
+void AirTravelDB::BuildEquipmentIndex() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    const size_t ntypes = equipment_codes_.size();
+    equipment_routes_.assign(ntypes, {});
+    std::vector<std::unordered_map<std::string, uint32_t>> type_airlines(ntypes);
+    std::vector<DistanceStats> type_distance(ntypes);
+    std::unordered_map<std::string, std::unordered_map<uint16_t, uint32_t>> airline_types;
+    std::unordered_map<std::string, DistanceStats> airline_distance;
+
+    for (uint32_t i = 0; i < routes_.size(); ++i) {
+        const auto& r = routes_[i];
+        double km = -1.0;
+        auto s = airports_by_iata_.find(r.src_iata);
+        auto d = airports_by_iata_.find(r.dst_iata);
+        if (s != airports_by_iata_.end() && d != airports_by_iata_.end())
+            km = CalculateDistanceKm(s->second->latitude, s->second->longitude,
+                d->second->latitude, d->second->longitude);
+
+        if (!r.equipment_ids.empty() && km >= 0) airline_distance[r.airline_iata].Add(km);
+        for (uint16_t id : r.equipment_ids) {
+            equipment_routes_[id].push_back(i);
+            ++type_airlines[id][r.airline_iata];
+            ++airline_types[r.airline_iata][id];
+            if (km >= 0) type_distance[id].Add(km);
+        }
+    }
+
+    auto busiest = [](std::vector<std::pair<std::string, uint32_t>>& v) {
+        std::sort(v.begin(), v.end(), [](const auto& a, const auto& b) {
+            if (a.second != b.second) return a.second > b.second;
+            return a.first < b.first;
+            });
+    };
+
+    equipment_stats_.assign(ntypes, nullptr);
+    for (size_t id = 0; id < ntypes; ++id) {
+        auto st = std::make_shared<EquipmentStats>();
+        st->type = equipment_codes_[id];
+        st->airlines.assign(type_airlines[id].begin(), type_airlines[id].end());
+        busiest(st->airlines);
+        st->distance = type_distance[id];
+        equipment_stats_[id] = std::move(st);
+    }
+
+    fleets_.clear();
+    for (auto& kv : airline_types) {
+        auto fl = std::make_shared<AirlineFleet>();
+        fl->airline_iata = kv.first;
+        for (const auto& t : kv.second) fl->types.emplace_back(equipment_codes_[t.first], t.second);
+        busiest(fl->types);
+        fl->distance = airline_distance[kv.first];
+        fleets_[kv.first] = std::move(fl);
+    }
+    std::cout << "Equipment index: " << ntypes << " aircraft types, " << fleets_.size() << " fleets\n";
+}
+
+std::vector<EquipmentStats> AirTravelDB::GetEquipmentTypes() const {
+    std::vector<EquipmentStats> out;
+    std::lock_guard<std::mutex> lk(mtx_);
+    out.reserve(equipment_stats_.size());
+    for (const auto& st : equipment_stats_) out.push_back(*st);
+    std::sort(out.begin(), out.end(), [](const EquipmentStats& a, const EquipmentStats& b) {
+        if (a.distance.routes != b.distance.routes) return a.distance.routes > b.distance.routes;
+        return a.type < b.type;
+        });
+    return out;
+}
+
+std::shared_ptr<EquipmentStats> AirTravelDB::GetEquipmentStats(const std::string& type) const {
+    std::string t = type;
+    std::transform(t.begin(), t.end(), t.begin(), ::toupper);
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = equipment_by_code_.find(t);
+    if (it == equipment_by_code_.end() || it->second >= equipment_stats_.size()) return nullptr;
+    return equipment_stats_[it->second];
+}
+
+std::vector<Route> AirTravelDB::GetRoutesByEquipment(const std::string& type, size_t limit) const {
+    std::vector<Route> out;
+    for (uint32_t i : GetRouteIdsByEquipment(type, limit)) out.push_back(routes_[i]);
+    return out;
+}
+
+std::vector<uint32_t> AirTravelDB::GetRouteIdsByEquipment(const std::string& type, size_t limit,
+    uint32_t start) const {
+    std::vector<uint32_t> out;
+    std::string t = type;
+    std::transform(t.begin(), t.end(), t.begin(), ::toupper);
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = equipment_by_code_.find(t);
+    if (it == equipment_by_code_.end() || it->second >= equipment_routes_.size()) return out;
+    const auto& postings = equipment_routes_[it->second]; // ascending
+    auto first = std::lower_bound(postings.begin(), postings.end(), start);
+    size_t avail = static_cast<size_t>(postings.end() - first);
+    size_t n = limit ? std::min(limit, avail) : avail;
+    out.assign(first, first + n);
+    return out;
+}
+
+std::shared_ptr<AirlineFleet> AirTravelDB::GetAirlineFleet(const std::string& airline_iata) const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = fleets_.find(airline_iata);
+    return it == fleets_.end() ? nullptr : it->second;
+}
+
+const std::string& AirTravelDB::EquipmentCode(uint16_t id) const {
+    static const std::string empty;
+    std::lock_guard<std::mutex> lk(mtx_);
+    return id < equipment_codes_.size() ? equipment_codes_[id] : empty;
+}
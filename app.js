@@ -1,167 +1,344 @@
-﻿/* Minimal front-end glue for the Air Travel DB UI.
-   - One-hop: calls /onehop/<SRC>/<DST>
-   - Airline lookup: /airline/<TERM>
-   - Airport lookup: /airport/<TERM>
-   - Autocomplete using /api/airlines/suggest and /api/airports/suggest
-*/
-
-(function () {
-  const byId = (id) => document.getElementById(id);
-
-  const stypeEl = byId('stype');
-  const codeEl = byId('code');
-  const searchBtn = byId('searchBtn');
-  const statusEl = byId('status');
-
-  const oneSrcEl = byId('one-src');
-  const oneDstEl = byId('one-dst');
-  const oneBtn = byId('oneBtn');
-
-  const resultBody = byId('resultBody');
-
-  // -------- Utilities --------
-  function setStatus(msg) { statusEl.textContent = msg || ''; }
-  function clearResults() { resultBody.innerHTML = ''; }
-
-  function renderJSON(data) {
-    const pre = document.createElement('pre');
-    pre.className = 'mb-0';
-    pre.textContent = JSON.stringify(data, null, 2);
-    resultBody.appendChild(pre);
-  }
-
-  function renderOneHop(src, dst, rows) {
-    clearResults();
-    const h = document.createElement('div');
-    h.className = 'mb-2 fw-semibold';
-    h.textContent = `${src} → ${dst}`;
-    resultBody.appendChild(h);
-
-    if (!rows || rows.length === 0) {
-      const p = document.createElement('div');
-      p.textContent = 'No one-hop routes found';
-      resultBody.appendChild(p);
-      return;
-    }
-
-    const table = document.createElement('table');
-    table.className = 'table table-sm table-striped';
-    const thead = document.createElement('thead');
-    thead.innerHTML = `<tr>
-        <th>#</th><th>Via</th><th>Leg1 Airline</th><th>Leg2 Airline</th><th>Total Miles</th>
-      </tr>`;
-    table.appendChild(thead);
-
-    const tbody = document.createElement('tbody');
-    rows.forEach((r, i) => {
-      const tr = document.createElement('tr');
-      tr.innerHTML = `<td>${i + 1}</td>
-        <td>${r.via}</td>
-        <td>${r.leg1_airline}</td>
-        <td>${r.leg2_airline}</td>
-        <td>${r.total_miles}</td>`;
-      tbody.appendChild(tr);
-    });
-    table.appendChild(tbody);
-    resultBody.appendChild(table);
-  }
-
-  async function getJSON(url) {
-    const res = await fetch(url);
-    if (!res.ok) {
-      throw new Error(`${res.status} ${res.statusText}`);
-    }
-    return res.json();
-  }
-
-  // -------- Suggestions --------
-  // Populate airline suggestions while typing in the top "code" box when Airline is selected
-  codeEl.addEventListener('input', async () => {
-    try {
-      const type = stypeEl.value;
-      if (type !== 'airline') return;
-
-      const q = codeEl.value.trim();
-      const box = document.getElementById('airline-suggest');
-      if (!q) { box.innerHTML = ''; return; }
-
-      const data = await getJSON(`/api/airlines/suggest?q=${encodeURIComponent(q)}`);
-      box.innerHTML = '';
-      (data.items || []).forEach(it => {
-        const opt = document.createElement('option');
-        opt.value = it.iata || it.icao || it.name;
-        opt.label = `${it.name}${it.iata ? ` (${it.iata})` : ''}${it.icao ? ` / ${it.icao}` : ''}`;
-        box.appendChild(opt);
-      });
-    } catch (_) { /* ignore */ }
-  });
-
-  // Populate airport suggestions for both one-hop inputs
-  function attachAirportSuggest(inputEl) {
-    inputEl.addEventListener('input', async () => {
-      try {
-        const q = inputEl.value.trim();
-        const box = document.getElementById('airport-suggest');
-        if (!q) { box.innerHTML = ''; return; }
-        const data = await getJSON(`/api/airports/suggest?q=${encodeURIComponent(q)}`);
-        box.innerHTML = '';
-        (data.items || []).forEach(it => {
-          const opt = document.createElement('option');
-          opt.value = it.iata || it.icao || it.name;
-          opt.label = `${it.name}${it.city ? ` – ${it.city}` : ''}${it.iata ? ` (${it.iata})` : ''}${it.icao ? ` / ${it.icao}` : ''}`;
-          box.appendChild(opt);
-        });
-      } catch (_) { /* ignore */ }
-    });
-  }
-  attachAirportSuggest(oneSrcEl);
-  attachAirportSuggest(oneDstEl);
-
-  // -------- Search buttons --------
-  searchBtn.addEventListener('click', async () => {
-    clearResults();
-    const type = stypeEl.value;
-    const term = codeEl.value.trim();
-    if (!term) { setStatus('Enter an airline/airport'); return; }
-
-    try {
-      setStatus('Searching…');
-      if (type === 'airline') {
-        const data = await getJSON(`/airline/${encodeURIComponent(term)}`);
-        renderJSON(data);
-      } else {
-        const data = await getJSON(`/airport/${encodeURIComponent(term)}`);
-        renderJSON(data);
-      }
-      setStatus('Done');
-    } catch (err) {
-      setStatus('Not found');
-      resultBody.textContent = `Error: ${err.message}`;
-    }
-  });
-
-  oneBtn.addEventListener('click', async () => {
-    clearResults();
-    const src = oneSrcEl.value.trim().toUpperCase();
-    const dst = oneDstEl.value.trim().toUpperCase();
-    if (!src || !dst) {
-      resultBody.textContent = 'Please provide both Source and Destination IATA codes.';
-      return;
-    }
-
-    if (src === dst) {
-        resultBody.textContent = 'Source and destination must be different for a one-hop search.';
-        return;
-    }
-
-    try {
-      setStatus('Searching one-hop…');
-      const data = await getJSON(`/onehop/${encodeURIComponent(src)}/${encodeURIComponent(dst)}`);
-      renderOneHop(src, dst, data);
-      setStatus('Done');
-    } catch (err) {
-      setStatus('Error');
-      resultBody.textContent = `Error: ${err.message}`;
-    }
-  });
-})();
+﻿// Initialize the Leaflet map only when the One-Hop tab becomes visible to avoid gray tiles.
+let oneHopMap = null;
+function ensureOneHopMap() {
+if (!window.L) return;
+try {
+if (!oneHopMap) {
+oneHopMap = L.map('map').setView([20, 0], 2);
+L.tileLayer('https://{s}.tile.openstreetmap.org/{z}/{x}/{y}.png', {
+maxZoom: 10,
+attribution: '&copy; OpenStreetMap'
+}).addTo(oneHopMap);
+}
+// Delay invalidateSize slightly so Bootstrap finishes its tab animations.
+setTimeout(() => oneHopMap.invalidateSize(), 150);
+} catch (err) {
+console.warn('Map initialization failed', err);
+}
+}
+
+const oneHopTabButton = document.querySelector('[data-bs-target="#onehop"]');
+if (oneHopTabButton) {
+oneHopTabButton.addEventListener('shown.bs.tab', ensureOneHopMap);
+if (oneHopTabButton.classList.contains('active')) {
+ensureOneHopMap();
+}
+} else {
+ensureOneHopMap();
+}
+
+// Utility functions
+const byId = (id) => document.getElementById(id);
+const clearElement = (el) => el.innerHTML = '';
+
+async function getJSON(url) {
+const res = await fetch(url);
+if (!res.ok) throw new Error(`${res.status} ${res.statusText}`);
+return res.json();
+}
+
+function setStatus(elementId, msg, type = 'info') {
+const el = byId(elementId);
+if (!msg) {
+el.innerHTML = '';
+return;
+}
+const badgeClass = type === 'error' ? 'status-error' : 'status-success';
+el.innerHTML = `<span class="status-badge ${badgeClass}">${msg}</span>`;
+}
+
+function renderJSON(data, targetId) {
+const target = byId(targetId);
+clearElement(target);
+const pre = document.createElement('pre');
+pre.textContent = JSON.stringify(data, null, 2);
+target.appendChild(pre);
+}
+
+// Suggestions: one socket to /ws/suggest per input box, every
+// keystroke tagged with a higher sequence number. The server skips
+// queries overtaken before they ran; replies to anything but the
+// newest are ignored. Without a socket the query goes through fetch.
+function suggestSource(kind, render) {
+let ws = null;
+let seq = 0;
+let latest = 0;
+let waiting = null; // query typed while the socket connects
+
+function connect() {
+const proto = location.protocol === 'https:' ? 'wss:' : 'ws:';
+ws = new WebSocket(`${proto}//${location.host}/ws/suggest`);
+ws.onopen = () => {
+if (waiting !== null) { send(waiting); waiting = null; }
+};
+ws.onmessage = (ev) => {
+const msg = JSON.parse(ev.data);
+if (msg.seq === latest && msg.items) render(msg.items);
+};
+ws.onclose = () => { ws = null; };
+}
+
+function send(q) {
+latest = ++seq;
+ws.send(JSON.stringify({ seq: latest, kind, q }));
+}
+
+async function viaFetch(q) {
+const mine = latest = ++seq;
+try {
+const data = await getJSON(`/api/${kind}s/suggest?q=${encodeURIComponent(q)}`);
+if (mine === latest) render(data.items || []);
+} catch (e) {
+console.error('Suggestion error:', e);
+}
+}
+
+return function (q) {
+if (!q) { latest = ++seq; render([]); return; }
+if (typeof WebSocket === 'undefined') { viaFetch(q); return; }
+if (!ws) connect();
+if (ws.readyState === WebSocket.OPEN) send(q);
+else if (ws.readyState === WebSocket.CONNECTING) waiting = q;
+else viaFetch(q);
+};
+}
+
+function fillOptions(box, items, label) {
+clearElement(box);
+items.forEach(it => {
+const opt = document.createElement('option');
+opt.value = it.iata || it.icao || it.name;
+opt.label = label(it);
+box.appendChild(opt);
+});
+}
+
+// Entity Lookup
+const lookupSuggest = {
+airline: suggestSource('airline', items => fillOptions(byId('suggestions'), items,
+it => `${it.name}${it.iata ? ` (${it.iata})` : ''}`)),
+airport: suggestSource('airport', items => fillOptions(byId('suggestions'), items,
+it => `${it.name} - ${it.city || ''} (${it.iata || it.icao})`))
+};
+byId('code').addEventListener('input', () => {
+const type = byId('stype').value === 'airline' ? 'airline' : 'airport';
+lookupSuggest[type](byId('code').value.trim());
+});
+
+byId('searchBtn').addEventListener('click', async () => {
+const type = byId('stype').value;
+const term = byId('code').value.trim();
+const resultBody = byId('resultBody');
+
+if (!term) {
+setStatus('status', 'Please enter a search term', 'error');
+return;
+}
+
+clearElement(resultBody);
+setStatus('status', 'Searching...');
+
+try {
+const endpoint = type === 'airline' ? '/airline' : '/airport';
+const data = await getJSON(`${endpoint}/${encodeURIComponent(term)}`);
+renderJSON(data, 'resultBody');
+setStatus('status', 'Found!', 'success');
+} catch (err) {
+setStatus('status', 'Not found', 'error');
+resultBody.textContent = `Error: ${err.message}`;
+}
+});
+
+// Reports
+byId('generateReport').addEventListener('click', async () => {
+const reportType = byId('reportType').value;
+const code = byId('reportCode').value.trim().toUpperCase();
+const format = byId('reportFormat').value;
+
+if (!code) {
+alert('Please enter an IATA code');
+return;
+}
+
+let endpoint;
+if (reportType === 'airline-airports') {
+endpoint = `/report/airline/${code}/airports-by-routes.${format}`;
+} else {
+endpoint = `/report/airport/${code}/airlines-by-routes.${format}`;
+}
+
+try {
+if (format === 'csv') {
+// Download CSV
+window.open(endpoint, '_blank');
+} else {
+// Display JSON
+const data = await getJSON(endpoint);
+const results = byId('reportResults');
+clearElement(results);
+
+// Create nice table display
+const title = document.createElement('h6');
+title.textContent = reportType === 'airline-airports'
+? `Airports for ${data.airline_name || code}`
+: `Airlines for ${data.airport_name || code}`;
+results.appendChild(title);
+
+if (data.items && data.items.length > 0) {
+const table = document.createElement('table');
+table.className = 'table table-sm table-striped report-table';
+
+const headers = reportType === 'airline-airports'
+? ['Airport IATA', 'Airport Name', 'Routes']
+: ['Airline IATA', 'Airline Name', 'Routes'];
+
+table.innerHTML = `<thead><tr>${headers.map(h => `<th>${h}</th>`).join('')}</tr></thead>`;
+
+const tbody = document.createElement('tbody');
+data.items.forEach(item => {
+const tr = document.createElement('tr');
+if (reportType === 'airline-airports') {
+tr.innerHTML = `<td>${item.airport_iata}</td><td>${item.airport_name}</td><td>${item.routes_count}</td>`;
+} else {
+tr.innerHTML = `<td>${item.airline_iata}</td><td>${item.airline_name}</td><td>${item.routes_count}</td>`;
+}
+tbody.appendChild(tr);
+});
+table.appendChild(tbody);
+results.appendChild(table);
+
+// Add download link
+const downloadLink = document.createElement('a');
+downloadLink.href = endpoint.replace('.json', '.csv');
+downloadLink.className = 'btn btn-sm btn-outline-secondary download-link';
+downloadLink.textContent = '📥 Download as CSV';
+downloadLink.target = '_blank';
+results.appendChild(downloadLink);
+} else {
+results.innerHTML = '<p class="text-muted">No data found</p>';
+}
+}
+} catch (err) {
+alert('Error generating report: ' + err.message);
+}
+});
+
+async function fetchFullReport(type) {
+const results = byId('reportResults');
+clearElement(results);
+results.innerHTML = '<p class="text-muted">Loading...</p>';
+
+try {
+const data = await getJSON(`/report/${type}/by-iata.json`);
+clearElement(results);
+
+const title = document.createElement('h6');
+title.textContent = `All ${type.charAt(0).toUpperCase() + type.slice(1)} (${data.length} total)`;
+results.appendChild(title);
+
+const pre = document.createElement('pre');
+pre.style.maxHeight = '400px';
+pre.textContent = JSON.stringify(data.slice(0, 50), null, 2);
+results.appendChild(pre);
+
+if (data.length > 50) {
+const note = document.createElement('p');
+note.className = 'text-muted small';
+note.textContent = `Showing first 50 of ${data.length} entries`;
+results.appendChild(note);
+}
+
+const downloadLink = document.createElement('a');
+downloadLink.href = `/report/${type}/by-iata.csv`;
+downloadLink.className = 'btn btn-sm btn-outline-secondary';
+downloadLink.textContent = '📥 Download Full CSV';
+downloadLink.target = '_blank';
+results.appendChild(downloadLink);
+} catch (err) {
+results.innerHTML = `<p class="text-danger">Error: ${err.message}</p>`;
+}
+}
+
+// One-Hop Routes
+function attachAirportSuggest(inputEl) {
+const suggest = suggestSource('airport', items => fillOptions(byId('airport-suggest'), items,
+it => `${it.name} - ${it.city || ''} (${it.iata})`));
+inputEl.addEventListener('input', () => suggest(inputEl.value.trim()));
+}
+
+attachAirportSuggest(byId('one-src'));
+attachAirportSuggest(byId('one-dst'));
+
+byId('oneBtn').addEventListener('click', async () => {
+const src = byId('one-src').value.trim().toUpperCase();
+const dst = byId('one-dst').value.trim().toUpperCase();
+const results = byId('oneHopResults');
+
+clearElement(results);
+
+if (!src || !dst) {
+setStatus('oneStatus', 'Enter both airports', 'error');
+return;
+}
+
+if (src === dst) {
+setStatus('oneStatus', 'Airports must be different', 'error');
+return;
+}
+
+setStatus('oneStatus', 'Searching...');
+
+try {
+const data = await getJSON(`/onehop/${src}/${dst}`);
+
+const header = document.createElement('h6');
+header.textContent = `${src} → ${dst} (${data.length} routes found)`;
+results.appendChild(header);
+
+if (data.length === 0) {
+results.innerHTML += '<p class="text-muted">No one-hop routes found</p>';
+setStatus('oneStatus', 'No routes found', 'error');
+return;
+}
+
+const table = document.createElement('table');
+table.className = 'table table-sm table-striped';
+table.innerHTML = `<thead><tr>
+<th>#</th><th>Via</th><th>Airline 1</th><th>Airline 2</th><th>Miles</th>
+</tr></thead>`;
+
+const tbody = document.createElement('tbody');
+data.forEach((r, i) => {
+const tr = document.createElement('tr');
+tr.innerHTML = `<td>${i + 1}</td><td>${r.via}</td><td>${r.leg1_airline}</td><td>${r.leg2_airline}</td><td>${r.total_miles}</td>`;
+tbody.appendChild(tr);
+});
+table.appendChild(tbody);
+results.appendChild(table);
+
+setStatus('oneStatus', `Found ${data.length} routes`, 'success');
+} catch (err) {
+setStatus('oneStatus', 'Error', 'error');
+results.innerHTML = `<p class="text-danger">Error: ${err.message}</p>`;
+}
+});
+
+// Student ID (placeholder - implement your endpoint)
+async function fetchStudentId() {
+const result = byId('studentIdResult');
+result.innerHTML = '<p class="mt-2"><strong>Student ID:</strong>20612701<br><strong>Name:</strong>Vaishak Renjith</p>';
+// TODO: Implement /api/student-id endpoint in server.cpp
+}
+
+function viewSourceCode() {
+try {
+window.location.href = '/download/source';
+} catch (err) {
+alert('Unable to start the download. Please try again.');
+}
+}
+
+// Make fetchFullReport available globally
+window.fetchFullReport = fetchFullReport;
+window.fetchStudentId = fetchStudentId;
+window.viewSourceCode = viewSourceCode;
@@ -0,0 +1,723 @@
+﻿#include "arrow_ipc.h"
+#include "airdb.h"
+#include "response_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+// Everything below assumes a little-endian host, which is what Arrow files
+// are written in by default (x86-64 and AArch64 both qualify).
+
+namespace {
+
+// ---------------- Flatbuffer builder ----------------
+// Minimal back-to-front builder, enough for Arrow's Schema/Message/Footer
+// tables. Positions are measured from the end of the buffer, as in the
+// reference implementation; children must be finished before their parent
+// table is started.
+class FlatBuilder {
+public:
+    uint32_t Size() const { return static_cast<uint32_t>(buf_.size()); }
+
+    void Prep(size_t align, size_t extra) {
+        if (align > minalign_) minalign_ = align;
+        const size_t pad = (~(buf_.size() + extra) + 1) & (align - 1);
+        buf_.insert(buf_.begin(), pad, 0);
+    }
+
+    template <class T>
+    void Push(T v) {
+        uint8_t b[sizeof(T)];
+        std::memcpy(b, &v, sizeof(T));
+        buf_.insert(buf_.begin(), b, b + sizeof(T));
+    }
+
+    uint32_t String(const std::string& s) {
+        Prep(4, s.size() + 1);
+        buf_.insert(buf_.begin(), 1, 0);
+        buf_.insert(buf_.begin(), s.begin(), s.end());
+        Push<uint32_t>(static_cast<uint32_t>(s.size()));
+        return Size();
+    }
+
+    uint32_t OffsetVector(const std::vector<uint32_t>& targets) {
+        Prep(4, 4 * targets.size());
+        for (auto it = targets.rbegin(); it != targets.rend(); ++it) pushOffset(*it);
+        Push<uint32_t>(static_cast<uint32_t>(targets.size()));
+        return Size();
+    }
+
+    // n structs of `size` bytes each, laid out in `data`
+    uint32_t StructVector(const void* data, size_t n, size_t size, size_t align) {
+        Prep(4, n * size);
+        Prep(align, n * size);
+        const auto* p = static_cast<const uint8_t*>(data);
+        buf_.insert(buf_.begin(), p, p + n * size);
+        Push<uint32_t>(static_cast<uint32_t>(n));
+        return Size();
+    }
+
+    void StartTable() {
+        fields_.clear();
+        table_start_ = Size();
+    }
+    template <class T>
+    void Add(uint16_t id, T v) {
+        Prep(sizeof(T), 0);
+        Push(v);
+        fields_.push_back({ id, Size() });
+    }
+    void AddOffset(uint16_t id, uint32_t target) {
+        pushOffset(target);
+        fields_.push_back({ id, Size() });
+    }
+    uint32_t EndTable() {
+        Prep(4, 0);
+        Push<int32_t>(0); // soffset to the vtable, patched below
+        const uint32_t table = Size();
+        uint16_t max_id = 0;
+        for (const auto& f : fields_) max_id = std::max<uint16_t>(max_id, f.id + 1);
+        std::vector<uint16_t> vt(max_id, 0);
+        for (const auto& f : fields_) vt[f.id] = static_cast<uint16_t>(table - f.pos);
+        for (auto it = vt.rbegin(); it != vt.rend(); ++it) Push<uint16_t>(*it);
+        Push<uint16_t>(static_cast<uint16_t>(table - table_start_));
+        Push<uint16_t>(static_cast<uint16_t>(4 + 2 * vt.size()));
+        const int32_t so = static_cast<int32_t>(Size() - table);
+        std::memcpy(&buf_[buf_.size() - table], &so, 4);
+        return table;
+    }
+
+    std::string Finish(uint32_t root) {
+        Prep(std::max<size_t>(minalign_, 8), 4);
+        pushOffset(root);
+        return std::string(buf_.begin(), buf_.end());
+    }
+
+private:
+    void pushOffset(uint32_t target) {
+        Prep(4, 0);
+        Push<uint32_t>(Size() + 4 - target);
+    }
+
+    struct FieldPos { uint16_t id; uint32_t pos; };
+    std::vector<uint8_t>  buf_;
+    std::vector<FieldPos> fields_;
+    uint32_t table_start_ = 0;
+    size_t   minalign_ = 1;
+};
+
+// ---------------- Flatbuffer reader ----------------
+// Bounds-checked view of one table; any out-of-range access clears *ok and
+// reads as zero, so malformed input fails the decode instead of crashing.
+struct FlatTable {
+    const uint8_t* buf = nullptr;
+    size_t len = 0;
+    uint32_t pos = 0;
+    bool* ok = nullptr;
+
+    template <class T>
+    T read(size_t at) const {
+        T v{};
+        if (at + sizeof(T) > len || at + sizeof(T) < at) { *ok = false; return v; }
+        std::memcpy(&v, buf + at, sizeof(T));
+        return v;
+    }
+    uint16_t field(uint16_t id) const {
+        const size_t vt = pos - static_cast<size_t>(read<int32_t>(pos));
+        const uint16_t vt_size = read<uint16_t>(vt);
+        if (4u + 2u * id >= vt_size) return 0;
+        return read<uint16_t>(vt + 4 + 2 * id);
+    }
+    bool has(uint16_t id) const { return field(id) != 0; }
+    template <class T>
+    T scalar(uint16_t id, T def = T()) const {
+        uint16_t f = field(id);
+        return f ? read<T>(pos + f) : def;
+    }
+    size_t indirect(uint16_t id) const {
+        uint16_t f = field(id);
+        if (!f) { *ok = false; return 0; }
+        return pos + f + read<uint32_t>(pos + f);
+    }
+    FlatTable table(uint16_t id) const {
+        return { buf, len, static_cast<uint32_t>(indirect(id)), ok };
+    }
+    // element count and start of a vector
+    size_t vector(uint16_t id, size_t& start) const {
+        size_t at = indirect(id);
+        start = at + 4;
+        return read<uint32_t>(at);
+    }
+    FlatTable element(size_t start, size_t i) const {
+        size_t at = start + 4 * i;
+        return { buf, len, static_cast<uint32_t>(at + read<uint32_t>(at)), ok };
+    }
+    std::string string(uint16_t id) const {
+        size_t at = indirect(id);
+        uint32_t n = read<uint32_t>(at);
+        if (at + 4 + n > len) { *ok = false; return {}; }
+        return std::string(reinterpret_cast<const char*>(buf + at + 4), n);
+    }
+};
+
+FlatTable rootTable(const uint8_t* buf, size_t len, bool* ok) {
+    FlatTable t{ buf, len, 0, ok };
+    t.pos = t.read<uint32_t>(0);
+    return t;
+}
+
+// ---------------- Arrow format constants ----------------
+constexpr int16_t kMetadataV5 = 4;
+constexpr uint8_t kHeaderSchema = 1, kHeaderDictionaryBatch = 2, kHeaderRecordBatch = 3;
+constexpr uint8_t kTypeInt = 2, kTypeFloatingPoint = 3, kTypeUtf8 = 5;
+constexpr int16_t kPrecisionDouble = 2;
+const char kMagic[] = "ARROW1";
+
+struct FieldNode { int64_t length; int64_t null_count; };
+struct BufferSpec { int64_t offset; int64_t length; };
+struct Block { int64_t offset; int32_t metadata_length; int32_t pad; int64_t body_length; };
+static_assert(sizeof(Block) == 24, "Block must match the flatbuffer struct");
+
+size_t pad8(size_t n) { return (n + 7) & ~size_t(7); }
+
+// Accumulates a message body: every buffer starts 8-byte aligned.
+struct Body {
+    std::string bytes;
+    std::vector<BufferSpec> buffers;
+    void Add(const void* data, size_t n) {
+        buffers.push_back({ static_cast<int64_t>(bytes.size()), static_cast<int64_t>(n) });
+        bytes.append(static_cast<const char*>(data), n);
+        bytes.resize(pad8(bytes.size()), '\0');
+    }
+    void AddEmpty() { buffers.push_back({ static_cast<int64_t>(bytes.size()), 0 }); }
+};
+
+uint32_t buildRecordBatch(FlatBuilder& fb, int64_t length, const std::vector<FieldNode>& nodes,
+    const std::vector<BufferSpec>& buffers) {
+    const uint32_t n = fb.StructVector(nodes.data(), nodes.size(), sizeof(FieldNode), 8);
+    const uint32_t b = fb.StructVector(buffers.data(), buffers.size(), sizeof(BufferSpec), 8);
+    fb.StartTable();
+    fb.Add<int64_t>(0, length);
+    fb.AddOffset(1, n);
+    fb.AddOffset(2, b);
+    return fb.EndTable();
+}
+
+std::string finishMessage(FlatBuilder& fb, uint8_t header_type, uint32_t header, int64_t body_length) {
+    fb.StartTable();
+    fb.Add<int64_t>(3, body_length);
+    fb.AddOffset(2, header);
+    fb.Add<int16_t>(0, kMetadataV5);
+    fb.Add<uint8_t>(1, header_type);
+    return fb.Finish(fb.EndTable());
+}
+
+// continuation marker, padded metadata length, metadata, padding
+void appendMessage(std::string& out, const std::string& metadata, const std::string& body,
+    std::vector<Block>* blocks) {
+    const size_t offset = out.size();
+    const size_t meta_len = pad8(8 + metadata.size()) - 8;
+    const uint32_t cont = 0xFFFFFFFFu;
+    const int32_t len = static_cast<int32_t>(meta_len);
+    out.append(reinterpret_cast<const char*>(&cont), 4);
+    out.append(reinterpret_cast<const char*>(&len), 4);
+    out += metadata;
+    out.resize(offset + 8 + meta_len, '\0');
+    out += body;
+    if (blocks) blocks->push_back({ static_cast<int64_t>(offset), static_cast<int32_t>(8 + meta_len), 0,
+        static_cast<int64_t>(body.size()) });
+}
+
+} // namespace
+
+// ---------------- Writer ----------------
+void ArrowFileWriter::AddInt32(const std::string& name, std::vector<int32_t> values) {
+    Column c;
+    c.name = name;
+    c.kind = Kind::Int32;
+    c.values.resize(values.size() * sizeof(int32_t));
+    if (!values.empty()) std::memcpy(c.values.data(), values.data(), c.values.size());
+    columns_.push_back(std::move(c));
+}
+
+void ArrowFileWriter::AddFloat64(const std::string& name, std::vector<double> values) {
+    Column c;
+    c.name = name;
+    c.kind = Kind::Float64;
+    c.values.resize(values.size() * sizeof(double));
+    if (!values.empty()) std::memcpy(c.values.data(), values.data(), c.values.size());
+    columns_.push_back(std::move(c));
+}
+
+void ArrowFileWriter::AddString(const std::string& name, const std::vector<const std::string*>& values) {
+    // dictionary in first-appearance order
+    std::unordered_map<std::string_view, int32_t> ids;
+    std::vector<int32_t> indices;
+    indices.reserve(values.size());
+    std::vector<const std::string*> dict;
+    size_t plain_bytes = 0, dict_bytes = 0;
+    for (const std::string* v : values) {
+        plain_bytes += v->size();
+        auto it = ids.emplace(std::string_view(*v), static_cast<int32_t>(dict.size())).first;
+        if (it->second == static_cast<int32_t>(dict.size())) {
+            dict.push_back(v);
+            dict_bytes += v->size();
+        }
+        indices.push_back(it->second);
+    }
+
+    Column c;
+    c.name = name;
+    c.kind = Kind::Utf8;
+    const std::vector<const std::string*>* strings = &values;
+    // narrowest signed index type that holds every dictionary id
+    const int width = dict.size() <= 128 ? 1 : dict.size() <= 32768 ? 2 : 4;
+    // plain: offsets + bytes; dictionary: indices + dictionary offsets + bytes
+    if (values.size() * width + dict.size() * 4 + dict_bytes < values.size() * 4 + plain_bytes) {
+        c.kind = Kind::DictUtf8;
+        c.dict_size = dict.size();
+        c.index_width = static_cast<uint8_t>(width);
+        c.values.resize(indices.size() * width);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (width == 1) c.values[i] = static_cast<uint8_t>(indices[i]);
+            else if (width == 2) { int16_t v = static_cast<int16_t>(indices[i]); std::memcpy(&c.values[2 * i], &v, 2); }
+            else std::memcpy(&c.values[4 * i], &indices[i], 4);
+        }
+        strings = &dict;
+    }
+    c.offsets.reserve(strings->size() + 1);
+    c.offsets.push_back(0);
+    for (const std::string* s : *strings) {
+        c.data += *s;
+        c.offsets.push_back(static_cast<int32_t>(c.data.size()));
+    }
+    columns_.push_back(std::move(c));
+}
+
+std::string ArrowFileWriter::Finish(size_t rows) {
+    // Schema, built into every builder that needs it (message and footer)
+    auto buildSchema = [this](FlatBuilder& fb) {
+        std::vector<uint32_t> fields;
+        int64_t dict_id = 0;
+        for (const auto& c : columns_) {
+            const uint32_t name = fb.String(c.name);
+            const uint32_t children = fb.OffsetVector({});
+            uint32_t type = 0;
+            uint8_t type_type = 0;
+            fb.StartTable();
+            if (c.kind == Kind::Int32) {
+                fb.Add<int32_t>(0, 32);
+                fb.Add<uint8_t>(1, 1);
+                type_type = kTypeInt;
+            }
+            else if (c.kind == Kind::Float64) {
+                fb.Add<int16_t>(0, kPrecisionDouble);
+                type_type = kTypeFloatingPoint;
+            }
+            else {
+                type_type = kTypeUtf8;
+            }
+            type = fb.EndTable();
+
+            uint32_t dictionary = 0;
+            if (c.kind == Kind::DictUtf8) {
+                fb.StartTable();
+                fb.Add<int32_t>(0, 8 * c.index_width);
+                fb.Add<uint8_t>(1, 1);
+                const uint32_t index_type = fb.EndTable();
+                fb.StartTable();
+                fb.Add<int64_t>(0, dict_id++);
+                fb.AddOffset(1, index_type);
+                dictionary = fb.EndTable();
+            }
+
+            fb.StartTable();
+            fb.AddOffset(0, name);
+            fb.AddOffset(3, type);
+            if (dictionary) fb.AddOffset(4, dictionary);
+            fb.AddOffset(5, children);
+            fb.Add<uint8_t>(1, 0);            // nullable: no column has nulls
+            fb.Add<uint8_t>(2, type_type);
+            fields.push_back(fb.EndTable());
+        }
+        const uint32_t vec = fb.OffsetVector(fields);
+        fb.StartTable();
+        fb.AddOffset(1, vec);
+        fb.Add<int16_t>(0, 0);                // little endian
+        return fb.EndTable();
+    };
+
+    std::string out(kMagic, 6);
+    out.append(2, '\0');
+    {
+        FlatBuilder fb;
+        appendMessage(out, finishMessage(fb, kHeaderSchema, buildSchema(fb), 0), std::string(), nullptr);
+    }
+
+    std::vector<Block> dict_blocks, batch_blocks;
+    int64_t dict_id = 0;
+    for (const auto& c : columns_) {
+        if (c.kind != Kind::DictUtf8) continue;
+        Body body;
+        body.AddEmpty();
+        body.Add(c.offsets.data(), c.offsets.size() * sizeof(int32_t));
+        body.Add(c.data.data(), c.data.size());
+        FlatBuilder fb;
+        const uint32_t batch = buildRecordBatch(fb, static_cast<int64_t>(c.dict_size),
+            { { static_cast<int64_t>(c.dict_size), 0 } }, body.buffers);
+        fb.StartTable();
+        fb.Add<int64_t>(0, dict_id++);
+        fb.AddOffset(1, batch);
+        const uint32_t header = fb.EndTable();
+        appendMessage(out, finishMessage(fb, kHeaderDictionaryBatch, header,
+            static_cast<int64_t>(body.bytes.size())), body.bytes, &dict_blocks);
+    }
+
+    {
+        Body body;
+        std::vector<FieldNode> nodes;
+        for (const auto& c : columns_) {
+            nodes.push_back({ static_cast<int64_t>(rows), 0 });
+            body.AddEmpty(); // validity
+            if (c.kind == Kind::Utf8) {
+                body.Add(c.offsets.data(), c.offsets.size() * sizeof(int32_t));
+                body.Add(c.data.data(), c.data.size());
+            }
+            else {
+                body.Add(c.values.data(), c.values.size());
+            }
+        }
+        FlatBuilder fb;
+        const uint32_t batch = buildRecordBatch(fb, static_cast<int64_t>(rows), nodes, body.buffers);
+        appendMessage(out, finishMessage(fb, kHeaderRecordBatch, batch,
+            static_cast<int64_t>(body.bytes.size())), body.bytes, &batch_blocks);
+    }
+
+    // end-of-stream marker, then the footer
+    const uint32_t eos[2] = { 0xFFFFFFFFu, 0 };
+    out.append(reinterpret_cast<const char*>(eos), sizeof(eos));
+
+    FlatBuilder fb;
+    const uint32_t schema = buildSchema(fb);
+    const uint32_t dicts = fb.StructVector(dict_blocks.data(), dict_blocks.size(), sizeof(Block), 8);
+    const uint32_t batches = fb.StructVector(batch_blocks.data(), batch_blocks.size(), sizeof(Block), 8);
+    fb.StartTable();
+    fb.AddOffset(1, schema);
+    fb.AddOffset(2, dicts);
+    fb.AddOffset(3, batches);
+    fb.Add<int16_t>(0, kMetadataV5);
+    const std::string footer = fb.Finish(fb.EndTable());
+    out += footer;
+    const int32_t footer_len = static_cast<int32_t>(footer.size());
+    out.append(reinterpret_cast<const char*>(&footer_len), 4);
+    out.append(kMagic, 6);
+    return out;
+}
+
+// ---------------- Reader ----------------
+namespace {
+
+struct BatchView {
+    int64_t length = 0;
+    std::vector<FieldNode>  nodes;
+    std::vector<BufferSpec> buffers;
+    const uint8_t* body = nullptr;
+    size_t body_len = 0;
+};
+
+// Reads the message at `b`; the header table comes back in `header`.
+bool readMessage(const std::string& file, const Block& b, uint8_t expect, BatchView& batch,
+    FlatTable& header, bool* ok) {
+    const auto* base = reinterpret_cast<const uint8_t*>(file.data());
+    if (b.offset < 0 || b.metadata_length < 8 || b.body_length < 0 ||
+        static_cast<uint64_t>(b.offset) + b.metadata_length + b.body_length > file.size()) return false;
+    uint32_t cont = 0;
+    std::memcpy(&cont, base + b.offset, 4);
+    if (cont != 0xFFFFFFFFu) return false;
+    const uint8_t* meta = base + b.offset + 8;
+    FlatTable msg = rootTable(meta, static_cast<size_t>(b.metadata_length - 8), ok);
+    if (msg.scalar<uint8_t>(1) != expect) return false;
+    header = msg.table(2);
+    FlatTable rb = expect == kHeaderDictionaryBatch ? header.table(1) : header;
+    batch.length = rb.scalar<int64_t>(0);
+    size_t start = 0;
+    size_t n = rb.vector(1, start);
+    for (size_t i = 0; i < n && *ok; ++i)
+        batch.nodes.push_back({ rb.read<int64_t>(start + 16 * i), rb.read<int64_t>(start + 16 * i + 8) });
+    n = rb.vector(2, start);
+    for (size_t i = 0; i < n && *ok; ++i)
+        batch.buffers.push_back({ rb.read<int64_t>(start + 16 * i), rb.read<int64_t>(start + 16 * i + 8) });
+    batch.body = meta + (b.metadata_length - 8);
+    batch.body_len = static_cast<size_t>(b.body_length);
+    for (const auto& buf : batch.buffers)
+        if (buf.offset < 0 || buf.length < 0 || static_cast<uint64_t>(buf.offset + buf.length) > batch.body_len) return false;
+    return *ok;
+}
+
+template <class T>
+bool copyBuffer(const BatchView& batch, size_t i, size_t count, std::vector<T>& out) {
+    if (i >= batch.buffers.size() || static_cast<uint64_t>(batch.buffers[i].length) < count * sizeof(T)) return false;
+    out.resize(count);
+    if (count) std::memcpy(out.data(), batch.body + batch.buffers[i].offset, count * sizeof(T));
+    return true;
+}
+
+bool decodeUtf8(const BatchView& batch, size_t first_buffer, size_t count, std::vector<std::string>& out) {
+    std::vector<int32_t> offsets;
+    if (!copyBuffer(batch, first_buffer, count + 1, offsets) || first_buffer + 1 >= batch.buffers.size()) return false;
+    const auto& data = batch.buffers[first_buffer + 1];
+    const char* bytes = reinterpret_cast<const char*>(batch.body + data.offset);
+    out.clear();
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (offsets[i] < 0 || offsets[i] > offsets[i + 1] || offsets[i + 1] > data.length) return false;
+        out.emplace_back(bytes + offsets[i], static_cast<size_t>(offsets[i + 1] - offsets[i]));
+    }
+    return true;
+}
+
+} // namespace
+
+bool ReadArrowFile(const std::string& file, ArrowTable& out, std::string& error) {
+    out = ArrowTable{};
+    if (file.size() < 8 + 4 + 6 || file.compare(0, 6, kMagic) != 0 ||
+        file.compare(file.size() - 6, 6, kMagic) != 0) { error = "missing ARROW1 magic"; return false; }
+    int32_t footer_len = 0;
+    std::memcpy(&footer_len, file.data() + file.size() - 10, 4);
+    if (footer_len <= 0 || static_cast<size_t>(footer_len) > file.size() - 18) { error = "bad footer length"; return false; }
+
+    bool ok = true;
+    const auto* footer_buf = reinterpret_cast<const uint8_t*>(file.data() + file.size() - 10 - footer_len);
+    FlatTable footer = rootTable(footer_buf, static_cast<size_t>(footer_len), &ok);
+    if (footer.scalar<int16_t>(0) != kMetadataV5) { error = "unsupported metadata version"; return false; }
+
+    // schema
+    struct FieldInfo { char type; bool dict; int64_t dict_id; int index_width; };
+    std::vector<FieldInfo> infos;
+    FlatTable schema = footer.table(1);
+    size_t start = 0;
+    const size_t nfields = schema.vector(1, start);
+    for (size_t i = 0; i < nfields && ok; ++i) {
+        FlatTable f = schema.element(start, i);
+        ArrowTable::Column col;
+        col.name = f.string(0);
+        const uint8_t tt = f.scalar<uint8_t>(2);
+        FlatTable type = f.table(3);
+        if (tt == kTypeInt && type.scalar<int32_t>(0) == 32 && type.scalar<uint8_t>(1)) col.type = 'i';
+        else if (tt == kTypeFloatingPoint && type.scalar<int16_t>(0) == kPrecisionDouble) col.type = 'd';
+        else if (tt == kTypeUtf8) col.type = 's';
+        else { error = "unsupported type in column " + col.name; return false; }
+        FieldInfo info{ col.type, f.has(4), 0, 0 };
+        if (info.dict) {
+            FlatTable enc = f.table(4);
+            info.dict_id = enc.scalar<int64_t>(0);
+            FlatTable index = enc.table(1);
+            const int32_t bits = index.scalar<int32_t>(0);
+            info.index_width = bits / 8;
+            if (col.type != 's' || !index.scalar<uint8_t>(1) || (bits != 8 && bits != 16 && bits != 32)) {
+                error = "unsupported dictionary in " + col.name; return false;
+            }
+            col.dictionary = true;
+        }
+        infos.push_back(info);
+        out.columns.push_back(std::move(col));
+    }
+    if (!ok) { error = "malformed schema"; return false; }
+
+    // dictionaries
+    auto readBlocks = [&](uint16_t id) {
+        std::vector<Block> blocks;
+        size_t s = 0;
+        const size_t n = footer.vector(id, s);
+        for (size_t i = 0; i < n && ok; ++i) {
+            Block b{};
+            b.offset = footer.read<int64_t>(s + 24 * i);
+            b.metadata_length = footer.read<int32_t>(s + 24 * i + 8);
+            b.body_length = footer.read<int64_t>(s + 24 * i + 16);
+            blocks.push_back(b);
+        }
+        return blocks;
+    };
+    std::unordered_map<int64_t, std::vector<std::string>> dictionaries;
+    for (const Block& b : readBlocks(2)) {
+        BatchView batch;
+        FlatTable header;
+        if (!readMessage(file, b, kHeaderDictionaryBatch, batch, header, &ok)) { error = "bad dictionary batch"; return false; }
+        if (!decodeUtf8(batch, 1, static_cast<size_t>(batch.length), dictionaries[header.scalar<int64_t>(0)])) {
+            error = "bad dictionary values"; return false;
+        }
+    }
+
+    // record batches (appended in order)
+    for (const Block& b : readBlocks(3)) {
+        BatchView batch;
+        FlatTable header;
+        if (!readMessage(file, b, kHeaderRecordBatch, batch, header, &ok) || batch.nodes.size() != infos.size()) {
+            error = "bad record batch"; return false;
+        }
+        const size_t rows = static_cast<size_t>(batch.length);
+        size_t buf = 0;
+        for (size_t c = 0; c < infos.size(); ++c) {
+            auto& col = out.columns[c];
+            if (batch.nodes[c].length != batch.length || batch.nodes[c].null_count != 0) { error = "unexpected nulls in " + col.name; return false; }
+            ++buf; // validity, empty
+            bool good = true;
+            if (col.type == 'i') {
+                std::vector<int32_t> v;
+                good = copyBuffer(batch, buf++, rows, v);
+                col.i32.insert(col.i32.end(), v.begin(), v.end());
+            }
+            else if (col.type == 'd') {
+                std::vector<double> v;
+                good = copyBuffer(batch, buf++, rows, v);
+                col.f64.insert(col.f64.end(), v.begin(), v.end());
+            }
+            else if (infos[c].dict) {
+                std::vector<int32_t> idx(rows);
+                const auto& dict = dictionaries[infos[c].dict_id];
+                if (infos[c].index_width == 1) {
+                    std::vector<int8_t> v;
+                    good = copyBuffer(batch, buf++, rows, v);
+                    std::copy(v.begin(), v.end(), idx.begin());
+                }
+                else if (infos[c].index_width == 2) {
+                    std::vector<int16_t> v;
+                    good = copyBuffer(batch, buf++, rows, v);
+                    std::copy(v.begin(), v.end(), idx.begin());
+                }
+                else {
+                    good = copyBuffer(batch, buf++, rows, idx);
+                }
+                for (size_t i = 0; good && i < rows; ++i) {
+                    if (idx[i] < 0 || static_cast<size_t>(idx[i]) >= dict.size()) good = false;
+                    else col.str.push_back(dict[idx[i]]);
+                }
+            }
+            else {
+                std::vector<std::string> v;
+                good = decodeUtf8(batch, buf, rows, v);
+                buf += 2;
+                col.str.insert(col.str.end(), v.begin(), v.end());
+            }
+            if (!good) { error = "bad buffers in " + col.name; return false; }
+        }
+        out.rows += batch.length;
+    }
+    if (!ok) { error = "malformed metadata"; return false; }
+    return true;
+}
+
+// ---------------- Table exports ----------------
+template <class T>
+static std::string writeRows(const RowSchema<T>& schema, const std::vector<T>& rows) {
+    ArrowFileWriter w;
+    for (const auto& f : schema.Fields()) {
+        switch (f.kind) {
+        case FieldKind::Int: {
+            std::vector<int32_t> v;
+            v.reserve(rows.size());
+            for (const T& r : rows) v.push_back(r.*(f.i32));
+            w.AddInt32(f.name, std::move(v));
+            break;
+        }
+        case FieldKind::Double: {
+            std::vector<double> v;
+            v.reserve(rows.size());
+            for (const T& r : rows) v.push_back(r.*(f.f64));
+            w.AddFloat64(f.name, std::move(v));
+            break;
+        }
+        case FieldKind::String: {
+            std::vector<const std::string*> v;
+            v.reserve(rows.size());
+            for (const T& r : rows) v.push_back(&(r.*(f.str)));
+            w.AddString(f.name, v);
+            break;
+        }
+        }
+    }
+    return w.Finish(rows.size());
+}
+
+bool WriteArrowTable(const AirTravelDB& db, const std::string& table, std::string& out) {
+    if (table == "airports") {
+        auto rows = db.GetAllAirports();
+        std::sort(rows.begin(), rows.end(), [](const Airport& a, const Airport& b) { return a.id < b.id; });
+        out = writeRows(Airport::Schema(), rows);
+    }
+    else if (table == "airlines") {
+        auto rows = db.GetAllAirlines();
+        std::sort(rows.begin(), rows.end(), [](const Airline& a, const Airline& b) { return a.id < b.id; });
+        out = writeRows(Airline::Schema(), rows);
+    }
+    else if (table == "routes") {
+        out = writeRows(Route::Schema(), db.GetAllRoutes());
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+template <class T>
+static bool compareRows(const RowSchema<T>& schema, const std::vector<T>& rows, const ArrowTable& t,
+    std::string& error) {
+    const auto& fields = schema.Fields();
+    if (t.rows != static_cast<int64_t>(rows.size()) || t.columns.size() != fields.size()) {
+        error = "shape mismatch";
+        return false;
+    }
+    for (size_t c = 0; c < fields.size(); ++c) {
+        const auto& f = fields[c];
+        const auto& col = t.columns[c];
+        if (col.name != f.name) { error = "column " + std::to_string(c) + " is " + col.name; return false; }
+        for (size_t i = 0; i < rows.size(); ++i) {
+            bool same = false;
+            switch (f.kind) {
+            case FieldKind::Int:    same = col.type == 'i' && col.i32[i] == rows[i].*(f.i32); break;
+            case FieldKind::Double: same = col.type == 'd' && std::memcmp(&col.f64[i], &(rows[i].*(f.f64)), sizeof(double)) == 0; break;
+            case FieldKind::String: same = col.type == 's' && col.str[i] == rows[i].*(f.str); break;
+            }
+            if (!same) { error = col.name + " differs at row " + std::to_string(i); return false; }
+        }
+    }
+    return true;
+}
+
+bool CheckArrowRoundTrip(const AirTravelDB& db, const std::string& table, std::string& error) {
+    std::string file;
+    if (!WriteArrowTable(db, table, file)) { error = "unknown table"; return false; }
+    ArrowTable t;
+    if (!ReadArrowFile(file, t, error)) return false;
+    if (table == "airports") {
+        auto rows = db.GetAllAirports();
+        std::sort(rows.begin(), rows.end(), [](const Airport& a, const Airport& b) { return a.id < b.id; });
+        return compareRows(Airport::Schema(), rows, t, error);
+    }
+    if (table == "airlines") {
+        auto rows = db.GetAllAirlines();
+        std::sort(rows.begin(), rows.end(), [](const Airline& a, const Airline& b) { return a.id < b.id; });
+        return compareRows(Airline::Schema(), rows, t, error);
+    }
+    return compareRows(Route::Schema(), db.GetAllRoutes(), t, error);
+}
+
+std::shared_ptr<const ArrowExports::File> ArrowExports::Get(const std::string& table, const AirTravelDB& db) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (epoch_ != db.Epoch()) {
+        files_.clear();
+        epoch_ = db.Epoch();
+    }
+    for (const auto& f : files_)
+        if (f.first == table) return f.second;
+
+    std::string body;
+    if (!WriteArrowTable(db, table, body)) return nullptr;
+    auto file = std::make_shared<File>();
+    file->body = std::make_shared<const std::string>(std::move(body));
+    file->etag = ResponseCacheMiddleware::MakeETag("/export/" + table + ".arrow", epoch_);
+    files_.emplace_back(table, file);
+    return file;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class AirTravelDB;
+
+// Apache Arrow IPC file format ("Feather v2") for the bulk exports. The
+// writer emits the flatbuffer metadata itself, so there is no Arrow
+// dependency; pyarrow, arrow-rs, DuckDB and friends can memory-map the
+// result without parsing. Fixed-width columns are copied as raw little-endian
+// buffers; string columns are dictionary-encoded (int8/16/32 indices, the
+// narrowest that fits) when that is smaller, plain utf8 otherwise. No column
+// has nulls.
+
+class ArrowFileWriter {
+public:
+    void AddInt32(const std::string& name, std::vector<int32_t> values);
+    void AddFloat64(const std::string& name, std::vector<double> values);
+    void AddString(const std::string& name, const std::vector<const std::string*>& values);
+
+    // Schema, one dictionary batch per dictionary column, one record batch
+    // and the footer. Every column must have `rows` values.
+    std::string Finish(size_t rows);
+
+private:
+    enum class Kind : uint8_t { Int32, Float64, Utf8, DictUtf8 };
+    struct Column {
+        std::string name;
+        Kind        kind;
+        std::vector<uint8_t> values;   // raw int32/float64 values or dictionary indices
+        std::vector<int32_t> offsets;  // utf8 offsets (plain or dictionary values)
+        std::string          data;     // utf8 bytes
+        size_t               dict_size = 0;
+        uint8_t              index_width = 4; // bytes per dictionary index: 1, 2 or 4
+    };
+    std::vector<Column> columns_;
+};
+
+// Decoded contents of an Arrow file written by ArrowFileWriter, used to
+// round-trip check the exports. Dictionary columns come back as strings.
+struct ArrowTable {
+    struct Column {
+        std::string name;
+        char        type = 0;          // 'i' int32, 'd' float64, 's' utf8
+        bool        dictionary = false;
+        std::vector<int32_t>     i32;
+        std::vector<double>      f64;
+        std::vector<std::string> str;
+    };
+    int64_t rows = 0;
+    std::vector<Column> columns;
+};
+
+// Validates the file layout (magic, footer, message framing, buffer
+// bounds) and decodes every column; false with `error` otherwise.
+bool ReadArrowFile(const std::string& file, ArrowTable& out, std::string& error);
+
+// "airports", "airlines" or "routes" from the loaded dataset; airports and
+// airlines in id order, routes in file order. False for an unknown table.
+bool WriteArrowTable(const AirTravelDB& db, const std::string& table, std::string& out);
+
+// Writes `table`, reads it back and compares every cell with the dataset.
+bool CheckArrowRoundTrip(const AirTravelDB& db, const std::string& table, std::string& error);
+
+// Arrow exports rendered once per dataset epoch, like PreparedReports.
+class ArrowExports {
+public:
+    struct File {
+        std::shared_ptr<const std::string> body;
+        std::string etag;
+    };
+    // null for an unknown table
+    std::shared_ptr<const File> Get(const std::string& table, const AirTravelDB& db);
+
+private:
+    std::mutex mtx_;
+    uint64_t   epoch_ = 0;
+    std::vector<std::pair<std::string, std::shared_ptr<const File>>> files_;
+};
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Requests per second and tail latency of the default multithreaded server
+# against the SO_REUSEPORT shard mode (SERVER_SHARDS), on keep-alive
+# connections and with a new connection per request.
+#
+#   ./bench_server_modes.sh [shards] [connections] [seconds]
+#
+# Needs ./app and ./loadgen (see the Dockerfile). Runs on port 18090; the
+# load generator shares the machine, so pin it away from the server cores
+# (e.g. SHARD_CPUS=0-7 and taskset -c 8-15 ./bench_server_modes.sh 8) for
+# numbers that mean something.
+SHARDS=${1:-$(nproc)}
+CONNS=${2:-64}
+SECS=${3:-10}
+PORT=18090
+PATHS="/airport/LHR /airline/BA /airport/JFK /api/airports/suggest?q=lon /routes/LHR/JFK /api/metro/London"
+
+run_mode() {
+    name=$1
+    shift
+    env PORT=$PORT "$@" ./app > /dev/null 2>&1 &
+    pid=$!
+    for _ in $(seq 1 100); do
+        ./loadgen -p $PORT -c 1 -d 0.1 /airport/LHR 2>/dev/null | grep -q '"requests":[1-9]' && break
+        sleep 0.2
+    done
+    # warm the caches, then measure
+    ./loadgen -p $PORT -c "$CONNS" -d 2 $PATHS > /dev/null
+    echo "$name keep-alive: $(./loadgen -p $PORT -c "$CONNS" -d "$SECS" $PATHS)"
+    echo "$name close:      $(./loadgen -p $PORT -c "$CONNS" -d "$SECS" --close $PATHS)"
+    kill $pid
+    wait $pid 2>/dev/null
+}
+
+run_mode "multithreaded" SERVER_SHARDS=0
+run_mode "shards=$SHARDS" SERVER_SHARDS="$SHARDS"
@@ -0,0 +1,256 @@
+﻿#include "bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// ---------------- bit helpers ----------------
+unsigned Bitmap::popcount64(uint64_t v) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<unsigned>(__popcnt64(v));
+#elif defined(_MSC_VER)
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<unsigned>((v * 0x0101010101010101ull) >> 56);
+#else
+    return static_cast<unsigned>(__builtin_popcountll(v));
+#endif
+}
+
+unsigned Bitmap::ctz64(uint64_t v) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long idx;
+    _BitScanForward64(&idx, v);
+    return static_cast<unsigned>(idx);
+#elif defined(_MSC_VER)
+    return popcount64((v & (0 - v)) - 1);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+}
+
+// Picks the cheaper representation for the container's cardinality.
+void Bitmap::normalize(Container& c) {
+    if (c.bitset && c.card <= kArrayMax) {
+        std::vector<uint16_t> arr;
+        arr.reserve(c.card);
+        for (size_t w = 0; w < kWords; ++w) {
+            uint64_t word = c.bits[w];
+            while (word) {
+                arr.push_back(static_cast<uint16_t>(w * 64 + ctz64(word)));
+                word &= word - 1;
+            }
+        }
+        c.array.swap(arr);
+        c.bits.clear(); c.bits.shrink_to_fit();
+        c.bitset = false;
+    }
+    else if (!c.bitset && c.card > kArrayMax) {
+        c.bits.assign(kWords, 0);
+        for (uint16_t lo : c.array) c.bits[lo >> 6] |= uint64_t(1) << (lo & 63);
+        c.array.clear(); c.array.shrink_to_fit();
+        c.bitset = true;
+    }
+}
+
+// ---------------- building / probing ----------------
+void Bitmap::Add(uint32_t v) {
+    const uint16_t key = static_cast<uint16_t>(v >> 16);
+    const uint16_t lo = static_cast<uint16_t>(v & 0xFFFF);
+
+    // loaders add in increasing order, so the last container is the usual hit
+    auto it = (!containers_.empty() && containers_.back().key == key)
+        ? containers_.end() - 1
+        : std::lower_bound(containers_.begin(), containers_.end(), key,
+            [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers_.end() || it->key != key) {
+        Container c;
+        c.key = key;
+        it = containers_.insert(it, std::move(c));
+    }
+
+    Container& c = *it;
+    if (c.bitset) {
+        uint64_t& word = c.bits[lo >> 6];
+        const uint64_t mask = uint64_t(1) << (lo & 63);
+        if (!(word & mask)) { word |= mask; ++c.card; }
+        return;
+    }
+    if (c.array.empty() || c.array.back() < lo) c.array.push_back(lo);
+    else {
+        auto pos = std::lower_bound(c.array.begin(), c.array.end(), lo);
+        if (pos != c.array.end() && *pos == lo) return;
+        c.array.insert(pos, lo);
+    }
+    ++c.card;
+    normalize(c);
+}
+
+bool Bitmap::Contains(uint32_t v) const {
+    const uint16_t key = static_cast<uint16_t>(v >> 16);
+    const uint16_t lo = static_cast<uint16_t>(v & 0xFFFF);
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+        [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers_.end() || it->key != key) return false;
+    if (it->bitset) return (it->bits[lo >> 6] >> (lo & 63)) & 1;
+    return std::binary_search(it->array.begin(), it->array.end(), lo);
+}
+
+size_t Bitmap::Cardinality() const {
+    size_t n = 0;
+    for (const auto& c : containers_) n += c.card;
+    return n;
+}
+
+size_t Bitmap::MemoryBytes() const {
+    size_t n = sizeof(*this) + containers_.capacity() * sizeof(Container);
+    for (const auto& c : containers_)
+        n += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    return n;
+}
+
+Bitmap Bitmap::Range(uint32_t n) {
+    Bitmap out;
+    for (uint32_t start = 0; start < n; start += 65536) {
+        Container c;
+        c.key = static_cast<uint16_t>(start >> 16);
+        c.card = std::min<uint32_t>(65536, n - start);
+        c.bitset = true;
+        c.bits.assign(kWords, 0);
+        for (uint32_t w = 0; w < c.card / 64; ++w) c.bits[w] = ~uint64_t(0);
+        if (c.card % 64) c.bits[c.card / 64] = (uint64_t(1) << (c.card % 64)) - 1;
+        normalize(c);
+        out.containers_.push_back(std::move(c));
+    }
+    return out;
+}
+
+std::vector<uint32_t> Bitmap::ToVector() const {
+    std::vector<uint32_t> out;
+    out.reserve(Cardinality());
+    ForEach([&](uint32_t v) { out.push_back(v); return true; });
+    return out;
+}
+
+// ---------------- container algebra ----------------
+Bitmap::Container Bitmap::andContainers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+    if (a.bitset && b.bitset) {
+        out.bitset = true;
+        out.bits.resize(kWords);
+        for (size_t w = 0; w < kWords; ++w) {
+            out.bits[w] = a.bits[w] & b.bits[w];
+            out.card += popcount64(out.bits[w]);
+        }
+    }
+    else if (a.bitset || b.bitset) {
+        const Container& arr = a.bitset ? b : a;
+        const Container& bs = a.bitset ? a : b;
+        for (uint16_t lo : arr.array)
+            if ((bs.bits[lo >> 6] >> (lo & 63)) & 1) out.array.push_back(lo);
+        out.card = static_cast<uint32_t>(out.array.size());
+    }
+    else {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+            std::back_inserter(out.array));
+        out.card = static_cast<uint32_t>(out.array.size());
+    }
+    normalize(out);
+    return out;
+}
+
+Bitmap::Container Bitmap::orContainers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+    if (!a.bitset && !b.bitset && a.card + b.card <= kArrayMax) {
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+            std::back_inserter(out.array));
+        out.card = static_cast<uint32_t>(out.array.size());
+        return out;
+    }
+    out.bitset = true;
+    out.bits.assign(kWords, 0);
+    for (const Container* c : { &a, &b }) {
+        if (c->bitset) for (size_t w = 0; w < kWords; ++w) out.bits[w] |= c->bits[w];
+        else for (uint16_t lo : c->array) out.bits[lo >> 6] |= uint64_t(1) << (lo & 63);
+    }
+    for (size_t w = 0; w < kWords; ++w) out.card += popcount64(out.bits[w]);
+    normalize(out);
+    return out;
+}
+
+Bitmap::Container Bitmap::andNotContainers(const Container& a, const Container& b) {
+    Container out;
+    out.key = a.key;
+    if (a.bitset) {
+        out.bitset = true;
+        out.bits = a.bits;
+        if (b.bitset) for (size_t w = 0; w < kWords; ++w) out.bits[w] &= ~b.bits[w];
+        else for (uint16_t lo : b.array) out.bits[lo >> 6] &= ~(uint64_t(1) << (lo & 63));
+        for (size_t w = 0; w < kWords; ++w) out.card += popcount64(out.bits[w]);
+    }
+    else if (b.bitset) {
+        for (uint16_t lo : a.array)
+            if (!((b.bits[lo >> 6] >> (lo & 63)) & 1)) out.array.push_back(lo);
+        out.card = static_cast<uint32_t>(out.array.size());
+    }
+    else {
+        std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+            std::back_inserter(out.array));
+        out.card = static_cast<uint32_t>(out.array.size());
+    }
+    normalize(out);
+    return out;
+}
+
+// ---------------- bitmap algebra ----------------
+Bitmap Bitmap::And(const Bitmap& a, const Bitmap& b) {
+    Bitmap out;
+    size_t i = 0, j = 0;
+    while (i < a.containers_.size() && j < b.containers_.size()) {
+        const auto& ca = a.containers_[i];
+        const auto& cb = b.containers_[j];
+        if (ca.key < cb.key) ++i;
+        else if (cb.key < ca.key) ++j;
+        else {
+            auto c = andContainers(ca, cb);
+            if (c.card) out.containers_.push_back(std::move(c));
+            ++i; ++j;
+        }
+    }
+    return out;
+}
+
+Bitmap Bitmap::Or(const Bitmap& a, const Bitmap& b) {
+    Bitmap out;
+    size_t i = 0, j = 0;
+    while (i < a.containers_.size() || j < b.containers_.size()) {
+        if (j == b.containers_.size() || (i < a.containers_.size() && a.containers_[i].key < b.containers_[j].key))
+            out.containers_.push_back(a.containers_[i++]);
+        else if (i == a.containers_.size() || b.containers_[j].key < a.containers_[i].key)
+            out.containers_.push_back(b.containers_[j++]);
+        else
+            out.containers_.push_back(orContainers(a.containers_[i++], b.containers_[j++]));
+    }
+    return out;
+}
+
+Bitmap Bitmap::AndNot(const Bitmap& a, const Bitmap& b) {
+    Bitmap out;
+    size_t j = 0;
+    for (const auto& ca : a.containers_) {
+        while (j < b.containers_.size() && b.containers_[j].key < ca.key) ++j;
+        if (j == b.containers_.size() || b.containers_[j].key != ca.key) {
+            out.containers_.push_back(ca);
+            continue;
+        }
+        auto c = andNotContainers(ca, b.containers_[j]);
+        if (c.card) out.containers_.push_back(std::move(c));
+    }
+    return out;
+}
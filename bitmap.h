@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Compressed bitmap in the style of Roaring: the 32-bit space is split into
+// 65536-value chunks keyed by the high 16 bits. A sparse chunk stores its
+// low halves as a sorted uint16 array, a dense one (> 4096 values) as a
+// 8 KiB bitset, so AND/OR/ANDNOT work chunk by chunk on the cheapest form.
+class Bitmap {
+public:
+    void Add(uint32_t v);
+    bool Contains(uint32_t v) const;
+    size_t Cardinality() const;
+    bool Empty() const { return containers_.empty(); }
+    size_t MemoryBytes() const;
+
+    // every value in [0, n)
+    static Bitmap Range(uint32_t n);
+
+    static Bitmap And(const Bitmap& a, const Bitmap& b);
+    static Bitmap Or(const Bitmap& a, const Bitmap& b);
+    static Bitmap AndNot(const Bitmap& a, const Bitmap& b);
+
+    // Calls f(value) in increasing order; stops early when f returns false.
+    template <class F>
+    void ForEach(F f) const {
+        for (const auto& c : containers_) {
+            const uint32_t hi = static_cast<uint32_t>(c.key) << 16;
+            if (!c.bitset) {
+                for (uint16_t lo : c.array) if (!f(hi | lo)) return;
+                continue;
+            }
+            for (size_t w = 0; w < c.bits.size(); ++w) {
+                uint64_t word = c.bits[w];
+                while (word) {
+                    unsigned bit = ctz64(word);
+                    if (!f(hi | static_cast<uint32_t>(w * 64 + bit))) return;
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    // Same, starting at the first value >= start (seeks to its chunk).
+    template <class F>
+    void ForEachFrom(uint32_t start, F f) const {
+        const uint16_t start_key = static_cast<uint16_t>(start >> 16);
+        const uint16_t start_lo = static_cast<uint16_t>(start & 0xFFFF);
+        auto c = std::lower_bound(containers_.begin(), containers_.end(), start_key,
+            [](const Container& x, uint16_t k) { return x.key < k; });
+        for (; c != containers_.end(); ++c) {
+            const uint32_t hi = static_cast<uint32_t>(c->key) << 16;
+            const uint16_t lo_min = c->key == start_key ? start_lo : 0;
+            if (!c->bitset) {
+                for (auto it = std::lower_bound(c->array.begin(), c->array.end(), lo_min); it != c->array.end(); ++it)
+                    if (!f(hi | *it)) return;
+                continue;
+            }
+            for (size_t w = lo_min / 64; w < c->bits.size(); ++w) {
+                uint64_t word = c->bits[w];
+                if (w == lo_min / 64) word &= ~uint64_t(0) << (lo_min % 64);
+                while (word) {
+                    unsigned bit = ctz64(word);
+                    if (!f(hi | static_cast<uint32_t>(w * 64 + bit))) return;
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> ToVector() const;
+
+private:
+    static constexpr size_t kArrayMax = 4096;
+    static constexpr size_t kWords = 1024;
+
+    struct Container {
+        uint16_t key = 0;
+        bool     bitset = false;
+        uint32_t card = 0;
+        std::vector<uint16_t> array; // sorted, when !bitset
+        std::vector<uint64_t> bits;  // kWords words, when bitset
+    };
+
+    static unsigned ctz64(uint64_t v);
+    static unsigned popcount64(uint64_t v);
+    static void normalize(Container& c);
+    static Container andContainers(const Container& a, const Container& b);
+    static Container orContainers(const Container& a, const Container& b);
+    static Container andNotContainers(const Container& a, const Container& b);
+
+    std::vector<Container> containers_; // sorted by key
+};
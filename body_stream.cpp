@@ -0,0 +1,73 @@
+﻿#include "body_stream.h"
+
+BodyStream& BodyStream::Text(std::string text) {
+    if (text.empty()) return *this;
+    if (!pieces_.empty() && !pieces_.back().row) pieces_.back().text += text;
+    else {
+        Piece p;
+        p.text = std::move(text);
+        pieces_.push_back(std::move(p));
+    }
+    return *this;
+}
+
+BodyStream& BodyStream::Rows(size_t n, RowFn row, std::string sep) {
+    if (n == 0) return *this;
+    Piece p;
+    p.n = n;
+    p.row = std::move(row);
+    p.sep = std::move(sep);
+    pieces_.push_back(std::move(p));
+    return *this;
+}
+
+size_t BodyStream::RowCount() const {
+    size_t n = 0;
+    for (const auto& p : pieces_) n += p.n;
+    return n;
+}
+
+std::string BodyStream::Render() && {
+    std::string out;
+    for (const auto& p : pieces_) {
+        if (!p.row) { out += p.text; continue; }
+        for (size_t i = 0; i < p.n; ++i) {
+            if (i) out += p.sep;
+            p.row(out, i);
+        }
+    }
+    pieces_.clear();
+    return out;
+}
+
+std::function<bool(std::string&)> BodyStream::Source(size_t chunk_bytes) && {
+    struct Cursor {
+        std::vector<Piece> pieces;
+        size_t piece = 0;
+        size_t row = 0;
+    };
+    auto cur = std::make_shared<Cursor>();
+    cur->pieces = std::move(pieces_);
+    pieces_.clear();
+
+    return [cur, chunk_bytes](std::string& out) {
+        while (cur->piece < cur->pieces.size()) {
+            Piece& p = cur->pieces[cur->piece];
+            if (!p.row) {
+                out += p.text;
+            }
+            else {
+                while (cur->row < p.n) {
+                    if (cur->row) out += p.sep;
+                    p.row(out, cur->row++);
+                    if (out.size() >= chunk_bytes) return true;
+                }
+                cur->row = 0;
+            }
+            p = Piece{}; // release captured row state as soon as it is consumed
+            ++cur->piece;
+            if (out.size() >= chunk_bytes) return cur->piece < cur->pieces.size();
+        }
+        return false;
+    };
+}
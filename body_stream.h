@@ -0,0 +1,99 @@
+#pragma once
+#include "encode.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A response body described as pieces -- literal text and runs of rows that
+// are encoded one at a time -- so it can either be rendered into one string
+// or pulled chunk by chunk (crow::response::body_source, sent with chunked
+// transfer encoding). While streaming, only about one chunk of output exists
+// at any moment and the connection asks for the next one only after the
+// previous one was written, so a slow reader throttles the encoder.
+//
+// Row callbacks run after the handler has returned: they must own (or hold
+// shared_ptrs to) whatever they read, apart from static schemas/layouts --
+// the dataset too, which a reload may replace mid-stream (hold the
+// LiveDataset pin).
+class BodyStream {
+public:
+    using RowFn = std::function<void(std::string& out, size_t row)>;
+
+    static constexpr size_t kChunkBytes = 64 * 1024;
+    // Results with fewer rows are rendered into one string instead, which
+    // keeps them cacheable and sent with a Content-Length.
+    static constexpr size_t kMinStreamRows = 1000;
+    // Never emitted by the JSON/CSV encoders (NUL is escaped), so it can
+    // mark the place of the streamed part inside a pre-rendered envelope.
+    static constexpr char kHole = '\0';
+
+    BodyStream& Text(std::string text);
+    // n rows, `sep` between consecutive rows
+    BodyStream& Rows(size_t n, RowFn row, std::string sep = ",");
+
+    // A JSON array of n rows, row(i) -> const T&, as
+    // RowSchema::AppendJSONArray writes them.
+    template <class T, class Get>
+    BodyStream& JsonArray(const RowSchema<T>& schema, typename RowSchema<T>::Projection p, size_t n, Get row) {
+        auto proj = std::make_shared<const typename RowSchema<T>::Projection>(std::move(p));
+        Text("[");
+        Rows(n, [&schema, proj, row](std::string& out, size_t i) {
+            schema.AppendJSON(out, row(i), *proj);
+            });
+        return Text("]");
+    }
+
+    // A JSON list of n layout objects, as JsonObjectLayout::WriteList writes it.
+    // `layout` must outlive the stream (a function-local static).
+    template <class F>
+    BodyStream& JsonList(const JsonObjectLayout& layout, size_t n, F member) {
+        Text("[");
+        Rows(n, [&layout, member](std::string& out, size_t i) {
+            layout.Write(out, [&](std::string& o, size_t m) { member(o, i, m); });
+            });
+        return Text("]");
+    }
+
+    // CSV header plus n rows
+    template <class T, class Get>
+    BodyStream& Csv(const RowSchema<T>& schema, typename RowSchema<T>::Projection p, size_t n, Get row) {
+        std::string header;
+        schema.AppendCSVHeader(header, p);
+        Text(std::move(header));
+        auto proj = std::make_shared<const typename RowSchema<T>::Projection>(std::move(p));
+        return Rows(n, [&schema, proj, row](std::string& out, size_t i) {
+            schema.AppendCSVRow(out, row(i), *proj);
+            }, "");
+    }
+
+    // Splits `rendered` at its kHole; `inner` adds the pieces that go there.
+    template <class F>
+    BodyStream& Around(const std::string& rendered, F&& inner) {
+        const size_t at = rendered.find(kHole);
+        Text(rendered.substr(0, at));
+        inner(*this);
+        return Text(at == std::string::npos ? std::string() : rendered.substr(at + 1));
+    }
+
+    size_t RowCount() const;
+    bool ShouldStream() const { return RowCount() >= kMinStreamRows; }
+
+    // The whole body in one string.
+    std::string Render() &&;
+    // Pull function for crow::response::body_source; each call appends at
+    // least chunk_bytes of output (less for the last one).
+    std::function<bool(std::string&)> Source(size_t chunk_bytes = kChunkBytes) &&;
+
+private:
+    struct Piece {
+        std::string text;
+        size_t n = 0;
+        RowFn  row;       // null for a text piece
+        std::string sep;
+    };
+    std::vector<Piece> pieces_;
+};
@@ -0,0 +1,166 @@
+﻿#include "codescan.h"
+
+#include <cctype>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CODESCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+bool PackCode(const std::string& code, uint32_t& out) {
+    // a NUL would be indistinguishable from the zero padding
+    if (code.size() > 4 || code.find('\0') != std::string::npos) return false;
+    out = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        uint32_t c = static_cast<unsigned char>(std::toupper(static_cast<unsigned char>(code[i])));
+        out |= c << (8 * i);
+    }
+    return true;
+}
+
+static inline uint32_t lenMask(unsigned len) {
+    return len >= 4 ? 0xFFFFFFFFu : ((1u << (8 * len)) - 1);
+}
+
+// ---------------- scalar ----------------
+static void scanScalarRange(const std::vector<const uint32_t*>& cols, size_t begin, size_t end,
+    uint32_t token, unsigned len, std::vector<uint32_t>& out) {
+    const uint32_t mask = lenMask(len);
+    const unsigned shifts = 4 - len;
+    for (size_t i = begin; i < end; ++i) {
+        bool hit = false;
+        for (const uint32_t* col : cols) {
+            const uint32_t v = col[i];
+            for (unsigned k = 0; k <= shifts && !hit; ++k)
+                hit = ((v >> (8 * k)) & mask) == token;
+            if (hit) break;
+        }
+        if (hit) out.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+void ScanCodeColumnsScalar(const std::vector<const uint32_t*>& cols, size_t rows,
+    uint32_t token, unsigned token_len, std::vector<uint32_t>& out) {
+    if (token_len == 0 || token_len > 4) return;
+    scanScalarRange(cols, 0, rows, token, token_len, out);
+}
+
+#ifdef CODESCAN_X86
+static inline unsigned ctz32(unsigned v) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, v);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctz(v));
+#endif
+}
+
+// ---------------- SSE2: 4 rows per step ----------------
+static size_t scanSSE2(const std::vector<const uint32_t*>& cols, size_t rows,
+    uint32_t token, unsigned len, std::vector<uint32_t>& out) {
+    const __m128i tok = _mm_set1_epi32(static_cast<int>(token));
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(lenMask(len)));
+    const unsigned shifts = 4 - len;
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        __m128i hit = _mm_setzero_si128();
+        for (const uint32_t* col : cols) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(col + i));
+            for (unsigned k = 0; k <= shifts; ++k) {
+                const __m128i s = _mm_srl_epi32(v, _mm_cvtsi32_si128(static_cast<int>(8 * k)));
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi32(_mm_and_si128(s, mask), tok));
+            }
+        }
+        unsigned m = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(hit)));
+        while (m) {
+            out.push_back(static_cast<uint32_t>(i + ctz32(m)));
+            m &= m - 1;
+        }
+    }
+    return i;
+}
+
+// ---------------- AVX2: 8 rows per step ----------------
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+static size_t scanAVX2(const std::vector<const uint32_t*>& cols, size_t rows,
+    uint32_t token, unsigned len, std::vector<uint32_t>& out) {
+    const __m256i tok = _mm256_set1_epi32(static_cast<int>(token));
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(lenMask(len)));
+    const unsigned shifts = 4 - len;
+    size_t i = 0;
+    for (; i + 8 <= rows; i += 8) {
+        __m256i hit = _mm256_setzero_si256();
+        for (const uint32_t* col : cols) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(col + i));
+            for (unsigned k = 0; k <= shifts; ++k) {
+                const __m256i s = _mm256_srl_epi32(v, _mm_cvtsi32_si128(static_cast<int>(8 * k)));
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi32(_mm256_and_si256(s, mask), tok));
+            }
+        }
+        unsigned m = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(hit)));
+        while (m) {
+            out.push_back(static_cast<uint32_t>(i + ctz32(m)));
+            m &= m - 1;
+        }
+    }
+    return i;
+}
+
+static bool cpuHasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    const bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+#endif // CODESCAN_X86
+
+enum class Kernel { Scalar, SSE2, AVX2 };
+
+static Kernel selectKernel() {
+#ifdef CODESCAN_X86
+    static const Kernel k = cpuHasAVX2() ? Kernel::AVX2 : Kernel::SSE2;
+    return k;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+const char* CodeScanKernel() {
+    switch (selectKernel()) {
+    case Kernel::AVX2: return "avx2";
+    case Kernel::SSE2: return "sse2";
+    default:           return "scalar";
+    }
+}
+
+void ScanCodeColumns(const std::vector<const uint32_t*>& cols, size_t rows,
+    uint32_t token, unsigned token_len, std::vector<uint32_t>& out) {
+    if (token_len == 0 || token_len > 4) return;
+    size_t done = 0;
+#ifdef CODESCAN_X86
+    switch (selectKernel()) {
+    case Kernel::AVX2: done = scanAVX2(cols, rows, token, token_len, out); break;
+    case Kernel::SSE2: done = scanSSE2(cols, rows, token, token_len, out); break;
+    default: break;
+    }
+#endif
+    scanScalarRange(cols, done, rows, token, token_len, out);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Fixed-width code columns: every code (airline/airport IATA) is upper-cased
+// and packed little-endian into a zero-padded uint32, so a substring test
+// becomes up to four masked 32-bit compares that vectorize cleanly.
+
+// Packs `code` (upper-cased) into `out`; false when it is longer than 4 bytes
+// or holds a NUL, so such codes and tokens never meet the packed columns.
+bool PackCode(const std::string& code, uint32_t& out);
+
+// Appends, in increasing order, every row i in [0, rows) where the packed
+// token (1-4 bytes, no NULs) occurs inside cols[c][i] for any column c.
+void ScanCodeColumns(const std::vector<const uint32_t*>& cols, size_t rows,
+    uint32_t token, unsigned token_len, std::vector<uint32_t>& out);
+
+// Portable reference kernel, used for tails and on non-x86 builds.
+void ScanCodeColumnsScalar(const std::vector<const uint32_t*>& cols, size_t rows,
+    uint32_t token, unsigned token_len, std::vector<uint32_t>& out);
+
+// Kernel picked at runtime: "avx2", "sse2" or "scalar".
+const char* CodeScanKernel();
@@ -0,0 +1,488 @@
+﻿#include "compress.h"
+#include "response_cache.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+std::string GzipCompress(const std::string& data, int level) {
+    z_stream zs{};
+    // windowBits 15 + 16 selects the gzip wrapper
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return {};
+    std::string out;
+    out.resize(deflateBound(&zs, static_cast<uLong>(data.size())));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) return {};
+    return out;
+}
+
+bool AcceptsEncoding(const std::string& accept_encoding, const std::string& coding) {
+    std::stringstream ss(accept_encoding);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::string name = item.substr(0, item.find(';'));
+        name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name != coding && name != "*") continue;
+        auto q = item.find("q=");
+        if (q == std::string::npos) return true;
+        return std::atof(item.c_str() + q + 2) > 0.0;
+    }
+    return false;
+}
+
+// ---------------- CPU clocks ----------------
+#ifdef _WIN32
+static uint64_t filetime_ns(const FILETIME& ft) {
+    return ((static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) * 100;
+}
+static uint64_t thread_cpu_ns() {
+    FILETIME c, e, k, u;
+    if (!GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u)) return 0;
+    return filetime_ns(k) + filetime_ns(u);
+}
+static uint64_t process_cpu_ns() {
+    FILETIME c, e, k, u;
+    if (!GetProcessTimes(GetCurrentProcess(), &c, &e, &k, &u)) return 0;
+    return filetime_ns(k) + filetime_ns(u);
+}
+#else
+static uint64_t clock_ns(clockid_t id) {
+    timespec ts{};
+    if (clock_gettime(id, &ts) != 0) return 0;
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+static uint64_t thread_cpu_ns() { return clock_ns(CLOCK_THREAD_CPUTIME_ID); }
+static uint64_t process_cpu_ns() { return clock_ns(CLOCK_PROCESS_CPUTIME_ID); }
+#endif
+
+static uint64_t wall_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// ---------------- deflate streams ----------------
+namespace {
+
+enum Coding { kGzip = 0, kDeflate = 1 };
+
+// windowBits 15 + 16 selects the gzip wrapper, plain 15 the zlib one
+// ("deflate" in HTTP is RFC 1950 zlib data)
+int window_bits(int coding) { return coding == kGzip ? 15 + 16 : 15; }
+
+struct ZStreamDeleter {
+    void operator()(z_stream* zs) const { deflateEnd(zs); delete zs; }
+};
+using ZStreamPtr = std::unique_ptr<z_stream, ZStreamDeleter>;
+
+ZStreamPtr new_stream(int coding, int level) {
+    auto* zs = new z_stream{};
+    if (deflateInit2(zs, level, Z_DEFLATED, window_bits(coding), 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete zs;
+        return nullptr;
+    }
+    return ZStreamPtr(zs);
+}
+
+// Runs `zs` over `in`, appending to `out`; the buffer grows as needed.
+bool deflate_append(z_stream* zs, const char* in, size_t n, int flush, std::string& out) {
+    zs->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+    zs->avail_in = static_cast<uInt>(n);
+    for (;;) {
+        size_t used = out.size();
+        size_t room = std::max<size_t>(deflateBound(zs, static_cast<uLong>(zs->avail_in)), 4096);
+        out.resize(used + room);
+        zs->next_out = reinterpret_cast<Bytef*>(&out[used]);
+        zs->avail_out = static_cast<uInt>(room);
+        const int rc = deflate(zs, flush);
+        out.resize(used + room - zs->avail_out);
+        if (rc == Z_STREAM_END) return true;
+        if (rc != Z_OK && rc != Z_BUF_ERROR) return false;
+        // Z_NO_FLUSH is done once the input is consumed; Z_FINISH goes on
+        // until the stream end is written
+        if (flush != Z_FINISH && zs->avail_in == 0 && zs->avail_out != 0) return true;
+    }
+}
+
+// One reusable z_stream per coding and level per io thread, created on
+// first use; deflateReset is all a response costs after that. Only the few
+// levels actually picked ever get a stream (~270 KB each).
+struct ThreadStreams {
+    ZStreamPtr streams[2][10];
+    z_stream* Get(int coding, int level, bool& reused) {
+        ZStreamPtr& zs = streams[coding][level];
+        reused = static_cast<bool>(zs);
+        if (!zs) zs = new_stream(coding, level);
+        else deflateReset(zs.get());
+        return zs.get();
+    }
+};
+thread_local ThreadStreams t_streams;
+
+const char* const kCodingName[2] = { "gzip", "deflate" };
+const char* const kETagSuffix[2] = { "-gz", "-df" };
+
+// text, JSON, JavaScript, XML and CSV compress well; images, archives and
+// Arrow files either do not or are already compressed
+bool compressible_type(const std::string& content_type) {
+    std::string t = content_type.substr(0, content_type.find(';'));
+    std::transform(t.begin(), t.end(), t.begin(), ::tolower);
+    return t.compare(0, 5, "text/") == 0 || t.find("json") != std::string::npos ||
+        t.find("javascript") != std::string::npos || t.find("xml") != std::string::npos ||
+        t.find("csv") != std::string::npos;
+}
+
+bool contains_ci(std::string haystack, const std::string& lower_needle) {
+    std::transform(haystack.begin(), haystack.end(), haystack.begin(), ::tolower);
+    return haystack.find(lower_needle) != std::string::npos;
+}
+
+// "\"abc\"" + "-gz" -> "\"abc-gz\"" (W/ kept)
+std::string suffix_etag(const std::string& etag, const char* suffix) {
+    if (etag.size() < 2 || etag.back() != '"') return etag;
+    return etag.substr(0, etag.size() - 1) + suffix + "\"";
+}
+
+} // namespace
+
+// ---------------- middleware state ----------------
+struct CompressionMiddleware::State {
+    std::atomic<uint64_t> compressed{ 0 }, streamed{ 0 }, by_coding[2]{};
+    std::atomic<uint64_t> skipped_small{ 0 }, skipped_type{ 0 }, skipped_encoded{ 0 };
+    std::atomic<uint64_t> not_accepted{ 0 }, incompressible{ 0 }, memo_hits{ 0 };
+    std::atomic<uint64_t> stream_inits{ 0 }, stream_resets{ 0 };
+    std::atomic<uint64_t> bytes_in{ 0 }, bytes_out{ 0 }, cpu_ns{ 0 };
+    std::atomic<uint64_t> by_level[10]{};
+
+    // CPU headroom: 1 - process CPU time / (wall time * cores) over the last
+    // sample period; whichever request finds the sample stale takes the next.
+    static constexpr uint64_t kSamplePeriodNs = 250000000ull;
+    std::atomic<uint64_t> sample_wall{ 0 };
+    std::atomic<uint64_t> sample_cpu{ 0 };
+    std::atomic<int>      headroom_permille{ 1000 };
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+    int Headroom() {
+        const uint64_t now = wall_ns();
+        uint64_t last = sample_wall.load(std::memory_order_relaxed);
+        if (now - last >= kSamplePeriodNs &&
+            sample_wall.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+            const uint64_t cpu = process_cpu_ns();
+            const uint64_t prev = sample_cpu.exchange(cpu, std::memory_order_relaxed);
+            if (last && cpu >= prev) {
+                const double used = static_cast<double>(cpu - prev) / (static_cast<double>(now - last) * cores);
+                const int permille = static_cast<int>((1.0 - std::min(1.0, used)) * 1000.0);
+                headroom_permille.store(permille, std::memory_order_relaxed);
+            }
+        }
+        return headroom_permille.load(std::memory_order_relaxed);
+    }
+
+    // Compressed forms of shared bodies, keyed by body address and coding;
+    // the weak_ptr tells a live body from a new one at a recycled address.
+    struct MemoEntry {
+        std::weak_ptr<const std::string> source;
+        std::shared_ptr<const std::string> encoded;
+        uint64_t key;
+    };
+    std::mutex memo_mtx;
+    std::list<MemoEntry> memo_lru;      // front = most recent
+    std::unordered_map<uint64_t, std::list<MemoEntry>::iterator> memo_index;
+    size_t memo_size = 0;
+
+    static uint64_t MemoKey(const std::shared_ptr<const std::string>& body, int coding) {
+        return (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(body.get())) << 1) | static_cast<uint64_t>(coding);
+    }
+
+    std::shared_ptr<const std::string> MemoGet(const std::shared_ptr<const std::string>& body, int coding) {
+        std::lock_guard<std::mutex> lk(memo_mtx);
+        auto it = memo_index.find(MemoKey(body, coding));
+        if (it == memo_index.end()) return nullptr;
+        if (it->second->source.lock() != body) {
+            memo_size -= it->second->encoded->size();
+            memo_lru.erase(it->second);
+            memo_index.erase(it);
+            return nullptr;
+        }
+        memo_lru.splice(memo_lru.begin(), memo_lru, it->second);
+        return it->second->encoded;
+    }
+
+    void MemoPut(const std::shared_ptr<const std::string>& body, int coding,
+        std::shared_ptr<const std::string> encoded, size_t capacity) {
+        if (encoded->size() > capacity / 4) return;
+        std::lock_guard<std::mutex> lk(memo_mtx);
+        const uint64_t key = MemoKey(body, coding);
+        auto it = memo_index.find(key);
+        if (it != memo_index.end()) {
+            memo_size -= it->second->encoded->size();
+            memo_lru.erase(it->second);
+            memo_index.erase(it);
+        }
+        memo_size += encoded->size();
+        memo_lru.push_front(MemoEntry{ body, std::move(encoded), key });
+        memo_index[key] = memo_lru.begin();
+        while (memo_size > capacity && !memo_lru.empty()) {
+            memo_size -= memo_lru.back().encoded->size();
+            memo_index.erase(memo_lru.back().key);
+            memo_lru.pop_back();
+        }
+    }
+
+    void Count(int coding, int level, uint64_t in, uint64_t out, uint64_t cpu) {
+        compressed.fetch_add(1, std::memory_order_relaxed);
+        by_coding[coding].fetch_add(1, std::memory_order_relaxed);
+        by_level[level].fetch_add(1, std::memory_order_relaxed);
+        bytes_in.fetch_add(in, std::memory_order_relaxed);
+        bytes_out.fetch_add(out, std::memory_order_relaxed);
+        cpu_ns.fetch_add(cpu, std::memory_order_relaxed);
+    }
+};
+
+CompressionMiddleware::CompressionMiddleware() : state_(new State) {}
+CompressionMiddleware::~CompressionMiddleware() = default;
+CompressionMiddleware::CompressionMiddleware(CompressionMiddleware&&) noexcept = default;
+
+int CompressionMiddleware::LevelFor(const std::string& url) const {
+    int level = default_level;
+    size_t best = 0;
+    for (const auto& l : levels) {
+        if (l.first.size() >= best && url.compare(0, l.first.size(), l.first) == 0) {
+            best = l.first.size();
+            level = l.second;
+        }
+    }
+    level = std::max(1, std::min(9, level));
+    const int scaled = (level * state_->Headroom() + 500) / 1000;
+    return std::max(1, std::min(level, scaled));
+}
+
+// ---------------- streamed bodies ----------------
+namespace {
+
+// Wraps a body_source: pulls identity chunks and hands out compressed ones
+// of at least kMinChunk bytes (or whatever is left). The pulls run after
+// the middleware has returned, so the z_stream belongs to the response, not
+// the thread; its deflateInit2 is small next to a body of 1000+ rows.
+class DeflateSource {
+public:
+    static constexpr size_t kMinChunk = 16 * 1024;
+
+    DeflateSource(ZStreamPtr zs, int coding, int level, std::string head,
+        std::function<bool(std::string&)> inner, CompressionMiddleware::State* st)
+        : zs_(std::move(zs)), coding_(coding), level_(level), head_(std::move(head)),
+        inner_(std::move(inner)), st_(st) {}
+
+    ~DeflateSource() { st_->Count(coding_, level_, in_, out_, cpu_); }
+
+    bool operator()(std::string& out) {
+        std::string in;
+        const size_t start = out.size();
+        while (!finished_ && out.size() - start < kMinChunk) {
+            in.clear();
+            if (!head_.empty()) in.swap(head_);
+            else if (!inner_done_) inner_done_ = !inner_(in);
+            const int flush = inner_done_ && head_.empty() ? Z_FINISH : Z_NO_FLUSH;
+            const uint64_t t0 = thread_cpu_ns();
+            const bool ok = deflate_append(zs_.get(), in.data(), in.size(), flush, out);
+            cpu_ += thread_cpu_ns() - t0;
+            in_ += in.size();
+            if (!ok) { finished_ = true; break; }  // the body ends short; the client sees a bad stream
+            if (flush == Z_FINISH) finished_ = true;
+        }
+        out_ += out.size() - start;
+        return !finished_;
+    }
+
+private:
+    ZStreamPtr  zs_;
+    int         coding_, level_;
+    std::string head_;
+    std::function<bool(std::string&)> inner_;
+    bool        inner_done_ = false;
+    bool        finished_ = false;
+    CompressionMiddleware::State* st_;
+    uint64_t    in_ = 0, out_ = 0, cpu_ = 0;
+};
+
+} // namespace
+
+// ---------------- middleware ----------------
+void CompressionMiddleware::before_handle(crow::request& req, crow::response& /*res*/, context& ctx) {
+    if (req.method == crow::HTTPMethod::Head) return;
+    const std::string ae = req.get_header_value("Accept-Encoding");
+    if (ae.empty()) return;
+    int coding = -1;
+    if (AcceptsEncoding(ae, "gzip")) coding = kGzip;
+    else if (AcceptsEncoding(ae, "deflate")) coding = kDeflate;
+    if (coding < 0) return;
+    ctx.coding = kCodingName[coding];
+
+    // A client revalidating an encoded variant sends its suffixed tag; add
+    // the identity tag it was derived from so the handler (or the response
+    // cache) can answer 304.
+    const std::string inm = req.get_header_value("If-None-Match");
+    if (inm.empty()) return;
+    const std::string suffix = std::string(kETagSuffix[coding]) + "\"";
+    std::string extra;
+    std::stringstream ss(inm);
+    std::string tag;
+    while (std::getline(ss, tag, ',')) {
+        size_t b = tag.find_first_not_of(" \t");
+        if (b == std::string::npos) continue;
+        size_t e = tag.find_last_not_of(" \t");
+        tag = tag.substr(b, e - b + 1);
+        if (tag.size() > suffix.size() + 1 && tag.compare(tag.size() - suffix.size(), suffix.size(), suffix) == 0)
+            extra += ", " + tag.substr(0, tag.size() - suffix.size()) + "\"";
+    }
+    if (extra.empty()) return;
+    ctx.if_none_match = inm;
+    req.headers.erase("If-None-Match");
+    req.headers.emplace("If-None-Match", inm + extra);
+}
+
+void CompressionMiddleware::after_handle(crow::request& req, crow::response& res, context& ctx) {
+    if (ctx.finished) return;
+    ctx.finished = true;
+    State& st = *state_;
+    const int coding = !ctx.coding ? -1 : ctx.coding == kCodingName[kGzip] ? kGzip : kDeflate;
+
+    if (res.code == 304) {
+        // answered through the identity tag: echo the variant's tag
+        const std::string etag = res.get_header_value("ETag");
+        if (coding >= 0 && !ctx.if_none_match.empty() && !etag.empty() &&
+            !ResponseCacheMiddleware::ETagMatches(ctx.if_none_match, etag))
+            res.set_header("ETag", suffix_etag(etag, kETagSuffix[coding]));
+        return;
+    }
+    if (res.code < 200 || res.code == 204 || res.is_static_type()) return;
+    if (!res.get_header_value("Content-Encoding").empty()) {
+        st.skipped_encoded.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!compressible_type(res.get_header_value("Content-Type")) ||
+        contains_ci(res.get_header_value("Cache-Control"), "no-transform")) {
+        st.skipped_type.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const size_t size = res.body.size() + (res.shared_body ? res.shared_body->size() : 0);
+    if (!res.body_source && size < min_bytes) {
+        st.skipped_small.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // from here on the representation depends on Accept-Encoding
+    const std::string vary = res.get_header_value("Vary");
+    if (vary.empty()) res.set_header("Vary", "Accept-Encoding");
+    else if (!contains_ci(vary, "accept-encoding")) res.set_header("Vary", vary + ", Accept-Encoding");
+    if (coding < 0) {
+        st.not_accepted.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const std::string etag = res.get_header_value("ETag");
+    auto mark_encoded = [&] {
+        res.set_header("Content-Encoding", kCodingName[coding]);
+        if (!etag.empty()) res.set_header("ETag", suffix_etag(etag, kETagSuffix[coding]));
+    };
+
+    const int level = LevelFor(req.url);
+
+    if (res.body_source) {
+        ZStreamPtr zs = new_stream(coding, level);
+        if (!zs) return;
+        st.stream_inits.fetch_add(1, std::memory_order_relaxed);
+        st.streamed.fetch_add(1, std::memory_order_relaxed);
+        auto src = std::make_shared<DeflateSource>(std::move(zs), coding, level,
+            std::move(res.body), std::move(res.body_source), &st);
+        res.body.clear();
+        res.body_source = [src](std::string& out) { return (*src)(out); };
+        mark_encoded();
+        return;
+    }
+
+    if (res.shared_body && res.body.empty()) {
+        if (auto hit = st.MemoGet(res.shared_body, coding)) {
+            st.memo_hits.fetch_add(1, std::memory_order_relaxed);
+            st.Count(coding, level, size, hit->size(), 0);
+            res.shared_body = std::move(hit);
+            mark_encoded();
+            return;
+        }
+    }
+
+    bool reused = false;
+    const uint64_t t0 = thread_cpu_ns();
+    z_stream* zs = t_streams.Get(coding, level, reused);
+    if (!zs) return;
+    (reused ? st.stream_resets : st.stream_inits).fetch_add(1, std::memory_order_relaxed);
+    std::string out;
+    out.reserve(deflateBound(zs, static_cast<uLong>(size)));
+    bool ok = true;
+    if (res.shared_body && !res.body.empty())
+        ok = deflate_append(zs, res.body.data(), res.body.size(), Z_NO_FLUSH, out);
+    const std::string& last = res.shared_body ? *res.shared_body : res.body;
+    ok = ok && deflate_append(zs, last.data(), last.size(), Z_FINISH, out);
+    const uint64_t cpu = thread_cpu_ns() - t0;
+    if (!ok) return;
+    if (out.size() >= size) {
+        st.incompressible.fetch_add(1, std::memory_order_relaxed);
+        st.cpu_ns.fetch_add(cpu, std::memory_order_relaxed);
+        return;
+    }
+
+    st.Count(coding, level, size, out.size(), cpu);
+    auto encoded = std::make_shared<const std::string>(std::move(out));
+    if (res.shared_body && res.body.empty()) st.MemoPut(res.shared_body, coding, encoded, memo_bytes);
+    res.body.clear();
+    res.shared_body = std::move(encoded);
+    mark_encoded();
+}
+
+CompressionMiddleware::Stats CompressionMiddleware::GetStats() const {
+    const State& st = *state_;
+    auto get = [](const std::atomic<uint64_t>& a) { return a.load(std::memory_order_relaxed); };
+    Stats s;
+    s.compressed = get(st.compressed);
+    s.streamed = get(st.streamed);
+    s.gzip = get(st.by_coding[kGzip]);
+    s.deflate = get(st.by_coding[kDeflate]);
+    s.skipped_small = get(st.skipped_small);
+    s.skipped_type = get(st.skipped_type);
+    s.skipped_encoded = get(st.skipped_encoded);
+    s.not_accepted = get(st.not_accepted);
+    s.incompressible = get(st.incompressible);
+    s.memo_hits = get(st.memo_hits);
+    s.stream_inits = get(st.stream_inits);
+    s.stream_resets = get(st.stream_resets);
+    s.bytes_in = get(st.bytes_in);
+    s.bytes_out = get(st.bytes_out);
+    s.cpu_ns = get(st.cpu_ns);
+    for (size_t i = 0; i < s.by_level.size(); ++i) s.by_level[i] = get(st.by_level[i]);
+    s.headroom = st.headroom_permille.load(std::memory_order_relaxed) / 1000.0;
+    return s;
+}
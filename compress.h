@@ -0,0 +1,82 @@
+#pragma once
+#include "crow/http_request.h"
+#include "crow/http_response.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// gzip (RFC 1952) encoding of `data`; empty on failure. level: 0-9, -1 = zlib default.
+std::string GzipCompress(const std::string& data, int level = 9);
+
+// True when an Accept-Encoding header value allows `coding` (q > 0).
+bool AcceptsEncoding(const std::string& accept_encoding, const std::string& coding);
+
+// Crow middleware: gzip/deflate for responses the handler left unencoded.
+//  - negotiates Accept-Encoding (gzip preferred), skips HEAD, 1xx/204/304,
+//    bodies under min_bytes, non-text types, no-transform and responses
+//    that already carry a Content-Encoding (prepared reports, static assets)
+//  - the level comes from the longest matching `levels` prefix (or
+//    default_level) scaled by the CPU headroom the process has left, so a
+//    busy server trades ratio for throughput down to level 1
+//  - compresses with z_streams kept per thread and per level, reset between
+//    responses instead of initialised each time; streamed bodies
+//    (body_source) get a stream of their own and are compressed chunk by chunk
+//  - remembers the compressed form of shared bodies (response cache hits,
+//    exports) so a popular body is compressed once per encoding
+//  - encoded variants get their own validator (ETag + "-gz"/"-df"); a client
+//    revalidating one is matched against the identity ETag too, and a 304
+//    echoes the variant's tag
+// Register ahead of ResponseCacheMiddleware so the cache keeps identity
+// bodies and its 304s see the rewritten If-None-Match.
+struct CompressionMiddleware {
+    struct context {
+        const char* coding = nullptr;   // "gzip", "deflate" or null
+        std::string if_none_match;      // as the client sent it, when rewritten
+        bool finished = false;          // after_handle ran (early, for offloaded handlers)
+    };
+
+    struct Stats {
+        uint64_t compressed = 0;        // responses sent encoded
+        uint64_t streamed = 0;          // of which chunked
+        uint64_t gzip = 0;
+        uint64_t deflate = 0;
+        uint64_t skipped_small = 0;
+        uint64_t skipped_type = 0;      // not text-like, or no-transform
+        uint64_t skipped_encoded = 0;   // handler already encoded the body
+        uint64_t not_accepted = 0;      // eligible, but the client takes identity only
+        uint64_t incompressible = 0;    // encoded form was not smaller; sent identity
+        uint64_t memo_hits = 0;
+        uint64_t stream_inits = 0;      // deflateInit2 calls
+        uint64_t stream_resets = 0;     // responses served by a reused z_stream
+        uint64_t bytes_in = 0;          // identity bytes of the encoded responses
+        uint64_t bytes_out = 0;         // what went on the wire for them
+        uint64_t cpu_ns = 0;            // thread CPU time spent in deflate
+        std::array<uint64_t, 10> by_level{};
+        double   headroom = 1.0;        // last sample, 0..1
+    };
+
+    size_t min_bytes = 1024;
+    int    default_level = 6;
+    std::vector<std::pair<std::string, int>> levels;    // URL prefix -> level at full headroom
+    size_t memo_bytes = 16u << 20;
+
+    CompressionMiddleware();
+    ~CompressionMiddleware();
+    CompressionMiddleware(CompressionMiddleware&&) noexcept;
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+
+    Stats GetStats() const;
+    // level for `url` at the current headroom
+    int LevelFor(const std::string& url) const;
+
+    struct State;
+
+private:
+    std::unique_ptr<State> state_;
+};
@@ -0,0 +1,199 @@
+﻿#include "compute_pool.h"
+
+#include <algorithm>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// index of the pool worker running on this thread, or -1
+static thread_local const ComputePool* tl_pool = nullptr;
+static thread_local int tl_worker = -1;
+
+static void pin_thread(std::thread::native_handle_type t, int cpu) {
+#ifdef _WIN32
+    if (cpu >= 0 && cpu < 64) SetThreadAffinityMask(t, DWORD_PTR(1) << cpu);
+#elif defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(t, sizeof(set), &set);
+#else
+    (void)t; (void)cpu;
+#endif
+}
+
+void PinThisThread(int cpu) {
+#ifdef _WIN32
+    pin_thread(GetCurrentThread(), cpu);
+#else
+    pin_thread(pthread_self(), cpu);
+#endif
+}
+
+// ---------------- pool ----------------
+ComputePool::ComputePool(unsigned threads, std::vector<int> cpus) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i) workers_.emplace_back(new Worker);
+    // every deque exists before any worker looks for work to steal
+    for (unsigned i = 0; i < threads; ++i) {
+        workers_[i]->thread = std::thread([this, i] { run(i); });
+        if (!cpus.empty()) pin_thread(workers_[i]->thread.native_handle(), cpus[i % cpus.size()]);
+    }
+}
+
+ComputePool::~ComputePool() {
+    {
+        std::lock_guard<std::mutex> lk(idle_mtx_);
+        stop_ = true;
+    }
+    idle_cv_.notify_all();
+    for (auto& w : workers_) w->thread.join();
+}
+
+void ComputePool::Submit(Job job) {
+    const unsigned target = tl_pool == this ? static_cast<unsigned>(tl_worker)
+        : next_.fetch_add(1, std::memory_order_relaxed) % Size();
+    {
+        // counted first, so pending_ never drops below the jobs queued, and
+        // under idle_mtx_ so a worker between its last look and its wait sees it
+        std::lock_guard<std::mutex> lk(idle_mtx_);
+        pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lk(workers_[target]->mtx);
+        workers_[target]->jobs.push_back(std::move(job));
+        workers_[target]->size.store(workers_[target]->jobs.size(), std::memory_order_relaxed);
+    }
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    idle_cv_.notify_one();
+}
+
+// ---------------- fork/join ----------------
+// Shared by the caller and its helpers. A helper that starts after every
+// index has been claimed returns without touching fn, which may be gone.
+struct ForkGroup {
+    const std::function<void(size_t)>* fn;
+    size_t count;
+    std::atomic<size_t> next{ 0 }, done{ 0 };
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    void Drain() {
+        size_t ran = 0;
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count; ++ran) (*fn)(i);
+        if (ran && done.fetch_add(ran, std::memory_order_acq_rel) + ran == count) {
+            std::lock_guard<std::mutex> lk(mtx);
+            cv.notify_all();
+        }
+    }
+};
+
+void ComputePool::ParallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) return;
+    if (count == 1) { fn(0); return; }
+    auto group = std::make_shared<ForkGroup>();
+    group->fn = &fn;
+    group->count = count;
+    const size_t helpers = std::min<size_t>(count - 1, Size());
+    for (size_t h = 0; h < helpers; ++h) Submit([group] { group->Drain(); });
+    parallel_.fetch_add(1, std::memory_order_relaxed);
+    // the caller works too, so this finishes even with every worker busy
+    group->Drain();
+    std::unique_lock<std::mutex> lk(group->mtx);
+    group->cv.wait(lk, [&] { return group->done.load(std::memory_order_acquire) == count; });
+}
+
+bool ComputePool::take(unsigned self, Job& job) {
+    {
+        Worker& w = *workers_[self];
+        std::lock_guard<std::mutex> lk(w.mtx);
+        if (!w.jobs.empty()) {
+            job = std::move(w.jobs.front());
+            w.jobs.pop_front();
+            w.size.store(w.jobs.size(), std::memory_order_relaxed);
+            return true;
+        }
+    }
+    // steal from the fullest deque; the sizes are only a hint
+    const unsigned n = Size();
+    for (unsigned tries = 0; tries < 2; ++tries) {
+        unsigned victim = self;
+        size_t most = 0;
+        for (unsigned k = 1; k < n; ++k) {
+            const unsigned v = (self + k) % n;
+            const size_t sz = workers_[v]->size.load(std::memory_order_relaxed);
+            if (sz > most) { most = sz; victim = v; }
+        }
+        if (victim == self) return false;
+        Worker& w = *workers_[victim];
+        std::lock_guard<std::mutex> lk(w.mtx);
+        if (w.jobs.empty()) continue;
+        job = std::move(w.jobs.front());
+        w.jobs.pop_front();
+        w.size.store(w.jobs.size(), std::memory_order_relaxed);
+        stolen_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void ComputePool::run(unsigned self) {
+    tl_pool = this;
+    tl_worker = static_cast<int>(self);
+    for (;;) {
+        Job job;
+        if (take(self, job)) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            busy_.fetch_add(1, std::memory_order_relaxed);
+            job();
+            busy_.fetch_sub(1, std::memory_order_relaxed);
+            executed_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(idle_mtx_);
+        if (stop_) return;
+        // a job queued after our look has bumped pending_ under idle_mtx_
+        if (pending_.load(std::memory_order_relaxed) > 0) continue;
+        idle_cv_.wait(lk, [this] { return stop_ || pending_.load(std::memory_order_relaxed) > 0; });
+        if (stop_) return;
+    }
+}
+
+ComputePool::Stats ComputePool::GetStats() const {
+    Stats st;
+    st.threads = Size();
+    st.submitted = submitted_.load(std::memory_order_relaxed);
+    st.executed = executed_.load(std::memory_order_relaxed);
+    st.stolen = stolen_.load(std::memory_order_relaxed);
+    st.queued = pending_.load(std::memory_order_relaxed);
+    st.busy = busy_.load(std::memory_order_relaxed);
+    st.parallel = parallel_.load(std::memory_order_relaxed);
+    return st;
+}
+
+std::vector<int> ComputePool::ParseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        if (part.empty()) continue;
+        int lo = -1, hi = -1;
+        char dash = 0;
+        std::stringstream ps(part);
+        ps >> lo;
+        if (ps >> dash) {
+            if (dash != '-' || !(ps >> hi)) return {};
+        }
+        else hi = lo;
+        if (lo < 0 || hi < lo || hi > 4095) return {};
+        for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
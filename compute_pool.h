@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool for CPU-heavy request handlers, so they do not
+// run on (and stall) Crow's io threads. Every worker owns a deque: jobs
+// submitted from outside the pool are dealt round-robin, jobs a worker
+// submits itself go to its own deque, and a worker that runs dry takes the
+// oldest job of the busiest other worker before going to sleep.
+// ParallelFor splits one job into pieces for whichever workers are idle.
+class ComputePool {
+public:
+    using Job = std::function<void()>;
+
+    struct Stats {
+        unsigned threads = 0;
+        uint64_t submitted = 0;
+        uint64_t executed = 0;
+        uint64_t stolen = 0;    // run by a worker other than the one it was queued on
+        uint64_t queued = 0;    // waiting right now
+        uint64_t busy = 0;      // workers running a job right now
+        uint64_t parallel = 0;  // ParallelFor calls split over several threads
+    };
+
+    // threads: 0 = one per hardware thread. cpus: pin worker i to
+    // cpus[i % cpus.size()]; empty = no pinning.
+    explicit ComputePool(unsigned threads = 0, std::vector<int> cpus = {});
+    ~ComputePool();
+
+    ComputePool(const ComputePool&) = delete;
+    ComputePool& operator=(const ComputePool&) = delete;
+
+    void Submit(Job job);
+
+    // Runs fn(i) for every i in [0, count) and returns when all have run.
+    // The calling thread takes part and up to Size() workers help, so it may
+    // be called from a pool job (nested) without tying up a worker waiting.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    unsigned Size() const { return static_cast<unsigned>(workers_.size()); }
+    Stats GetStats() const;
+
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}; empty for an empty or malformed list
+    static std::vector<int> ParseCpuList(const std::string& list);
+
+private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Job> jobs;
+        std::atomic<size_t> size{ 0 };  // jobs.size(), readable without mtx
+        std::thread thread;
+    };
+
+    void run(unsigned self);
+    bool take(unsigned self, Job& job);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<unsigned> next_{ 0 };
+    std::atomic<uint64_t> pending_{ 0 };
+
+    std::mutex idle_mtx_;
+    std::condition_variable idle_cv_;
+    bool stop_ = false;
+
+    std::atomic<uint64_t> submitted_{ 0 }, executed_{ 0 }, stolen_{ 0 }, busy_{ 0 }, parallel_{ 0 };
+};
+
+// Pins the calling thread to `cpu` (Linux and Windows; elsewhere a no-op).
+void PinThisThread(int cpu);
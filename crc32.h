@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// CRC-32 as used by ZIP and gzip (reflected polynomial 0xEDB88320).
+// `crc` is the value returned by the previous call (0 to start), so a
+// stream can be checksummed chunk by chunk.
+uint32_t Crc32Update(uint32_t crc, const void* data, size_t n);
+
+inline uint32_t Crc32(const std::string& data) {
+    return Crc32Update(0, data.data(), data.size());
+}
+
+// Portable slicing-by-8 kernel, used for tails and on non-x86 builds.
+uint32_t Crc32UpdateSlice8(uint32_t crc, const void* data, size_t n);
+
+// Kernel picked at runtime: "pclmul" or "slice8".
+const char* Crc32Kernel();
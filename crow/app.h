@@ -319,6 +319,7 @@ namespace crow
             else
 #endif
             {
+                if (!shard_servers_.empty()) return shard_servers_.front()->port();
                 return server_->port();
             }
         }
@@ -389,6 +390,20 @@ namespace crow
             return *this;
         }
 
+        /// \brief Run `count` independent single-threaded servers instead
+        ///
+        /// Each shard has its own SO_REUSEPORT listener and io_context on the
+        /// port, so accepting and dispatching are never shared; the kernel
+        /// spreads new connections over the shards. `init(i)` runs first on
+        /// shard i's thread (pinning, per-thread state). TCP only; `count`
+        /// below 2 keeps the single acceptor of concurrency().
+        self_t& shards(unsigned int count, std::function<void(unsigned int)> init = nullptr)
+        {
+            shards_ = count;
+            shard_init_ = init;
+            return *this;
+        }
+
         /// \brief Get the number of threads that server is using
         std::uint16_t concurrency() const
         {
@@ -448,6 +463,20 @@ namespace crow
             return router_.exception_handler();
         }
 
+        /// \brief Run the pulls of chunked bodies (response::body_source) through `f` instead of on the io thread
+        ///
+        /// `f` must run the task it is given, on any thread. The socket writes stay on the io thread.
+        self_t& stream_executor(std::function<void(std::function<void()>)> f)
+        {
+            stream_executor_ = std::move(f);
+            return *this;
+        }
+
+        const std::function<void(std::function<void()>)>& stream_executor() const
+        {
+            return stream_executor_;
+        }
+
         /// \brief Set a custom duration and function to run on every tick
         template<typename Duration, typename Func>
         self_t& tick(Duration d, Func f)
@@ -577,6 +606,11 @@ namespace crow
                         return;
                     }
                     TCPAcceptor::endpoint endpoint(addr, port_);
+                    if (shards_ > 1)
+                    {
+                        run_shards(endpoint);
+                        return;
+                    }
                     server_ = std::move(std::unique_ptr<server_t>(new server_t(this, endpoint, server_name_, &middlewares_, concurrency_, timeout_, nullptr)));
                     server_->set_tick_function(tick_interval_, tick_function_);
                     for (auto snum : signals_)
@@ -613,6 +647,7 @@ namespace crow
             {
                 close_websockets();
                 if (server_) { server_->stop(); }
+                for (auto& shard : shard_servers_) { shard->stop(); }
                 if (unix_server_) { unix_server_->stop(); }
             }
         }
@@ -770,6 +805,9 @@ namespace crow
             {
                 if (server_) {
                     status = server_->wait_for_start(wait_until);
+                } else if (!shard_servers_.empty()) {
+                    for (auto& shard : shard_servers_)
+                        if (status == std::cv_status::no_timeout) status = shard->wait_for_start(wait_until);
                 } else if (unix_server_) {
                     status = unix_server_->wait_for_start(wait_until);
                 }
@@ -793,6 +831,29 @@ namespace crow
                 black_magic::tuple_extract<Middlewares, decltype(fwd)>(fwd))...);
         }
 
+        /// \brief Runs the shards, one thread each, until they all stop
+        void run_shards(const TCPAcceptor::endpoint& endpoint)
+        {
+            for (unsigned int i = 0; i < shards_; i++)
+            {
+                shard_servers_.emplace_back(new server_t(this, endpoint, server_name_, &middlewares_, 1, timeout_, nullptr, true));
+                auto& shard = shard_servers_.back();
+                shard->set_tick_function(tick_interval_, tick_function_);
+                if (shard_init_)
+                    shard->set_thread_init([this, i] { shard_init_(i); });
+                for (auto snum : signals_)
+                {
+                    shard->signal_add(snum);
+                }
+            }
+            notify_server_start();
+            std::vector<std::thread> threads;
+            for (unsigned int i = 1; i < shards_; i++)
+                threads.emplace_back([this, i] { shard_servers_[i]->run(); });
+            shard_servers_.front()->run();
+            for (auto& t : threads) t.join();
+        }
+
         /// \brief Notify anything using \ref wait_for_server_start() to proceed
         void notify_server_start()
         {
@@ -829,6 +890,7 @@ namespace crow
 
         std::chrono::milliseconds tick_interval_;
         std::function<void()> tick_function_;
+        std::function<void(std::function<void()>)> stream_executor_;
 
         std::tuple<Middlewares...> middlewares_;
 
@@ -840,6 +902,9 @@ namespace crow
 
         std::unique_ptr<server_t> server_;
         std::unique_ptr<unix_server_t> unix_server_;
+        unsigned int shards_ = 0;
+        std::function<void(unsigned int)> shard_init_;
+        std::vector<std::unique_ptr<server_t>> shard_servers_;
 
         std::vector<int> signals_{SIGINT, SIGTERM};
 
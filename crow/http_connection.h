@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstdio>
 #include <memory>
 #include <vector>
 
@@ -28,6 +29,14 @@
 #include "crow/task_timer.h"
 #include "crow/utility.h"
 
+#if defined(__linux__) && !defined(CROW_USE_BOOST)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#define CROW_HAS_SENDFILE
+#endif
+
 namespace crow
 {
 #ifdef CROW_USE_BOOST
@@ -42,6 +51,24 @@ namespace crow
     static std::atomic<int> connectionCount;
 #endif
 
+    namespace detail
+    {
+        /// Whether a response file can go out with sendfile(2) (kernel-side copy). Only plain TCP
+        /// sockets qualify; the others stream the file through a buffer.
+        template<typename Socket>
+        inline bool can_send_file(Socket&)
+        {
+            return false;
+        }
+
+#ifdef CROW_HAS_SENDFILE
+        inline bool can_send_file(tcp::socket&)
+        {
+            return true;
+        }
+#endif
+    } // namespace detail
+
     /// An HTTP connection.
     template<typename Adaptor, typename Handler, typename... Middlewares>
     class Connection : public std::enable_shared_from_this<Connection<Adaptor, Handler, Middlewares...>>
@@ -78,6 +105,10 @@ namespace crow
 
         ~Connection()
         {
+#ifdef CROW_HAS_SENDFILE
+            if (file_fd_ >= 0)
+                ::close(file_fd_);
+#endif
             queue_length_--;
 #ifdef CROW_ENABLE_DEBUG
             connectionCount--;
@@ -140,6 +171,7 @@ namespace crow
             cancel_deadline_timer();
             bool is_invalid_request = false;
             add_keep_alive_ = false;
+            handling_ = true;
 
             // Create context
             ctx_ = detail::context<Middlewares...>();
@@ -171,6 +203,7 @@ namespace crow
                         detail::middleware_call_helper<detail::middleware_call_criteria_only_global,
                                                        0, decltype(ctx_), decltype(*middlewares_)>({}, *middlewares_, req_, res, ctx_);
                         close_connection_ = true;
+                        handling_ = false;
                         handler_->handle_upgrade(req_, res, std::move(adaptor_));
                         return;
                     }
@@ -186,26 +219,52 @@ namespace crow
                 res.complete_request_handler_ = nullptr;
                 auto self = this->shared_from_this();
                 res.is_alive_helper_ = [self]() -> bool {
-                    return self->adaptor_.is_open();
+                    return !self->peer_gone_.load(std::memory_order_relaxed);
                 };
 
                 detail::middleware_call_helper<detail::middleware_call_criteria_only_global,
                                                0, decltype(ctx_), decltype(*middlewares_)>({}, *middlewares_, req_, res, ctx_);
+                dispatch();
+                if (response_pending())
+                    watch_peer();
+            }
+            else
+            {
+                complete_request();
+            }
+            handling_ = false;
+        }
 
-                if (!res.completed_)
-                {
-                    res.complete_request_handler_ = [self] {
-                        self->complete_request();
-                    };
-                    need_to_call_after_handlers_ = true;
-                    handler_->handle(req_, res, routing_handle_result_);
-                    if (add_keep_alive_)
-                        res.set_header("connection", "Keep-Alive");
-                }
-                else
-                {
-                    complete_request();
-                }
+        /// Whether the response to the last request is still to be completed or written.
+        bool response_pending() const
+        {
+            return need_to_call_after_handlers_ || streaming_;
+        }
+
+        /// After the middlewares' before_handle: runs the handler, unless one of them answered or parked the request.
+        void dispatch()
+        {
+            auto self = this->shared_from_this();
+            if (res.is_deferred())
+            {
+                res.complete_request_handler_ = [self] {
+                    self->complete_request();
+                };
+                res.resume_handler_ = [self] {
+                    self->resume_request();
+                };
+                need_to_call_after_handlers_ = true;
+            }
+            else if (!res.completed_)
+            {
+                res.complete_request_handler_ = [self] {
+                    self->complete_request();
+                };
+                need_to_call_after_handlers_ = true;
+                handler_->handle(req_, res, routing_handle_result_);
+                // a response already ended may be streaming from its headers
+                if (add_keep_alive_ && !res.completed_)
+                    res.set_header("connection", "Keep-Alive");
             }
             else
             {
@@ -213,10 +272,40 @@ namespace crow
             }
         }
 
+        /// res.resume() of a deferred request: the rest of the middleware chain, then the handler.
+        void resume_request()
+        {
+            handling_ = true;
+            need_to_call_after_handlers_ = false;
+            res.complete_request_handler_ = nullptr;
+            const int first = res.deferred_at + 1;
+            detail::middleware_call_helper<detail::middleware_call_criteria_global_range,
+                                           0, decltype(ctx_), decltype(*middlewares_)>({first, static_cast<int>(sizeof...(Middlewares))}, *middlewares_, req_, res, ctx_);
+            if (res.completed_)
+            {
+                // answered by a later middleware; those up to the one that deferred still owe their after_handle
+                detail::after_handlers_call_helper<
+                  detail::middleware_call_criteria_global_range,
+                  (static_cast<int>(sizeof...(Middlewares)) - 1),
+                  decltype(ctx_),
+                  decltype(*middlewares_)>({0, first}, *middlewares_, ctx_, req_, res);
+            }
+            dispatch();
+            handling_ = false;
+        }
+
         /// Call the after handle middleware and send the write the response to the connection.
         void complete_request()
         {
             CROW_LOG_INFO << "Response: " << this << ' ' << req_.raw_url << ' ' << res.code << ' ' << close_connection_;
+            if (!handling_)
+            {
+                // res.end() deferred past handle(): the completion handler
+                // may hold the last reference, dropped by prepare_buffers()
+                // while res.end() is still running; release it from the
+                // io_context instead
+                asio::post(adaptor_.get_io_context(), [self = this->shared_from_this()] {});
+            }
             res.is_alive_helper_ = nullptr;
 
             if (need_to_call_after_handlers_)
@@ -259,9 +348,26 @@ namespace crow
             }
 #endif
 
+            if (res.body_source)
+            {
+                // HTTP/1.0 has no chunked encoding: send the raw stream and mark its end by closing
+                if (req_.check_version(1, 1))
+                    res.set_header("Transfer-Encoding", "chunked");
+                else
+                {
+                    close_connection_ = true;
+                    add_keep_alive_ = false;
+                }
+                res.manual_length_header = true;
+            }
+
             prepare_buffers();
 
-            if (res.is_static_type())
+            if (res.body_source)
+            {
+                do_write_chunked();
+            }
+            else if (res.is_static_type())
             {
                 do_write_static();
             }
@@ -272,6 +378,43 @@ namespace crow
         }
 
     private:
+        /// While a response is pending no read is outstanding, so a client that goes away would go
+        /// unnoticed until the write. Waits on the io thread for the socket to turn readable and sets
+        /// peer_gone_ on a reset or a closed socket; res.is_alive() only reads that flag, from any
+        /// thread. A half-close (FIN after the request) is not a disconnect: the client may still be
+        /// waiting for the answer. Nor is a pipelined request; the watch stops there.
+        void watch_peer()
+        {
+            if (peer_watch_armed_ || peer_gone_.load(std::memory_order_relaxed))
+                return;
+            peer_watch_armed_ = true;
+            auto self = this->shared_from_this();
+            adaptor_.raw_socket().async_wait(asio::socket_base::wait_read, [self](const error_code& ec) {
+                self->peer_watch_armed_ = false;
+                if (ec)
+                {
+                    // the socket was closed under the wait
+                    self->peer_gone_.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                auto& sock = self->adaptor_.raw_socket();
+                error_code peek_ec;
+                const bool was_non_blocking = sock.non_blocking();
+                sock.non_blocking(true, peek_ec);
+                char c;
+                sock.receive(asio::buffer(&c, 1), asio::socket_base::message_peek, peek_ec);
+                error_code ignored;
+                sock.non_blocking(was_non_blocking, ignored);
+                if (peek_ec == asio::error::would_block || peek_ec == asio::error::try_again)
+                {
+                    if (self->response_pending())
+                        self->watch_peer();
+                }
+                else if (peek_ec && peek_ec != asio::error::eof)
+                    self->peer_gone_.store(true, std::memory_order_relaxed);
+            });
+        }
+
         void prepare_buffers()
         {
             res.complete_request_handler_ = nullptr;
@@ -288,6 +431,25 @@ namespace crow
 
         void do_write_static()
         {
+#ifdef CROW_HAS_SENDFILE
+            if (res.file_info.statResult == 0 && detail::can_send_file(adaptor_.socket()) &&
+                (file_fd_ = ::open(res.file_info.path.c_str(), O_RDONLY | O_CLOEXEC)) >= 0)
+            {
+                streaming_ = true;
+                file_offset_ = 0;
+                file_size_ = static_cast<size_t>(res.file_info.statbuf.st_size);
+                start_deadline();
+                auto self = this->shared_from_this();
+                asio::async_write(adaptor_.socket(), buffers_, [self](const error_code& ec, std::size_t /*bytes_transferred*/) {
+                    self->cancel_deadline_timer();
+                    if (ec)
+                        self->finish_file(ec);
+                    else
+                        self->send_file();
+                });
+                return;
+            }
+#endif
             asio::write(adaptor_.socket(), buffers_);
 
             if (res.file_info.statResult == 0)
@@ -316,21 +478,60 @@ namespace crow
             parser_.clear();
         }
 
+#ifdef CROW_HAS_SENDFILE
+        /// Hands the file to sendfile(2) until the socket buffer is full, then waits on the io thread
+        /// for the socket to become writable again, under the connection's deadline. A file that
+        /// ends short of the Content-Length sent, or a socket error, closes the connection, so the
+        /// client never takes a truncated body for a complete one.
+        void send_file()
+        {
+            auto& sock = adaptor_.raw_socket();
+            error_code ec;
+            sock.native_non_blocking(true, ec);
+            while (!ec && file_offset_ < static_cast<off_t>(file_size_))
+            {
+                const ssize_t n = ::sendfile(sock.native_handle(), file_fd_, &file_offset_, file_size_ - static_cast<size_t>(file_offset_));
+                if (n > 0 || (n < 0 && errno == EINTR))
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    start_deadline();
+                    auto self = this->shared_from_this();
+                    sock.async_wait(tcp::socket::wait_write, [self](const error_code& ec) {
+                        self->cancel_deadline_timer();
+                        if (ec)
+                            self->finish_file(ec);
+                        else
+                            self->send_file();
+                    });
+                    return;
+                }
+                ec = n == 0 ? error_code(asio::error::eof) : error_code(errno, asio::error::get_system_category());
+            }
+            finish_file(ec);
+        }
+
+        void finish_file(const error_code& ec)
+        {
+            ::close(file_fd_);
+            file_fd_ = -1;
+            finish_stream(ec);
+        }
+#endif
+
         void do_write_general()
         {
             if (res.body.length() < res_stream_threshold_)
             {
                 res_body_copy_.swap(res.body);
                 buffers_.emplace_back(res_body_copy_.data(), res_body_copy_.size());
+                // res keeps shared_body alive until do_write_sync() clears it
+                if (res.shared_body)
+                    buffers_.emplace_back(res.shared_body->data(), res.shared_body->size());
 
                 do_write_sync(buffers_);
 
-                if (need_to_start_read_after_complete_)
-                {
-                    need_to_start_read_after_complete_ = false;
-                    start_deadline();
-                    do_read();
-                }
+                read_after_complete();
             }
             else
             {
@@ -363,49 +564,173 @@ namespace crow
             }
         }
 
+        /// Writes the headers, then pulls chunks from res.body_source one at a time, each written with
+        /// async_write before the next is pulled: a slow client throttles the source, only one chunk is
+        /// buffered, and the io thread serves other connections meanwhile. The pulls run through the
+        /// app's stream_executor when it has one. Every write runs under the connection's deadline, so
+        /// a client that stops reading is dropped; a write error (client gone) stops the pull.
+        void do_write_chunked()
+        {
+            streaming_ = true;
+            stream_more_ = true;
+            stream_ended_ = false;
+            stream_chunk_ = std::move(res.body);
+            write_stream(buffers_);
+        }
+
+        void write_stream(const std::vector<asio::const_buffer>& buffers)
+        {
+            start_deadline();
+            auto self = this->shared_from_this();
+            asio::async_write(adaptor_.socket(), buffers, [self](const error_code& ec, std::size_t /*bytes_transferred*/) {
+                self->cancel_deadline_timer();
+                if (ec)
+                    self->finish_stream(ec);
+                else
+                    self->next_chunk();
+            });
+        }
+
+        /// After a write: the chunk already pulled, else the next pull, else the end of the body.
+        void next_chunk()
+        {
+            static const std::string crlf = "\r\n";
+            const bool chunked = req_.check_version(1, 1);
+            if (!stream_chunk_.empty())
+            {
+                stream_sent_ = std::move(stream_chunk_);
+                stream_chunk_.clear();
+                stream_buffers_.clear();
+                if (chunked)
+                {
+                    int n = std::snprintf(stream_size_line_, sizeof(stream_size_line_), "%zx\r\n", stream_sent_.size());
+                    stream_buffers_.emplace_back(asio::buffer(stream_size_line_, static_cast<size_t>(n)));
+                }
+                stream_buffers_.emplace_back(asio::buffer(stream_sent_));
+                if (chunked)
+                    stream_buffers_.emplace_back(asio::buffer(crlf));
+                write_stream(stream_buffers_);
+            }
+            else if (stream_more_)
+                pull_chunk();
+            else if (chunked && !stream_ended_)
+            {
+                static const std::string last_chunk = "0\r\n\r\n";
+                stream_ended_ = true;
+                stream_buffers_.assign(1, asio::buffer(last_chunk));
+                write_stream(stream_buffers_);
+            }
+            else
+                finish_stream({});
+        }
+
+        void pull_chunk()
+        {
+            auto self = this->shared_from_this();
+            auto pull = [self] {
+                std::string chunk;
+                bool more = false, failed = false;
+                try
+                {
+                    more = self->res.body_source(chunk);
+                }
+                catch (const std::exception& e)
+                {
+                    CROW_LOG_ERROR << "body source threw: " << e.what();
+                    failed = true;
+                }
+                asio::post(self->adaptor_.get_io_context(), [self, chunk = std::move(chunk), more, failed]() mutable {
+                    // a failed source leaves the client a truncated body
+                    if (failed)
+                        return self->finish_stream(asio::error::operation_aborted);
+                    self->stream_chunk_ = std::move(chunk);
+                    self->stream_more_ = more;
+                    self->next_chunk();
+                });
+            };
+            const auto& executor = handler_->stream_executor();
+            if (executor)
+                executor(std::move(pull));
+            else
+                pull();
+        }
+
+        void finish_stream(const error_code& ec)
+        {
+            streaming_ = false;
+            stream_chunk_.clear();
+            stream_sent_.clear();
+            stream_buffers_.clear();
+            if (ec)
+            {
+                CROW_LOG_DEBUG << this << " from write (chunked): " << ec.message();
+                close_connection_ = true;
+            }
+            if (close_connection_)
+            {
+                adaptor_.shutdown_readwrite();
+                adaptor_.close();
+                CROW_LOG_DEBUG << this << " from write (chunked)";
+            }
+
+            res.end();
+            res.clear();
+            buffers_.clear();
+            parser_.clear();
+
+            read_after_complete();
+        }
+
         void do_read()
         {
             auto self = this->shared_from_this();
             adaptor_.socket().async_read_some(
               asio::buffer(buffer_),
               [self](const error_code& ec, std::size_t bytes_transferred) {
-                  bool error_while_reading = true;
-                  if (!ec)
-                  {
-                      bool ret = self->parser_.feed(self->buffer_.data(), bytes_transferred);
-                      if (ret && self->adaptor_.is_open())
-                      {
-                          error_while_reading = false;
-                      }
-                  }
-
-                  if (error_while_reading)
-                  {
-                      self->cancel_deadline_timer();
-                      self->parser_.done();
-                      self->adaptor_.shutdown_read();
-                      self->adaptor_.close();
-                      CROW_LOG_DEBUG << self << " from read(1) with description: \"" << http_errno_description(static_cast<http_errno>(self->parser_.http_errno)) << '\"';
-                  }
-                  else if (self->close_connection_)
-                  {
-                      self->cancel_deadline_timer();
-                      self->parser_.done();
-                      // adaptor will close after write
-                  }
-                  else if (!self->need_to_call_after_handlers_)
-                  {
-                      self->start_deadline();
-                      self->do_read();
-                  }
-                  else
-                  {
-                      // res will be completed later by user
-                      self->need_to_start_read_after_complete_ = true;
-                  }
+                  self->after_feed(!ec && self->parser_.feed(self->buffer_.data(), bytes_transferred));
               });
         }
 
+        /// After feeding the parser: closes on an error, else reads on unless a response is still
+        /// pending; then read_after_complete() does once it has gone out.
+        void after_feed(bool ok)
+        {
+            if (!ok || !adaptor_.is_open())
+            {
+                cancel_deadline_timer();
+                parser_.done();
+                adaptor_.shutdown_read();
+                adaptor_.close();
+                CROW_LOG_DEBUG << this << " from read(1) with description: \"" << http_errno_description(static_cast<http_errno>(parser_.http_errno)) << '\"';
+            }
+            else if (close_connection_)
+            {
+                cancel_deadline_timer();
+                parser_.done();
+                // adaptor will close after write
+            }
+            else if (!response_pending())
+            {
+                start_deadline();
+                do_read();
+            }
+            else
+            {
+                // res will be completed later by user
+                need_to_start_read_after_complete_ = true;
+            }
+        }
+
+        /// Once a response completed after handle() returned has gone out: handles the requests the
+        /// parser held back behind it, then reads on.
+        void read_after_complete()
+        {
+            if (!need_to_start_read_after_complete_ || !adaptor_.is_open())
+                return;
+            need_to_start_read_after_complete_ = false;
+            after_feed(parser_.feed_held());
+        }
+
         void do_write()
         {
             auto self = this->shared_from_this();
@@ -506,9 +831,30 @@ namespace crow
 
         detail::task_timer::identifier_type task_id_{};
 
+        // body in flight (do_write_chunked, or send_file below)
+        bool streaming_{};
+        bool stream_more_{};
+        bool stream_ended_{};
+        std::string stream_chunk_;   // pulled, not written yet
+        std::string stream_sent_;    // being written
+        char stream_size_line_[24];
+        std::vector<asio::const_buffer> stream_buffers_;
+
+#ifdef CROW_HAS_SENDFILE
+        // file in flight (send_file)
+        int file_fd_ = -1;
+        off_t file_offset_ = 0;
+        size_t file_size_ = 0;
+#endif
+
+        // client reset or socket closed (watch_peer); read from any thread through res.is_alive()
+        std::atomic<bool> peer_gone_{false};
+        bool peer_watch_armed_{};
+
         bool continue_requested{};
         bool need_to_call_after_handlers_{};
         bool need_to_start_read_after_complete_{};
+        bool handling_{};
         bool add_keep_alive_{};
 
         std::tuple<Middlewares...>* middlewares_;
@@ -1,5 +1,7 @@
 #pragma once
 #include <string>
+#include <memory>
+#include <functional>
 #include <unordered_map>
 #include <ios>
 #include <fstream>
@@ -48,6 +50,8 @@ namespace crow
 
         int code{200};    ///< The Status code for the response.
         std::string body; ///< The actual payload containing the response data.
+        std::shared_ptr<const std::string> shared_body; ///< Immutable payload shared between responses; sent after `body` without being copied.
+        std::function<bool(std::string&)> body_source;  ///< Pull source for a chunked body: appends the next chunk, returns false once exhausted. Sent after `body`.
         ci_map headers;   ///< HTTP headers.
 
 #ifdef CROW_ENABLE_COMPRESSION
@@ -55,6 +59,7 @@ namespace crow
 #endif
         bool skip_body = false;            ///< Whether this is a response to a HEAD request.
         bool manual_length_header = false; ///< Whether Crow should automatically add a "Content-Length" header.
+        int deferred_at = -1;              ///< Index of the middleware that deferred the request (set by the middleware chain).
 
         /// Set the value of an existing header in the response.
         void set_header(std::string key, std::string value)
@@ -175,6 +180,8 @@ namespace crow
         response& operator=(response&& r) noexcept
         {
             body = std::move(r.body);
+            shared_body = std::move(r.shared_body);
+            body_source = std::move(r.body_source);
             code = r.code;
             headers = std::move(r.headers);
             completed_ = r.completed_;
@@ -191,9 +198,14 @@ namespace crow
         void clear()
         {
             body.clear();
+            shared_body.reset();
+            body_source = nullptr;
             code = 200;
             headers.clear();
             completed_ = false;
+            deferred_ = false;
+            deferred_at = -1;
+            resume_handler_ = nullptr;
             file_info = static_file_info{};
         }
 
@@ -248,10 +260,17 @@ namespace crow
             if (!completed_)
             {
                 completed_ = true;
+                deferred_ = false;
+                resume_handler_ = nullptr;
                 if (skip_body)
                 {
-                    set_header("Content-Length", std::to_string(body.size()));
+                    if (body_source)
+                        set_header("Transfer-Encoding", "chunked");
+                    else
+                        set_header("Content-Length", std::to_string(body.size() + (shared_body ? shared_body->size() : 0)));
                     body = "";
+                    shared_body.reset();
+                    body_source = nullptr;
                     manual_length_header = true;
                 }
                 if (complete_request_handler_)
@@ -263,6 +282,29 @@ namespace crow
             }
         }
 
+        /// Park the request from a middleware's before_handle without holding the io thread: the later
+        /// middlewares and the handler are skipped until resume() runs them, or end() answers the request
+        /// as it stands (every middleware's after_handle then runs). Call either on req.io_context.
+        void defer()
+        {
+            deferred_ = true;
+        }
+
+        /// Whether the request is parked by defer().
+        bool is_deferred() const noexcept
+        {
+            return deferred_;
+        }
+
+        /// Continue a deferred request with the middlewares after the one that deferred it, then the handler.
+        void resume()
+        {
+            auto handler = std::move(resume_handler_);
+            resume_handler_ = nullptr;
+            deferred_ = false;
+            if (handler) handler();
+        }
+
         /// Same as end() except it adds a body part right before ending.
         void end(const std::string& body_part)
         {
@@ -402,7 +444,7 @@ namespace crow
             auto& status = statusCodes.find(code)->second;
             buffers.emplace_back(status.data(), status.size());
 
-            if (code >= 400 && body.empty())
+            if (code >= 400 && body.empty() && !shared_body)
                 body = statusCodes[code].substr(9);
 
             for (auto& kv : headers)
@@ -415,7 +457,7 @@ namespace crow
 
             if (!manual_length_header && !headers.count("content-length"))
             {
-                content_length_buffer = std::to_string(body.size());
+                content_length_buffer = std::to_string(body.size() + (shared_body ? shared_body->size() : 0));
                 static std::string content_length_tag = "Content-Length: ";
                 buffers.emplace_back(content_length_tag.data(), content_length_tag.size());
                 buffers.emplace_back(content_length_buffer.data(), content_length_buffer.size());
@@ -447,7 +489,9 @@ namespace crow
         }
 
         bool completed_{};
+        bool deferred_{};
         std::function<void()> complete_request_handler_;
+        std::function<void()> resume_handler_;
         std::function<bool()> is_alive_helper_;
         static_file_info file_info;
     };
@@ -51,9 +51,10 @@ namespace crow // NOTE: Already documented in "crow/app.h"
              std::tuple<Middlewares...>* middlewares = nullptr,
              unsigned int concurrency = 1,
              uint8_t timeout = 5,
-             typename Adaptor::context* adaptor_ctx = nullptr):
+             typename Adaptor::context* adaptor_ctx = nullptr,
+             bool reuse_port = false):
           concurrency_(concurrency),
-          task_queue_length_pool_(concurrency_ - 1),
+          task_queue_length_pool_(concurrency_ > 1 ? concurrency_ - 1 : 1),
           acceptor_(io_context_),
           signals_(io_context_),
           tick_timer_(io_context_),
@@ -84,6 +85,22 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                 return;
             }
 
+            // several servers may listen on the port; the kernel spreads
+            // incoming connections over them (Linux 3.9+)
+            if (reuse_port)
+            {
+#ifdef SO_REUSEPORT
+                acceptor_.raw_acceptor().set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true), ec);
+#else
+                ec = asio::error::operation_not_supported;
+#endif
+                if (ec) {
+                    CROW_LOG_ERROR << "Failed to set SO_REUSEPORT: " << ec.message();
+                    startup_failed_ = true;
+                    return;
+                }
+            }
+
             acceptor_.raw_acceptor().bind(endpoint, ec);
             if (ec) {
                 CROW_LOG_ERROR << "Failed to bind to " << acceptor_.address()
@@ -108,6 +125,12 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             tick_function_ = f;
         }
 
+        /// Runs first on every io thread of this server
+        void set_thread_init(std::function<void()> f)
+        {
+            thread_init_ = f;
+        }
+
         void on_tick()
         {
             tick_function_();
@@ -127,7 +150,8 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                 return;
             }
 
-            uint16_t worker_thread_count = concurrency_ - 1;
+            // with concurrency 1 the accepting thread serves its connections too
+            uint16_t worker_thread_count = concurrency_ > 1 ? concurrency_ - 1 : 0;
             for (int i = 0; i < worker_thread_count; i++)
                 io_context_pool_.emplace_back(new asio::io_context());
             get_cached_date_str_pool_.resize(worker_thread_count);
@@ -139,6 +163,7 @@ namespace crow // NOTE: Already documented in "crow/app.h"
                 v.push_back(
                   std::async(
                     std::launch::async, [this, i, &init_count] {
+                        if (thread_init_) thread_init_();
                         // thread local date string get function
                         auto last = std::chrono::steady_clock::now();
 
@@ -215,10 +240,36 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             while (worker_thread_count != init_count)
                 std::this_thread::yield();
 
-            do_accept();
-
             std::thread(
-              [this] {
+              [this, worker_thread_count] {
+                  if (thread_init_) thread_init_();
+                  std::string date_str;
+                  auto last = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+                  std::unique_ptr<detail::task_timer> task_timer;
+                  if (worker_thread_count == 0)
+                  {
+                      get_cached_date_str_pool_.assign(1, [&]() -> std::string {
+                          if (std::chrono::steady_clock::now() - last >= std::chrono::seconds(1))
+                          {
+                              last = std::chrono::steady_clock::now();
+                              auto last_time_t = time(0);
+                              tm my_tm;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+                              gmtime_s(&my_tm, &last_time_t);
+#else
+                              gmtime_r(&last_time_t, &my_tm);
+#endif
+                              date_str.resize(100);
+                              date_str.resize(strftime(&date_str[0], 99, "%a, %d %b %Y %H:%M:%S GMT", &my_tm));
+                          }
+                          return date_str;
+                      });
+                      task_timer.reset(new detail::task_timer(io_context_));
+                      task_timer->set_default_timeout(timeout_);
+                      task_timer_pool_.assign(1, task_timer.get());
+                      task_queue_length_pool_[0] = 0;
+                  }
+                  do_accept();
                   notify_start();
                   io_context_.run();
                   CROW_LOG_INFO << "Exiting.";
@@ -306,7 +357,7 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             if (!shutting_down_)
             {
                 size_t context_idx = pick_io_context_idx();
-                asio::io_context& ic = *io_context_pool_[context_idx];
+                asio::io_context& ic = io_context_pool_.empty() ? io_context_ : *io_context_pool_[context_idx];
                 auto p = std::make_shared<Connection<Adaptor, Handler, Middlewares...>>(
                     ic, handler_, server_name_, middlewares_,
                     get_cached_date_str_pool_[context_idx], *task_timer_pool_[context_idx], adaptor_ctx_, task_queue_length_pool_[context_idx]);
@@ -360,6 +411,7 @@ namespace crow // NOTE: Already documented in "crow/app.h"
 
         std::chrono::milliseconds tick_interval_;
         std::function<void()> tick_function_;
+        std::function<void()> thread_init_;
 
         std::tuple<Middlewares...>* middlewares_;
 
@@ -148,6 +148,12 @@ namespace crow // NOTE: Already documented in "crow/app.h"
 
             using parent_context_t = typename Context::template partial<N - 1>;
             before_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
+            if (res.is_deferred())
+            {
+                // after_handle runs once the parked request is answered
+                res.deferred_at = N;
+                return true;
+            }
             if (res.is_completed())
             {
                 after_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
@@ -156,7 +162,8 @@ namespace crow // NOTE: Already documented in "crow/app.h"
 
             if (middleware_call_helper<CallCriteria, N + 1, Context, Container>(cc, middlewares, req, res, ctx))
             {
-                after_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
+                if (!res.is_deferred())
+                    after_handler_call<CurrentMW, Context, parent_context_t>(std::get<N>(middlewares), req, res, ctx, static_cast<parent_context_t&>(ctx));
                 return true;
             }
 
@@ -209,6 +216,19 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             }
         };
 
+        /// Global middlewares with an index in [first, last): the part of the chain a resumed request still runs.
+        struct middleware_call_criteria_global_range
+        {
+            int first;
+            int last;
+
+            template<typename MW>
+            constexpr bool enabled(int n) const
+            {
+                return n >= first && n < last && is_middleware_global<MW>::value;
+            }
+        };
+
         template<typename F, typename... Args>
         typename std::enable_if<black_magic::CallHelper<F, black_magic::S<Args...>>::value, void>::type
           wrapped_handler_call(crow::request& /*req*/, crow::response& res, const F& f, Args&&... args)
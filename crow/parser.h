@@ -97,6 +97,13 @@ namespace crow
 
             self->message_complete = true;
             self->process_message();
+            // The response is still going out: stop here, and hold back what
+            // follows (pipelined requests) until the connection asks for it.
+            if (self->handler_->response_pending())
+            {
+                self->paused = true;
+                return 1;
+            }
             return 0;
         }
         HTTPParser(Handler* handler):
@@ -125,6 +132,13 @@ namespace crow
             };
 
             int nparsed = http_parser_execute(this, &settings_, buffer, length);
+            if (paused)
+            {
+                paused = false;
+                http_errno = CHPE_OK;
+                held.assign(buffer + nparsed, buffer + length);
+                return true;
+            }
             if (http_errno != CHPE_OK)
             {
                 return false;
@@ -132,6 +146,14 @@ namespace crow
             return nparsed == length;
         }
 
+        /// Parse what feed() held back behind a response that was still going out.
+        bool feed_held()
+        {
+            std::string rest;
+            rest.swap(held);
+            return rest.empty() || feed(rest.data(), static_cast<int>(rest.size()));
+        }
+
         bool done()
         {
             return feed(nullptr, 0);
@@ -190,6 +212,8 @@ namespace crow
     private:
         int header_building_state = 0;
         bool message_complete = false;
+        bool paused = false;
+        std::string held; ///< Bytes after a message whose response was still pending.
         std::string header_field;
         std::string header_value;
 
@@ -102,6 +102,10 @@ namespace crow
         template<typename F>
         void start(F f)
         {
+            // a response written in more than one segment would otherwise
+            // wait out the client's delayed ACK (~40 ms) on keep-alive
+            error_code ec;
+            socket_.set_option(tcp::no_delay(true), ec);
             f(error_code());
         }
 
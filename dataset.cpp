@@ -0,0 +1,611 @@
+﻿#include "dataset.h"
+
+#include <algorithm>
+#include <csignal>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+
+// How often the reload thread looks for work: a SIGHUP, a file change to
+// check, an old version to free
+static constexpr std::chrono::milliseconds kTick{ 200 };
+
+// ---------------- SIGHUP ----------------
+static std::atomic<bool> g_hangup{ false };
+
+extern "C" void onHangup(int) {
+    g_hangup.store(true, std::memory_order_relaxed);
+}
+
+// ---------------- Rows ----------------
+static std::string routeKey(const Route& r) {
+    return r.airline_iata + '\x1f' + r.src_iata + '\x1f' + r.dst_iata;
+}
+
+template <class T>
+static void upsertById(std::vector<T>& rows, const T& row) {
+    for (auto& r : rows) {
+        if (r.id == row.id) { r = row; return; }
+    }
+    rows.push_back(row);
+}
+
+void DatasetRows::Apply(const DatasetChange* begin, const DatasetChange* end, std::vector<uint32_t>* prev_route) {
+    // last change per route key; null = withdrawn
+    std::unordered_map<std::string, const Route*> by_key;
+    std::vector<const std::string*> order;
+    for (const DatasetChange* c = begin; c != end; ++c) {
+        switch (c->kind) {
+        case DatasetChange::Kind::AddRoute:
+        case DatasetChange::Kind::WithdrawRoute: {
+            auto it = by_key.emplace(routeKey(c->route), nullptr);
+            if (it.second) order.push_back(&it.first->first);
+            it.first->second = c->kind == DatasetChange::Kind::AddRoute ? &c->route : nullptr;
+            break;
+        }
+        case DatasetChange::Kind::UpsertAirport: upsertById(airports, c->airport); break;
+        case DatasetChange::Kind::UpsertAirline: upsertById(airlines, c->airline); break;
+        }
+    }
+    if (prev_route) prev_route->clear();
+    if (by_key.empty()) {
+        if (prev_route) {
+            prev_route->resize(routes.size());
+            std::iota(prev_route->begin(), prev_route->end(), 0u);
+        }
+        return;
+    }
+
+    // a replaced route takes the place of the first row with its key
+    std::vector<Route> out;
+    out.reserve(routes.size() + order.size());
+    std::unordered_set<std::string> placed;
+    for (uint32_t i = 0; i < routes.size(); ++i) {
+        auto it = by_key.find(routeKey(routes[i]));
+        if (it == by_key.end()) {
+            out.push_back(std::move(routes[i]));
+            if (prev_route) prev_route->push_back(i);
+        }
+        else if (it->second && placed.insert(it->first).second) {
+            out.push_back(*it->second);
+            if (prev_route) prev_route->push_back(Timetable::kNewRoute);
+        }
+    }
+    for (const std::string* key : order) {
+        const Route* r = by_key[*key];
+        if (r && !placed.count(*key)) {
+            out.push_back(*r);
+            if (prev_route) prev_route->push_back(Timetable::kNewRoute);
+        }
+    }
+    routes.swap(out);
+}
+
+// ---------------- Resolving changes ----------------
+template <class T>
+static void copyFields(const RowSchema<T>& schema, const std::vector<std::string>& names, const T& from, T& to) {
+    for (const auto& f : schema.Fields()) {
+        if (std::find(names.begin(), names.end(), f.name) == names.end()) continue;
+        switch (f.kind) {
+        case FieldKind::String: to.*(f.str) = from.*(f.str); break;
+        case FieldKind::Int: to.*(f.i32) = from.*(f.i32); break;
+        default: to.*(f.f64) = from.*(f.f64); break;
+        }
+    }
+}
+
+static bool sets(const DatasetChange& c, const char* field) {
+    return std::find(c.fields.begin(), c.fields.end(), field) != c.fields.end();
+}
+
+// A code the change sets must not already name another row
+template <class T>
+static bool codeFree(const DatasetChange& c, const char* field, const std::string& code,
+    const std::shared_ptr<T>& holder, int id, std::string& error) {
+    if (!sets(c, field) || code.empty() || !holder || holder->id == id) return true;
+    error = std::string(field) + " " + code + " already belongs to id " + std::to_string(holder->id);
+    return false;
+}
+
+// Whether a route of `db`, or one `routes` adds, names `code` as its
+// airline (airline) or as its source or destination airport
+static bool routesUse(const AirTravelDB& db, const std::vector<DatasetChange>& routes, const std::string& code,
+    bool airline) {
+    if (code.empty()) return false;
+    for (const auto& c : routes) {
+        const Route& r = c.route;
+        if (c.kind == DatasetChange::Kind::AddRoute &&
+            (airline ? r.airline_iata == code : r.src_iata == code || r.dst_iata == code))
+            return true;
+    }
+    RouteFilter by_airline, by_src, by_dst;
+    by_airline.airlines = { code };
+    by_src.src = { code };
+    by_dst.dst = { code };
+    size_t total = 0;
+    for (const RouteFilter* f : { &by_airline, &by_src, &by_dst }) {
+        if ((f == &by_airline) != airline) continue;
+        db.QueryRouteIds(*f, 1, &total);
+        if (total) return true;
+    }
+    return false;
+}
+
+ChangeResult::Status LiveDataset::resolve(DatasetChange& change, AirTravelDB& db,
+    const std::vector<DatasetChange>& routes, bool& reindex, std::vector<std::string>& moved, std::string& error) {
+    using Status = ChangeResult::Status;
+    switch (change.kind) {
+    case DatasetChange::Kind::AddRoute: {
+        Route& r = change.route;
+        auto airline = db.GetAirlineByIATA(r.airline_iata);
+        auto src = db.GetAirportByIATA(r.src_iata);
+        auto dst = db.GetAirportByIATA(r.dst_iata);
+        if (!airline) error = "unknown airline " + r.airline_iata;
+        else if (!src || !dst) error = "unknown airport " + (src ? r.dst_iata : r.src_iata);
+        if (!error.empty()) return Status::Invalid;
+        r.airline_id = airline->id;
+        r.src_id = src->id;
+        r.dst_id = dst->id;
+        return Status::Applied;
+    }
+    case DatasetChange::Kind::WithdrawRoute:
+        return Status::Applied;
+    case DatasetChange::Kind::UpsertAirport: {
+        const Airport& in = change.airport;
+        auto existing = sets(change, "id") ? db.GetAirportByID(in.id) : db.GetAirportByIATA(in.iata);
+        Airport row = existing ? *existing : Airport{};
+        copyFields(Airport::Schema(), change.fields, in, row);
+        if (!existing) {
+            if (row.name.empty() || row.iata.empty()) {
+                error = "a new airport needs a name and an iata code";
+                return Status::Invalid;
+            }
+            if (!sets(change, "id")) row.id = next_airport_id_;
+        }
+        if (row.latitude < -90 || row.latitude > 90 || row.longitude < -180 || row.longitude > 180) {
+            error = "latitude or longitude out of range";
+            return Status::Invalid;
+        }
+        if (!codeFree(change, "iata", row.iata, db.GetAirportByIATA(row.iata), row.id, error) ||
+            !codeFree(change, "icao", row.icao, db.GetAirportByICAO(row.icao), row.id, error))
+            return Status::Conflict;
+        if (existing && existing->iata != row.iata && routesUse(db, routes, existing->iata, false)) {
+            error = "routes use iata " + existing->iata + "; withdraw them before changing the code";
+            return Status::Conflict;
+        }
+        if (!existing || existing->iata != row.iata || existing->latitude != row.latitude ||
+            existing->longitude != row.longitude || existing->tz_offset != row.tz_offset)
+            moved.push_back(row.iata);
+        next_airport_id_ = std::max(next_airport_id_, row.id + 1);
+        if (db.UpsertAirport(row)) reindex = true;
+        change.airport = std::move(row);
+        change.fields.clear();
+        return Status::Applied;
+    }
+    case DatasetChange::Kind::UpsertAirline: {
+        const Airline& in = change.airline;
+        auto existing = sets(change, "id") ? db.GetAirlineByID(in.id) : db.GetAirlineByIATA(in.iata);
+        Airline row = existing ? *existing : Airline{};
+        copyFields(Airline::Schema(), change.fields, in, row);
+        if (!existing) {
+            if (row.name.empty() || row.iata.empty()) {
+                error = "a new airline needs a name and an iata code";
+                return Status::Invalid;
+            }
+            if (!sets(change, "id")) row.id = next_airline_id_;
+        }
+        if (!codeFree(change, "iata", row.iata, db.GetAirlineByIATA(row.iata), row.id, error) ||
+            !codeFree(change, "icao", row.icao, db.GetAirlineByICAO(row.icao), row.id, error))
+            return Status::Conflict;
+        if (existing && existing->iata != row.iata && routesUse(db, routes, existing->iata, true)) {
+            error = "routes use iata " + existing->iata + "; withdraw them before changing the code";
+            return Status::Conflict;
+        }
+        next_airline_id_ = std::max(next_airline_id_, row.id + 1);
+        db.UpsertAirline(row);
+        change.airline = std::move(row);
+        change.fields.clear();
+        return Status::Applied;
+    }
+    }
+    return Status::Invalid;
+}
+
+// ---------------- LiveDataset ----------------
+LiveDataset::LiveDataset(Options opts) : opts_(std::move(opts)), reaper_(std::make_shared<Reaper>()) {
+    thread_ = std::thread([this] { run(); });
+}
+
+LiveDataset::~LiveDataset() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    for (auto& w : writes_) {
+        ChangeResult r;
+        r.epoch = Epoch();
+        r.error = "shutting down";
+        r.applied = w.change;
+        w.done(r);
+    }
+    writes_.clear();
+    std::atomic_store(&current_, std::shared_ptr<const Dataset>());
+    std::vector<Dataset*> dead;
+    {
+        std::lock_guard<std::mutex> lk(reaper_->mtx);
+        reaper_->closed = true;
+        dead.swap(reaper_->dead);
+    }
+    for (Dataset* d : dead) delete d;
+}
+
+bool LiveDataset::Load(std::string& error) {
+    auto stamps = stampFiles();
+    auto rows = std::make_shared<DatasetRows>();
+    if (!readFiles(*rows, error)) return false;
+    auto next = build(*rows, "startup", true, error);
+    std::lock_guard<std::mutex> lk(mtx_);
+    stamps_ = std::move(stamps);
+    if (!next) return false;
+    countIds(*rows);
+    base_ = std::move(rows);
+    loaded_at_ = std::time(nullptr);
+    publish(std::move(next));
+    return true;
+}
+
+std::shared_ptr<const Dataset> LiveDataset::Get() const {
+    return std::atomic_load(&current_);
+}
+
+bool LiveDataset::Reload(const std::string& trigger) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (reloading_ || !pending_.empty()) return false;
+        pending_ = trigger;
+    }
+    cv_.notify_one();
+    return true;
+}
+
+void LiveDataset::Apply(const DatasetChange& change, Done done) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        writes_.push_back({ change, std::move(done) });
+    }
+    cv_.notify_one();
+}
+
+void LiveDataset::Watch(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    watch_interval_ = interval;
+}
+
+void LiveDataset::ReloadOnHangup() {
+#ifdef SIGHUP
+    std::signal(SIGHUP, onHangup);
+#endif
+}
+
+LiveDataset::Stats LiveDataset::GetStats() const {
+    Stats st;
+    auto cur = Get();
+    if (cur) {
+        st.epoch = cur->db.Epoch();
+        st.trigger = cur->trigger;
+        st.load_ms = cur->load_ms;
+    }
+    st.alive = reaper_->alive.load();
+    st.released = reaper_->released.load();
+    std::lock_guard<std::mutex> lk(mtx_);
+    st.loaded_at = loaded_at_;
+    st.reloads = reloads_;
+    st.rejected = rejected_;
+    st.last_error = last_error_;
+    st.reloading = reloading_ || !pending_.empty();
+    st.watching = watch_interval_.count() > 0;
+    st.changes = log_.size();
+    st.deltas = log_.size() - folded_;
+    st.change_builds = change_builds_;
+    st.compactions = compactions_;
+    return st;
+}
+
+bool LiveDataset::readFiles(DatasetRows& rows, std::string& error) const {
+    if (!AirTravelDB::ReadAirlinesCSV(opts_.airlines, rows.airlines)) error = "cannot read " + opts_.airlines;
+    else if (!AirTravelDB::ReadAirportsCSV(opts_.airports, rows.airports)) error = "cannot read " + opts_.airports;
+    else if (!AirTravelDB::ReadRoutesCSV(opts_.routes, rows.routes)) error = "cannot read " + opts_.routes;
+    return error.empty();
+}
+
+std::shared_ptr<Dataset> LiveDataset::newVersion() const {
+    auto reaper = reaper_;
+    std::shared_ptr<Dataset> next(new Dataset, [reaper](Dataset* d) {
+        std::unique_lock<std::mutex> lk(reaper->mtx);
+        if (!reaper->closed) {
+            reaper->dead.push_back(d);
+            return;
+        }
+        lk.unlock();
+        delete d;
+        reaper->alive.fetch_sub(1);
+        reaper->released.fetch_add(1);
+    });
+    reaper->alive.fetch_add(1);
+    next->db.SetParallelism(opts_.pool, opts_.grain);
+    return next;
+}
+
+std::shared_ptr<Dataset> LiveDataset::build(const DatasetRows& rows, const std::string& trigger,
+    bool prepare_reports, std::string& error) const {
+    const auto t0 = std::chrono::steady_clock::now();
+    auto next = newVersion();
+    AirTravelDB& db = next->db;
+    db.AddAirlines(rows.airlines);
+    db.AddAirports(rows.airports);
+    db.AddRoutes(rows.routes);
+    db.BuildIndexes();
+    auto timetable = std::make_shared<Timetable>();
+    timetable->Build(db);
+    next->timetable = timetable;
+    if (!validate(*next, error)) return nullptr;
+    if (opts_.placement.Enabled()) {
+        db.PlaceSnapshot(opts_.placement);
+        timetable->PlaceSnapshot(opts_.placement);
+    }
+    // after a change the reports are rendered on first request instead
+    if (prepare_reports) next->reports.Prepare(db);
+    next->trigger = trigger;
+    next->load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return next;
+}
+
+bool LiveDataset::validate(const Dataset& next, std::string& error) const {
+    const size_t counts[] = { next.db.GetAllAirlines().size(), next.db.GetAllAirports().size(),
+        next.db.GetAllRoutes().size() };
+    const char* names[] = { "airlines", "airports", "routes" };
+    auto cur = Get();
+    for (size_t i = 0; i < 3; ++i) {
+        if (!counts[i]) {
+            error = std::string("no ") + names[i];
+            return false;
+        }
+        if (!cur) continue;
+        const size_t serving = i == 0 ? cur->db.GetAllAirlines().size()
+            : i == 1 ? cur->db.GetAllAirports().size() : cur->db.GetAllRoutes().size();
+        if (static_cast<double>(counts[i]) < static_cast<double>(serving) * opts_.min_fraction) {
+            error = std::to_string(counts[i]) + " " + names[i] + ", down from " + std::to_string(serving);
+            return false;
+        }
+    }
+    if (!next.timetable || !next.timetable->ConnectionCount()) {
+        error = "empty timetable";
+        return false;
+    }
+    return true;
+}
+
+void LiveDataset::publish(std::shared_ptr<Dataset> next) {
+    std::ostringstream line;
+    line << "Dataset epoch " << next->db.Epoch() << " (" << next->trigger << "): "
+        << next->db.GetAllAirlines().size() << " airlines, " << next->db.GetAllAirports().size() << " airports, "
+        << next->db.GetAllRoutes().size() << " routes";
+    if (next->changes) line << ", " << next->changes << " changes";
+    line << ", built in " << static_cast<long long>(next->load_ms) << " ms\n";
+    std::cout << line.str();
+    const uint64_t epoch = next->db.Epoch();
+    std::atomic_store(&current_, std::shared_ptr<const Dataset>(std::move(next)));
+    epoch_.store(epoch, std::memory_order_release);
+}
+
+std::vector<LiveDataset::FileStamp> LiveDataset::stampFiles() const {
+    std::vector<FileStamp> out;
+    for (const std::string* path : { &opts_.airlines, &opts_.airports, &opts_.routes }) {
+        FileStamp s;
+        struct stat st;
+        if (stat(path->c_str(), &st) == 0) {
+            s.exists = true;
+            s.size = static_cast<size_t>(st.st_size);
+            s.mtime = st.st_mtime;
+        }
+        out.push_back(s);
+    }
+    return out;
+}
+
+void LiveDataset::reload(const std::string& trigger) {
+    auto stamps = stampFiles();
+    auto rows = std::make_shared<DatasetRows>();
+    std::string error;
+    std::shared_ptr<Dataset> next;
+    if (readFiles(*rows, error)) {
+        // changes made through the API outlive a reload
+        rows->Apply(log_.data(), log_.data() + log_.size());
+        next = build(*rows, trigger, true, error);
+    }
+    std::lock_guard<std::mutex> lk(mtx_);
+    stamps_ = std::move(stamps);
+    if (!next) {
+        ++rejected_;
+        last_error_ = error;
+        std::cerr << "Dataset reload (" << trigger << ") rejected, still serving epoch " << Epoch()
+            << ": " << error << "\n";
+        return;
+    }
+    next->changes = log_.size();
+    countIds(*rows);
+    base_ = std::move(rows);
+    folded_ = log_.size();
+    ++reloads_;
+    last_error_.clear();
+    loaded_at_ = std::time(nullptr);
+    publish(std::move(next));
+}
+
+void LiveDataset::countIds(const DatasetRows& rows) {
+    next_airline_id_ = 0;
+    next_airport_id_ = 0;
+    for (const auto& a : rows.airlines) next_airline_id_ = std::max(next_airline_id_, a.id + 1);
+    for (const auto& a : rows.airports) next_airport_id_ = std::max(next_airport_id_, a.id + 1);
+}
+
+void LiveDataset::applyWrites() {
+    std::vector<Write> batch;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        batch.assign(std::make_move_iterator(writes_.begin()), std::make_move_iterator(writes_.end()));
+        writes_.clear();
+    }
+    const auto t0 = std::chrono::steady_clock::now();
+    auto cur = Get();
+    auto next = newVersion();
+    AirTravelDB& db = next->db;
+    db.CopyFrom(cur->db);
+
+    // each change meets the rows as the ones before it left them
+    std::vector<ChangeResult> results(batch.size());
+    std::vector<DatasetChange> applied, routes;
+    std::vector<std::string> moved;
+    bool reindex = false;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ChangeResult& r = results[i];
+        r.applied = batch[i].change;
+        r.status = resolve(r.applied, db, routes, reindex, moved, r.error);
+        if (r.status != ChangeResult::Status::Applied) continue;
+        if (r.applied.kind == DatasetChange::Kind::AddRoute || r.applied.kind == DatasetChange::Kind::WithdrawRoute)
+            routes.push_back(r.applied);
+        applied.push_back(r.applied);
+    }
+
+    std::string error;
+    if (!applied.empty()) {
+        std::vector<uint32_t> prev_route;
+        if (!routes.empty()) {
+            DatasetRows rows;
+            rows.routes = db.GetAllRoutes();
+            rows.Apply(routes.data(), routes.data() + routes.size(), &prev_route);
+            db.ReplaceRoutes(std::move(rows.routes));
+            reindex = true;
+        }
+        if (reindex) db.BuildIndexes();
+        if (routes.empty() && moved.empty()) next->timetable = cur->timetable;
+        else {
+            if (prev_route.empty()) {
+                prev_route.resize(db.GetAllRoutes().size());
+                std::iota(prev_route.begin(), prev_route.end(), 0u);
+            }
+            auto timetable = std::make_shared<Timetable>();
+            timetable->Update(*cur->timetable, db, prev_route, moved);
+            next->timetable = std::move(timetable);
+        }
+        if (validate(*next, error)) {
+            if (opts_.placement.Enabled()) db.PlaceSnapshot(opts_.placement);
+            next->trigger = "changes";
+            next->load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        else next.reset();
+    }
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (!applied.empty() && next) {
+            log_.insert(log_.end(), applied.begin(), applied.end());
+            next->changes = log_.size();
+            ++change_builds_;
+            last_write_ = std::chrono::steady_clock::now();
+            publish(std::move(next));
+        }
+        else if (!applied.empty()) {
+            ++rejected_;
+            last_error_ = error;
+        }
+    }
+    const uint64_t epoch = Epoch();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ChangeResult& r = results[i];
+        if (r.status == ChangeResult::Status::Applied && !error.empty()) {
+            r.status = ChangeResult::Status::Failed;
+            r.error = error;
+        }
+        r.epoch = epoch;
+        batch[i].done(r);
+    }
+}
+
+void LiveDataset::compact() {
+    const auto t0 = std::chrono::steady_clock::now();
+    auto rows = std::make_shared<DatasetRows>(*base_);
+    rows->Apply(log_.data() + folded_, log_.data() + log_.size());
+    std::lock_guard<std::mutex> lk(mtx_);
+    std::cout << "Folded " << log_.size() - folded_ << " dataset changes into the base rows in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count()
+        << " ms\n";
+    base_ = std::move(rows);
+    folded_ = log_.size();
+    ++compactions_;
+}
+
+void LiveDataset::run() {
+    using clock = std::chrono::steady_clock;
+    auto next_check = clock::now();
+    std::vector<FileStamp> seen;       // changed stamps, waiting to settle
+    clock::time_point seen_at;
+
+    std::unique_lock<std::mutex> lk(mtx_);
+    while (!stop_) {
+        cv_.wait_for(lk, kTick, [this] { return stop_ || !pending_.empty() || !writes_.empty(); });
+        if (stop_) break;
+
+        std::string trigger;
+        if (!pending_.empty()) trigger.swap(pending_);
+        else if (g_hangup.exchange(false, std::memory_order_relaxed)) trigger = "SIGHUP";
+        else if (watch_interval_.count() > 0 && clock::now() >= next_check) {
+            next_check = clock::now() + watch_interval_;
+            lk.unlock();
+            auto stamps = stampFiles();
+            lk.lock();
+            // wait for a copy in progress to finish before reading the files
+            if (stamps != stamps_) {
+                if (seen.empty() || stamps != seen) {
+                    seen = std::move(stamps);
+                    seen_at = clock::now();
+                }
+                else if (clock::now() - seen_at >= opts_.settle) trigger = "watch";
+            }
+            else seen.clear();
+        }
+        const bool writes = !writes_.empty();
+        const size_t deltas = log_.size() - folded_;
+        const bool fold = deltas && (deltas >= opts_.compact_after || clock::now() - last_write_ >= opts_.compact_idle);
+
+        lk.unlock();
+        std::vector<Dataset*> dead;
+        {
+            std::lock_guard<std::mutex> rk(reaper_->mtx);
+            dead.swap(reaper_->dead);
+        }
+        for (Dataset* d : dead) {
+            std::cout << "Freed dataset epoch " << d->db.Epoch() << "\n";
+            delete d;
+            reaper_->alive.fetch_sub(1);
+            reaper_->released.fetch_add(1);
+        }
+        if (!trigger.empty()) {
+            lk.lock();
+            reloading_ = true;
+            lk.unlock();
+            reload(trigger);
+            lk.lock();
+            reloading_ = false;
+            seen.clear();
+            continue;
+        }
+        if (writes) applyWrites();
+        else if (fold) compact();
+        lk.lock();
+    }
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include "airdb.h"
+#include "timetable.h"
+#include "reports.h"
+#include "arrow_ipc.h"
+#include "snapshot_memory.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ComputePool;
+
+// One change made through the mutation API, on top of the rows the files
+// gave. Routes are keyed by (airline_iata, src_iata, dst_iata), upper case:
+// AddRoute replaces the rows with its key (or appends one), WithdrawRoute
+// removes them. An upsert as requested names the fields it sets (`fields`,
+// schema names) and finds its row by id when it sets one, else by IATA
+// code; LiveDataset resolves it against the version it is applied to (see
+// Apply) into the whole row, which then replaces the row with the same id,
+// or is appended.
+struct DatasetChange {
+    enum class Kind : uint8_t { AddRoute, WithdrawRoute, UpsertAirport, UpsertAirline };
+    Kind    kind = Kind::AddRoute;
+    Route   route;      // WithdrawRoute: only the key fields
+    Airport airport;
+    Airline airline;
+    std::vector<std::string> fields;   // empty once resolved
+};
+
+// What became of a change: applied, or refused on its own (Invalid: it
+// does not make a valid row; Conflict: it clashes with the rows it met),
+// or lost with its version (Failed).
+struct ChangeResult {
+    enum class Status : uint8_t { Applied, Invalid, Conflict, Failed };
+    Status        status = Status::Failed;
+    uint64_t      epoch = 0;       // of the serving version afterwards
+    std::string   error;
+    DatasetChange applied;         // as resolved: the stored row, with its id
+};
+
+// The rows a version is built from, in file order.
+struct DatasetRows {
+    std::vector<Airline> airlines;
+    std::vector<Airport> airports;
+    std::vector<Route>   routes;
+
+    // Applies resolved changes in order, in one pass over the routes.
+    // `prev_route` (optional) receives, per resulting route, the index it
+    // had before, or Timetable::kNewRoute for an added or replaced row.
+    void Apply(const DatasetChange* begin, const DatasetChange* end,
+        std::vector<uint32_t>* prev_route = nullptr);
+};
+
+// One complete version of what the handlers serve: the database, the
+// timetable built from it, and the reports and exports rendered from it.
+// Immutable once published by LiveDataset.
+struct Dataset {
+    AirTravelDB     db;
+    // shared with the version it was derived from when a change leaves it as is
+    std::shared_ptr<const Timetable> timetable;
+    // filled on demand (internally locked)
+    mutable PreparedReports reports;
+    mutable ArrowExports    exports;
+    std::string     trigger;   // what built it: "startup", "admin", "SIGHUP", "watch", "changes"
+    double          load_ms = 0;
+    uint64_t        changes = 0;  // logged changes it includes
+};
+
+// The dataset currently being served, replaced without downtime: a reload
+// builds a complete new Dataset from the .dat files on a background thread
+// while the old one keeps serving, validates it, and swaps it in with one
+// pointer store. A request pins the version it started on (Get) and keeps
+// reading it until it lets go of the pointer, streamed bodies included; the
+// old version is freed, on the reload thread, once its last reader is gone.
+//
+// Changes (Apply) are layered on the serving version instead: the next
+// version starts as a copy of its database, each change is checked and
+// applied to that copy in turn, and only what the changes touch is derived
+// again. Airline rows feed nothing else; an airport re-indexes the route
+// graph and bitmaps only when its code, position, city or country moves;
+// the timetable is shared unless routes or airport positions change, and
+// then only the routes concerned are generated again. Changes queued while
+// a version builds share the next one. Every change is also logged, as a
+// delta over the base rows, and compaction folds the deltas into the base
+// rows once there are compact_after of them, or after compact_idle without
+// changes; the log itself is kept, so a reload from the files applies it
+// again.
+class LiveDataset {
+public:
+    struct Options {
+        std::string airlines = "airlines.dat";
+        std::string airports = "airports.dat";
+        std::string routes = "routes.dat";
+        ComputePool* pool = nullptr;       // see AirTravelDB::SetParallelism
+        size_t grain = 16384;
+        SnapshotPlacement placement;
+        // a new version with fewer airlines, airports or routes than this
+        // share of the serving one is rejected (a file caught mid-copy)
+        double min_fraction = 0.5;
+        // the watch (Watch) reloads once the files have stayed unchanged
+        // for this long after a change
+        std::chrono::milliseconds settle{ 2000 };
+        size_t compact_after = 64;
+        std::chrono::milliseconds compact_idle{ 10000 };
+    };
+
+    struct Stats {
+        uint64_t epoch = 0;            // of the serving version
+        std::string trigger;
+        double   load_ms = 0;
+        time_t   loaded_at = 0;
+        uint64_t reloads = 0;          // versions swapped in after startup
+        uint64_t rejected = 0;         // built but failed validation
+        std::string last_error;
+        bool     reloading = false;
+        uint64_t alive = 0;            // versions still held, the serving one included
+        uint64_t released = 0;         // old versions freed
+        bool     watching = false;
+        uint64_t changes = 0;          // logged since the files were read
+        uint64_t deltas = 0;           // ... of those, not folded into the base rows yet
+        uint64_t change_builds = 0;    // versions built for changes
+        uint64_t compactions = 0;
+    };
+
+    explicit LiveDataset(Options opts);
+    ~LiveDataset();
+
+    LiveDataset(const LiveDataset&) = delete;
+    LiveDataset& operator=(const LiveDataset&) = delete;
+
+    // Builds the first version on the calling thread; false (and `error`)
+    // when it does not validate. Call before serving.
+    bool Load(std::string& error);
+
+    // The serving version. Hold on to it for as long as anything reads from
+    // it; a reload does not wait for readers.
+    std::shared_ptr<const Dataset> Get() const;
+    // Epoch of the serving version, without pinning it
+    uint64_t Epoch() const { return epoch_.load(std::memory_order_acquire); }
+
+    // Starts a reload on the background thread; false when one is already
+    // running (the request is then dropped, not queued).
+    bool Reload(const std::string& trigger);
+
+    // Queues `change` for the reload thread, which builds one new version
+    // for all the changes queued meanwhile. There each is resolved and
+    // checked against the rows as the changes before it left them: an
+    // upsert takes the fields it does not set from the existing row, and a
+    // new row gets the next free id unless it brings one; a code that
+    // already names another row, or an IATA code change for a row that
+    // routes refer to, is a Conflict. A refused change is left out of the
+    // version and the others still apply. `done` runs on the reload thread
+    // once the version is serving, or failed validation.
+    using Done = std::function<void(const ChangeResult& result)>;
+    void Apply(const DatasetChange& change, Done done);
+
+    // Reloads whenever one of the .dat files changes size or mtime, checked
+    // every `interval`.
+    void Watch(std::chrono::milliseconds interval);
+
+    // Reloads on SIGHUP (POSIX only). The handler only raises a flag the
+    // reload thread polls.
+    void ReloadOnHangup();
+
+    Stats GetStats() const;
+
+private:
+    // Old versions are deleted on the reload thread, not by whichever
+    // io or compute thread happened to drop the last reference; shared with
+    // the deleters so a version released after shutdown is still freed.
+    struct Reaper {
+        std::mutex mtx;
+        std::vector<Dataset*> dead;
+        bool closed = false;
+        std::atomic<uint64_t> alive{ 0 };
+        std::atomic<uint64_t> released{ 0 };
+    };
+
+    struct FileStamp {
+        bool   exists = false;
+        size_t size = 0;
+        time_t mtime = 0;
+        bool operator==(const FileStamp& o) const { return exists == o.exists && size == o.size && mtime == o.mtime; }
+    };
+
+    struct Write {
+        DatasetChange change;
+        Done          done;
+    };
+
+    bool readFiles(DatasetRows& rows, std::string& error) const;
+    std::shared_ptr<Dataset> newVersion() const;
+    std::shared_ptr<Dataset> build(const DatasetRows& rows, const std::string& trigger,
+        bool prepare_reports, std::string& error) const;
+    // Resolves and checks one change against `db` (the next version so far)
+    // and applies an upsert to it; `routes` holds the route changes accepted
+    // before it, which are applied to `db` after the last one.
+    ChangeResult::Status resolve(DatasetChange& change, AirTravelDB& db, const std::vector<DatasetChange>& routes,
+        bool& reindex, std::vector<std::string>& moved, std::string& error);
+    void countIds(const DatasetRows& rows);
+    bool validate(const Dataset& next, std::string& error) const;
+    void publish(std::shared_ptr<Dataset> next);
+    std::vector<FileStamp> stampFiles() const;
+    void reload(const std::string& trigger);          // on the reload thread
+    void applyWrites();                               // same
+    void compact();                                   // same
+    void run();
+
+    Options opts_;
+    std::shared_ptr<Reaper> reaper_;
+
+    // current_ is read and replaced with std::atomic_load / atomic_store
+    std::shared_ptr<const Dataset> current_;
+    std::atomic<uint64_t> epoch_{ 0 };
+
+    mutable std::mutex mtx_;           // guards everything below
+    std::condition_variable cv_;
+    std::string pending_;              // trigger of a requested reload
+    bool reloading_ = false;
+    bool stop_ = false;
+    std::chrono::milliseconds watch_interval_{ 0 };
+    std::vector<FileStamp> stamps_;    // of the files the serving version came from
+    // written by the reload thread only, which reads them without the lock
+    std::shared_ptr<const DatasetRows> base_;   // the files' rows plus log_[0, folded_)
+    std::vector<DatasetChange> log_;   // every change since the files were read
+    size_t folded_ = 0;
+    int next_airline_id_ = 0;          // first ids no row of the serving version has
+    int next_airport_id_ = 0;
+    std::deque<Write> writes_;
+    std::chrono::steady_clock::time_point last_write_;
+    uint64_t change_builds_ = 0;
+    uint64_t compactions_ = 0;
+    uint64_t reloads_ = 0;
+    uint64_t rejected_ = 0;
+    std::string last_error_;
+    time_t loaded_at_ = 0;
+    std::thread thread_;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// Time budget for a long search, optionally cut short by a cancel probe
+// (e.g. "the client has gone away"). Search loops call Expired() once per
+// step; the clock and the probe are only consulted every kStride calls, so
+// the common case costs a counter increment. Once expired it stays expired,
+// and Fired() tells the caller that what the search returned is partial.
+// The chunks of a parallel search may share one Deadline: only one thread
+// at a time runs the probe. A default-constructed Deadline never expires.
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr uint32_t kStride = 256;
+
+    Deadline() = default;
+    explicit Deadline(std::chrono::milliseconds budget, std::function<bool()> cancelled = nullptr)
+        : at_(Clock::now() + budget), bounded_(true), cancelled_(std::move(cancelled)) {}
+
+    bool Expired() {
+        if (Fired()) return true;
+        if ((calls_.fetch_add(1, std::memory_order_relaxed) + 1) % kStride) return false;
+        return Check();
+    }
+
+    // consults the clock and the probe now
+    bool Check() {
+        if (Fired()) return true;
+        if (bounded_ && Clock::now() >= at_) fired_.store(true, std::memory_order_relaxed);
+        else if (cancelled_ && !probing_.exchange(true, std::memory_order_acquire)) {
+            if (cancelled_()) {
+                cancelled_hit_.store(true, std::memory_order_relaxed);
+                fired_.store(true, std::memory_order_relaxed);
+            }
+            probing_.store(false, std::memory_order_release);
+        }
+        return Fired();
+    }
+
+    bool Fired() const { return fired_.load(std::memory_order_relaxed); }
+    bool Cancelled() const { return cancelled_hit_.load(std::memory_order_relaxed); }
+
+private:
+    Clock::time_point at_{};
+    bool     bounded_ = false;
+    std::function<bool()> cancelled_;
+    std::atomic<uint32_t> calls_{ 0 };
+    std::atomic<bool> fired_{ false };
+    std::atomic<bool> cancelled_hit_{ false };
+    std::atomic<bool> probing_{ false };
+};
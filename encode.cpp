@@ -0,0 +1,128 @@
+﻿#include "encode.h"
+
+#include <charconv>
+#include <cmath>
+
+// ---------------- Scalars ----------------
+static const char kHex[] = "0123456789abcdef";
+
+// Same escapes as crow::json::escape, but copies unescaped runs in one go.
+void AppendJsonString(std::string& out, const std::string& s) {
+    out.push_back('"');
+    const char* p = s.data();
+    const char* end = p + s.size();
+    const char* run = p;
+    for (; p != end; ++p) {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out.append(run, p);
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out.push_back(kHex[c >> 4]);
+            out.push_back(kHex[c & 0xF]);
+            break;
+        }
+        run = p + 1;
+    }
+    out.append(run, end);
+    out.push_back('"');
+}
+
+void AppendJsonInt(std::string& out, int64_t v) {
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+void AppendJsonUInt(std::string& out, uint64_t v) {
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+// crow prints doubles with "%.*g" (DBL_DECIMAL_DIG) and then cuts trailing
+// zeros after the decimal point, keeping one ("1.0"); this mirrors it.
+void AppendJsonDouble(std::string& out, double v) {
+    if (std::isnan(v) || std::isinf(v)) {
+        out += "null";
+        return;
+    }
+    char buf[64];
+    auto r = std::to_chars(buf, buf + sizeof(buf) - 1, v, std::chars_format::general, 17);
+    *r.ptr = '\0';
+
+    enum { start, decp, zero } state = start;
+    char* p = buf;
+    char* first_trailing_0 = nullptr;
+    while (*p != '\0') {
+        const char ch = *p;
+        switch (state) {
+        case start:
+            if (ch == '.') {
+                if (*(p + 1) == '0') p++;
+                state = decp;
+            }
+            p++;
+            break;
+        case decp:
+            if (ch == '0') {
+                state = zero;
+                first_trailing_0 = p;
+            }
+            p++;
+            break;
+        case zero:
+            if (ch != '0') {
+                first_trailing_0 = nullptr;
+                state = decp;
+            }
+            p++;
+            break;
+        }
+    }
+    out.append(buf, first_trailing_0 ? first_trailing_0 : r.ptr);
+}
+
+void AppendCsvField(std::string& out, const std::string& s) {
+    if (s.find_first_of(",\"\n\r") == std::string::npos) {
+        out += s;
+        return;
+    }
+    out.push_back('"');
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != '"') continue;
+        out.append(s, run, i + 1 - run);
+        out.push_back('"');
+        run = i + 1;
+    }
+    out.append(s, run, std::string::npos);
+    out.push_back('"');
+}
+
+void AppendCsvInt(std::string& out, int64_t v) {
+    AppendJsonInt(out, v);
+}
+
+void AppendCsvDouble(std::string& out, double v) {
+    char buf[64];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::general, 6);
+    out.append(buf, r.ptr);
+}
+
+// ---------------- Objects ----------------
+JsonObjectLayout::JsonObjectLayout(std::initializer_list<const char*> keys) {
+    for (const char* k : keys) {
+        std::string q;
+        AppendJsonString(q, k);
+        quoted_.push_back(q + ":");
+    }
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Direct-to-buffer JSON/CSV encoding. Scalars are written the way
+// crow::json::wvalue and the ostream/csv_escape code wrote them; object
+// members go out in a fixed, declared order.
+
+// ---------------- Scalars ----------------
+void AppendJsonString(std::string& out, const std::string& s);  // quoted and escaped
+void AppendJsonInt(std::string& out, int64_t v);
+void AppendJsonUInt(std::string& out, uint64_t v);
+void AppendJsonDouble(std::string& out, double v);               // %.17g, trailing zeros trimmed; NaN/Inf -> null
+void AppendCsvField(std::string& out, const std::string& s);    // RFC 4180 quoting
+void AppendCsvInt(std::string& out, int64_t v);
+void AppendCsvDouble(std::string& out, double v);                // as std::ostream prints it (%g)
+
+// An object whose members are written in the order its keys are declared;
+// Write() asks for each member's value by its index.
+class JsonObjectLayout {
+public:
+    JsonObjectLayout(std::initializer_list<const char*> keys);
+
+    template <class F>
+    void Write(std::string& out, F&& member) const {
+        out.push_back('{');
+        for (size_t i = 0; i < quoted_.size(); ++i) {
+            if (i) out.push_back(',');
+            out += quoted_[i];
+            member(out, i);
+        }
+        out.push_back('}');
+    }
+
+    // A list of n objects; member(out, row, index) writes each value.
+    template <class F>
+    void WriteList(std::string& out, size_t n, F&& member) const {
+        out.push_back('[');
+        for (size_t row = 0; row < n; ++row) {
+            if (row) out.push_back(',');
+            Write(out, [&](std::string& o, size_t m) { member(o, row, m); });
+        }
+        out.push_back(']');
+    }
+
+private:
+    std::vector<std::string> quoted_; // "\"key\":"
+};
+
+// ---------------- Row schemas ----------------
+enum class FieldKind : uint8_t { String, Int, Double };
+
+// One column of T; exactly one of the member pointers is set.
+template <class T>
+struct FieldDesc {
+    const char* name;
+    FieldKind   kind;
+    std::string T::* str;
+    int T::* i32;
+    double T::* f64;
+};
+
+template <class T>
+constexpr FieldDesc<T> StrField(const char* name, std::string T::* m) { return { name, FieldKind::String, m, nullptr, nullptr }; }
+template <class T>
+constexpr FieldDesc<T> IntField(const char* name, int T::* m) { return { name, FieldKind::Int, nullptr, m, nullptr }; }
+template <class T>
+constexpr FieldDesc<T> DblField(const char* name, double T::* m) { return { name, FieldKind::Double, nullptr, nullptr, m }; }
+
+// Encoders for rows of T generated from a field list. A Projection picks
+// columns by name; CSV and JSON write them in the listed order. The full
+// row's JSON order can be declared apart from the field (CSV) order, for
+// rows whose JSON predates the schema.
+template <class T>
+class RowSchema {
+public:
+    struct Projection {
+        std::vector<uint8_t> columns;     // listed order, as field indices
+        std::vector<uint8_t> json;        // JSON member order, as field indices
+        std::vector<std::string> keys;    // "\"name\":" per field index
+    };
+
+    template <size_t N>
+    explicit RowSchema(const FieldDesc<T>(&fields)[N]) : fields_(fields, fields + N) {
+        std::vector<std::string> names;
+        for (const auto& f : fields_) names.push_back(f.name);
+        all_ = Project(names);
+    }
+    // `json_order` names every field once
+    template <size_t N>
+    RowSchema(const FieldDesc<T>(&fields)[N], std::initializer_list<const char*> json_order) : RowSchema(fields) {
+        all_.json = Project(std::vector<std::string>(json_order.begin(), json_order.end())).columns;
+    }
+
+    // Unknown names are skipped.
+    Projection Project(const std::vector<std::string>& names) const {
+        Projection p;
+        p.keys.resize(fields_.size());
+        for (const auto& n : names) {
+            for (size_t i = 0; i < fields_.size(); ++i) {
+                if (n != fields_[i].name) continue;
+                p.columns.push_back(static_cast<uint8_t>(i));
+                p.keys[i] = std::string("\"") + fields_[i].name + "\":";
+                break;
+            }
+        }
+        p.json = p.columns;
+        return p;
+    }
+    Projection Project(std::initializer_list<const char*> names) const {
+        return Project(std::vector<std::string>(names.begin(), names.end()));
+    }
+
+    const Projection& All() const { return all_; }
+    const std::vector<FieldDesc<T>>& Fields() const { return fields_; }
+
+    void AppendJSON(std::string& out, const T& row) const { AppendJSON(out, row, all_); }
+    void AppendJSON(std::string& out, const T& row, const Projection& p) const {
+        out.push_back('{');
+        bool first = true;
+        for (uint8_t i : p.json) {
+            if (!first) out.push_back(',');
+            first = false;
+            out += p.keys[i];
+            const auto& f = fields_[i];
+            switch (f.kind) {
+            case FieldKind::String: AppendJsonString(out, row.*(f.str)); break;
+            case FieldKind::Int:    AppendJsonInt(out, row.*(f.i32)); break;
+            case FieldKind::Double: AppendJsonDouble(out, row.*(f.f64)); break;
+            }
+        }
+        out.push_back('}');
+    }
+
+    template <class Range>
+    void AppendJSONArray(std::string& out, const Range& rows) const { AppendJSONArray(out, rows, all_); }
+    template <class Range>
+    void AppendJSONArray(std::string& out, const Range& rows, const Projection& p) const {
+        out.push_back('[');
+        bool first = true;
+        for (const T& row : rows) {
+            if (!first) out.push_back(',');
+            first = false;
+            AppendJSON(out, row, p);
+        }
+        out.push_back(']');
+    }
+
+    void AppendCSVHeader(std::string& out, const Projection& p) const {
+        for (size_t c = 0; c < p.columns.size(); ++c) {
+            if (c) out.push_back(',');
+            out += fields_[p.columns[c]].name;
+        }
+        out += "\r\n";
+    }
+    void AppendCSVRow(std::string& out, const T& row, const Projection& p) const {
+        for (size_t c = 0; c < p.columns.size(); ++c) {
+            if (c) out.push_back(',');
+            const auto& f = fields_[p.columns[c]];
+            switch (f.kind) {
+            case FieldKind::String: AppendCsvField(out, row.*(f.str)); break;
+            case FieldKind::Int:    AppendCsvInt(out, row.*(f.i32)); break;
+            case FieldKind::Double: AppendCsvDouble(out, row.*(f.f64)); break;
+            }
+        }
+        out += "\r\n";
+    }
+
+private:
+    std::vector<FieldDesc<T>> fields_;
+    Projection all_;
+};
@@ -0,0 +1,172 @@
+﻿// Closed-loop HTTP load generator for comparing server modes
+// (bench_server_modes.sh). Every connection runs on its own thread and
+// sends its next GET as soon as the previous response is in, cycling
+// through the given paths; --close opens a new connection per request to
+// measure accept throughput instead. Prints one JSON line of results.
+//
+//   loadgen [-h host] [-p port] [-c connections] [-d seconds] [--close] path...
+#include <asio.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using asio::ip::tcp;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "18080";
+    unsigned connections = 64;
+    double seconds = 10;
+    bool close = false;
+    std::vector<std::string> paths;
+};
+
+struct WorkerResult {
+    std::vector<uint32_t> latency_us;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+};
+
+// Reads one response off `sock` (Content-Length or chunked body); false on
+// a broken connection or a malformed response.
+static bool read_response(tcp::socket& sock, std::string& buf, uint64_t& bytes, bool& keep_alive) {
+    asio::error_code ec;
+    size_t head_end;
+    while ((head_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        char tmp[16384];
+        size_t n = sock.read_some(asio::buffer(tmp), ec);
+        if (ec) return false;
+        buf.append(tmp, n);
+    }
+    std::string head = buf.substr(0, head_end + 4);
+    std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+    buf.erase(0, head_end + 4);
+    keep_alive = head.find("connection: close") == std::string::npos;
+
+    auto read_more = [&] {
+        char tmp[16384];
+        size_t n = sock.read_some(asio::buffer(tmp), ec);
+        if (ec) return false;
+        buf.append(tmp, n);
+        return true;
+    };
+    const size_t cl = head.find("content-length:");
+    if (cl != std::string::npos) {
+        const size_t len = std::strtoull(head.c_str() + cl + 15, nullptr, 10);
+        while (buf.size() < len) if (!read_more()) return false;
+        buf.erase(0, len);
+        bytes += len;
+        return true;
+    }
+    if (head.find("transfer-encoding: chunked") != std::string::npos) {
+        for (;;) {
+            size_t eol;
+            while ((eol = buf.find("\r\n")) == std::string::npos) if (!read_more()) return false;
+            const size_t len = std::strtoull(buf.c_str(), nullptr, 16);
+            while (buf.size() < eol + 2 + len + 2) if (!read_more()) return false;
+            buf.erase(0, eol + 2 + len + 2);
+            bytes += len;
+            if (len == 0) return true;
+        }
+    }
+    return true;  // no body (304, 204)
+}
+
+static void run_worker(const Options& opt, const tcp::resolver::results_type& endpoints, unsigned id,
+    Clock::time_point stop_at, WorkerResult& out) {
+    asio::io_context io;
+    tcp::socket sock(io);
+    std::string buf;
+    bool connected = false;
+    size_t next = id;
+    while (Clock::now() < stop_at) {
+        const std::string& path = opt.paths[next++ % opt.paths.size()];
+        const std::string req = "GET " + path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n"
+            + (opt.close ? "Connection: close\r\n" : "") + "\r\n";
+        const auto t0 = Clock::now();
+        asio::error_code ec;
+        if (!connected) {
+            buf.clear();
+            asio::connect(sock, endpoints, ec);
+            if (!ec) sock.set_option(tcp::no_delay(true), ec);
+            if (ec) { ++out.errors; sock.close(ec); continue; }
+            connected = true;
+        }
+        bool keep_alive = true;
+        asio::write(sock, asio::buffer(req), ec);
+        if (ec || !read_response(sock, buf, out.bytes, keep_alive)) {
+            ++out.errors;
+            sock.close(ec);
+            connected = false;
+            continue;
+        }
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+        out.latency_us.push_back(static_cast<uint32_t>(std::min<int64_t>(us, UINT32_MAX)));
+        if (opt.close || !keep_alive) {
+            sock.close(ec);
+            connected = false;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) { std::cerr << a << " needs a value\n"; std::exit(2); }
+            return argv[++i];
+        };
+        if (a == "-h") opt.host = value();
+        else if (a == "-p") opt.port = value();
+        else if (a == "-c") opt.connections = static_cast<unsigned>(std::max(1, std::atoi(value().c_str())));
+        else if (a == "-d") opt.seconds = std::max(0.1, std::atof(value().c_str()));
+        else if (a == "--close") opt.close = true;
+        else opt.paths.push_back(a);
+    }
+    if (opt.paths.empty()) opt.paths.push_back("/");
+
+    asio::io_context io;
+    tcp::resolver resolver(io);
+    asio::error_code ec;
+    auto endpoints = resolver.resolve(opt.host, opt.port, ec);
+    if (ec) { std::cerr << "resolve: " << ec.message() << "\n"; return 1; }
+
+    std::vector<WorkerResult> results(opt.connections);
+    std::vector<std::thread> threads;
+    const auto start = Clock::now();
+    const auto stop_at = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.seconds));
+    for (unsigned i = 0; i < opt.connections; ++i)
+        threads.emplace_back([&, i] { run_worker(opt, endpoints, i, stop_at, results[i]); });
+    for (auto& t : threads) t.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint32_t> all;
+    uint64_t errors = 0, bytes = 0;
+    for (auto& r : results) {
+        all.insert(all.end(), r.latency_us.begin(), r.latency_us.end());
+        errors += r.errors;
+        bytes += r.bytes;
+    }
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double p) {
+        if (all.empty()) return 0.0;
+        size_t k = static_cast<size_t>(p * static_cast<double>(all.size() - 1));
+        return all[k] / 1000.0;
+    };
+    std::printf("{\"connections\":%u,\"close\":%s,\"seconds\":%.2f,\"requests\":%zu,\"errors\":%llu,"
+        "\"rps\":%.0f,\"mb_per_sec\":%.1f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"p999_ms\":%.3f,\"max_ms\":%.3f}\n",
+        opt.connections, opt.close ? "true" : "false", elapsed, all.size(),
+        static_cast<unsigned long long>(errors), all.size() / elapsed, bytes / elapsed / 1e6,
+        pct(0.50), pct(0.99), pct(0.999), all.empty() ? 0.0 : all.back() / 1000.0);
+    return 0;
+}
@@ -0,0 +1,82 @@
+﻿#include "paging.h"
+
+#include <cstdlib>
+
+// ---------------- Cursor ----------------
+static const char kHex[] = "0123456789abcdef";
+static const char kPartSep = '\x1f';
+
+int64_t PageCursor::Int(size_t i) const {
+    return std::strtoll(parts_[i].c_str(), nullptr, 10);
+}
+
+std::string PageCursor::Encode() const {
+    std::string raw;
+    for (size_t i = 0; i < parts_.size(); ++i) {
+        if (i) raw.push_back(kPartSep);
+        raw += parts_[i];
+    }
+    std::string out;
+    out.reserve(raw.size() * 2);
+    for (unsigned char c : raw) {
+        out.push_back(kHex[c >> 4]);
+        out.push_back(kHex[c & 15]);
+    }
+    return out;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool PageCursor::Decode(const std::string& text, PageCursor& out) {
+    out.parts_.clear();
+    if (text.size() % 2) return false;
+    std::string part;
+    for (size_t i = 0; i < text.size(); i += 2) {
+        int hi = hexValue(text[i]), lo = hexValue(text[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        char c = static_cast<char>(hi << 4 | lo);
+        if (c == kPartSep) { out.parts_.push_back(std::move(part)); part.clear(); }
+        else part.push_back(c);
+    }
+    out.parts_.push_back(std::move(part));
+    return true;
+}
+
+// ---------------- Request ----------------
+static bool parseSize(const char* s, size_t& out) {
+    if (!s || !*s) return false;
+    char* end = nullptr;
+    long long v = std::strtoll(s, &end, 10);
+    if (*end || v < 0) return false;
+    out = static_cast<size_t>(v);
+    return true;
+}
+
+bool PageRequest::Parse(const crow::query_string& qs, size_t key_parts, std::string& error) {
+    if (const char* l = qs.get("limit")) {
+        if (!parseSize(l, limit)) { error = "limit must be a non-negative integer"; return false; }
+        has_limit = paged = true;
+    }
+    if (const char* c = qs.get("cursor")) {
+        if (!PageCursor::Decode(c, after) || after.Size() != key_parts) { error = "Invalid cursor"; return false; }
+        has_cursor = paged = true;
+    }
+    if (const char* f = qs.get("fields")) {
+        std::string list = f;
+        size_t pos = 0;
+        while (pos <= list.size()) {
+            size_t comma = list.find(',', pos);
+            if (comma == std::string::npos) comma = list.size();
+            std::string name = list.substr(pos, comma - pos);
+            size_t b = name.find_first_not_of(' '), e = name.find_last_not_of(' ');
+            if (b != std::string::npos) fields.push_back(name.substr(b, e - b + 1));
+            pos = comma + 1;
+        }
+    }
+    return true;
+}
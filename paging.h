@@ -0,0 +1,73 @@
+#pragma once
+#include "crow/query_string.h"
+#include "encode.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keyset pagination and column projection shared by the list endpoints:
+//   ?limit=N     page size (0 = no limit)
+//   ?cursor=C    continue after the row C names; C is the X-Next-Cursor
+//                header of the previous page and encodes that row's sort key
+//   ?fields=a,b  encode only these columns, in this order
+// A request without limit/cursor is unpaged and keeps the endpoint's
+// historical order and size, so existing clients see identical bodies.
+
+class PageCursor {
+public:
+    PageCursor& Add(const std::string& part) { parts_.push_back(part); return *this; }
+    PageCursor& Add(int64_t v) { parts_.push_back(std::to_string(v)); return *this; }
+
+    size_t Size() const { return parts_.size(); }
+    const std::string& Str(size_t i) const { return parts_[i]; }
+    int64_t Int(size_t i) const;
+
+    // URL-safe opaque form (hex), and back; Decode is false on malformed input
+    std::string Encode() const;
+    static bool Decode(const std::string& text, PageCursor& out);
+
+private:
+    std::vector<std::string> parts_;
+};
+
+struct PageRequest {
+    size_t limit = 0;               // 0 = unbounded
+    bool   has_limit = false;
+    bool   paged = false;           // limit or cursor given
+    bool   has_cursor = false;
+    PageCursor after;               // valid when has_cursor
+    std::vector<std::string> fields;
+
+    // Parses limit/cursor/fields; false (with `error`) when the cursor does
+    // not decode to `key_parts` parts or a limit is not a number.
+    bool Parse(const crow::query_string& qs, size_t key_parts, std::string& error);
+    // limit if given, otherwise the endpoint's default
+    size_t LimitOr(size_t fallback) const { return has_limit ? limit : fallback; }
+};
+
+// Sorts `rows` by `less` and keeps the first `limit` (0 = all). Only the
+// kept prefix is fully sorted (partial_sort), which is what makes a small
+// page over a large candidate set cheap. Returns true when rows were cut.
+template <class T, class Less>
+bool TakePage(std::vector<T>& rows, size_t limit, Less less) {
+    if (limit && rows.size() > limit) {
+        std::partial_sort(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(limit), rows.end(), less);
+        rows.resize(limit);
+        return true;
+    }
+    std::sort(rows.begin(), rows.end(), less);
+    return false;
+}
+
+// The requested columns, or `fallback` when fields= is absent. False when
+// fields= names no known column.
+template <class T>
+bool ProjectFields(const RowSchema<T>& schema, const PageRequest& page,
+    const typename RowSchema<T>::Projection& fallback, typename RowSchema<T>::Projection& out) {
+    if (page.fields.empty()) { out = fallback; return true; }
+    out = schema.Project(page.fields);
+    return !out.columns.empty();
+}
@@ -0,0 +1,323 @@
+﻿#include "reports.h"
+#include "airdb.h"
+#include "compress.h"
+#include "response_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <unordered_map>
+
+// ---------------- Renderers ----------------
+static std::vector<Airline> airlinesByIata(const AirTravelDB& db) {
+    auto all = db.GetAllAirlines();
+    std::sort(all.begin(), all.end(), [](const Airline& a, const Airline& b) {
+        const bool ae = a.iata.empty() || a.iata == "\\N";
+        const bool be = b.iata.empty() || b.iata == "\\N";
+        if (ae != be) return !ae;
+        return a.iata < b.iata;
+        });
+    return all;
+}
+
+static std::vector<Airport> airportsByIata(const AirTravelDB& db) {
+    auto all = db.GetAllAirports();
+    std::sort(all.begin(), all.end(), [](const Airport& a, const Airport& b) {
+        const bool ae = a.iata.empty() || a.iata == "\\N";
+        const bool be = b.iata.empty() || b.iata == "\\N";
+        if (ae != be) return !ae;
+        return a.iata < b.iata;
+        });
+    return all;
+}
+
+const RowSchema<Airline>::Projection& AirlineReportColumns() {
+    static const auto cols = Airline::Schema().Project({ "iata", "icao", "name", "alias", "country", "active" });
+    return cols;
+}
+
+const RowSchema<Airport>::Projection& AirportReportCsvColumns() {
+    static const auto cols = Airport::Schema().Project({ "iata", "icao", "name", "city", "country", "latitude", "longitude" });
+    return cols;
+}
+
+std::string RenderAirlinesByIataJSON(const AirTravelDB& db) {
+    std::string out;
+    Airline::Schema().AppendJSONArray(out, airlinesByIata(db), AirlineReportColumns());
+    return out;
+}
+
+std::string RenderAirlinesByIataCSV(const AirTravelDB& db) {
+    const auto& schema = Airline::Schema();
+    std::string out;
+    schema.AppendCSVHeader(out, AirlineReportColumns());
+    for (const auto& a : airlinesByIata(db)) schema.AppendCSVRow(out, a, AirlineReportColumns());
+    return out;
+}
+
+std::string RenderAirportsByIataJSON(const AirTravelDB& db) {
+    std::string out;
+    Airport::Schema().AppendJSONArray(out, airportsByIata(db));
+    return out;
+}
+
+std::string RenderAirportsByIataCSV(const AirTravelDB& db) {
+    const auto& schema = Airport::Schema();
+    std::string out;
+    schema.AppendCSVHeader(out, AirportReportCsvColumns());
+    for (const auto& ap : airportsByIata(db)) schema.AppendCSVRow(out, ap, AirportReportCsvColumns());
+    return out;
+}
+
+// Paged by-IATA rows are ordered by (missing code, iata, id) so every row
+// has a distinct key; the cursor is (iata, id).
+template <class T>
+static bool iataKeyLess(const T& a, const T& b) {
+    const bool am = a.iata.empty() || a.iata == "\\N";
+    const bool bm = b.iata.empty() || b.iata == "\\N";
+    if (am != bm) return !am;
+    if (a.iata != b.iata) return a.iata < b.iata;
+    return a.id < b.id;
+}
+
+template <class T>
+static BodyStream byIataPage(std::vector<T> all, const RowSchema<T>& schema, bool csv,
+    const PageRequest& page, const typename RowSchema<T>::Projection& cols, std::string* next_cursor) {
+    auto rows = std::make_shared<std::vector<T>>(std::move(all));
+    if (page.has_cursor) {
+        T after;
+        after.iata = page.after.Str(0);
+        after.id = static_cast<int>(page.after.Int(1));
+        rows->erase(std::remove_if(rows->begin(), rows->end(),
+            [&after](const T& r) { return !iataKeyLess(after, r); }), rows->end());
+    }
+    if (TakePage(*rows, page.LimitOr(0), iataKeyLess<T>) && next_cursor)
+        *next_cursor = PageCursor().Add(rows->back().iata).Add(rows->back().id).Encode();
+
+    BodyStream body;
+    auto get = [rows](size_t i) -> const T& { return (*rows)[i]; };
+    if (csv) body.Csv(schema, cols, rows->size(), get);
+    else body.JsonArray(schema, cols, rows->size(), get);
+    return body;
+}
+
+BodyStream AirlinesByIata(const AirTravelDB& db, bool csv, const PageRequest& page,
+    const RowSchema<Airline>::Projection& cols, std::string* next_cursor) {
+    return byIataPage(db.GetAllAirlines(), Airline::Schema(), csv, page, cols, next_cursor);
+}
+
+BodyStream AirportsByIata(const AirTravelDB& db, bool csv, const PageRequest& page,
+    const RowSchema<Airport>::Projection& cols, std::string* next_cursor) {
+    return byIataPage(db.GetAllAirports(), Airport::Schema(), csv, page, cols, next_cursor);
+}
+
+// ---------------- Route-count reports ----------------
+const RowSchema<RouteCountRow>& AirportCountSchema() {
+    static constexpr FieldDesc<RouteCountRow> kFields[] = {
+        StrField("airport_iata", &RouteCountRow::iata),
+        StrField("airport_name", &RouteCountRow::name),
+        IntField("routes_count", &RouteCountRow::routes_count),
+    };
+    static const RowSchema<RouteCountRow> schema(kFields);
+    return schema;
+}
+
+const RowSchema<RouteCountRow>& AirlineCountSchema() {
+    static constexpr FieldDesc<RouteCountRow> kFields[] = {
+        StrField("airline_iata", &RouteCountRow::iata),
+        StrField("airline_name", &RouteCountRow::name),
+        IntField("routes_count", &RouteCountRow::routes_count),
+    };
+    static const RowSchema<RouteCountRow> schema(kFields);
+    return schema;
+}
+
+// (routes_count desc, iata): iata is unique within a report, so this is
+// also the keyset order and the cursor is (routes_count, iata)
+static bool countLess(const RouteCountRow& a, const RouteCountRow& b) {
+    if (a.routes_count != b.routes_count) return a.routes_count > b.routes_count;
+    return a.iata < b.iata;
+}
+
+static void sortByCount(std::vector<RouteCountRow>& rows) {
+    std::sort(rows.begin(), rows.end(), countLess);
+}
+
+// Cuts the sorted rows down to the requested page.
+static void pageByCount(std::vector<RouteCountRow>& rows, const PageRequest& page, std::string* next_cursor) {
+    if (page.has_cursor) {
+        const RouteCountRow after{ page.after.Str(1), {}, static_cast<int>(page.after.Int(0)) };
+        rows.erase(rows.begin(), std::upper_bound(rows.begin(), rows.end(), after, countLess));
+    }
+    const size_t limit = page.LimitOr(0);
+    if (limit && rows.size() > limit) {
+        rows.resize(limit);
+        if (next_cursor) *next_cursor = PageCursor().Add(rows.back().routes_count).Add(rows.back().iata).Encode();
+    }
+}
+
+// Per-chunk counts over the route rows `ids`, summed into one map
+template <class Count>
+static std::unordered_map<std::string, int> countRoutes(const AirTravelDB& db,
+    const std::vector<uint32_t>& ids, Count count) {
+    const auto& all_routes = db.GetAllRoutes();
+    std::vector<std::unordered_map<std::string, int>> parts(db.ParallelChunks(ids.size(), 4));
+    db.ParallelFor(ids.size(), parts.size(), [&](size_t c, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) count(parts[c], all_routes[ids[k]]);
+        });
+    for (size_t c = 1; c < parts.size(); ++c)
+        for (const auto& kv : parts[c]) parts.front()[kv.first] += kv.second;
+    return std::move(parts.front());
+}
+
+std::vector<RouteCountRow> AirportsByRoutes(const AirTravelDB& db, const std::string& airline_iata) {
+    auto counts = countRoutes(db, db.SearchRoutes(airline_iata),
+        [&](std::unordered_map<std::string, int>& into, const Route& r) {
+            if (r.airline_iata != airline_iata) return;
+            ++into[r.src_iata];
+            ++into[r.dst_iata];
+        });
+    std::vector<RouteCountRow> rows; rows.reserve(counts.size());
+    for (auto& kv : counts) {
+        auto ap = db.GetAirportByIATA(kv.first);
+        rows.push_back({ kv.first, ap ? ap->name : std::string{}, kv.second });
+    }
+    sortByCount(rows);
+    return rows;
+}
+
+std::vector<RouteCountRow> AirlinesByRoutes(const AirTravelDB& db, const std::string& airport_iata) {
+    auto counts = countRoutes(db, db.SearchRoutes(airport_iata),
+        [&](std::unordered_map<std::string, int>& into, const Route& r) {
+            if (r.src_iata == airport_iata || r.dst_iata == airport_iata) {
+                ++into[r.airline_iata];
+            }
+        });
+    std::vector<RouteCountRow> rows; rows.reserve(counts.size());
+    for (auto& kv : counts) {
+        auto al = db.GetAirlineByIATA(kv.first);
+        rows.push_back({ kv.first, al ? al->name : std::string{}, kv.second });
+    }
+    sortByCount(rows);
+    return rows;
+}
+
+BodyStream AirlineAirportsJSON(const AirTravelDB& db, const std::string& airline_iata,
+    const PageRequest& page, const RowSchema<RouteCountRow>::Projection* cols, std::string* next_cursor) {
+    static const JsonObjectLayout layout({ "airline_iata", "airline_name", "items" });
+    auto rows = std::make_shared<std::vector<RouteCountRow>>(AirportsByRoutes(db, airline_iata));
+    pageByCount(*rows, page, next_cursor);
+    std::string airline_name;
+    if (auto a = db.GetAirlineByIATA(airline_iata)) airline_name = a->name;
+
+    std::string envelope;
+    layout.Write(envelope, [&](std::string& o, size_t member) {
+        switch (member) {
+        case 0: AppendJsonString(o, airline_iata); break;
+        case 1: AppendJsonString(o, airline_name); break;
+        default: o.push_back(BodyStream::kHole); break;
+        }
+        });
+    BodyStream body;
+    body.Around(envelope, [&rows, cols](BodyStream& b) {
+        b.JsonArray(AirportCountSchema(), cols ? *cols : AirportCountSchema().All(), rows->size(),
+            [rows](size_t i) -> const RouteCountRow& { return (*rows)[i]; });
+        });
+    return body;
+}
+
+BodyStream AirlineAirportsCSV(const AirTravelDB& db, const std::string& airline_iata,
+    const PageRequest& page, const RowSchema<RouteCountRow>::Projection* cols, std::string* next_cursor) {
+    auto rows = std::make_shared<std::vector<RouteCountRow>>(AirportsByRoutes(db, airline_iata));
+    pageByCount(*rows, page, next_cursor);
+    BodyStream body;
+    body.Csv(AirportCountSchema(), cols ? *cols : AirportCountSchema().All(), rows->size(),
+        [rows](size_t i) -> const RouteCountRow& { return (*rows)[i]; });
+    return body;
+}
+
+BodyStream AirportAirlinesJSON(const AirTravelDB& db, const std::string& airport_iata,
+    const PageRequest& page, const RowSchema<RouteCountRow>::Projection* cols, std::string* next_cursor) {
+    static const JsonObjectLayout layout({ "airport_iata", "airport_name", "items" });
+    auto rows = std::make_shared<std::vector<RouteCountRow>>(AirlinesByRoutes(db, airport_iata));
+    pageByCount(*rows, page, next_cursor);
+    std::string airport_name;
+    if (auto ap = db.GetAirportByIATA(airport_iata)) airport_name = ap->name;
+
+    std::string envelope;
+    layout.Write(envelope, [&](std::string& o, size_t member) {
+        switch (member) {
+        case 0: AppendJsonString(o, airport_iata); break;
+        case 1: AppendJsonString(o, airport_name); break;
+        default: o.push_back(BodyStream::kHole); break;
+        }
+        });
+    BodyStream body;
+    body.Around(envelope, [&rows, cols](BodyStream& b) {
+        b.JsonArray(AirlineCountSchema(), cols ? *cols : AirlineCountSchema().All(), rows->size(),
+            [rows](size_t i) -> const RouteCountRow& { return (*rows)[i]; });
+        });
+    return body;
+}
+
+BodyStream AirportAirlinesCSV(const AirTravelDB& db, const std::string& airport_iata,
+    const PageRequest& page, const RowSchema<RouteCountRow>::Projection* cols, std::string* next_cursor) {
+    auto rows = std::make_shared<std::vector<RouteCountRow>>(AirlinesByRoutes(db, airport_iata));
+    pageByCount(*rows, page, next_cursor);
+    BodyStream body;
+    body.Csv(AirlineCountSchema(), cols ? *cols : AirlineCountSchema().All(), rows->size(),
+        [rows](size_t i) -> const RouteCountRow& { return (*rows)[i]; });
+    return body;
+}
+
+// ---------------- Prepared bodies ----------------
+static std::shared_ptr<const PreparedBody> prepare(const std::string& url, uint64_t epoch,
+    std::string body, const char* content_type, const char* disposition) {
+    auto p = std::make_shared<PreparedBody>();
+    p->content_type = content_type;
+    p->disposition = disposition;
+    auto gz = GzipCompress(body);
+    if (!gz.empty()) p->gzip = std::make_shared<const std::string>(std::move(gz));
+    p->identity = std::make_shared<const std::string>(std::move(body));
+    p->etag = ResponseCacheMiddleware::MakeETag(url, epoch);
+    p->gzip_etag = p->etag.substr(0, p->etag.size() - 1) + "-gz\"";
+    return p;
+}
+
+void PreparedReports::Prepare(const AirTravelDB& db) {
+    auto t0 = std::chrono::steady_clock::now();
+    const uint64_t epoch = db.Epoch();
+    std::array<std::shared_ptr<const PreparedBody>, kReportCount> bodies;
+    bodies[AirlinesJSON] = prepare("/report/airlines/by-iata.json", epoch,
+        RenderAirlinesByIataJSON(db), "application/json", "");
+    bodies[AirlinesCSV] = prepare("/report/airlines/by-iata.csv", epoch,
+        RenderAirlinesByIataCSV(db), "text/csv; charset=utf-8", "attachment; filename=\"all_airlines_by_iata.csv\"");
+    bodies[AirportsJSON] = prepare("/report/airports/by-iata.json", epoch,
+        RenderAirportsByIataJSON(db), "application/json", "");
+    bodies[AirportsCSV] = prepare("/report/airports/by-iata.csv", epoch,
+        RenderAirportsByIataCSV(db), "text/csv; charset=utf-8", "attachment; filename=\"all_airports_by_iata.csv\"");
+
+    size_t identity = 0, gzip = 0;
+    for (const auto& b : bodies) {
+        identity += b->identity->size();
+        gzip += b->gzip ? b->gzip->size() : 0;
+    }
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        bodies_ = std::move(bodies);
+        epoch_ = epoch;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Prepared reports: " << identity / 1024 << " KiB (" << gzip / 1024 << " KiB gzip) in "
+        << ms << " ms\n";
+}
+
+std::shared_ptr<const PreparedBody> PreparedReports::Get(Report report, const AirTravelDB& db) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (epoch_ == db.Epoch() && bodies_[report]) return bodies_[report];
+    }
+    Prepare(db);
+    std::lock_guard<std::mutex> lk(mtx_);
+    return bodies_[report];
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "airdb.h"
+#include "body_stream.h"
+#include "encode.h"
+#include "paging.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One row of the route-count reports (Section III.2.1)
+struct RouteCountRow {
+    std::string iata;
+    std::string name;
+    int         routes_count = 0;
+};
+
+// airport_iata, airport_name, routes_count
+const RowSchema<RouteCountRow>& AirportCountSchema();
+// airline_iata, airline_name, routes_count
+const RowSchema<RouteCountRow>& AirlineCountSchema();
+
+// Airports an airline serves / airlines serving an airport, busiest first
+std::vector<RouteCountRow> AirportsByRoutes(const AirTravelDB& db, const std::string& airline_iata);
+std::vector<RouteCountRow> AirlinesByRoutes(const AirTravelDB& db, const std::string& airport_iata);
+
+// The same as report bodies; the rows are computed up front, encoding is
+// deferred until the body is rendered or streamed. A paged request keeps
+// the rows after page.after (cursor: routes_count, iata) up to its limit and
+// sets *next_cursor when more follow; cols defaults to every column.
+BodyStream AirlineAirportsJSON(const AirTravelDB& db, const std::string& airline_iata,
+    const PageRequest& page = PageRequest(), const RowSchema<RouteCountRow>::Projection* cols = nullptr,
+    std::string* next_cursor = nullptr);
+BodyStream AirlineAirportsCSV(const AirTravelDB& db, const std::string& airline_iata,
+    const PageRequest& page = PageRequest(), const RowSchema<RouteCountRow>::Projection* cols = nullptr,
+    std::string* next_cursor = nullptr);
+BodyStream AirportAirlinesJSON(const AirTravelDB& db, const std::string& airport_iata,
+    const PageRequest& page = PageRequest(), const RowSchema<RouteCountRow>::Projection* cols = nullptr,
+    std::string* next_cursor = nullptr);
+BodyStream AirportAirlinesCSV(const AirTravelDB& db, const std::string& airport_iata,
+    const PageRequest& page = PageRequest(), const RowSchema<RouteCountRow>::Projection* cols = nullptr,
+    std::string* next_cursor = nullptr);
+
+// Full-table reports ordered by IATA code (Section III.2.2)
+std::string RenderAirlinesByIataJSON(const AirTravelDB& db);
+std::string RenderAirlinesByIataCSV(const AirTravelDB& db);
+std::string RenderAirportsByIataJSON(const AirTravelDB& db);
+std::string RenderAirportsByIataCSV(const AirTravelDB& db);
+
+// Default columns of the airline reports and the airport CSV report
+const RowSchema<Airline>::Projection& AirlineReportColumns();
+const RowSchema<Airport>::Projection& AirportReportCsvColumns();
+
+// Per-request variants for paged (cursor: iata, id) or projected requests;
+// the prepared bodies below only cover the default, unpaged form.
+BodyStream AirlinesByIata(const AirTravelDB& db, bool csv, const PageRequest& page,
+    const RowSchema<Airline>::Projection& cols, std::string* next_cursor);
+BodyStream AirportsByIata(const AirTravelDB& db, bool csv, const PageRequest& page,
+    const RowSchema<Airport>::Projection& cols, std::string* next_cursor);
+
+// An immutable response body with its gzip variant, rendered once per
+// dataset epoch and then served by reference.
+struct PreparedBody {
+    std::shared_ptr<const std::string> identity;
+    std::shared_ptr<const std::string> gzip;   // null if compression failed
+    std::string content_type;
+    std::string disposition;                   // Content-Disposition, may be empty
+    std::string etag;                          // strong ETag of the identity body
+    std::string gzip_etag;                     // strong ETag of the gzip body
+};
+
+// The four by-IATA reports, re-rendered whenever the dataset epoch moves.
+class PreparedReports {
+public:
+    enum Report { AirlinesJSON, AirlinesCSV, AirportsJSON, AirportsCSV, kReportCount };
+
+    // Renders and compresses every report for db.Epoch().
+    void Prepare(const AirTravelDB& db);
+
+    // Prepared body for the current epoch (re-prepares after a reload).
+    std::shared_ptr<const PreparedBody> Get(Report report, const AirTravelDB& db);
+
+private:
+    std::mutex mtx_;
+    uint64_t   epoch_ = 0;
+    std::array<std::shared_ptr<const PreparedBody>, kReportCount> bodies_;
+};
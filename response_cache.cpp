@@ -0,0 +1,495 @@
+﻿#include "response_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+// ---------------- hashing ----------------
+static uint64_t fnv1a64(const std::string& s) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ull; }
+    return h;
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// ---------------- frequency sketch ----------------
+// Count-min sketch with 4 rows of saturating 4-bit counters (stored one per
+// byte). Counters are halved once the sample period is reached so that the
+// popularity estimate follows the recent workload.
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t width) {
+        size_t w = 64;
+        while (w < width) w <<= 1;
+        table_.assign(w * 4, 0);
+        mask_ = w - 1;
+        sample_period_ = w * 10;
+    }
+
+    void Increment(uint64_t hash) {
+        bool added = false;
+        for (size_t row = 0; row < 4; ++row) {
+            uint8_t& c = table_[row * (mask_ + 1) + index(hash, row)];
+            if (c < 15) { ++c; added = true; }
+        }
+        if (added && ++additions_ >= sample_period_) reset();
+    }
+
+    unsigned Frequency(uint64_t hash) const {
+        unsigned f = 15;
+        for (size_t row = 0; row < 4; ++row)
+            f = std::min<unsigned>(f, table_[row * (mask_ + 1) + index(hash, row)]);
+        return f;
+    }
+
+private:
+    size_t index(uint64_t hash, size_t row) const {
+        return static_cast<size_t>(mix64(hash + row * 0x9E3779B97F4A7C15ull)) & mask_;
+    }
+    void reset() {
+        for (auto& c : table_) c >>= 1;
+        additions_ /= 2;
+    }
+
+    std::vector<uint8_t> table_;
+    size_t mask_ = 0;
+    size_t sample_period_ = 0;
+    size_t additions_ = 0;
+};
+
+// ---------------- shard ----------------
+struct ResponseCache::Shard {
+    struct Entry {
+        std::string key;
+        uint64_t    hash = 0;
+        uint64_t    epoch = 0;
+        size_t      bytes = 0;
+        bool        in_window = true;
+        std::shared_ptr<const CachedResponse> value;
+    };
+    using List = std::list<Entry>;
+
+    Shard(size_t capacity, double window_fraction)
+        : window_cap(std::max<size_t>(1, static_cast<size_t>(capacity * window_fraction))),
+          main_cap(capacity - std::min(capacity, window_cap)),
+          sketch(std::max<size_t>(1024, capacity / 4096)) {}
+
+    std::mutex mtx;
+    List window, main;  // front = most recently used
+    std::unordered_map<std::string, List::iterator> index;
+    size_t window_cap, main_cap;
+    size_t window_bytes = 0, main_bytes = 0;
+    FrequencySketch sketch;
+    Stats stats;
+
+    void erase(List::iterator it) {
+        (it->in_window ? window_bytes : main_bytes) -= it->bytes;
+        index.erase(it->key);
+        (it->in_window ? window : main).erase(it);
+    }
+
+    // Moves window overflow into the main segment, letting TinyLFU decide
+    // whether the candidate is worth more than the main segment's victims.
+    void balance() {
+        while (window_bytes > window_cap && !window.empty()) {
+            auto cand = std::prev(window.end());
+            if (cand->bytes > main_cap) { erase(cand); ++stats.evictions; continue; }
+
+            const unsigned cand_freq = sketch.Frequency(cand->hash);
+            bool admit = true;
+            size_t freed = 0;
+            auto victim = main.end();
+            while (main_bytes - freed + cand->bytes > main_cap && victim != main.begin()) {
+                --victim;
+                if (sketch.Frequency(victim->hash) >= cand_freq) { admit = false; break; }
+                freed += victim->bytes;
+            }
+            if (!admit) {
+                erase(cand);
+                ++stats.rejected;
+                continue;
+            }
+            while (main_bytes + cand->bytes > main_cap && !main.empty()) {
+                erase(std::prev(main.end()));
+                ++stats.evictions;
+            }
+            window_bytes -= cand->bytes;
+            main_bytes += cand->bytes;
+            cand->in_window = false;
+            main.splice(main.begin(), window, cand);
+            ++stats.admitted;
+        }
+    }
+};
+
+// ---------------- cache ----------------
+ResponseCache::ResponseCache() : ResponseCache(Options{}) {}
+
+ResponseCache::ResponseCache(Options opts) : opts_(opts) {
+    if (opts_.shards == 0) opts_.shards = 1;
+    const size_t per_shard = std::max<size_t>(1, opts_.capacity_bytes / opts_.shards);
+    for (size_t i = 0; i < opts_.shards; ++i)
+        shards_.push_back(std::make_unique<Shard>(per_shard, opts_.window_fraction));
+}
+
+ResponseCache::~ResponseCache() = default;
+
+ResponseCache::Shard& ResponseCache::shardFor(uint64_t hash) const {
+    return *shards_[mix64(hash) % shards_.size()];
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::Get(const std::string& key, uint64_t epoch) {
+    const uint64_t h = fnv1a64(key);
+    Shard& s = shardFor(h);
+    std::lock_guard<std::mutex> lk(s.mtx);
+    s.sketch.Increment(h);
+    auto it = s.index.find(key);
+    if (it == s.index.end()) { ++s.stats.misses; return nullptr; }
+    if (it->second->epoch != epoch) {
+        s.erase(it->second);
+        ++s.stats.stale;
+        ++s.stats.misses;
+        return nullptr;
+    }
+    auto& list = it->second->in_window ? s.window : s.main;
+    list.splice(list.begin(), list, it->second);
+    ++s.stats.hits;
+    return it->second->value;
+}
+
+void ResponseCache::Put(const std::string& key, uint64_t epoch, std::shared_ptr<const CachedResponse> value) {
+    if (!value) return;
+    size_t bytes = key.size() + (value->body ? value->body->size() : 0) + 128;
+    for (const auto& h : value->headers) bytes += h.first.size() + h.second.size();
+
+    const uint64_t h = fnv1a64(key);
+    Shard& s = shardFor(h);
+    std::lock_guard<std::mutex> lk(s.mtx);
+    if (bytes > s.main_cap) return; // never fits
+    auto it = s.index.find(key);
+    if (it != s.index.end()) s.erase(it->second);
+
+    Shard::Entry e;
+    e.key = key;
+    e.hash = h;
+    e.epoch = epoch;
+    e.bytes = bytes;
+    e.value = std::move(value);
+    s.window.push_front(std::move(e));
+    s.index[key] = s.window.begin();
+    s.window_bytes += bytes;
+    s.balance();
+}
+
+// ---------------- single-flight ----------------
+struct ResponseCache::Flight {
+    std::string id;
+    std::chrono::steady_clock::time_point started;
+    std::mutex mtx;
+    bool   done = false;
+    size_t followers = 0;
+    std::vector<FlightAnswer> waiting;
+    std::shared_ptr<const CachedResponse> result;
+};
+
+bool ResponseCache::JoinFlight(const std::string& key, uint64_t epoch, std::shared_ptr<Flight>& flight) {
+    std::string id = std::to_string(epoch) + ' ' + key;
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lk(flights_mtx_);
+    auto& slot = flights_[id];
+    if (slot && now - slot->started < kFlightTimeout) {
+        std::lock_guard<std::mutex> fl(slot->mtx);
+        ++slot->followers;
+        flight = slot;
+        return false;
+    }
+    slot = std::make_shared<Flight>();
+    slot->id = std::move(id);
+    slot->started = now;
+    flight = slot;
+    return true;
+}
+
+bool ResponseCache::HasFollowers(const std::shared_ptr<Flight>& flight) const {
+    std::lock_guard<std::mutex> fl(flight->mtx);
+    return flight->followers > 0;
+}
+
+void ResponseCache::FinishFlight(const std::shared_ptr<Flight>& flight, std::shared_ptr<const CachedResponse> result) {
+    {
+        std::lock_guard<std::mutex> lk(flights_mtx_);
+        auto it = flights_.find(flight->id);
+        if (it != flights_.end() && it->second == flight) flights_.erase(it);
+    }
+    bool waited = false;
+    std::vector<FlightAnswer> waiting;
+    {
+        std::lock_guard<std::mutex> fl(flight->mtx);
+        flight->done = true;
+        flight->result = std::move(result);
+        waited = flight->followers > 0;
+        waiting.swap(flight->waiting);
+    }
+    for (auto& answer : waiting) answer(flight->result);
+    if (waited) {
+        std::lock_guard<std::mutex> lk(flights_mtx_);
+        ++flights_shared_;
+    }
+}
+
+void ResponseCache::AwaitFlight(const std::shared_ptr<Flight>& flight, FlightAnswer answer) {
+    {
+        std::lock_guard<std::mutex> fl(flight->mtx);
+        if (!flight->done) {
+            flight->waiting.push_back(std::move(answer));
+            return;
+        }
+    }
+    answer(flight->result);
+}
+
+std::chrono::steady_clock::time_point ResponseCache::FlightStarted(const std::shared_ptr<Flight>& flight) {
+    return flight->started;
+}
+
+void ResponseCache::CountFollower(bool coalesced) {
+    std::lock_guard<std::mutex> lk(flights_mtx_);
+    ++(coalesced ? coalesced_ : flight_fallbacks_);
+}
+
+ResponseCache::Stats ResponseCache::GetStats() const {
+    Stats total;
+    for (const auto& sp : shards_) {
+        std::lock_guard<std::mutex> lk(sp->mtx);
+        total.hits += sp->stats.hits;
+        total.misses += sp->stats.misses;
+        total.stale += sp->stats.stale;
+        total.admitted += sp->stats.admitted;
+        total.rejected += sp->stats.rejected;
+        total.evictions += sp->stats.evictions;
+        total.entries += sp->index.size();
+        total.bytes += sp->window_bytes + sp->main_bytes;
+    }
+    total.not_modified = not_modified_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lk(flights_mtx_);
+    total.coalesced = coalesced_;
+    total.flights_shared = flights_shared_;
+    total.flight_fallbacks = flight_fallbacks_;
+    total.flights = flights_.size();
+    return total;
+}
+
+ResponseCache::Stats& ResponseCache::Stats::operator+=(const Stats& o) {
+    hits += o.hits;
+    misses += o.misses;
+    stale += o.stale;
+    admitted += o.admitted;
+    rejected += o.rejected;
+    evictions += o.evictions;
+    not_modified += o.not_modified;
+    coalesced += o.coalesced;
+    flights_shared += o.flights_shared;
+    flight_fallbacks += o.flight_fallbacks;
+    flights += o.flights;
+    entries += o.entries;
+    bytes += o.bytes;
+    return *this;
+}
+
+// ---------------- middleware ----------------
+std::string ResponseCacheMiddleware::NormalizeKey(const crow::request& req) {
+    std::string key = req.url;
+    auto q = req.raw_url.find('?');
+    if (q == std::string::npos) return key;
+    std::vector<std::string> params;
+    std::stringstream ss(req.raw_url.substr(q + 1));
+    std::string p;
+    while (std::getline(ss, p, '&')) if (!p.empty()) params.push_back(p);
+    std::sort(params.begin(), params.end());
+    for (size_t i = 0; i < params.size(); ++i) {
+        key += (i == 0 ? '?' : '&');
+        key += params[i];
+    }
+    return key;
+}
+
+std::string ResponseCacheMiddleware::MakeETag(const std::string& key, uint64_t epoch) {
+    // the salt keeps validators from one process run from matching another's
+    static const uint64_t salt = mix64(static_cast<uint64_t>(
+        std::chrono::system_clock::now().time_since_epoch().count()) ^ std::random_device{}());
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "\"%08x-%llx-%016llx\"",
+        static_cast<unsigned>(salt & 0xffffffffu),
+        static_cast<unsigned long long>(epoch),
+        static_cast<unsigned long long>(fnv1a64(key)));
+    return buf;
+}
+
+bool ResponseCacheMiddleware::ETagMatches(const std::string& if_none_match, const std::string& etag) {
+    std::stringstream ss(if_none_match);
+    std::string tag;
+    while (std::getline(ss, tag, ',')) {
+        size_t b = tag.find_first_not_of(" \t");
+        if (b == std::string::npos) continue;
+        size_t e = tag.find_last_not_of(" \t");
+        tag = tag.substr(b, e - b + 1);
+        if (tag == "*" || tag == etag) return true;
+        // If-None-Match uses the weak comparison
+        if (tag.size() > 2 && tag.compare(0, 2, "W/") == 0 && tag.substr(2) == etag) return true;
+    }
+    return false;
+}
+
+static thread_local ResponseCache* tl_cache = nullptr;
+
+void ResponseCacheMiddleware::BindThreadCache(ResponseCache* c) {
+    tl_cache = c;
+}
+
+void ResponseCacheMiddleware::before_handle(crow::request& req, crow::response& res, context& ctx) {
+    ResponseCache* cache = tl_cache ? tl_cache : this->cache;
+    if (!cache || !epoch || req.method != crow::HTTPMethod::Get) return;
+    bool match = false;
+    for (const auto& p : prefixes) {
+        if (req.url.compare(0, p.size(), p) == 0) { match = true; break; }
+    }
+    if (!match) return;
+
+    ctx.cache = cache;
+    ctx.cacheable = true;
+    ctx.epoch = epoch();
+    ctx.key = NormalizeKey(req);
+    ctx.etag = MakeETag(ctx.key, ctx.epoch);
+
+    const std::string inm = req.get_header_value("If-None-Match");
+    if (!inm.empty() && ETagMatches(inm, ctx.etag)) {
+        cache->CountNotModified();
+        res.code = 304;
+        res.set_header("ETag", ctx.etag);
+        res.set_header("Cache-Control", "no-cache");
+        ctx.cacheable = false;
+        res.end();
+        return;
+    }
+
+    if (auto hit = cache->Get(ctx.key, ctx.epoch)) {
+        serve(*hit, "HIT", res, ctx);
+        return;
+    }
+
+    std::shared_ptr<ResponseCache::Flight> flight;
+    if (cache->JoinFlight(ctx.key, ctx.epoch, flight)) {
+        ctx.flight = std::move(flight);
+        return;
+    }
+    follow(cache, flight, req, res, ctx);
+}
+
+void ResponseCacheMiddleware::serve(const CachedResponse& hit, const char* how, crow::response& res, context& ctx) {
+    res.code = hit.code;
+    for (const auto& h : hit.headers) res.set_header(h.first, h.second);
+    res.shared_body = hit.body;
+    if (hit.code == 200) {
+        res.set_header("ETag", ctx.etag);
+        res.set_header("Cache-Control", "no-cache");
+    }
+    res.set_header("X-Cache", how);
+    ctx.cacheable = false;
+    res.end();
+}
+
+void ResponseCacheMiddleware::follow(ResponseCache* cache, const std::shared_ptr<ResponseCache::Flight>& flight,
+    crow::request& req, crow::response& res, context& ctx) {
+    // Parked until the leader's result comes in, which is then served on
+    // this request's io thread; when that cannot be shared, or does not come
+    // within kFlightTimeout, the request goes on to render it itself.
+    struct Parked {
+        std::atomic<bool> answered{ false };
+        asio::steady_timer timer;
+        explicit Parked(asio::io_context& io) : timer(io) {}
+    };
+    asio::io_context& io = *req.io_context;
+    auto parked = std::make_shared<Parked>(io);
+    auto answer = [cache, parked, &res, &ctx](std::shared_ptr<const CachedResponse> shared) {
+        parked->timer.cancel();
+        cache->CountFollower(shared != nullptr);
+        if (shared) serve(*shared, "COALESCED", res, ctx);
+        else res.resume();
+    };
+    res.defer();
+    parked->timer.expires_at(ResponseCache::FlightStarted(flight) + ResponseCache::kFlightTimeout);
+    parked->timer.async_wait([parked, answer](const asio::error_code& ec) {
+        if (ec || parked->answered.exchange(true)) return;
+        answer(nullptr);
+    });
+    cache->AwaitFlight(flight, [parked, answer, &io](std::shared_ptr<const CachedResponse> shared) {
+        if (parked->answered.exchange(true)) return;
+        asio::post(io, [answer, shared] { answer(shared); });
+    });
+}
+
+void ResponseCacheMiddleware::after_handle(crow::request& /*req*/, crow::response& res, context& ctx) {
+    std::shared_ptr<const CachedResponse> entry = store(res, ctx);
+    // offloaded handlers run this early, on the pool; Crow's pass is then a no-op
+    ctx.cacheable = false;
+    if (ctx.flight) {
+        ctx.cache->FinishFlight(ctx.flight, std::move(entry));
+        ctx.flight.reset();
+    }
+}
+
+std::shared_ptr<const CachedResponse> ResponseCacheMiddleware::store(crow::response& res, context& ctx) {
+    if (!ctx.cacheable) return nullptr;
+    // the dataset changed while the handler ran; the body may mix snapshots
+    if (epoch() != ctx.epoch) return nullptr;
+    // the handler negotiated its own representation and validator
+    if (!res.get_header_value("Vary").empty()) return nullptr;
+    // only complete successes are cached, but waiting followers get any outcome
+    const bool keep = res.code == 200 && res.get_header_value("X-Partial-Result").empty();
+    const bool share = ctx.flight && ctx.cache->HasFollowers(ctx.flight);
+    if (!keep && !share) return nullptr;
+    // Streamed bodies are not kept, but requests waiting on this render can
+    // only share a materialized one; without followers it keeps streaming.
+    bool materialized = false;
+    if (res.body_source) {
+        if (!share) return nullptr;
+        std::string chunk;
+        for (bool more = true; more;) {
+            chunk.clear();
+            more = res.body_source(chunk);
+            res.body += chunk;
+        }
+        res.body_source = nullptr;
+        materialized = true;
+    }
+
+    auto entry = std::make_shared<CachedResponse>();
+    entry->code = res.code;
+    for (const auto& h : res.headers) entry->headers.emplace_back(h.first, h.second);
+    if (res.shared_body) entry->body = res.shared_body;
+    else {
+        auto body = std::make_shared<const std::string>(std::move(res.body));
+        res.body.clear();
+        res.shared_body = body;
+        entry->body = std::move(body);
+    }
+    if (!keep) return entry;
+    if (!materialized) ctx.cache->Put(ctx.key, ctx.epoch, entry);
+
+    res.set_header("ETag", ctx.etag);
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("X-Cache", "MISS");
+    return entry;
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include "crow/http_request.h"
+#include "crow/http_response.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A fully rendered response as the handler produced it.
+struct CachedResponse {
+    int code = 200;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::shared_ptr<const std::string> body;
+};
+
+// Sharded, byte-bounded response cache with W-TinyLFU admission: new
+// entries land in a small LRU window; an entry leaving the window only
+// displaces main-segment entries when a count-min sketch says it is
+// requested more often than the main segment's LRU victim. Every entry is
+// tagged with the dataset epoch it was rendered from, so a reload only has
+// to bump the epoch; stale entries are dropped lazily on lookup.
+class ResponseCache {
+public:
+    struct Options {
+        size_t capacity_bytes = 64u << 20;
+        size_t shards = 16;
+        double window_fraction = 0.01;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stale = 0;      // found but rendered from an older epoch
+        uint64_t admitted = 0;   // window -> main promotions
+        uint64_t rejected = 0;   // lost the frequency contest on admission
+        uint64_t evictions = 0;
+        uint64_t not_modified = 0;
+        uint64_t coalesced = 0;         // served the result of a concurrent render
+        uint64_t flights_shared = 0;    // renders that had someone waiting on them
+        uint64_t flight_fallbacks = 0;  // waited, but had to render after all
+        size_t   flights = 0;           // renders in progress
+        size_t   entries = 0;
+        size_t   bytes = 0;
+
+        Stats& operator+=(const Stats& o);  // totals over several caches
+    };
+
+    ResponseCache();
+    explicit ResponseCache(Options opts);
+    ~ResponseCache();
+
+    std::shared_ptr<const CachedResponse> Get(const std::string& key, uint64_t epoch);
+    void Put(const std::string& key, uint64_t epoch, std::shared_ptr<const CachedResponse> value);
+    void CountNotModified() { not_modified_.fetch_add(1, std::memory_order_relaxed); }
+
+    // Single-flight: a request that missed the cache joins the flight for
+    // its key and epoch. The first one leads and renders; requests arriving
+    // while it does follow and are answered with its result. A flight older
+    // than kFlightTimeout is presumed lost and replaced.
+    struct Flight;
+    using FlightAnswer = std::function<void(std::shared_ptr<const CachedResponse> result)>;
+    static constexpr std::chrono::milliseconds kFlightTimeout{ 5000 };
+    // true when the caller leads `flight` and must finish it
+    bool JoinFlight(const std::string& key, uint64_t epoch, std::shared_ptr<Flight>& flight);
+    bool HasFollowers(const std::shared_ptr<Flight>& flight) const;
+    // Hands `result` (null: not shareable) to the followers and retires the flight.
+    void FinishFlight(const std::shared_ptr<Flight>& flight, std::shared_ptr<const CachedResponse> result);
+    // Registers a follower: `answer` gets the leader's result (null when it
+    // was not shareable) on the thread that finishes the flight, or at once
+    // when it already has. It does not fire for a leader that never finishes.
+    void AwaitFlight(const std::shared_ptr<Flight>& flight, FlightAnswer answer);
+    // When the flight was started, for a follower's timeout
+    static std::chrono::steady_clock::time_point FlightStarted(const std::shared_ptr<Flight>& flight);
+    // A follower was answered: with the leader's result, or by rendering after all
+    void CountFollower(bool coalesced);
+
+    Stats GetStats() const;
+    size_t CapacityBytes() const { return opts_.capacity_bytes; }
+
+private:
+    struct Shard;
+    Shard& shardFor(uint64_t hash) const;
+
+    Options opts_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> not_modified_{ 0 };
+
+    mutable std::mutex flights_mtx_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    uint64_t coalesced_ = 0, flights_shared_ = 0, flight_fallbacks_ = 0;
+};
+
+// Crow middleware: answers cacheable GETs from the cache (or with 304 when
+// If-None-Match matches) before the handler runs, and stores successful
+// responses afterwards (not those flagged X-Partial-Result). On a miss, identical requests already being
+// rendered are waited for (single-flight) instead of rendered again: the
+// follower is parked (crow::response::defer) and answered from its io
+// thread once the leader finishes, so no io thread waits. Configure
+// `cache`, `epoch` and `prefixes` before app.run(). An io thread bound to a
+// cache of its own (BindThreadCache) uses that one instead of `cache`.
+struct ResponseCacheMiddleware {
+    struct context {
+        ResponseCache* cache = nullptr;                 // the one this request uses
+        bool        cacheable = false;
+        uint64_t    epoch = 0;
+        std::string key;
+        std::string etag;
+        std::shared_ptr<ResponseCache::Flight> flight;  // set while leading a render
+    };
+
+    ResponseCache*              cache = nullptr;
+    std::function<uint64_t()>   epoch;
+    std::vector<std::string>    prefixes; // cacheable URL prefixes
+
+    // Requests arriving on the calling thread use `c` (null: unbind).
+    static void BindThreadCache(ResponseCache* c);
+
+    void before_handle(crow::request& req, crow::response& res, context& ctx);
+    void after_handle(crow::request& req, crow::response& res, context& ctx);
+
+    // path + query parameters sorted by name
+    static std::string NormalizeKey(const crow::request& req);
+    // strong validator: process salt, dataset epoch and key hash
+    static std::string MakeETag(const std::string& key, uint64_t epoch);
+    static bool ETagMatches(const std::string& if_none_match, const std::string& etag);
+
+private:
+    // caches a successful response; returns what a flight's followers get
+    std::shared_ptr<const CachedResponse> store(crow::response& res, context& ctx);
+    static void serve(const CachedResponse& hit, const char* how, crow::response& res, context& ctx);
+    // parks a follower of `flight` and answers it once the leader finishes
+    static void follow(ResponseCache* cache, const std::shared_ptr<ResponseCache::Flight>& flight,
+        crow::request& req, crow::response& res, context& ctx);
+};
@@ -0,0 +1,282 @@
+﻿// Self-checks for the encoders and scan kernels, with the timings that go
+// with them. Loads the .dat files from the working directory, runs every
+// check (or the ones named on the command line), prints one line per check
+// and exits non-zero when any fails. The Dockerfile builds and runs it.
+//
+//   selftest [check...]
+#include "airdb.h"
+#include "arrow_ipc.h"
+#include "codescan.h"
+#include "crc32.h"
+#include "encode.h"
+#include "crow/json.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double msBetween(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+struct Check {
+    const char* name;
+    bool (*run)(const AirTravelDB& db, std::string& detail);
+};
+
+// ---------------- encoders ----------------
+// Schema encoders vs. the wvalue/ostream code they replaced, where a legacy
+// endpoint still answers in the old bytes: /airline/<term> and
+// /airport/<term> (one object, as toJSON().dump() wrote it) and the airport
+// CSV report rows.
+static bool checkEncoders(const AirTravelDB& db, std::string& detail) {
+    const auto airlines = db.GetAllAirlines();
+    const auto airports = db.GetAllAirports();
+    auto old_csv_escape = [](const std::string& s) {
+        if (s.find_first_of(",\"\n\r") == std::string::npos) return s;
+        std::string out = "\"";
+        for (char c : s) {
+            if (c == '"') out += "\"\"";
+            else out.push_back(c);
+        }
+        return out + "\"";
+    };
+
+    auto t0 = Clock::now();
+    std::vector<std::string> old_json;
+    for (const auto& x : airlines) old_json.push_back(x.toJSON().dump());
+    for (const auto& x : airports) old_json.push_back(x.toJSON().dump());
+    std::ostringstream old_csv;
+    for (const auto& ap : airports) {
+        old_csv << old_csv_escape(ap.iata) << ',' << old_csv_escape(ap.name) << ','
+            << ap.latitude << ',' << ap.longitude << ',' << ap.altitude_ft << "\r\n";
+    }
+    auto t1 = Clock::now();
+
+    std::vector<std::string> new_json;
+    for (const auto& x : airlines) { new_json.emplace_back(); Airline::Schema().AppendJSON(new_json.back(), x); }
+    for (const auto& x : airports) { new_json.emplace_back(); Airport::Schema().AppendJSON(new_json.back(), x); }
+    static const auto cols = Airport::Schema().Project({ "iata", "name", "latitude", "longitude", "altitude_ft" });
+    std::string new_csv;
+    for (const auto& ap : airports) Airport::Schema().AppendCSVRow(new_csv, ap, cols);
+    auto t2 = Clock::now();
+
+    size_t differ = 0;
+    for (size_t i = 0; i < new_json.size(); ++i) {
+        if (new_json[i] == old_json[i]) continue;
+        if (!differ++) detail = "first difference:\n  old " + old_json[i] + "\n  new " + new_json[i] + "\n";
+    }
+    const bool csv_ok = new_csv == old_csv.str();
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "%zu objects, %zu differ, csv %s; wvalue %.1f ms, schema %.1f ms",
+        new_json.size(), differ, csv_ok ? "identical" : "DIFFERS", msBetween(t0, t1), msBetween(t1, t2));
+    detail = buf + (differ ? "\n" + detail : std::string());
+    return !differ && csv_ok;
+}
+
+// ---------------- arrow ----------------
+// Arrow vs full-column CSV for each export: round-trip check against the
+// dataset, sizes, and write / read times (CSV read = splitting into fields only)
+static bool checkArrow(const AirTravelDB& db, std::string& detail) {
+    auto csv_of = [](const auto& schema, const auto& rows) {
+        std::string s;
+        schema.AppendCSVHeader(s, schema.All());
+        for (const auto& r : rows) schema.AppendCSVRow(s, r, schema.All());
+        return s;
+    };
+    auto split_csv = [](const std::string& csv) {
+        std::vector<std::string> fields;
+        std::string cur;
+        bool quoted = false;
+        for (size_t i = 0; i < csv.size(); ++i) {
+            char c = csv[i];
+            if (quoted) {
+                if (c == '"' && i + 1 < csv.size() && csv[i + 1] == '"') { cur.push_back('"'); ++i; }
+                else if (c == '"') quoted = false;
+                else cur.push_back(c);
+            }
+            else if (c == '"') quoted = true;
+            else if (c == ',' || c == '\n') { fields.push_back(std::move(cur)); cur.clear(); }
+            else if (c != '\r') cur.push_back(c);
+        }
+        return fields.size();
+    };
+
+    bool all_ok = true;
+    for (const char* table : { "airports", "airlines", "routes" }) {
+        std::string error;
+        const bool ok = CheckArrowRoundTrip(db, table, error);
+        all_ok = all_ok && ok;
+
+        auto t0 = Clock::now();
+        std::string arrow;
+        WriteArrowTable(db, table, arrow);
+        auto t1 = Clock::now();
+        ArrowTable decoded;
+        ReadArrowFile(arrow, decoded, error);
+        auto t2 = Clock::now();
+        std::string csv = std::string(table) == "airports" ? csv_of(Airport::Schema(), db.GetAllAirports())
+            : std::string(table) == "airlines" ? csv_of(Airline::Schema(), db.GetAllAirlines())
+            : csv_of(Route::Schema(), db.GetAllRoutes());
+        auto t3 = Clock::now();
+        size_t fields = split_csv(csv);
+        auto t4 = Clock::now();
+
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+            "\n  %-8s %s, %lld rows; arrow %zu B, write %.1f ms, read %.1f ms; csv %zu B, %zu fields, write %.1f ms, split %.1f ms",
+            table, ok ? "round-trips" : "DIFFERS", static_cast<long long>(decoded.rows), arrow.size(),
+            msBetween(t0, t1), msBetween(t1, t2), csv.size(), fields, msBetween(t2, t3), msBetween(t3, t4));
+        detail += buf;
+        if (!error.empty()) detail += " (" + error + ")";
+    }
+    return all_ok;
+}
+
+// ---------------- search-routes ----------------
+// Packed-column SearchRoutes vs. the per-row string scan it replaced, for
+// tokens of every length, mixed case, a NUL and one longer than any code.
+static bool checkSearchRoutes(const AirTravelDB& db, std::string& detail) {
+    const auto& all = db.GetAllRoutes();
+    const std::string tokens[] = { "A", "AA", "lhr", "EGL", "KJFK", "9", std::string("A\0", 2),
+        std::string("\0", 1), "ABCDE" };
+    bool ok = true;
+    double packed_ms = 0, string_ms = 0;
+    for (const std::string& q : tokens) {
+        auto t0 = Clock::now();
+        const std::vector<uint32_t> packed = db.SearchRoutes(q);
+        auto t1 = Clock::now();
+        std::string t = q;
+        std::transform(t.begin(), t.end(), t.begin(), ::toupper);
+        std::vector<uint32_t> scanned;
+        for (uint32_t i = 0; i < all.size(); ++i) {
+            std::string a = all[i].airline_iata, s = all[i].src_iata, d = all[i].dst_iata;
+            std::transform(a.begin(), a.end(), a.begin(), ::toupper);
+            std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+            std::transform(d.begin(), d.end(), d.begin(), ::toupper);
+            if (a.find(t) != std::string::npos || s.find(t) != std::string::npos || d.find(t) != std::string::npos)
+                scanned.push_back(i);
+        }
+        auto t2 = Clock::now();
+        packed_ms += msBetween(t0, t1);
+        string_ms += msBetween(t1, t2);
+        if (packed != scanned) {
+            ok = false;
+            detail += "\n  token of " + std::to_string(q.size()) + " bytes: " + std::to_string(packed.size()) +
+                " packed vs " + std::to_string(scanned.size()) + " scanned";
+        }
+    }
+    const double scanned_rows = static_cast<double>(all.size() * std::size(tokens));
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "%zu routes, kernel %s; packed %.1f routes/us, string %.1f routes/us",
+        all.size(), CodeScanKernel(), scanned_rows / 1000.0 / packed_ms, scanned_rows / 1000.0 / string_ms);
+    detail = buf + detail;
+    return ok;
+}
+
+// ---------------- crc32 ----------------
+// The dispatched CRC32 kernel against the portable slicing-by-8 one: the
+// check value, every short length at every alignment, chunked updates, and
+// throughput over the .dat files.
+static bool checkCrc32(const AirTravelDB& /*db*/, std::string& detail) {
+    std::string data;
+    for (const char* path : { "airlines.dat", "airports.dat", "routes.dat" }) {
+        std::ifstream in(path, std::ios::binary);
+        data.append(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    bool ok = Crc32("123456789") == 0xCBF43926u;
+    if (!ok) detail += "\n  wrong check value for \"123456789\"";
+    for (size_t offset = 0; offset < 16 && ok; ++offset) {
+        for (size_t n = 0; n <= 512 && offset + n <= data.size(); ++n) {
+            if (Crc32Update(0, data.data() + offset, n) == Crc32UpdateSlice8(0, data.data() + offset, n)) continue;
+            detail += "\n  differs at offset " + std::to_string(offset) + ", length " + std::to_string(n);
+            ok = false;
+            break;
+        }
+    }
+    uint32_t chunked = 0;
+    for (size_t at = 0, step = 1; at < data.size(); at += step, step = step * 3 % 100003 + 1)
+        chunked = Crc32Update(chunked, data.data() + at, std::min(step, data.size() - at));
+    if (chunked != Crc32(data)) {
+        detail += "\n  chunked updates differ";
+        ok = false;
+    }
+
+    const int iters = 20;
+    uint32_t fast = 0, portable = 0;
+    auto t0 = Clock::now();
+    for (int it = 0; it < iters; ++it) fast = Crc32(data);
+    auto t1 = Clock::now();
+    for (int it = 0; it < iters; ++it) portable = Crc32UpdateSlice8(0, data.data(), data.size());
+    auto t2 = Clock::now();
+    if (fast != portable) {
+        detail += "\n  kernels disagree over the .dat files";
+        ok = false;
+    }
+    auto mb_per_sec = [&](double ms) { return ms > 0 ? static_cast<double>(data.size()) * iters / ms / 1e3 : 0.0; };
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "%zu bytes, kernel %s; %.0f MB/s, slice8 %.0f MB/s",
+        data.size(), Crc32Kernel(), mb_per_sec(msBetween(t0, t1)), mb_per_sec(msBetween(t1, t2)));
+    detail = buf + detail;
+    return ok;
+}
+
+// ---------------- paths ----------------
+// Place-to-place searches with a known best answer: a nonstop between two
+// metros wins over any chain of shorter hops.
+static bool checkPaths(const AirTravelDB& db, std::string& detail) {
+    struct Case { const char* from; const char* to; size_t legs; };
+    static const Case kCases[] = {
+        { "London", "New York", 1 },
+        { "LHR", "JFK", 1 },
+        { "LHR", "SYD", 2 },
+        { "LHR", "LHR", 0 },
+    };
+    bool ok = true;
+    for (const Case& c : kCases) {
+        const PathResult p = db.FindShortestPath(c.from, c.to);
+        std::string route;
+        for (const auto& leg : p.legs) route += (route.empty() ? leg.src_iata : "") + "-" + leg.dst_iata;
+        const bool pass = c.legs ? p.found && p.legs.size() == c.legs : !p.found || p.legs.empty();
+        detail += std::string("\n  ") + c.from + " -> " + c.to + ": " + (p.found ? route : "no path") +
+            (p.found ? " (" + std::to_string(p.total_km) + " km)" : "") +
+            (pass ? "" : ", expected " + std::to_string(c.legs) + " legs");
+        ok = ok && pass;
+    }
+    return ok;
+}
+
+static const Check kChecks[] = {
+    { "encoders", checkEncoders },
+    { "arrow", checkArrow },
+    { "search-routes", checkSearchRoutes },
+    { "crc32", checkCrc32 },
+    { "paths", checkPaths },
+};
+
+int main(int argc, char** argv) {
+    AirTravelDB db;
+    if (!db.LoadAirlinesCSV("airlines.dat") || !db.LoadAirportsCSV("airports.dat") || !db.LoadRoutesCSV("routes.dat")) {
+        std::fprintf(stderr, "selftest: cannot load the .dat files from the working directory\n");
+        return 2;
+    }
+    db.BuildIndexes();
+
+    int failed = 0;
+    for (const Check& c : kChecks) {
+        if (argc > 1 && std::find(argv + 1, argv + argc, std::string(c.name)) == argv + argc) continue;
+        std::string detail;
+        const auto t0 = Clock::now();
+        const bool ok = c.run(db, detail);
+        std::printf("%-4s %-14s %9.1f ms  %s\n", ok ? "ok" : "FAIL", c.name, msBetween(t0, Clock::now()), detail.c_str());
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+}
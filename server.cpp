@@ -1,257 +1,674 @@
 ﻿#include "crow.h"
 #include "airdb.h"
+#include "timetable.h"
+#include "response_cache.h"
+#include "reports.h"
+#include "compress.h"
+#include "static_assets.h"
+#include "source_bundle.h"
+#include "body_stream.h"
+#include "paging.h"
+#include "arrow_ipc.h"
+#include "suggest_channel.h"
+#include "admission.h"
+#include "compute_pool.h"
+#include "deadline.h"
+#include "snapshot_memory.h"
+#include "dataset.h"
 #include "crow/json.h"
 
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
 #include <array>
+#include <cctype>
 #include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
 #ifdef _WIN32
 #include <cstdlib>
-static int read_port() {
+static std::string read_env(const char* name) {
     char* buf = nullptr; size_t len = 0;
-    int port = 18080;
-    if (_dupenv_s(&buf, &len, "PORT") == 0 && buf) {
-        port = std::atoi(buf);
+    std::string value;
+    if (_dupenv_s(&buf, &len, name) == 0 && buf) {
+        value = buf;
         free(buf);
     }
-    return port;
+    return value;
 }
 #else
 #include <cstdlib>
-static int read_port() {
-    const char* p = std::getenv("PORT");
-    return p ? std::atoi(p) : 18080;
+static std::string read_env(const char* name) {
+    const char* p = std::getenv(name);
+    return p ? p : "";
 }
 #endif
 
+static int read_port() {
+    std::string p = read_env("PORT");
+    return p.empty() ? 18080 : std::atoi(p.c_str());
+}
+
 
 // ---------- helpers ----------
-static bool read_file_strict(const std::string& path, std::string& out) {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) return false;
-    std::ostringstream ss;
-    ss << f.rdbuf();
-    out = ss.str();
+// Path segments reach handlers still percent-encoded ("New%20York").
+static std::string url_decode(const std::string& s) {
+    std::string out = s;
+    out.resize(crow::qs_decode(&out[0]));
+    return out;
+}
+
+// "AA,BA, DL" -> {"AA", "BA", "DL"}
+static std::vector<std::string> split_list(const char* s) {
+    std::vector<std::string> out;
+    if (!s) return out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t b = item.find_first_not_of(' ');
+        size_t e = item.find_last_not_of(' ');
+        if (b != std::string::npos) out.push_back(item.substr(b, e - b + 1));
+    }
+    return out;
+}
+
+// "lhr" -> "LHR"
+static std::string to_upper(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+    return s;
+}
+
+static crow::response json_response(std::string body) {
+    crow::response res{ std::move(body) };
+    res.add_header("Content-Type", "application/json");
+    return res;
+}
+
+// Large results go out with chunked transfer and are encoded while the
+// socket drains; small ones are rendered in one piece so they keep a
+// Content-Length and stay cacheable.
+static crow::response stream_response(BodyStream body, const std::string& content_type) {
+    crow::response res;
+    res.add_header("Content-Type", content_type);
+    if (body.ShouldStream()) res.body_source = std::move(body).Source();
+    else res.body = std::move(body).Render();
+    return res;
+}
+
+// limit/cursor/fields for a list endpoint whose sort key has key_parts
+// parts; on a bad parameter `err` is the 400 to return.
+template <class T>
+static bool parse_page(const crow::request& req, size_t key_parts, const RowSchema<T>& schema,
+    const typename RowSchema<T>::Projection& fallback, PageRequest& page,
+    typename RowSchema<T>::Projection& cols, crow::response& err) {
+    std::string msg;
+    if (!page.Parse(req.url_params, key_parts, msg)) { err = crow::response(400, msg); return false; }
+    if (!ProjectFields(schema, page, fallback, cols)) { err = crow::response(400, "fields names no known column"); return false; }
+    return true;
+}
+
+// stops=0,1 and codeshare=Y|N on a route query; on a bad value `err` is
+// the 400 to return.
+static bool parse_route_flags(const crow::request& req, RouteFilter& f, crow::response& err) {
+    for (const auto& s : split_list(req.url_params.get("stops"))) {
+        char* end = nullptr;
+        const long v = std::strtol(s.c_str(), &end, 10);
+        if (*end || v < 0 || v > 1000) { err = crow::response(400, "stops must be a list of non-negative integers"); return false; }
+        f.stops.push_back(static_cast<int>(v));
+    }
+    if (const char* cs = req.url_params.get("codeshare")) {
+        const std::string v = cs;
+        if (v == "Y" || v == "y" || v == "1" || v == "true") f.codeshare = 1;
+        else if (v == "N" || v == "n" || v == "0" || v == "false") f.codeshare = 0;
+        else { err = crow::response(400, "codeshare must be Y or N"); return false; }
+    }
     return true;
 }
 
-static std::string read_file(const std::string& path) {
-    std::string data;
-    if (!read_file_strict(path, data)) return {};
-    return data;
+// Keyset page over ascending route indices fetched with limit + 1: drops
+// the probe row and returns the cursor naming the last row kept, if any.
+static std::string trim_route_page(std::vector<uint32_t>& ids, size_t limit) {
+    if (!limit || ids.size() <= limit) return {};
+    ids.resize(limit);
+    return PageCursor().Add(ids.back()).Encode();
+}
+
+// First route index after the cursor
+static uint32_t route_page_start(const PageRequest& page) {
+    if (!page.has_cursor) return 0;
+    int64_t last = page.after.Int(0);
+    return last < 0 ? 0 : static_cast<uint32_t>(last + 1);
 }
 
-static std::array<uint32_t, 256> make_crc32_table() {
-    std::array<uint32_t, 256> table{};
-    for (uint32_t i = 0; i < 256; ++i) {
-        uint32_t c = i;
-        for (int j = 0; j < 8; ++j) {
-            if (c & 1) c = 0xEDB88320u ^ (c >> 1);
-            else c >>= 1;
+static crow::response not_found(const std::string& msg = "Not found") {
+    return crow::response(404, msg);
+}
+
+// ---------- autocomplete ----------
+static std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+// Airlines whose name, IATA or ICAO code contains q, case-insensitively
+static std::vector<Airline> match_airlines(const AirTravelDB& db, const std::string& q) {
+    const std::string ql = lower(q);
+    std::vector<Airline> items;
+    for (const auto& a : db.GetAllAirlines()) {
+        if (lower(a.name).find(ql) != std::string::npos || lower(a.iata).find(ql) != std::string::npos
+            || lower(a.icao).find(ql) != std::string::npos) {
+            items.push_back(a);
         }
-        table[i] = c;
     }
-    return table;
+    return items;
 }
 
-static uint32_t crc32(const std::string& data) {
-    static const auto table = make_crc32_table();
-    uint32_t crc = 0xFFFFFFFFu;
-    for (unsigned char ch : data) {
-        crc = table[(crc ^ ch) & 0xFF] ^ (crc >> 8);
+// Airports whose name, city, country, IATA or ICAO code contains q
+static std::vector<Airport> match_airports(const AirTravelDB& db, const std::string& q) {
+    const std::string ql = lower(q);
+    std::vector<Airport> items;
+    for (const auto& ap : db.GetAllAirports()) {
+        if (lower(ap.name).find(ql) != std::string::npos || lower(ap.city).find(ql) != std::string::npos
+            || lower(ap.country).find(ql) != std::string::npos || lower(ap.iata).find(ql) != std::string::npos
+            || lower(ap.icao).find(ql) != std::string::npos) {
+            items.push_back(ap);
+        }
     }
-    return crc ^ 0xFFFFFFFFu;
+    return items;
+}
+
+// Unpaged suggestion order: the first `limit` by name
+template <class T>
+static void first_by_name(std::vector<T>& items, size_t limit) {
+    std::sort(items.begin(), items.end(), [](const T& a, const T& b) { return a.name < b.name; });
+    if (items.size() > limit) items.resize(limit);
 }
 
-static void write_le16(std::string& out, uint16_t value) {
-    out.push_back(static_cast<char>(value & 0xFF));
-    out.push_back(static_cast<char>((value >> 8) & 0xFF));
+static const RowSchema<Airline>::Projection& airline_suggest_cols() {
+    static const auto cols = Airline::Schema().Project({ "name", "iata", "icao" });
+    return cols;
 }
 
-static void write_le32(std::string& out, uint32_t value) {
-    out.push_back(static_cast<char>(value & 0xFF));
-    out.push_back(static_cast<char>((value >> 8) & 0xFF));
-    out.push_back(static_cast<char>((value >> 16) & 0xFF));
-    out.push_back(static_cast<char>((value >> 24) & 0xFF));
+static const RowSchema<Airport>::Projection& airport_suggest_cols() {
+    static const auto cols = Airport::Schema().Project({ "name", "city", "country", "iata", "icao" });
+    return cols;
 }
 
-struct ZipCentralEntry {
-    std::string name;
-    uint32_t crc;
-    uint32_t size;
-    uint32_t offset;
-};
-
-// Builds a minimal ZIP archive (stored entries only) directly in-memory so the
-// server can stream an attachment without touching disk.
-static std::string build_zip_from_files(const std::vector<std::string>& files) {
-    std::string zip;
-    std::vector<ZipCentralEntry> central_entries;
-    central_entries.reserve(files.size());
-
-    for (const auto& path : files) {
-        std::string data;
-        if (!read_file_strict(path, data)) {
-            return {};
-        }
-
-        const uint32_t offset = static_cast<uint32_t>(zip.size());
-        const uint32_t crc = crc32(data);
-        const uint32_t size = static_cast<uint32_t>(data.size());
-        const uint16_t name_len = static_cast<uint16_t>(path.size());
-
-        write_le32(zip, 0x04034b50);
-        write_le16(zip, 20);
-        write_le16(zip, 0);
-        write_le16(zip, 0);
-        write_le16(zip, 0);
-        write_le16(zip, 0);
-        write_le32(zip, crc);
-        write_le32(zip, size);
-        write_le32(zip, size);
-        write_le16(zip, name_len);
-        write_le16(zip, 0);
-        zip.append(path);
-        zip.append(data);
-
-        central_entries.push_back({ path, crc, size, offset });
+// The items array the suggest endpoints return for q, unpaged
+static std::string suggest_items(const AirTravelDB& db, const SuggestQuery& q) {
+    std::string out;
+    if (q.kind == "airline") {
+        auto items = q.q.empty() ? std::vector<Airline>() : match_airlines(db, q.q);
+        first_by_name(items, q.limit);
+        Airline::Schema().AppendJSONArray(out, items, airline_suggest_cols());
+    }
+    else {
+        auto items = q.q.empty() ? std::vector<Airport>() : match_airports(db, q.q);
+        first_by_name(items, q.limit);
+        Airport::Schema().AppendJSONArray(out, items, airport_suggest_cols());
     }
+    return out;
+}
 
-    const uint32_t central_dir_offset = static_cast<uint32_t>(zip.size());
-    std::string central_dir;
-    for (const auto& entry : central_entries) {
-        write_le32(central_dir, 0x02014b50);
-        write_le16(central_dir, 20);
-        write_le16(central_dir, 20);
-        write_le16(central_dir, 0);
-        write_le16(central_dir, 0);
-        write_le16(central_dir, 0);
-        write_le16(central_dir, 0);
-        write_le32(central_dir, entry.crc);
-        write_le32(central_dir, entry.size);
-        write_le32(central_dir, entry.size);
-        write_le16(central_dir, static_cast<uint16_t>(entry.name.size()));
-        write_le16(central_dir, 0);
-        write_le16(central_dir, 0);
-        write_le16(central_dir, 0);
-        write_le16(central_dir, 0);
-        write_le32(central_dir, 0);
-        write_le32(central_dir, entry.offset);
-        central_dir.append(entry.name);
+// Serves a pre-rendered report body: gzip when the client accepts it, 304
+// when If-None-Match matches the variant's validator. The body is shared, so
+// nothing is copied per request.
+static crow::response serve_prepared(const crow::request& req, const PreparedBody& p) {
+    const bool gz = p.gzip && AcceptsEncoding(req.get_header_value("Accept-Encoding"), "gzip");
+    const std::string& etag = gz ? p.gzip_etag : p.etag;
+    crow::response res;
+    res.add_header("Vary", "Accept-Encoding");
+    res.add_header("ETag", etag);
+    res.add_header("Cache-Control", "no-cache");
+    if (ResponseCacheMiddleware::ETagMatches(req.get_header_value("If-None-Match"), etag)) {
+        res.code = 304;
+        return res;
     }
+    res.add_header("Content-Type", p.content_type);
+    if (!p.disposition.empty()) res.add_header("Content-Disposition", p.disposition);
+    if (gz) res.add_header("Content-Encoding", "gzip");
+    res.shared_body = gz ? p.gzip : p.identity;
+    return res;
+}
 
-    zip.append(central_dir);
+// Serves a cached source artifact, from memory or (when spilled) from disk.
+static crow::response serve_artifact(const crow::request& req, const SourceBundle::Artifact& a,
+    const std::string& content_type) {
+    crow::response res;
+    res.add_header("ETag", a.etag);
+    res.add_header("Cache-Control", "no-cache");
+    if (ResponseCacheMiddleware::ETagMatches(req.get_header_value("If-None-Match"), a.etag)) {
+        res.code = 304;
+        return res;
+    }
+    if (a.body) {
+        res.add_header("Content-Type", content_type);
+        res.shared_body = a.body;
+    }
+    else {
+        res.set_static_file_info_unsafe(a.path, content_type);
+    }
+    return res;
+}
 
-    write_le32(zip, 0x06054b50);
-    write_le16(zip, 0);
-    write_le16(zip, 0);
-    write_le16(zip, static_cast<uint16_t>(central_entries.size()));
-    write_le16(zip, static_cast<uint16_t>(central_entries.size()));
-    write_le32(zip, static_cast<uint32_t>(central_dir.size()));
-    write_le32(zip, central_dir_offset);
-    write_le16(zip, 0);
+// ---------- snapshot placement ----------
+// Where each placed array landed, and what huge pages did to TLB misses
+// over the largest one (random reads, placed copy vs. its 4 KB-paged master).
+static void report_snapshot(const SnapshotPlacement& placement, const AirTravelDB& db, const Timetable& timetable) {
+    const auto& topo = NumaTopology::Get();
+    std::cout << "Snapshot placement:" << (placement.replicate ? " per-node copies," : " one copy,")
+        << (placement.pages == SnapshotPlacement::Pages::Explicit ? " explicit huge pages,"
+            : placement.pages == SnapshotPlacement::Pages::Transparent ? " transparent huge pages," : " 4 KB pages,")
+        << (placement.lock ? " mlocked" : " unlocked") << "; " << topo.Nodes() << " NUMA node(s)\n";
+    auto arrays = db.SnapshotArrays();
+    arrays.emplace_back("timetable connections", &timetable.SnapshotArray());
+    for (const auto& a : arrays) {
+        for (size_t i = 0; i < a.second->Copies(); ++i) {
+            const auto rep = a.second->Copy(i).Inspect();
+            std::cout << "  " << a.first << ", node " << rep.node << ": " << (rep.bytes + 1023) / 1024 << " KB, "
+                << rep.huge_bytes / 1024 << " KB on " << (rep.explicit_huge ? "explicit" : "transparent") << " huge pages";
+            if (rep.pages_sampled)
+                std::cout << ", " << rep.pages_on_node * 100 / rep.pages_sampled << "% of sampled pages on node";
+            if (placement.lock) std::cout << (rep.locked ? ", locked" : ", mlock failed");
+            std::cout << "\n";
+        }
+    }
+    const ReplicatedArray& conns = timetable.SnapshotArray();
+    if (!conns.Placed()) return;
+    const size_t bytes = conns.Copy(0).Bytes();
+    const TlbProbe before = ProbeRandomReads(timetable.ConnectionData(), bytes);
+    const TlbProbe after = ProbeRandomReads(conns.Copy(0).Data(), bytes);
+    auto fmt = [](double v) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.1f", v);
+        return std::string(buf);
+    };
+    std::cout << "  TLB probe over the timetable connections (" << bytes / 1024 << " KB, random reads): ";
+    if (before.counted && after.counted) {
+        std::cout << fmt(before.misses_per_1k) << " -> " << fmt(after.misses_per_1k) << " dTLB misses per 1k reads";
+        if (before.misses_per_1k > 0)
+            std::cout << " (" << static_cast<int>(100 - after.misses_per_1k * 100 / before.misses_per_1k) << "% fewer)";
+    }
+    else std::cout << "no PMU access, dTLB misses not counted";
+    std::cout << "; " << fmt(before.ns_per_read) << " -> " << fmt(after.ns_per_read) << " ns per read\n";
+}
 
-    return zip;
+// ---------- compute offload ----------
+// Runs the middlewares' after_handle for a response rendered off the io thread
+using FinishFn = std::function<void(crow::request&, crow::response&)>;
+
+// Connection response the current pool thread is rendering for, if any
+static thread_local crow::response* tl_rendering = nullptr;
+
+// Sends a response rendered off the io thread: runs the after_handle
+// passes on the calling thread, then hands the response to the
+// connection's io_context.
+static void deliver(const FinishFn& finish, const crow::request& req, crow::response& res,
+    std::shared_ptr<crow::response> out) {
+    // the connection leaves req alone until res.end()
+    finish(const_cast<crow::request&>(req), *out);
+    asio::post(*req.io_context, [&res, out] {
+        res = std::move(*out);
+        res.end();
+    });
 }
 
-static crow::response not_found(const std::string& msg = "Not found") {
-    return crow::response(404, msg);
+// Wraps a handler (request + route parameters -> response) so it renders on
+// `pool` instead of the io thread that read the request. The middlewares'
+// after_handle run on the pool as well, so admission slots and cache flights
+// are released without waiting for the io thread; the finished response is
+// then handed to the connection's io_context, where Crow's own after_handle
+// pass finds nothing left to do.
+template <typename... Args, typename Render>
+static auto offloaded(ComputePool& pool, FinishFn finish, Render render) {
+    return [&pool, finish, render](const crow::request& req, crow::response& res, Args... args) {
+        pool.Submit([finish, render, &req, &res, args...] {
+            auto out = std::make_shared<crow::response>();
+            tl_rendering = &res;
+            try {
+                *out = render(req, args...);
+            }
+            catch (const std::exception& e) {
+                CROW_LOG_ERROR << "handler for " << req.url << " threw: " << e.what();
+                *out = crow::response(500);
+            }
+            tl_rendering = nullptr;
+            deliver(finish, req, res, std::move(out));
+        });
+    };
 }
 
-// CSV escape helper: wrap fields with commas/quotes/newlines in double quotes,
-// and double-up any embedded quotes per RFC 4180.
-static std::string csv_escape(const std::string& s) {
-    bool need_quotes = s.find_first_of(",\"\n\r") != std::string::npos;
-    if (!need_quotes) return s;
-    std::string out;
-    out.reserve(s.size() + 2);
-    out.push_back('"');
-    for (char c : s) {
-        if (c == '"') out += "\"\"";
-        else out.push_back(c);
+// Flags a response built from a search the deadline cut short. The
+// response cache shares it with waiting requests but does not keep it.
+static void mark_partial(crow::response& res, const Deadline& deadline) {
+    if (deadline.Fired()) res.set_header("X-Partial-Result", deadline.Cancelled() ? "cancelled" : "deadline");
+}
+
+// ---------- dataset changes ----------
+// Admin endpoints answer loopback clients, or with ADMIN_TOKEN set any
+// client sending "Authorization: Bearer <token>".
+static bool admin_allowed(const crow::request& req, const std::string& token) {
+    if (!token.empty()) return req.get_header_value("Authorization") == "Bearer " + token;
+    const std::string& ip = req.remote_ip_address;
+    return ip == "127.0.0.1" || ip == "::1" || ip == "::ffff:127.0.0.1";
+}
+
+// Overwrites the fields of `row` named in a JSON object (schema field
+// names); false and `err` on an unknown name or a value of the wrong type.
+template <class T>
+static bool merge_json_row(const RowSchema<T>& schema, const crow::json::rvalue& obj, T& row, std::string& err) {
+    if (obj.t() != crow::json::type::Object) { err = "expected a JSON object"; return false; }
+    for (const auto& v : obj) {
+        const FieldDesc<T>* field = nullptr;
+        for (const auto& f : schema.Fields()) {
+            if (v.key() == f.name) { field = &f; break; }
+        }
+        if (!field) { err = "unknown field " + std::string(v.key()); return false; }
+        const bool number = v.t() == crow::json::type::Number;
+        switch (field->kind) {
+        case FieldKind::String:
+            if (v.t() != crow::json::type::String) { err = std::string(field->name) + " must be a string"; return false; }
+            row.*(field->str) = v.s();
+            break;
+        case FieldKind::Int:
+            if (!number || v.nt() == crow::json::num_type::Floating_point) { err = std::string(field->name) + " must be an integer"; return false; }
+            row.*(field->i32) = static_cast<int>(v.i());
+            break;
+        default:
+            if (!number) { err = std::string(field->name) + " must be a number"; return false; }
+            row.*(field->f64) = v.d();
+            break;
+        }
     }
-    out.push_back('"');
-    return out;
+    return true;
 }
 
+// Upper-cases a code the change sets (field `name` of `body`) and checks it
+// is `len` letters or digits, as in the .dat files; an empty icao code is
+// allowed.
+static bool normalize_code(const crow::json::rvalue& body, const char* name, std::string& code, size_t len, std::string& err) {
+    if (!body.has(name)) return true;
+    code = to_upper(code);
+    if (code.empty() && std::string(name) == "icao") return true;
+    const bool ok = code.size() == len &&
+        std::all_of(code.begin(), code.end(), [](unsigned char c) { return std::isalnum(c) != 0; });
+    if (!ok) err = std::string(name) + " must be " + std::to_string(len) + " letters or digits";
+    return ok;
+}
+
+// Wraps a handler that turns a request into a dataset change. Anything but
+// a 200 from it is answered as is. The change is then resolved and applied
+// on the dataset's reload thread (LiveDataset::Apply), so neither the io
+// thread nor the compute pool waits for the new version, and answered once
+// a version that includes it serves: the stored row (the handler's 200 for
+// a withdrawal), with that version's epoch in X-Dataset-Epoch. A change
+// that makes no valid row is a 400; one that clashes with the rows, or
+// whose version failed validation, a 409.
+using ChangeFn = std::function<crow::response(const crow::request&, DatasetChange&)>;
+
+static auto changing(LiveDataset& live, FinishFn finish, ChangeFn prepare) {
+    return [&live, finish, prepare](const crow::request& req, crow::response& res) {
+        DatasetChange change;
+        auto out = std::make_shared<crow::response>(prepare(req, change));
+        if (out->code != 200) {
+            res = std::move(*out);
+            res.end();
+            return;
+        }
+        live.Apply(change, [finish, &req, &res, out](const ChangeResult& result) {
+            const DatasetChange& c = result.applied;
+            std::string body;
+            switch (result.status) {
+            case ChangeResult::Status::Applied:
+                switch (c.kind) {
+                case DatasetChange::Kind::AddRoute: Route::Schema().AppendJSON(body, c.route); break;
+                case DatasetChange::Kind::UpsertAirport: Airport::Schema().AppendJSON(body, c.airport); break;
+                case DatasetChange::Kind::UpsertAirline: Airline::Schema().AppendJSON(body, c.airline); break;
+                case DatasetChange::Kind::WithdrawRoute: break;
+                }
+                if (!body.empty()) *out = json_response(std::move(body));
+                out->add_header("X-Dataset-Epoch", std::to_string(result.epoch));
+                break;
+            case ChangeResult::Status::Invalid: *out = crow::response(400, result.error); break;
+            case ChangeResult::Status::Conflict: *out = crow::response(409, result.error); break;
+            case ChangeResult::Status::Failed: *out = crow::response(409, "change rejected: " + result.error); break;
+            }
+            deliver(finish, req, res, out);
+        });
+    };
+}
 
 // ---------- main ----------
 int main() {
-    crow::SimpleApp app;
-    AirTravelDB db;
+    crow::App<CompressionMiddleware, ResponseCacheMiddleware, AdmissionMiddleware> app;
+    ResponseCache response_cache;
+
+    // Reports, exports and route searches render on the compute pool, so a
+    // slow one never holds up the other connections of its io thread.
+    // COMPUTE_THREADS=n sizes it (default: one per core), COMPUTE_CPUS=0-3
+    // pins the workers. Large scans inside one query are split over it
+    // too; PARALLEL_GRAIN=n sets the work per chunk (0 = never split).
+    const std::string compute_threads = read_env("COMPUTE_THREADS");
+    ComputePool compute(compute_threads.empty() ? 0u : static_cast<unsigned>(std::max(0, std::atoi(compute_threads.c_str()))),
+        ComputePool::ParseCpuList(read_env("COMPUTE_CPUS")));
+    const std::string grain = read_env("PARALLEL_GRAIN");
+
+    // The .dat files are loaded into one immutable dataset version, which
+    // POST /api/admin/reload, SIGHUP or (RELOAD_WATCH_MS=n) a change to the
+    // files replaces without downtime: the new version is built and checked
+    // in the background, then swapped in. Handlers pin the version they
+    // started on; it is freed after its last request is done with it.
+    // SNAPSHOT_PLACEMENT=numa,thp|explicit,mlock copies the arrays the hot
+    // queries scan into per-NUMA-node, huge-page backed, locked memory.
+    LiveDataset::Options dataset_opts;
+    dataset_opts.pool = &compute;
+    dataset_opts.grain = grain.empty() ? 16384 : static_cast<size_t>(std::max(0, std::atoi(grain.c_str())));
+    dataset_opts.placement = ParseSnapshotPlacement(read_env("SNAPSHOT_PLACEMENT"));
+    LiveDataset live(dataset_opts);
+    {
+        std::string error;
+        if (!live.Load(error)) {
+            std::cerr << "Dataset failed to load: " << error << "\n";
+            return 1;
+        }
+        if (dataset_opts.placement.Enabled()) {
+            auto snap = live.Get();
+            report_snapshot(dataset_opts.placement, snap->db, *snap->timetable);
+        }
+        live.ReloadOnHangup();
+        const int watch_ms = std::atoi(read_env("RELOAD_WATCH_MS").c_str());
+        if (watch_ms > 0) live.Watch(std::chrono::milliseconds(watch_ms));
+    }
 
-    // Load data (adjust paths if needed)
-    db.LoadAirlinesCSV("airlines.dat");
-    db.LoadAirportsCSV("airports.dat");
-    db.LoadRoutesCSV("routes.dat");
+    // Dataset-derived endpoints are cached per epoch and revalidated by ETag;
+    // concurrent misses for the same URL share one render
+    auto& cache_mw = app.get_middleware<ResponseCacheMiddleware>();
+    cache_mw.cache = &response_cache;
+
+    // SERVER_SHARDS=n (n >= 2) serves from n single-threaded listeners on
+    // the port (SO_REUSEPORT, Linux) instead of one acceptor feeding a
+    // thread pool. Shard i is pinned to SHARD_CPUS[i] (default: core i) and
+    // keeps its own slice of the cache budget; the dataset, the compute pool
+    // and admission control stay shared.
+    const unsigned shards = static_cast<unsigned>(std::max(0, std::atoi(read_env("SERVER_SHARDS").c_str())));
+    std::vector<std::unique_ptr<ResponseCache>> shard_caches;
+    std::vector<int> shard_cpus = ComputePool::ParseCpuList(read_env("SHARD_CPUS"));
+    if (shards > 1) {
+        ResponseCache::Options opts;
+        opts.capacity_bytes = response_cache.CapacityBytes() / shards;
+        opts.shards = 4;
+        for (unsigned i = 0; i < shards; ++i) shard_caches.emplace_back(new ResponseCache(opts));
+        if (shard_cpus.empty()) {
+            const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned i = 0; i < shards; ++i) shard_cpus.push_back(static_cast<int>(i % cores));
+        }
+    }
+    auto cache_stats = [&response_cache, &shard_caches] {
+        ResponseCache::Stats st = response_cache.GetStats();
+        for (const auto& c : shard_caches) st += c->GetStats();
+        return st;
+    };
+    cache_mw.epoch = [&live] { return live.Epoch(); };
+    cache_mw.prefixes = {
+        "/airline/", "/airport/", "/api/airline/", "/api/airlines/suggest", "/api/airports/suggest",
+        "/report/", "/onehop/", "/routes/", "/paths/", "/itinerary/",
+        "/api/routes", "/api/equipment", "/api/metro"
+    };
+
+    // Responses the handlers leave unencoded are gzipped on the way out.
+    // Cached bodies are compressed once and remembered, so they can afford
+    // a high level; streamed lists are compressed anew on every request.
+    auto& compress_mw = app.get_middleware<CompressionMiddleware>();
+    compress_mw.levels = {
+        { "/report/", 9 }, { "/api/airlines/suggest", 9 }, { "/api/airports/suggest", 9 },
+        { "/api/routes", 4 }, { "/api/equipment/", 4 }, { "/onehop/", 4 }
+    };
+
+    // Requests that get past the cache are admitted per class. Queued
+    // requests are parked without a thread, but a running one may hold its
+    // io thread, so the limits follow the io threads actually serving (one
+    // per shard, or concurrency() - 1 behind a single acceptor) and lookups
+    // never wait behind a report burst.
+    // CLIENT_RPS=n also limits each client to n requests per second.
+    auto& admission_mw = app.get_middleware<AdmissionMiddleware>();
+    {
+        const unsigned threads = shards > 1 ? shards : std::max(2u, std::thread::hardware_concurrency()) - 1;
+        const unsigned heavy = std::max(1u, threads / 8), suggest = std::max(1u, threads / 4);
+        admission_mw.AddClass({ "lookup", {}, 0, 0, std::chrono::milliseconds(0), 1, {} });
+        admission_mw.AddClass({ "suggest", { "/api/airlines/suggest", "/api/airports/suggest" },
+            suggest, suggest, std::chrono::milliseconds(100), 0.5, {} });
+        admission_mw.AddClass({ "report", { "/report/", "/export/", "/download/", "/api/source-code", "/api/batch" },
+            heavy, heavy, std::chrono::milliseconds(1000), 4, {} });
+        admission_mw.AddClass({ "path", { "/onehop/", "/paths/", "/itinerary/", "/routes/", "/api/routes", "/api/equipment/" },
+            heavy, heavy, std::chrono::milliseconds(500), 2, {} });
+        // dataset changes wait for a rebuild without holding a thread, and
+        // the ones arriving meanwhile share the next: no slot to wait for
+        admission_mw.AddClass({ "change", { "/api/routes", "/api/airports", "/api/airlines", "/api/admin/" },
+            0, 0, std::chrono::milliseconds(0), 1, { crow::HTTPMethod::Post, crow::HTTPMethod::Delete } });
+        const std::string rps = read_env("CLIENT_RPS");
+        if (!rps.empty()) {
+            admission_mw.client_rate = std::atof(rps.c_str());
+            admission_mw.client_burst = std::max(admission_mw.client_rate * 4, 20.0);
+        }
+    }
+
+    FinishFn finish = [&app](crow::request& req, crow::response& res) {
+        // Crow's order: last registered first
+        app.get_middleware<AdmissionMiddleware>().after_handle(req, res, app.get_context<AdmissionMiddleware>(req));
+        app.get_middleware<ResponseCacheMiddleware>().after_handle(req, res, app.get_context<ResponseCacheMiddleware>(req));
+        app.get_middleware<CompressionMiddleware>().after_handle(req, res, app.get_context<CompressionMiddleware>(req));
+    };
+
+    // Streamed bodies are encoded (and compressed) chunk by chunk on the
+    // pool; the io threads only write them out.
+    app.stream_executor([&compute](std::function<void()> pull) { compute.Submit(std::move(pull)); });
+
+    // Budget for a search: ?timeout_ms= (1..60000) or the route's default.
+    // An offloaded search is also abandoned once its client disconnects,
+    // unless other requests are waiting on the same render.
+    auto deadline_for = [&app](const crow::request& req, int default_ms) {
+        int ms = default_ms;
+        if (auto p = req.url_params.get("timeout_ms")) ms = std::max(1, std::min(60000, std::atoi(p)));
+        crow::response* res = tl_rendering;
+        if (!res) return Deadline(std::chrono::milliseconds(ms));
+        const auto& cache_ctx = app.get_context<ResponseCacheMiddleware>(req);
+        auto flight = cache_ctx.flight;
+        ResponseCache* cache = cache_ctx.cache;
+        return Deadline(std::chrono::milliseconds(ms), [res, flight, cache] {
+            return !res->is_alive() && !(flight && cache->HasFollowers(flight));
+        });
+    };
+
+    // Source downloads are rebuilt only when one of the files changes
+    SourceBundle sources(
+        { "server.cpp", "airdp.cpp", "airdb.h", "index.html", "style.css", "app.js" },
+        { "server.cpp", "airdb.h", "airdp.cpp", "index.html", "style.css" });
 
     // ---------- Static files ----------
+    // Read once into memory (re-read when the file changes on disk)
+    StaticAssets assets;
+    assets.Add("/static/style.css", "style.css", "text/css; charset=utf-8");
+    assets.Add("/static/app.js", "app.js", "application/javascript; charset=utf-8");
+    assets.Add("/", "index.html", "text/html; charset=utf-8", true);
+    assets.Load();
+
     CROW_ROUTE(app, "/")
-        ([] {
-        auto html = read_file("index.html");
-        if (html.empty()) return crow::response(500, "index.html missing");
-        crow::response res{ html };
-        res.add_header("Content-Type", "text/html; charset=utf-8");
-        return res;
+        ([&assets](const crow::request& req) {
+        auto html = assets.Get("/");
+        if (!html) return crow::response(500, "index.html missing");
+        return assets.Serve(req, *html);
             });
 
     CROW_ROUTE(app, "/static/style.css")
-        ([] {
-        auto css = read_file("style.css");
-        if (css.empty()) return crow::response(404);
-        crow::response res{ css };
-        res.add_header("Content-Type", "text/css; charset=utf-8");
-        return res;
+        ([&assets](const crow::request& req) {
+        auto css = assets.Get("/static/style.css");
+        if (!css) return crow::response(404);
+        return assets.Serve(req, *css);
             });
 
     CROW_ROUTE(app, "/static/app.js")
-        ([] {
-        auto js = read_file("app.js");
-        if (js.empty()) return crow::response(404);
-        crow::response res{ js };
-        res.add_header("Content-Type", "application/javascript; charset=utf-8");
-        return res;
+        ([&assets](const crow::request& req) {
+        auto js = assets.Get("/static/app.js");
+        if (!js) return crow::response(404);
+        return assets.Serve(req, *js);
             });
 
     CROW_ROUTE(app, "/download/source")
-        ([] {
-        const std::vector<std::string> files = {
-            "server.cpp",
-            "airdp.cpp",
-            "airdb.h",
-            "index.html",
-            "style.css",
-            "app.js"
-        };
-        auto zipped = build_zip_from_files(files);
-        if (zipped.empty()) {
+        ([&sources](const crow::request& req) {
+        // ?deflate=1 compresses the entries; the default stays stored
+        const char* deflate = req.url_params.get("deflate");
+        auto zipped = sources.Zip(deflate && std::string(deflate) == "1");
+        if (!zipped) {
             return crow::response(500, "Source zip unavailable");
         }
-        crow::response res{ zipped };
-        res.add_header("Content-Type", "application/zip");
-        res.add_header("Content-Disposition", "attachment; filename=\"air-travel-source.zip\"");
+        auto res = serve_artifact(req, *zipped, "application/zip");
+        if (res.code == 200) res.add_header("Content-Disposition", "attachment; filename=\"air-travel-source.zip\"");
         return res;
             });
 
+    // ---------- Autocomplete channel (WebSocket) ----------
+    // One connection per input box; superseded keystrokes are dropped
+    // before they run (see SuggestChannel)
+    SuggestChannel suggest_channel([&live](const SuggestQuery& q) { return suggest_items(live.Get()->db, q); });
+
+    CROW_WEBSOCKET_ROUTE(app, "/ws/suggest")
+        .max_payload(4096)
+        .onopen([&suggest_channel](crow::websocket::connection& conn) {
+        suggest_channel.Open(conn);
+            })
+        .onmessage([&suggest_channel](crow::websocket::connection& conn, const std::string& data, bool /*is_binary*/) {
+        suggest_channel.Message(conn, data);
+            })
+        .onclose([&suggest_channel](crow::websocket::connection& conn, const std::string& /*reason*/, uint16_t /*code*/) {
+        suggest_channel.Close(conn);
+            });
+
     // ---------- Section III.1: Individual Entity Retrieval ----------
 
     // 1.1: Airline lookup by IATA (flexible: also supports ICAO and name search)
     CROW_ROUTE(app, "/airline/<string>")
-        ([&db](const std::string& term) {
+        ([&live](const std::string& term) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        std::string out;
         // Try IATA first
         if (auto a = db.GetAirlineByIATA(term)) {
-            return crow::response(a->toJSON());
+            Airline::Schema().AppendJSON(out, *a);
+            return json_response(std::move(out));
         }
         // Try ICAO if term is 3 characters
         if (term.size() == 3) {
             if (auto a = db.GetAirlineByICAO(term)) {
-                return crow::response(a->toJSON());
+                Airline::Schema().AppendJSON(out, *a);
+                return json_response(std::move(out));
             }
         }
         // Fallback: search by name (case-insensitive)
@@ -262,11 +679,8 @@ int main() {
             std::string name = a.name;
             std::transform(name.begin(), name.end(), name.begin(), ::tolower);
             if (name.find(ql) != std::string::npos) {
-                crow::json::wvalue j;
-                j["id"] = a.id; j["name"] = a.name; j["alias"] = a.alias;
-                j["iata"] = a.iata; j["icao"] = a.icao;
-                j["callsign"] = a.callsign; j["country"] = a.country; j["active"] = a.active;
-                return crow::response(j);
+                Airline::Schema().AppendJSON(out, a);
+                return json_response(std::move(out));
             }
         }
         return not_found("Airline not found");
@@ -274,66 +688,80 @@ int main() {
 
     // Explicit ICAO endpoint for autocomplete
     CROW_ROUTE(app, "/api/airline/by-icao/<string>")
-        ([&db](const std::string& icao) {
+        ([&live](const std::string& icao) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
         if (auto a = db.GetAirlineByICAO(icao)) {
-            return crow::response(a->toJSON());
+            std::string out;
+            Airline::Schema().AppendJSON(out, *a);
+            return json_response(std::move(out));
         }
         return crow::response(404);
             });
 
     // Airline suggestions for autocomplete
     CROW_ROUTE(app, "/api/airlines/suggest")
-        ([&db](const crow::request& req) {
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        static const JsonObjectLayout layout({ "items" });
+        PageRequest page;
+        RowSchema<Airline>::Projection proj;
+        crow::response err;
+        if (!parse_page(req, 2, Airline::Schema(), airline_suggest_cols(), page, proj, err)) return err;
         auto qit = req.url_params.get("q");
-        int limit = 10;
-        crow::json::wvalue out;
-        out["items"] = crow::json::wvalue::list();
-        if (!qit || std::string(qit).empty()) return crow::response(out);
-
-        std::string q = qit;
-        std::string ql = q; std::transform(ql.begin(), ql.end(), ql.begin(), ::tolower);
-
-        auto all = db.GetAllAirlines();
-        struct Item { std::string name, iata, icao; };
-        std::vector<Item> items;
-        items.reserve(all.size());
-        for (const auto& a : all) {
-            std::string nm = a.name, ia = a.iata, ic = a.icao;
-            std::string nm_l = nm; std::transform(nm_l.begin(), nm_l.end(), nm_l.begin(), ::tolower);
-            std::string ia_l = ia; std::transform(ia_l.begin(), ia_l.end(), ia_l.begin(), ::tolower);
-            std::string ic_l = ic; std::transform(ic_l.begin(), ic_l.end(), ic_l.begin(), ::tolower);
-            if (nm_l.find(ql) != std::string::npos || ia_l.find(ql) != std::string::npos || ic_l.find(ql) != std::string::npos) {
-                items.push_back({ nm, ia, ic });
+        const size_t limit = page.LimitOr(10);
+        std::string next;
+        std::vector<Airline> items;
+        if (qit && !std::string(qit).empty()) {
+            items = match_airlines(db, qit);
+            if (!page.paged) {
+                first_by_name(items, limit);
+            }
+            else {
+                // keyset order (name, id); only the page itself gets sorted
+                auto less = [](const Airline& a, const Airline& b) {
+                    return std::tie(a.name, a.id) < std::tie(b.name, b.id);
+                };
+                if (page.has_cursor) {
+                    Airline after;
+                    after.name = page.after.Str(0);
+                    after.id = static_cast<int>(page.after.Int(1));
+                    items.erase(std::remove_if(items.begin(), items.end(),
+                        [&](const Airline& x) { return !less(after, x); }), items.end());
+                }
+                if (TakePage(items, limit, less))
+                    next = PageCursor().Add(items.back().name).Add(items.back().id).Encode();
             }
         }
-        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
-            return a.name < b.name;
-            });
-        if ((int)items.size() > limit) items.resize(limit);
 
-        for (size_t i = 0; i < items.size(); ++i) {
-            crow::json::wvalue it;
-            it["name"] = items[i].name;
-            it["iata"] = items[i].iata;
-            it["icao"] = items[i].icao;
-            out["items"][i] = std::move(it);
-        }
-        return crow::response(out);
+        std::string out;
+        layout.Write(out, [&](std::string& o, size_t) { Airline::Schema().AppendJSONArray(o, items, proj); });
+        auto res = json_response(std::move(out));
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
             });
 
     // 1.2: Airport lookup by IATA (flexible: also supports ID, ICAO, and name/city search)
     CROW_ROUTE(app, "/airport/<string>")
-        ([&db](const std::string& term) {
+        ([&live](const std::string& term) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        auto found = [](const Airport& ap) {
+            std::string out;
+            Airport::Schema().AppendJSON(out, ap);
+            return json_response(std::move(out));
+        };
         // Try numeric ID
         if (!term.empty() && std::all_of(term.begin(), term.end(), ::isdigit)) {
             int id = std::stoi(term);
-            if (auto ap = db.GetAirportByID(id)) return crow::response(ap->toJSON());
+            if (auto ap = db.GetAirportByID(id)) return found(*ap);
         }
         // Try IATA
-        if (auto ap = db.GetAirportByIATA(term)) return crow::response(ap->toJSON());
+        if (auto ap = db.GetAirportByIATA(term)) return found(*ap);
         // Try ICAO if 4 characters
         if (term.size() == 4) {
-            if (auto ap = db.GetAirportByICAO(term)) return crow::response(ap->toJSON());
+            if (auto ap = db.GetAirportByICAO(term)) return found(*ap);
         }
         // Fallback: search by name or city
         auto all = db.GetAllAirports();
@@ -343,8 +771,7 @@ int main() {
             std::transform(nm.begin(), nm.end(), nm.begin(), ::tolower);
             std::transform(ct.begin(), ct.end(), ct.begin(), ::tolower);
             if (nm.find(ql) != std::string::npos || ct.find(ql) != std::string::npos) {
-                crow::json::wvalue j = ap.toJSON();
-                return crow::response(j);
+                return found(ap);
             }
         }
         return not_found("Airport not found");
@@ -352,292 +779,212 @@ int main() {
 
     // Airport suggestions for autocomplete
     CROW_ROUTE(app, "/api/airports/suggest")
-        ([&db](const crow::request& req) {
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        static const JsonObjectLayout layout({ "items" });
+        PageRequest page;
+        RowSchema<Airport>::Projection proj;
+        crow::response err;
+        if (!parse_page(req, 2, Airport::Schema(), airport_suggest_cols(), page, proj, err)) return err;
         auto qit = req.url_params.get("q");
-        int limit = 10;
-        crow::json::wvalue out;
-        out["items"] = crow::json::wvalue::list();
-        if (!qit || std::string(qit).empty()) return crow::response(out);
-
-        std::string q = qit;
-        std::string ql = q; std::transform(ql.begin(), ql.end(), ql.begin(), ::tolower);
-
-        auto all = db.GetAllAirports();
-        struct Item { std::string name, city, country, iata, icao; };
-        std::vector<Item> items;
-        items.reserve(all.size());
-        for (const auto& ap : all) {
-            std::string name = ap.name, city = ap.city, country = ap.country, iata = ap.iata, icao = ap.icao;
-            std::string n = name; std::transform(n.begin(), n.end(), n.begin(), ::tolower);
-            std::string c = city; std::transform(c.begin(), c.end(), c.begin(), ::tolower);
-            std::string co = country; std::transform(co.begin(), co.end(), co.begin(), ::tolower);
-            std::string ia = iata; std::transform(ia.begin(), ia.end(), ia.begin(), ::tolower);
-            std::string ic = icao; std::transform(ic.begin(), ic.end(), ic.begin(), ::tolower);
-            if (n.find(ql) != std::string::npos || c.find(ql) != std::string::npos || co.find(ql) != std::string::npos
-                || ia.find(ql) != std::string::npos || ic.find(ql) != std::string::npos) {
-                items.push_back({ name, city, country, iata, icao });
+        const size_t limit = page.LimitOr(10);
+        std::string next;
+        std::vector<Airport> items;
+        if (qit && !std::string(qit).empty()) {
+            items = match_airports(db, qit);
+            if (!page.paged) {
+                first_by_name(items, limit);
+            }
+            else {
+                // keyset order (name, id); only the page itself gets sorted
+                auto less = [](const Airport& a, const Airport& b) {
+                    return std::tie(a.name, a.id) < std::tie(b.name, b.id);
+                };
+                if (page.has_cursor) {
+                    Airport after;
+                    after.name = page.after.Str(0);
+                    after.id = static_cast<int>(page.after.Int(1));
+                    items.erase(std::remove_if(items.begin(), items.end(),
+                        [&](const Airport& x) { return !less(after, x); }), items.end());
+                }
+                if (TakePage(items, limit, less))
+                    next = PageCursor().Add(items.back().name).Add(items.back().id).Encode();
             }
         }
-        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
-            return a.name < b.name;
-            });
-        if ((int)items.size() > limit) items.resize(limit);
 
-        for (size_t i = 0; i < items.size(); ++i) {
-            crow::json::wvalue it;
-            it["name"] = items[i].name; it["city"] = items[i].city; it["country"] = items[i].country;
-            it["iata"] = items[i].iata; it["icao"] = items[i].icao;
-            out["items"][i] = std::move(it);
-        }
-        return crow::response(out);
+        std::string out;
+        layout.Write(out, [&](std::string& o, size_t) { Airport::Schema().AppendJSONArray(o, items, proj); });
+        auto res = json_response(std::move(out));
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
             });
 
     // ---------- Section III.2.1.a: Airline -> Airports Report (ordered by # routes) ----------
 
     // JSON version
     CROW_ROUTE(app, "/report/airline/<string>/airports-by-routes.json")
-        ([&db](const std::string& airline_iata) {
-        auto routes = db.SearchRoutes(airline_iata);
-        std::unordered_map<std::string, int> counts;
-        for (const auto& r : routes) {
-            if (r.airline_iata != airline_iata) continue;
-            ++counts[r.src_iata];
-            ++counts[r.dst_iata];
-        }
-
-        struct Row { std::string iata; std::string name; int n; };
-        std::vector<Row> rows; rows.reserve(counts.size());
-        for (auto& kv : counts) {
-            auto ap = db.GetAirportByIATA(kv.first);
-            rows.push_back({ kv.first, ap ? ap->name : std::string{}, kv.second });
-        }
-
-        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
-            if (a.n != b.n) return a.n > b.n;
-            return a.iata < b.iata;
-            });
-
-        std::string airline_name;
-        if (auto a = db.GetAirlineByIATA(airline_iata)) airline_name = a->name;
-
-        crow::json::wvalue out;
-        out["airline_iata"] = airline_iata;
-        out["airline_name"] = airline_name;
-        out["items"] = crow::json::wvalue::list();
-        unsigned idx = 0;
-        for (auto& r : rows) {
-            crow::json::wvalue it;
-            it["airport_iata"] = r.iata;
-            it["airport_name"] = r.name;
-            it["routes_count"] = r.n;
-            out["items"][idx++] = std::move(it);
-        }
-        return crow::response(out);
-            });
+        (offloaded<std::string>(compute, finish, [&live](const crow::request& req, const std::string& airline_iata) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<RouteCountRow>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, AirportCountSchema(), AirportCountSchema().All(), page, cols, err)) return err;
+        std::string next;
+        auto res = stream_response(AirlineAirportsJSON(db, airline_iata, page, &cols, &next), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
+            }));
 
     // CSV version
     CROW_ROUTE(app, "/report/airline/<string>/airports-by-routes.csv")
-        ([&db](const std::string& airline_iata) {
-        auto routes = db.SearchRoutes(airline_iata);
-        std::unordered_map<std::string, int> counts;
-        for (const auto& r : routes) {
-            if (r.airline_iata != airline_iata) continue;
-            ++counts[r.src_iata];
-            ++counts[r.dst_iata];
-        }
-        struct Row { std::string iata; std::string name; int n; };
-        std::vector<Row> rows; rows.reserve(counts.size());
-        for (auto& kv : counts) {
-            auto ap = db.GetAirportByIATA(kv.first);
-            rows.push_back({ kv.first, ap ? ap->name : std::string{}, kv.second });
-        }
-        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
-            if (a.n != b.n) return a.n > b.n;
-            return a.iata < b.iata;
-            });
-
-        std::ostringstream ss;
-        ss << "airport_iata,airport_name,routes_count\r\n";
-        for (auto& r : rows) {
-            ss << csv_escape(r.iata) << ','
-                << csv_escape(r.name) << ','
-                << r.n << "\r\n";
-        }
-        crow::response res{ ss.str() };
-        res.add_header("Content-Type", "text/csv; charset=utf-8");
+        (offloaded<std::string>(compute, finish, [&live](const crow::request& req, const std::string& airline_iata) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<RouteCountRow>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, AirportCountSchema(), AirportCountSchema().All(), page, cols, err)) return err;
+        std::string next;
+        auto res = stream_response(AirlineAirportsCSV(db, airline_iata, page, &cols, &next), "text/csv; charset=utf-8");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
         res.add_header("Content-Disposition", "attachment; filename=\"airline_" + airline_iata + "_airports.csv\"");
         return res;
-            });
+            }));
 
     // ---------- Section III.2.1.b: Airport -> Airlines Report (ordered by # routes) ----------
 
     // JSON version
     CROW_ROUTE(app, "/report/airport/<string>/airlines-by-routes.json")
-        ([&db](const std::string& airport_iata) {
-        auto routes = db.SearchRoutes(airport_iata);
-        std::unordered_map<std::string, int> counts;
-        for (const auto& r : routes) {
-            if (r.src_iata == airport_iata || r.dst_iata == airport_iata) {
-                ++counts[r.airline_iata];
-            }
-        }
-
-        struct Row { std::string iata; std::string name; int n; };
-        std::vector<Row> rows; rows.reserve(counts.size());
-        for (auto& kv : counts) {
-            auto al = db.GetAirlineByIATA(kv.first);
-            rows.push_back({ kv.first, al ? al->name : std::string{}, kv.second });
-        }
-        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
-            if (a.n != b.n) return a.n > b.n;
-            return a.iata < b.iata;
-            });
-
-        std::string airport_name;
-        if (auto ap = db.GetAirportByIATA(airport_iata)) airport_name = ap->name;
-
-        crow::json::wvalue out;
-        out["airport_iata"] = airport_iata;
-        out["airport_name"] = airport_name;
-        out["items"] = crow::json::wvalue::list();
-        unsigned idx = 0;
-        for (auto& r : rows) {
-            crow::json::wvalue it;
-            it["airline_iata"] = r.iata;
-            it["airline_name"] = r.name;
-            it["routes_count"] = r.n;
-            out["items"][idx++] = std::move(it);
-        }
-        return crow::response(out);
-            });
+        (offloaded<std::string>(compute, finish, [&live](const crow::request& req, const std::string& airport_iata) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<RouteCountRow>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, AirlineCountSchema(), AirlineCountSchema().All(), page, cols, err)) return err;
+        std::string next;
+        auto res = stream_response(AirportAirlinesJSON(db, airport_iata, page, &cols, &next), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
+            }));
 
     // CSV version
     CROW_ROUTE(app, "/report/airport/<string>/airlines-by-routes.csv")
-        ([&db](const std::string& airport_iata) {
-        auto routes = db.SearchRoutes(airport_iata);
-        std::unordered_map<std::string, int> counts;
-        for (const auto& r : routes) {
-            if (r.src_iata == airport_iata || r.dst_iata == airport_iata) {
-                ++counts[r.airline_iata];
-            }
-        }
-        struct Row { std::string iata; std::string name; int n; };
-        std::vector<Row> rows; rows.reserve(counts.size());
-        for (auto& kv : counts) {
-            auto al = db.GetAirlineByIATA(kv.first);
-            rows.push_back({ kv.first, al ? al->name : std::string{}, kv.second });
-        }
-        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
-            if (a.n != b.n) return a.n > b.n;
-            return a.iata < b.iata;
-            });
-
-        std::ostringstream ss;
-        ss << "airline_iata,airline_name,routes_count\r\n";
-        for (auto& r : rows) {
-            ss << csv_escape(r.iata) << ','
-                << csv_escape(r.name) << ','
-                << r.n << "\r\n";
-        }
-        crow::response res{ ss.str() };
-        res.add_header("Content-Type", "text/csv; charset=utf-8");
+        (offloaded<std::string>(compute, finish, [&live](const crow::request& req, const std::string& airport_iata) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<RouteCountRow>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, AirlineCountSchema(), AirlineCountSchema().All(), page, cols, err)) return err;
+        std::string next;
+        auto res = stream_response(AirportAirlinesCSV(db, airport_iata, page, &cols, &next), "text/csv; charset=utf-8");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
         res.add_header("Content-Disposition", "attachment; filename=\"airport_" + airport_iata + "_airlines.csv\"");
         return res;
-            });
+            }));
 
     // ---------- Section III.2.2: Reports Ordered by IATA Code ----------
 
     // 2.2.a: All Airlines ordered by IATA - JSON
     CROW_ROUTE(app, "/report/airlines/by-iata.json")
-        ([&db] {
-        auto all = db.GetAllAirlines();
-        std::sort(all.begin(), all.end(), [](const Airline& a, const Airline& b) {
-            const bool ae = a.iata.empty() || a.iata == "\\N";
-            const bool be = b.iata.empty() || b.iata == "\\N";
-            if (ae != be) return !ae;
-            return a.iata < b.iata;
-            });
-        crow::json::wvalue arr = crow::json::wvalue::list();
-        for (const auto& a : all) {
-            crow::json::wvalue j;
-            j["iata"] = a.iata; j["icao"] = a.icao; j["name"] = a.name;
-            j["alias"] = a.alias; j["country"] = a.country; j["active"] = a.active;
-            arr[arr.size()] = std::move(j);
-        }
-        return crow::response(arr);
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<Airline>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, Airline::Schema(), AirlineReportColumns(), page, cols, err)) return err;
+        if (!page.paged && page.fields.empty())
+            return serve_prepared(req, *snap->reports.Get(PreparedReports::AirlinesJSON, db));
+        std::string next;
+        auto res = stream_response(AirlinesByIata(db, false, page, cols, &next), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
             });
 
     // 2.2.a: All Airlines ordered by IATA - CSV
     CROW_ROUTE(app, "/report/airlines/by-iata.csv")
-        ([&db] {
-        auto all = db.GetAllAirlines();
-        std::sort(all.begin(), all.end(), [](const Airline& a, const Airline& b) {
-            const bool ae = a.iata.empty() || a.iata == "\\N";
-            const bool be = b.iata.empty() || b.iata == "\\N";
-            if (ae != be) return !ae;
-            return a.iata < b.iata;
-            });
-        std::ostringstream ss;
-        ss << "iata,icao,name,alias,country,active\r\n";
-        for (const auto& a : all) {
-            ss << csv_escape(a.iata) << ','
-                << csv_escape(a.icao) << ','
-                << csv_escape(a.name) << ','
-                << csv_escape(a.alias) << ','
-                << csv_escape(a.country) << ','
-                << csv_escape(a.active) << "\r\n";
-        }
-        crow::response res{ ss.str() };
-        res.add_header("Content-Type", "text/csv; charset=utf-8");
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<Airline>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, Airline::Schema(), AirlineReportColumns(), page, cols, err)) return err;
+        if (!page.paged && page.fields.empty())
+            return serve_prepared(req, *snap->reports.Get(PreparedReports::AirlinesCSV, db));
+        std::string next;
+        auto res = stream_response(AirlinesByIata(db, true, page, cols, &next), "text/csv; charset=utf-8");
         res.add_header("Content-Disposition", "attachment; filename=\"all_airlines_by_iata.csv\"");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
         return res;
             });
 
     // 2.2.b: All Airports ordered by IATA - JSON
     CROW_ROUTE(app, "/report/airports/by-iata.json")
-        ([&db] {
-        auto all = db.GetAllAirports();
-        std::sort(all.begin(), all.end(), [](const Airport& a, const Airport& b) {
-            const bool ae = a.iata.empty() || a.iata == "\\N";
-            const bool be = b.iata.empty() || b.iata == "\\N";
-            if (ae != be) return !ae;
-            return a.iata < b.iata;
-            });
-        crow::json::wvalue arr = crow::json::wvalue::list();
-        for (const auto& ap : all) {
-            crow::json::wvalue j = ap.toJSON();
-            arr[arr.size()] = std::move(j);
-        }
-        return crow::response(arr);
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<Airport>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, Airport::Schema(), Airport::Schema().All(), page, cols, err)) return err;
+        if (!page.paged && page.fields.empty())
+            return serve_prepared(req, *snap->reports.Get(PreparedReports::AirportsJSON, db));
+        std::string next;
+        auto res = stream_response(AirportsByIata(db, false, page, cols, &next), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
             });
 
     // 2.2.b: All Airports ordered by IATA - CSV
     CROW_ROUTE(app, "/report/airports/by-iata.csv")
-        ([&db] {
-        auto all = db.GetAllAirports();
-        std::sort(all.begin(), all.end(), [](const Airport& a, const Airport& b) {
-            const bool ae = a.iata.empty() || a.iata == "\\N";
-            const bool be = b.iata.empty() || b.iata == "\\N";
-            if (ae != be) return !ae;
-            return a.iata < b.iata;
-            });
-        std::ostringstream ss;
-        ss << "iata,icao,name,city,country,latitude,longitude\r\n";
-        for (const auto& ap : all) {
-            ss << csv_escape(ap.iata) << ','
-                << csv_escape(ap.icao) << ','
-                << csv_escape(ap.name) << ','
-                << csv_escape(ap.city) << ','
-                << csv_escape(ap.country) << ','
-                << ap.latitude << ','
-                << ap.longitude << "\r\n";
-        }
-        crow::response res{ ss.str() };
-        res.add_header("Content-Type", "text/csv; charset=utf-8");
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<Airport>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 2, Airport::Schema(), AirportReportCsvColumns(), page, cols, err)) return err;
+        if (!page.paged && page.fields.empty())
+            return serve_prepared(req, *snap->reports.Get(PreparedReports::AirportsCSV, db));
+        std::string next;
+        auto res = stream_response(AirportsByIata(db, true, page, cols, &next), "text/csv; charset=utf-8");
         res.add_header("Content-Disposition", "attachment; filename=\"all_airports_by_iata.csv\"");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
         return res;
             });
 
+    // ---------- Bulk Exports (Arrow IPC file format) ----------
+    // /export/airports.arrow, /export/airlines.arrow, /export/routes.arrow
+    CROW_ROUTE(app, "/export/<string>")
+        (offloaded<std::string>(compute, finish, [&live](const crow::request& req, const std::string& name) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        const std::string ext = ".arrow";
+        if (name.size() <= ext.size() || name.compare(name.size() - ext.size(), ext.size(), ext) != 0) {
+            return not_found("Unknown export");
+        }
+        const std::string table = name.substr(0, name.size() - ext.size());
+        auto file = snap->exports.Get(table, db);
+        if (!file) return not_found("Unknown export");
+
+        crow::response res;
+        res.add_header("ETag", file->etag);
+        res.add_header("Cache-Control", "no-cache");
+        if (ResponseCacheMiddleware::ETagMatches(req.get_header_value("If-None-Match"), file->etag)) {
+            res.code = 304;
+            return res;
+        }
+        res.add_header("Content-Type", "application/vnd.apache.arrow.file");
+        res.add_header("Content-Disposition", "attachment; filename=\"" + table + ".arrow\"");
+        res.shared_body = file->body;
+        return res;
+            }));
+
     // ---------- Section III.2.3: Student ID ----------
     CROW_ROUTE(app, "/api/student-id")
         ([] {
@@ -654,11 +1001,17 @@ int main() {
 
     // ---------- Section IV.3: One-Hop Routes (EXTRA CREDIT) ----------
     CROW_ROUTE(app, "/onehop/<string>/<string>")
-        ([&db](const std::string& src, const std::string& dst) -> crow::response {
+        (offloaded<std::string, std::string>(compute, finish, [&live, &deadline_for](const crow::request& req, const std::string& src, const std::string& dst) -> crow::response {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<OneHopRoute>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 3, OneHopRoute::Schema(), OneHopRoute::Schema().All(), page, cols, err)) return err;
+
         // Disallow same src/dst
         if (src == dst) {
-            crow::json::wvalue arr = crow::json::wvalue::list();
-            return crow::response(arr);
+            return json_response("[]");
         }
 
         auto src_ap = db.GetAirportByIATA(src);
@@ -667,119 +1020,655 @@ int main() {
             return not_found("Source or destination airport not found");
         }
 
-        // Find first-leg candidates from src with 0 stops
-        std::vector<Route> from_src;
-        {
-            auto routes = db.SearchRoutes(src);
-            for (const auto& r : routes) {
-                if (r.src_iata == src && r.dst_iata != dst && r.stops == 0) {
-                    from_src.push_back(r);
-                }
+        auto deadline = deadline_for(req, 2000);
+        auto matches = std::make_shared<std::vector<OneHopMatch>>(db.FindOneHop(src, dst, &deadline));
+        std::string next;
+        if (!page.paged) {
+            // Sort by total distance (shortest first)
+            std::sort(matches->begin(), matches->end(),
+                [](const OneHopMatch& a, const OneHopMatch& b) {
+                    return a.total_miles < b.total_miles;
+                });
+        }
+        else {
+            // keyset order (total_miles, leg1, leg2); only the page gets sorted
+            auto key = [](const OneHopMatch& m) {
+                return std::make_tuple(static_cast<int64_t>(m.total_miles), static_cast<int64_t>(m.leg1),
+                    static_cast<int64_t>(m.leg2));
+            };
+            if (page.has_cursor) {
+                const auto after = std::make_tuple(page.after.Int(0), page.after.Int(1), page.after.Int(2));
+                matches->erase(std::remove_if(matches->begin(), matches->end(),
+                    [&](const OneHopMatch& m) { return !(after < key(m)); }), matches->end());
+            }
+            if (TakePage(*matches, page.LimitOr(0), [&](const OneHopMatch& a, const OneHopMatch& b) { return key(a) < key(b); })) {
+                const auto& last = matches->back();
+                next = PageCursor().Add(last.total_miles).Add(last.leg1).Add(last.leg2).Encode();
             }
         }
 
-        struct OneHopRoute {
-            std::string src_iata, via_iata, dst_iata;
-            std::string leg1_airline, leg2_airline;
-            int total_distance_miles;
-        };
-        std::vector<OneHopRoute> results;
-
-        // For each potential connecting airport, find second leg
-        for (const auto& leg1 : from_src) {
-            auto to_dst = db.GetRoutesFromTo(leg1.dst_iata, dst);
-            // Filter to only 0-stop routes
-            to_dst.erase(std::remove_if(to_dst.begin(), to_dst.end(),
-                [](const Route& r) { return r.stops != 0; }), to_dst.end());
-            if (to_dst.empty()) continue;
-
-            auto via_ap = db.GetAirportByIATA(leg1.dst_iata);
-            if (!via_ap) continue;
-
-            // Calculate total distance using GPS coordinates
-            double d1_km = db.CalculateDistanceKm(src_ap->latitude, src_ap->longitude,
-                via_ap->latitude, via_ap->longitude);
-            double d2_km = db.CalculateDistanceKm(via_ap->latitude, via_ap->longitude,
-                dst_ap->latitude, dst_ap->longitude);
-            int miles = static_cast<int>(std::lround((d1_km + d2_km) * 0.621371));
-
-            for (const auto& leg2 : to_dst) {
-                results.push_back({ leg1.src_iata, leg1.dst_iata, leg2.dst_iata,
-                                   leg1.airline_iata, leg2.airline_iata, miles });
+        // rows are expanded from the route table one at a time as they are encoded
+        auto row = std::make_shared<OneHopRoute>();
+        BodyStream body;
+        body.JsonArray(OneHopRoute::Schema(), cols, matches->size(),
+            [snap, matches, row](size_t i) -> const OneHopRoute& {
+                row->Assign((*matches)[i], snap->db.GetAllRoutes());
+                return *row;
+            });
+        auto res = stream_response(std::move(body), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        mark_partial(res, deadline);
+        return res;
+            }));
+
+    // ---------- Filtered Route Query (bitmap indexes) ----------
+    // /api/routes?airline=AA,BA&equipment=738&stops=0&codeshare=N
+    //            &src=..&dst=..&src_country=..&dst_country=..&limit=N (0 = all)
+    CROW_ROUTE(app, "/api/routes")
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<Route>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 1, Route::Schema(), Route::Schema().All(), page, cols, err)) return err;
+        RouteFilter f;
+        f.airlines = split_list(req.url_params.get("airline"));
+        f.src = split_list(req.url_params.get("src"));
+        f.dst = split_list(req.url_params.get("dst"));
+        f.src_countries = split_list(req.url_params.get("src_country"));
+        f.dst_countries = split_list(req.url_params.get("dst_country"));
+        f.equipment = split_list(req.url_params.get("equipment"));
+        if (!parse_route_flags(req, f, err)) return err;
+        const size_t limit = page.LimitOr(100);
+
+        size_t total = 0;
+        auto page_ids = db.QueryRouteIds(f, limit ? limit + 1 : 0, &total, route_page_start(page));
+        const std::string next = trim_route_page(page_ids, limit);
+        auto ids = std::make_shared<const std::vector<uint32_t>>(std::move(page_ids));
+        static const JsonObjectLayout layout({ "total", "items" });
+        std::string envelope;
+        layout.Write(envelope, [&](std::string& o, size_t member) {
+            if (member == 0) AppendJsonUInt(o, total);
+            else o.push_back(BodyStream::kHole);
+            });
+        BodyStream body;
+        body.Around(envelope, [&](BodyStream& b) {
+            b.JsonArray(Route::Schema(), cols, ids->size(),
+                [snap, ids](size_t i) -> const Route& { return snap->db.GetAllRoutes()[(*ids)[i]]; });
+            });
+        auto res = stream_response(std::move(body), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
+            });
+
+    // ---------- Equipment / Fleet Analytics ----------
+
+    // All aircraft types, busiest first
+    CROW_ROUTE(app, "/api/equipment")
+        ([&live] {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        static const JsonObjectLayout layout({ "type", "routes", "airline_count" });
+        const auto& types = db.GetEquipmentTypes();
+        std::string out;
+        layout.WriteList(out, types.size(), [&types](std::string& o, size_t row, size_t member) {
+            const auto& st = types[row];
+            switch (member) {
+            case 0: AppendJsonString(o, st.type); break;
+            case 1: AppendJsonUInt(o, st.distance.routes); break;
+            default: AppendJsonUInt(o, st.airlines.size()); break;
             }
-        }
+            });
+        return json_response(std::move(out));
+            });
+
+    // Precomputed stats plus the routes flown by one type (?limit=N, default 100)
+    CROW_ROUTE(app, "/api/equipment/<string>/routes")
+        ([&live](const crow::request& req, const std::string& type) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        static const JsonObjectLayout layout({ "type", "routes", "airline_count", "airlines", "distance", "items" });
+        static const JsonObjectLayout airline_layout({ "airline_iata", "routes" });
+        PageRequest page;
+        RowSchema<Route>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 1, Route::Schema(), Route::Schema().All(), page, cols, err)) return err;
+        auto st = db.GetEquipmentStats(type);
+        if (!st) return not_found("Equipment type not found");
+        const size_t limit = page.LimitOr(100);
+
+        auto page_ids = db.GetRouteIdsByEquipment(type, limit ? limit + 1 : 0, route_page_start(page));
+        const std::string next = trim_route_page(page_ids, limit);
+        auto ids = std::make_shared<const std::vector<uint32_t>>(std::move(page_ids));
+        std::string envelope;
+        layout.Write(envelope, [&](std::string& o, size_t member) {
+            switch (member) {
+            case 0: AppendJsonString(o, st->type); break;
+            case 1: AppendJsonUInt(o, st->distance.routes); break;
+            case 2: AppendJsonUInt(o, st->airlines.size()); break;
+            case 3:
+                airline_layout.WriteList(o, st->airlines.size(), [&](std::string& a, size_t row, size_t m) {
+                    if (m == 0) AppendJsonString(a, st->airlines[row].first);
+                    else AppendJsonUInt(a, st->airlines[row].second);
+                    });
+                break;
+            case 4: o += st->distance.toJSON().dump(); break; // small fixed-size summary
+            default: o.push_back(BodyStream::kHole); break;
+            }
+            });
+        BodyStream body;
+        body.Around(envelope, [&](BodyStream& b) {
+            b.JsonArray(Route::Schema(), cols, ids->size(),
+                [snap, ids](size_t i) -> const Route& { return snap->db.GetAllRoutes()[(*ids)[i]]; });
+            });
+        auto res = stream_response(std::move(body), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
+            });
 
-        // Sort by total distance (shortest first)
-        std::sort(results.begin(), results.end(),
-            [](const OneHopRoute& a, const OneHopRoute& b) {
-                return a.total_distance_miles < b.total_distance_miles;
+    // Aircraft types an airline operates, with route counts and distances
+    CROW_ROUTE(app, "/api/airline/<string>/fleet")
+        ([&live](const std::string& iata) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        auto fl = db.GetAirlineFleet(iata);
+        if (!fl) return not_found("Airline fleet not found");
+        crow::json::wvalue out = fl->toJSON();
+        if (auto a = db.GetAirlineByIATA(iata)) out["airline_name"] = a->name;
+        return crow::response(out);
+            });
+
+    // Response cache counters
+    CROW_ROUTE(app, "/api/cache/stats")
+        ([&live, &response_cache, &cache_stats, &shard_caches] {
+        auto st = cache_stats();
+        crow::json::wvalue out;
+        out["epoch"] = live.Epoch();
+        out["capacity_bytes"] = static_cast<uint64_t>(response_cache.CapacityBytes());
+        out["shards"] = static_cast<uint64_t>(shard_caches.size());
+        out["bytes"] = static_cast<uint64_t>(st.bytes);
+        out["entries"] = static_cast<uint64_t>(st.entries);
+        out["hits"] = st.hits;
+        out["misses"] = st.misses;
+        out["stale"] = st.stale;
+        out["not_modified"] = st.not_modified;
+        out["admitted"] = st.admitted;
+        out["rejected"] = st.rejected;
+        out["evictions"] = st.evictions;
+        out["coalesced"] = st.coalesced;
+        out["flights_shared"] = st.flights_shared;
+        out["flight_fallbacks"] = st.flight_fallbacks;
+        out["flights"] = static_cast<uint64_t>(st.flights);
+        return crow::response(out);
             });
 
+    // Response compression counters
+    CROW_ROUTE(app, "/api/compression/stats")
+        ([&compress_mw] {
+        auto st = compress_mw.GetStats();
+        crow::json::wvalue out;
+        out["headroom"] = st.headroom;
+        out["compressed"] = st.compressed;
+        out["streamed"] = st.streamed;
+        out["gzip"] = st.gzip;
+        out["deflate"] = st.deflate;
+        out["skipped_small"] = st.skipped_small;
+        out["skipped_type"] = st.skipped_type;
+        out["skipped_encoded"] = st.skipped_encoded;
+        out["not_accepted"] = st.not_accepted;
+        out["incompressible"] = st.incompressible;
+        out["memo_hits"] = st.memo_hits;
+        out["stream_inits"] = st.stream_inits;
+        out["stream_resets"] = st.stream_resets;
+        out["bytes_in"] = st.bytes_in;
+        out["bytes_out"] = st.bytes_out;
+        out["bytes_saved"] = st.bytes_in - st.bytes_out;
+        out["cpu_ms"] = st.cpu_ns / 1e6;
+        for (size_t i = 1; i < st.by_level.size(); ++i)
+            out["by_level"][std::to_string(i)] = st.by_level[i];
+        return crow::response(out);
+            });
+
+    // Autocomplete channel counters
+    CROW_ROUTE(app, "/api/suggest/stats")
+        ([&suggest_channel] {
+        auto st = suggest_channel.GetStats();
+        crow::json::wvalue out;
+        out["sessions_open"] = st.sessions_open;
+        out["sessions_total"] = st.sessions_total;
+        out["received"] = st.received;
+        out["executed"] = st.executed;
+        out["superseded"] = st.superseded;
+        out["stale"] = st.stale;
+        out["rejected"] = st.rejected;
+        out["sent"] = st.sent;
+        return crow::response(out);
+            });
+
+    // ---------- Metro Areas / Place-to-Place Paths ----------
+
+    // All multi-airport metro areas
+    CROW_ROUTE(app, "/api/metros")
+        ([&live] {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
         crow::json::wvalue arr = crow::json::wvalue::list();
-        for (const auto& r : results) {
-            crow::json::wvalue j;
-            j["src"] = r.src_iata;
-            j["via"] = r.via_iata;
-            j["dst"] = r.dst_iata;
-            j["leg1_airline"] = r.leg1_airline;
-            j["leg2_airline"] = r.leg2_airline;
-            j["total_miles"] = r.total_distance_miles;
-            arr[arr.size()] = std::move(j);
-        }
+        for (const auto& m : db.GetMetroAreas()) arr[arr.size()] = m.toJSON();
         return crow::response(arr);
             });
 
+    // Metro area by city name ("London", "London, United Kingdom") or member IATA code
+    CROW_ROUTE(app, "/api/metro/<string>")
+        ([&live](const std::string& raw) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        const std::string term = url_decode(raw);
+        if (auto m = db.GetMetroArea(term)) return crow::response(m->toJSON());
+        return not_found("Metro area not found");
+            });
+
+    // Itinerary with the fewest legs (then the fewest km) between two places;
+    // either side may be an IATA code, a comma separated code list or a
+    // city/metro name (London -> New York).
+    CROW_ROUTE(app, "/paths/<string>/<string>")
+        (offloaded<std::string, std::string>(compute, finish, [&live, &deadline_for](const crow::request& req, const std::string& raw_from, const std::string& raw_to) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        const std::string from = url_decode(raw_from), to = url_decode(raw_to);
+        auto src = db.ResolvePlace(from);
+        auto dst = db.ResolvePlace(to);
+        if (src.empty() || dst.empty()) {
+            return not_found("Source or destination not found");
+        }
+        auto deadline = deadline_for(req, 2000);
+        auto path = db.FindShortestPath(from, to, &deadline);
+
+        crow::json::wvalue out;
+        out["from"] = crow::json::wvalue::list();
+        for (size_t i = 0; i < src.size(); ++i) out["from"][i] = src[i];
+        out["to"] = crow::json::wvalue::list();
+        for (size_t i = 0; i < dst.size(); ++i) out["to"][i] = dst[i];
+        out["found"] = path.found;
+        out["total_km"] = path.total_km;
+        out["total_miles"] = static_cast<int>(std::lround(path.total_km * 0.621371));
+        out["legs"] = crow::json::wvalue::list();
+        for (size_t i = 0; i < path.legs.size(); ++i) {
+            const auto& leg = path.legs[i];
+            crow::json::wvalue j;
+            j["src"] = leg.src_iata;
+            j["dst"] = leg.dst_iata;
+            j["distance_km"] = leg.distance_km;
+            j["airlines"] = crow::json::wvalue::list();
+            for (size_t k = 0; k < leg.airlines.size(); ++k) j["airlines"][k] = leg.airlines[k];
+            out["legs"][i] = std::move(j);
+        }
+        if (deadline.Fired()) out["partial"] = true;
+        crow::response res(out);
+        mark_partial(res, deadline);
+        return res;
+            }));
+
+    // Earliest-arrival itinerary over the synthetic timetable.
+    // ?depart=HH:MM (local at origin, default 08:00) &day=N &mct=minutes
+    CROW_ROUTE(app, "/itinerary/<string>/<string>")
+        (offloaded<std::string, std::string>(compute, finish, [&live, &deadline_for](const crow::request& req, const std::string& raw_from, const std::string& raw_to) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        const Timetable& timetable = *snap->timetable;
+        const std::string from = url_decode(raw_from), to = url_decode(raw_to);
+        auto src = db.ResolvePlace(from);
+        auto dst = db.ResolvePlace(to);
+        if (src.empty() || dst.empty()) {
+            return not_found("Source or destination not found");
+        }
+
+        int depart_local = 8 * 60, day = 0, mct = -1;
+        if (auto p = req.url_params.get("depart")) {
+            int h = 0, m = 0;
+            if (std::sscanf(p, "%d:%d", &h, &m) != 2 || h < 0 || h > 23 || m < 0 || m > 59)
+                return crow::response(400, "depart must be HH:MM");
+            depart_local = h * 60 + m;
+        }
+        if (auto p = req.url_params.get("day")) day = std::max(0, std::atoi(p));
+        if (auto p = req.url_params.get("mct")) mct = std::max(0, std::atoi(p));
+
+        const double src_tz = timetable.TzOffset(src.front());
+        const int32_t depart_utc = day * 1440 + depart_local - static_cast<int32_t>(std::lround(src_tz * 60.0));
+
+        auto deadline = deadline_for(req, 2000);
+        auto t0 = std::chrono::steady_clock::now();
+        auto it = timetable.EarliestArrival(src, dst, depart_utc, mct, &deadline);
+        auto scan_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+
+        crow::json::wvalue out;
+        out["found"] = it.found;
+        out["connections_scanned"] = static_cast<uint64_t>(it.scanned);
+        out["scan_us"] = static_cast<int64_t>(scan_us);
+        out["legs"] = crow::json::wvalue::list();
+        if (it.found) {
+            out["duration_min"] = it.arrival - it.departure;
+            for (size_t i = 0; i < it.legs.size(); ++i) {
+                const auto& leg = it.legs[i];
+                int dep_day = 0, arr_day = 0;
+                crow::json::wvalue j;
+                j["src"] = leg.src_iata;
+                j["dst"] = leg.dst_iata;
+                j["airline"] = leg.airline_iata;
+                j["depart_local"] = Timetable::FormatLocal(leg.dep_time, leg.src_tz, &dep_day);
+                j["depart_day"] = dep_day;
+                j["arrive_local"] = Timetable::FormatLocal(leg.arr_time, leg.dst_tz, &arr_day);
+                j["arrive_day"] = arr_day;
+                j["block_min"] = leg.arr_time - leg.dep_time;
+                out["legs"][i] = std::move(j);
+            }
+        }
+        if (deadline.Fired()) out["partial"] = true;
+        crow::response res(out);
+        mark_partial(res, deadline);
+        return res;
+            }));
+
     // ---------- Section IV.2: Source Code Viewer (EXTRA CREDIT) ----------
     CROW_ROUTE(app, "/api/source-code")
-        ([] {
-        std::ostringstream combined;
+        ([&sources](const crow::request& req) {
+        auto res = serve_artifact(req, *sources.Listing(), "text/plain; charset=utf-8");
+        if (res.code == 200) res.add_header("Content-Disposition", "inline; filename=\"airdb_source.txt\"");
+        return res;
+            });
+
+    // ---------- Additional Helper Routes ----------
 
-        std::vector<std::string> files = {
-            "server.cpp", "airdb.h", "airdp.cpp",
-            "index.html", "style.css"
+    // Direct routes list (helper for one-hop calculation)
+    CROW_ROUTE(app, "/routes/<string>/<string>")
+        (offloaded<std::string, std::string>(compute, finish, [&live](const crow::request& req, const std::string& src, const std::string& dst) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        PageRequest page;
+        RowSchema<Route>::Projection cols;
+        crow::response err;
+        if (!parse_page(req, 1, Route::Schema(), Route::Schema().All(), page, cols, err)) return err;
+        const size_t limit = page.LimitOr(0);
+        auto page_ids = db.GetRouteIdsFromTo(src, dst, route_page_start(page), limit ? limit + 1 : 0);
+        const std::string next = trim_route_page(page_ids, limit);
+        auto ids = std::make_shared<const std::vector<uint32_t>>(std::move(page_ids));
+        BodyStream body;
+        body.JsonArray(Route::Schema(), cols, ids->size(),
+            [snap, ids](size_t i) -> const Route& { return snap->db.GetAllRoutes()[(*ids)[i]]; });
+        auto res = stream_response(std::move(body), "application/json");
+        if (!next.empty()) res.set_header("X-Next-Cursor", next);
+        return res;
+            }));
+
+    // ---------- Batch Lookup ----------
+
+    // POST a JSON array of lookups, get one JSON array back in input order:
+    //   {"airport": "LHR" | "EGLL" | 507}   -> the /airport/<term> object
+    //   {"airline": "BA" | "BAW" | 1355}    -> the /airline/<term> object
+    //   {"route": ["LHR", "JFK"] | "LHR-JFK"} -> the /routes/<src>/<dst> array
+    // Unmatched lookups give null. Everything resolves against one dataset
+    // version (X-Dataset-Epoch), and repeated lookups are resolved once.
+    CROW_ROUTE(app, "/api/batch").methods(crow::HTTPMethod::Post)
+        ([&live](const crow::request& req) {
+        auto snap = live.Get();
+        const AirTravelDB& db = snap->db;
+        static const size_t kMaxItems = 1000;
+        auto body = crow::json::load(req.body);
+        if (!body || body.t() != crow::json::type::List)
+            return crow::response(400, "expected a JSON array of lookups");
+        if (body.size() > kMaxItems)
+            return crow::response(413, "at most " + std::to_string(kMaxItems) + " lookups per batch");
+
+        auto code_of = [](const crow::json::rvalue& v, std::string& out) {
+            if (v.t() == crow::json::type::String) { out = v.s(); return !out.empty(); }
+            if (v.t() == crow::json::type::Number && v.nt() != crow::json::num_type::Floating_point && v.i() >= 0) {
+                out = std::to_string(v.i());
+                return true;
+            }
+            return false;
         };
 
-        combined << "=================================================\n";
-        combined << "  Air Travel Database - Complete Source Code\n";
-        combined << "  CIS 22C Capstone Project\n";
-        combined << "=================================================\n\n";
-
-        for (const auto& filename : files) {
-            combined << "\n\n";
-            combined << "╔════════════════════════════════════════════════╗\n";
-            combined << "║  FILE: " << filename;
-            for (size_t i = filename.length(); i < 38; ++i) combined << " ";
-            combined << "║\n";
-            combined << "╚════════════════════════════════════════════════╝\n\n";
-
-            auto content = read_file(filename);
-            if (!content.empty()) {
-                combined << content << "\n";
+        std::vector<BatchLookup> unique;
+        std::vector<size_t> slot(body.size());
+        std::unordered_map<std::string, size_t> seen;
+        for (size_t i = 0; i < body.size(); ++i) {
+            const auto& item = body[i];
+            BatchLookup q;
+            bool ok = item.t() == crow::json::type::Object && item.size() == 1;
+            if (ok && item.has("airport")) ok = code_of(item["airport"], q.code);
+            else if (ok && item.has("airline")) {
+                q.kind = BatchLookup::Kind::Airline;
+                ok = code_of(item["airline"], q.code);
             }
-            else {
-                combined << "// [File not found or could not be read]\n";
+            else if (ok && item.has("route")) {
+                q.kind = BatchLookup::Kind::RoutePair;
+                const auto& r = item["route"];
+                if (r.t() == crow::json::type::List && r.size() == 2 &&
+                    r[0].t() == crow::json::type::String && r[1].t() == crow::json::type::String) {
+                    q.code = r[0].s();
+                    q.dst = r[1].s();
+                }
+                else if (r.t() == crow::json::type::String) {
+                    std::string pair = r.s();
+                    size_t dash = pair.find('-');
+                    if (dash != std::string::npos) {
+                        q.code = pair.substr(0, dash);
+                        q.dst = pair.substr(dash + 1);
+                    }
+                }
+                ok = !q.code.empty() && !q.dst.empty();
+            }
+            else ok = false;
+            if (!ok) {
+                return crow::response(400, "lookup " + std::to_string(i) +
+                    ": expected {\"airport\": code}, {\"airline\": code} or {\"route\": [src, dst]}");
             }
+            std::string key = std::to_string(static_cast<int>(q.kind)) + ':' + q.code + '\x1f' + q.dst;
+            auto it = seen.emplace(std::move(key), unique.size());
+            if (it.second) unique.push_back(std::move(q));
+            slot[i] = it.first->second;
         }
 
-        combined << "\n\n=================================================\n";
-        combined << "  End of Source Code\n";
-        combined << "=================================================\n";
+        uint64_t epoch = 0;
+        const auto hits = db.LookupBatch(unique, &epoch);
+        std::vector<std::string> encoded(hits.size());
+        const auto& routes = db.GetAllRoutes();
+        for (size_t u = 0; u < hits.size(); ++u) {
+            std::string& e = encoded[u];
+            if (hits[u].airport) Airport::Schema().AppendJSON(e, *hits[u].airport);
+            else if (hits[u].airline) Airline::Schema().AppendJSON(e, *hits[u].airline);
+            else if (unique[u].kind == BatchLookup::Kind::RoutePair) {
+                e.push_back('[');
+                for (size_t k = 0; k < hits[u].routes.size(); ++k) {
+                    if (k) e.push_back(',');
+                    Route::Schema().AppendJSON(e, routes[hits[u].routes[k]]);
+                }
+                e.push_back(']');
+            }
+            else e = "null";
+        }
 
-        crow::response res{ combined.str() };
-        res.add_header("Content-Type", "text/plain; charset=utf-8");
-        res.add_header("Content-Disposition", "inline; filename=\"airdb_source.txt\"");
+        std::string out;
+        size_t bytes = 2 + slot.size();
+        for (size_t u : slot) bytes += encoded[u].size();
+        out.reserve(bytes);
+        out.push_back('[');
+        for (size_t i = 0; i < slot.size(); ++i) {
+            if (i) out.push_back(',');
+            out += encoded[slot[i]];
+        }
+        out.push_back(']');
+        auto res = json_response(std::move(out));
+        res.add_header("X-Dataset-Epoch", std::to_string(epoch));
         return res;
             });
 
-    // ---------- Additional Helper Routes ----------
+    // Admission control per request class; ?reset=1 restarts the percentiles
+    CROW_ROUTE(app, "/api/admission/stats")
+        ([&admission_mw](const crow::request& req) {
+        auto st = admission_mw.GetStats(req.url_params.get("reset") != nullptr);
+        crow::json::wvalue out;
+        out["client_rate"] = admission_mw.client_rate;
+        out["clients"] = static_cast<uint64_t>(st.clients);
+        for (const auto& c : st.classes) {
+            auto& o = out["classes"][c.name];
+            o["running"] = c.running;
+            o["queued"] = c.queued;
+            o["max_running"] = c.max_running;
+            o["max_queued"] = c.max_queued;
+            o["admitted"] = c.admitted;
+            o["waited"] = c.waited;
+            o["shed_full"] = c.shed_full;
+            o["shed_timeout"] = c.shed_timeout;
+            o["throttled"] = c.throttled;
+            o["service_ms"] = c.service_ms;
+            o["p50_ms"] = c.p50_ms;
+            o["p99_ms"] = c.p99_ms;
+        }
+        return crow::response(out);
+            });
 
-    // Direct routes list (helper for one-hop calculation)
-    CROW_ROUTE(app, "/routes/<string>/<string>")
-        ([&db](const std::string& src, const std::string& dst) {
-        auto vec = db.GetRoutesFromTo(src, dst);
-        crow::json::wvalue arr = crow::json::wvalue::list();
-        for (const auto& r : vec) arr[arr.size()] = r.toJSON();
-        return crow::response(arr);
+    // Compute pool counters
+    CROW_ROUTE(app, "/api/compute/stats")
+        ([&compute] {
+        auto st = compute.GetStats();
+        crow::json::wvalue out;
+        out["threads"] = st.threads;
+        out["submitted"] = st.submitted;
+        out["executed"] = st.executed;
+        out["stolen"] = st.stolen;
+        out["queued"] = st.queued;
+        out["busy"] = st.busy;
+        out["parallel"] = st.parallel;
+        return crow::response(out);
+            });
+
+    // ---------- Dataset reload ----------
+    // Starts building a new dataset version from the .dat files: 202, or 409
+    // while a reload is already running. Admin only (ADMIN_TOKEN).
+    const std::string admin_token = read_env("ADMIN_TOKEN");
+    CROW_ROUTE(app, "/api/admin/reload").methods(crow::HTTPMethod::Post)
+        ([&live, &admin_token](const crow::request& req) {
+        if (!admin_allowed(req, admin_token)) return crow::response(403);
+        const bool started = live.Reload("admin");
+        crow::json::wvalue out;
+        out["started"] = started;
+        out["epoch"] = live.Epoch();
+        crow::response res(out);
+        res.code = started ? 202 : 409;
+        return res;
+            });
+
+    // ---------- Dataset changes ----------
+    // Seasonal route changes and airport/airline corrections without a
+    // reload. The handlers only parse them; each is checked against the rows
+    // as the changes before it left them, logged as a delta and answered
+    // once a version including it serves (see changing, LiveDataset). Admin
+    // only.
+
+    // Adds a route, or replaces the rows with the same airline, source and
+    // destination: {"airline_iata": "BA", "src_iata": "LHR", "dst_iata": "JFK",
+    // "stops": 0, "codeshare": "", "equipment": "777 744"}
+    CROW_ROUTE(app, "/api/routes").methods(crow::HTTPMethod::Post)
+        (changing(live, finish, [&admin_token](const crow::request& req, DatasetChange& change) {
+        if (!admin_allowed(req, admin_token)) return crow::response(403);
+        auto body = crow::json::load(req.body);
+        if (!body) return crow::response(400, "expected a JSON object");
+        Route& r = change.route;
+        std::string err;
+        if (!merge_json_row(Route::Schema(), body, r, err)) return crow::response(400, err);
+        for (std::string* code : { &r.airline_iata, &r.src_iata, &r.dst_iata })
+            std::transform(code->begin(), code->end(), code->begin(), ::toupper);
+        if (r.airline_iata.empty() || r.src_iata.empty() || r.dst_iata.empty())
+            return crow::response(400, "airline_iata, src_iata and dst_iata are required");
+        if (r.src_iata == r.dst_iata || r.stops < 0) return crow::response(400, "not a route");
+        return crow::response(200);
+            }));
+
+    // Withdraws every route of an airline between two airports:
+    // DELETE /api/routes?airline=BA&src=LHR&dst=JFK
+    CROW_ROUTE(app, "/api/routes").methods(crow::HTTPMethod::Delete)
+        (changing(live, finish, [&live, &admin_token](const crow::request& req, DatasetChange& change) {
+        if (!admin_allowed(req, admin_token)) return crow::response(403);
+        change.kind = DatasetChange::Kind::WithdrawRoute;
+        Route& r = change.route;
+        const char* airline = req.url_params.get("airline");
+        const char* src = req.url_params.get("src");
+        const char* dst = req.url_params.get("dst");
+        if (!airline || !src || !dst) return crow::response(400, "airline, src and dst are required");
+        r.airline_iata = airline;
+        r.src_iata = src;
+        r.dst_iata = dst;
+        for (std::string* code : { &r.airline_iata, &r.src_iata, &r.dst_iata })
+            std::transform(code->begin(), code->end(), code->begin(), ::toupper);
+
+        auto snap = live.Get();
+        const auto& routes = snap->db.GetAllRoutes();
+        size_t withdrawn = 0;
+        for (uint32_t i : snap->db.GetRouteIdsFromTo(r.src_iata, r.dst_iata))
+            withdrawn += routes[i].airline_iata == r.airline_iata;
+        if (!withdrawn) return not_found("Route not found");
+        return json_response("{\"withdrawn\":" + std::to_string(withdrawn) + "}");
+            }));
+
+    // Creates or updates an airport; fields left out keep their value. The
+    // row is found by "id", else by "iata"; a new one needs a name and an
+    // IATA code, and gets the next free id unless it brings one. Codes are
+    // upper-cased and checked; one that already names another airport, or
+    // an IATA change while routes use the old code, is refused with 409.
+    CROW_ROUTE(app, "/api/airports").methods(crow::HTTPMethod::Post)
+        (changing(live, finish, [&admin_token](const crow::request& req, DatasetChange& change) {
+        if (!admin_allowed(req, admin_token)) return crow::response(403);
+        auto body = crow::json::load(req.body);
+        if (!body || body.t() != crow::json::type::Object) return crow::response(400, "expected a JSON object");
+        change.kind = DatasetChange::Kind::UpsertAirport;
+        Airport& ap = change.airport;
+        std::string err;
+        if (!merge_json_row(Airport::Schema(), body, ap, err)) return crow::response(400, err);
+        if (!normalize_code(body, "iata", ap.iata, 3, err) || !normalize_code(body, "icao", ap.icao, 4, err))
+            return crow::response(400, err);
+        for (const auto& v : body) change.fields.push_back(v.key());
+        return crow::response(200);
+            }));
+
+    // Creates or updates an airline, like /api/airports
+    CROW_ROUTE(app, "/api/airlines").methods(crow::HTTPMethod::Post)
+        (changing(live, finish, [&admin_token](const crow::request& req, DatasetChange& change) {
+        if (!admin_allowed(req, admin_token)) return crow::response(403);
+        auto body = crow::json::load(req.body);
+        if (!body || body.t() != crow::json::type::Object) return crow::response(400, "expected a JSON object");
+        change.kind = DatasetChange::Kind::UpsertAirline;
+        Airline& al = change.airline;
+        std::string err;
+        if (!merge_json_row(Airline::Schema(), body, al, err)) return crow::response(400, err);
+        if (!normalize_code(body, "iata", al.iata, 2, err) || !normalize_code(body, "icao", al.icao, 3, err))
+            return crow::response(400, err);
+        for (const auto& v : body) change.fields.push_back(v.key());
+        return crow::response(200);
+            }));
+
+    // Serving dataset version and reload counters
+    CROW_ROUTE(app, "/api/dataset/stats")
+        ([&live] {
+        auto st = live.GetStats();
+        crow::json::wvalue out;
+        out["epoch"] = st.epoch;
+        out["trigger"] = st.trigger;
+        out["load_ms"] = st.load_ms;
+        out["loaded_at"] = static_cast<int64_t>(st.loaded_at);
+        out["reloads"] = st.reloads;
+        out["rejected"] = st.rejected;
+        out["last_error"] = st.last_error;
+        out["reloading"] = st.reloading;
+        out["watching"] = st.watching;
+        out["versions_alive"] = st.alive;
+        out["versions_released"] = st.released;
+        out["changes"] = st.changes;
+        out["deltas"] = st.deltas;
+        out["change_builds"] = st.change_builds;
+        out["compactions"] = st.compactions;
+        return crow::response(out);
             });
 
     // Legacy /code endpoint
@@ -800,6 +1689,10 @@ int main() {
     std::cout << "Access at: http://localhost:" << port << "\n";
     std::cout << "===================================\n";
     std::cout << "\nEndpoints Available:\n";
+    std::cout << "  (list endpoints take ?limit=&cursor=&fields=; next page cursor in X-Next-Cursor)\n";
+    std::cout << "  - Autocomplete:\n";
+    std::cout << "    GET /api/airlines/suggest?q=  GET /api/airports/suggest?q=\n";
+    std::cout << "    WS  /ws/suggest  {\"seq\":n,\"kind\":\"airport|airline\",\"q\":\"...\"}\n";
     std::cout << "  - Entity Lookup:\n";
     std::cout << "    GET /airline/<term>\n";
     std::cout << "    GET /airport/<term>\n";
@@ -808,14 +1701,43 @@ int main() {
     std::cout << "    GET /report/airport/<iata>/airlines-by-routes.json|csv\n";
     std::cout << "    GET /report/airlines/by-iata.json|csv\n";
     std::cout << "    GET /report/airports/by-iata.json|csv\n";
+    std::cout << "  - Bulk Exports (Arrow IPC):\n";
+    std::cout << "    GET /export/airports.arrow|airlines.arrow|routes.arrow\n";
     std::cout << "  - One-Hop Routes:\n";
     std::cout << "    GET /onehop/<src>/<dst>\n";
+    std::cout << "  - Route Query:\n";
+    std::cout << "    GET /api/routes?airline=&equipment=&stops=&codeshare=&src_country=&dst_country=\n";
+    std::cout << "  - Equipment / Fleets:\n";
+    std::cout << "    GET /api/equipment\n";
+    std::cout << "    GET /api/equipment/<type>/routes\n";
+    std::cout << "    GET /api/airline/<iata>/fleet\n";
+    std::cout << "  - Metro Areas / Paths:\n";
+    std::cout << "    GET /api/metros\n";
+    std::cout << "    GET /api/metro/<city|iata>\n";
+    std::cout << "    GET /paths/<from>/<to>\n";
+    std::cout << "    GET /itinerary/<from>/<to>?depart=HH:MM&day=N&mct=M\n";
+    std::cout << "    (one-hop, paths and itinerary take ?timeout_ms=; a cut-short search answers with X-Partial-Result)\n";
+    std::cout << "  - Batch Lookup:\n";
+    std::cout << "    POST /api/batch  [{\"airport\":\"LHR\"},{\"airline\":\"BA\"},{\"route\":[\"LHR\",\"JFK\"]}]\n";
+    std::cout << "  - Dataset Reload (also on SIGHUP, or file changes with RELOAD_WATCH_MS):\n";
+    std::cout << "    POST /api/admin/reload  GET /api/dataset/stats\n";
+    std::cout << "  - Dataset Changes (admin):\n";
+    std::cout << "    POST /api/routes  DELETE /api/routes?airline=&src=&dst=\n";
+    std::cout << "    POST /api/airports  POST /api/airlines\n";
     std::cout << "  - Student Info:\n";
     std::cout << "    GET /api/student-id\n";
     std::cout << "  - Source Code:\n";
     std::cout << "    GET /api/source-code\n";
+    std::cout << "    GET /download/source?deflate=1\n";
     std::cout << "===================================\n\n";
 
-    app.port(port).multithreaded().run();
+    if (shards > 1) {
+        std::cout << "Serving from " << shards << " SO_REUSEPORT shards\n\n";
+        app.port(port).shards(shards, [&shard_caches, &shard_cpus](unsigned i) {
+            PinThisThread(shard_cpus[i % shard_cpus.size()]);
+            ResponseCacheMiddleware::BindThreadCache(shard_caches[i].get());
+        }).run();
+    }
+    else app.port(port).multithreaded().run();
     return 0;
 }
@@ -0,0 +1,261 @@
+﻿#include "snapshot_memory.h"
+#include "compute_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static constexpr size_t kHugePage = 2u << 20;
+
+// ---------------- topology ----------------
+NumaTopology::NumaTopology() {
+#ifdef __linux__
+    for (size_t node = 0;; ++node) {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!f) break;
+        std::string list;
+        std::getline(f, list);
+        cpus_.push_back(ComputePool::ParseCpuList(list));
+    }
+#endif
+    if (cpus_.empty()) {
+        cpus_.emplace_back();
+        for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c)
+            cpus_.back().push_back(static_cast<int>(c));
+    }
+    for (size_t node = 0; node < cpus_.size(); ++node) {
+        for (int cpu : cpus_[node]) {
+            if (cpu >= static_cast<int>(node_of_cpu_.size())) node_of_cpu_.resize(cpu + 1, 0);
+            node_of_cpu_[cpu] = static_cast<uint16_t>(node);
+        }
+    }
+}
+
+const NumaTopology& NumaTopology::Get() {
+    static const NumaTopology topology;
+    return topology;
+}
+
+size_t NumaTopology::CurrentNode() const {
+    if (cpus_.size() == 1) return 0;
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    if (cpu >= 0 && cpu < static_cast<int>(node_of_cpu_.size())) return node_of_cpu_[cpu];
+#endif
+    return 0;
+}
+
+// ---------------- regions ----------------
+std::unique_ptr<SnapshotRegion> SnapshotRegion::Create(const void* src, size_t bytes, size_t node,
+    const SnapshotPlacement& placement) {
+    std::unique_ptr<SnapshotRegion> r(new SnapshotRegion);
+    r->bytes_ = bytes;
+    r->node_ = node;
+    const bool huge = placement.pages != SnapshotPlacement::Pages::Default;
+#ifdef _WIN32
+    r->mapped_ = bytes;
+    r->base_ = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!r->base_) return nullptr;
+    r->data_ = r->base_;
+    (void)huge;
+#else
+#ifdef MAP_HUGETLB
+    if (placement.pages == SnapshotPlacement::Pages::Explicit) {
+        r->mapped_ = (bytes + kHugePage - 1) / kHugePage * kHugePage;
+        void* p = mmap(nullptr, r->mapped_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            r->base_ = r->data_ = p;
+            r->explicit_huge_ = true;
+        }
+    }
+#endif
+    if (!r->base_) {
+        // room to start on a huge-page boundary, so THP can back all of it
+        r->mapped_ = huge ? bytes + kHugePage : bytes;
+        void* p = mmap(nullptr, r->mapped_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return nullptr;
+        r->base_ = p;
+        uintptr_t at = reinterpret_cast<uintptr_t>(p);
+        if (huge) at = (at + kHugePage - 1) / kHugePage * kHugePage;
+        r->data_ = reinterpret_cast<void*>(at);
+#ifdef MADV_HUGEPAGE
+        if (huge) madvise(r->data_, (bytes + kHugePage - 1) / kHugePage * kHugePage, MADV_HUGEPAGE);
+#endif
+    }
+#endif
+
+    // first touch from the target node places the pages there
+    auto fill = [&] { std::memcpy(r->data_, src, bytes); };
+    const auto& topo = NumaTopology::Get();
+    if (placement.replicate && topo.Nodes() > 1 && !topo.Cpus(node).empty()) {
+        std::thread t([&] {
+            PinThisThread(topo.Cpus(node).front());
+            fill();
+        });
+        t.join();
+    }
+    else fill();
+
+#ifdef _WIN32
+    DWORD old = 0;
+    VirtualProtect(r->data_, bytes, PAGE_READONLY, &old);
+    if (placement.lock) r->locked_ = VirtualLock(r->data_, bytes) != 0;
+#else
+    mprotect(r->base_, r->mapped_, PROT_READ);
+    if (placement.lock) r->locked_ = mlock(r->data_, bytes) == 0;
+#endif
+    return r;
+}
+
+SnapshotRegion::~SnapshotRegion() {
+    if (!base_) return;
+#ifdef _WIN32
+    if (locked_) VirtualUnlock(data_, bytes_);
+    VirtualFree(base_, 0, MEM_RELEASE);
+#else
+    if (locked_) munlock(data_, bytes_);
+    munmap(base_, mapped_);
+#endif
+}
+
+SnapshotRegion::Report SnapshotRegion::Inspect() const {
+    Report rep;
+    rep.node = node_;
+    rep.bytes = bytes_;
+    rep.explicit_huge = explicit_huge_;
+    rep.locked = locked_;
+#ifdef __linux__
+    if (explicit_huge_) rep.huge_bytes = mapped_;
+    else {
+        // AnonHugePages of the mapping that holds the data
+        std::ifstream smaps("/proc/self/smaps");
+        const uintptr_t at = reinterpret_cast<uintptr_t>(data_);
+        std::string line;
+        bool inside = false;
+        while (std::getline(smaps, line)) {
+            unsigned long long lo = 0, hi = 0;
+            char dash = 0;
+            std::istringstream ls(line);
+            if (line.find(':') > line.find(' ') && (ls >> std::hex >> lo >> dash >> hi) && dash == '-') {
+                inside = at >= lo && at < hi;
+                continue;
+            }
+            if (inside && line.compare(0, 14, "AnonHugePages:") == 0)
+                rep.huge_bytes += std::strtoull(line.c_str() + 14, nullptr, 10) * 1024;
+        }
+    }
+    // the huge page around a small copy also covers the mapping's padding
+    rep.huge_bytes = std::min(rep.huge_bytes, bytes_);
+#ifdef SYS_move_pages
+    // where the pages are: up to 1024 samples spread over the copy
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t pages = (bytes_ + page - 1) / page;
+    const size_t step = std::max<size_t>(1, pages / 1024);
+    std::vector<void*> addrs;
+    for (size_t p = 0; p < pages; p += step) addrs.push_back(static_cast<char*>(data_) + p * page);
+    std::vector<int> status(addrs.size(), -1);
+    if (syscall(SYS_move_pages, 0, addrs.size(), addrs.data(), nullptr, status.data(), 0) == 0) {
+        rep.pages_sampled = addrs.size();
+        for (int s : status) rep.pages_on_node += s == static_cast<int>(node_);
+    }
+#endif
+#endif
+    return rep;
+}
+
+// ---------------- replicas ----------------
+void ReplicatedArray::place(const void* src, size_t bytes, const SnapshotPlacement& placement) {
+    copies_.clear();
+    if (!bytes || !placement.Enabled()) return;
+    const auto& topo = NumaTopology::Get();
+    const size_t nodes = placement.replicate ? topo.Nodes() : 1;
+    for (size_t node = 0; node < nodes; ++node) {
+        auto copy = SnapshotRegion::Create(src, bytes, node, placement);
+        // without every copy, readers stay on the master
+        if (!copy) { copies_.clear(); return; }
+        copies_.push_back(std::move(copy));
+    }
+}
+
+const void* ReplicatedArray::local() const {
+    if (copies_.size() == 1) return copies_.front()->Data();
+    const size_t node = NumaTopology::Get().CurrentNode();
+    return copies_[node < copies_.size() ? node : 0]->Data();
+}
+
+// ---------------- TLB probe ----------------
+TlbProbe ProbeRandomReads(const void* data, size_t bytes, size_t reads) {
+    TlbProbe probe;
+    const size_t words = bytes / sizeof(uint64_t);
+    if (!words) return probe;
+    const uint64_t* w = static_cast<const uint64_t*>(data);
+
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    uint64_t x = 0x9E3779B97F4A7C15ull, sum = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads; ++i) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        sum += w[x % words];
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t misses = 0;
+        if (read(fd, &misses, sizeof(misses)) == static_cast<ssize_t>(sizeof(misses))) {
+            probe.counted = true;
+            probe.misses_per_1k = static_cast<double>(misses) * 1000.0 / static_cast<double>(reads);
+        }
+        close(fd);
+    }
+#endif
+    // keeps the loop from being optimized away
+    volatile uint64_t sink = sum;
+    (void)sink;
+    probe.ns_per_read = std::chrono::duration<double, std::nano>(t1 - t0).count() / static_cast<double>(reads);
+    return probe;
+}
+
+SnapshotPlacement ParseSnapshotPlacement(const std::string& spec) {
+    SnapshotPlacement p;
+    std::stringstream ss(spec);
+    std::string word;
+    while (std::getline(ss, word, ',')) {
+        if (word == "numa") p.replicate = true;
+        else if (word == "thp") p.pages = SnapshotPlacement::Pages::Transparent;
+        else if (word == "explicit") p.pages = SnapshotPlacement::Pages::Explicit;
+        else if (word == "mlock") p.lock = true;
+    }
+    return p;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Placement of the immutable index arrays the hot queries scan (route code
+// columns, route graph, timetable connections). By default they stay in
+// their std::vectors; a placement copies them into dedicated mappings.
+struct SnapshotPlacement {
+    enum class Pages { Default, Transparent, Explicit };
+    bool  replicate = false;        // one copy per NUMA node, read by that node's threads
+    Pages pages = Pages::Default;   // Transparent: THP via madvise; Explicit: MAP_HUGETLB,
+                                    // falling back to THP when no huge pages are reserved
+    bool  lock = false;             // mlock, so the copies are never paged out
+
+    bool Enabled() const { return replicate || pages != Pages::Default || lock; }
+};
+
+// NUMA nodes and their CPUs, from sysfs on Linux; a single node elsewhere.
+class NumaTopology {
+public:
+    static const NumaTopology& Get();
+
+    size_t Nodes() const { return cpus_.size(); }
+    const std::vector<int>& Cpus(size_t node) const { return cpus_[node]; }
+    // node of the CPU the calling thread is running on
+    size_t CurrentNode() const;
+
+private:
+    NumaTopology();
+    std::vector<std::vector<int>> cpus_;
+    std::vector<uint16_t> node_of_cpu_;
+};
+
+// One read-only copy of an array in a mapping of its own, written by a
+// thread running on `node` so first-touch allocation puts it there.
+class SnapshotRegion {
+public:
+    // What the kernel actually gave us, for the startup report.
+    struct Report {
+        size_t node = 0;
+        size_t bytes = 0;
+        size_t huge_bytes = 0;      // backed by huge pages (smaps)
+        size_t pages_sampled = 0;   // pages asked about via move_pages
+        size_t pages_on_node = 0;   // ... of those, resident on `node`
+        bool   explicit_huge = false;
+        bool   locked = false;
+    };
+
+    static std::unique_ptr<SnapshotRegion> Create(const void* src, size_t bytes, size_t node,
+        const SnapshotPlacement& placement);
+    ~SnapshotRegion();
+
+    SnapshotRegion(const SnapshotRegion&) = delete;
+    SnapshotRegion& operator=(const SnapshotRegion&) = delete;
+
+    const void* Data() const { return data_; }
+    size_t Bytes() const { return bytes_; }
+    Report Inspect() const;
+
+private:
+    SnapshotRegion() = default;
+    void*  base_ = nullptr;     // the whole mapping
+    size_t mapped_ = 0;
+    void*  data_ = nullptr;     // huge-page aligned start inside it
+    size_t bytes_ = 0;
+    size_t node_ = 0;
+    bool   explicit_huge_ = false;
+    bool   locked_ = false;
+};
+
+// Copies of one array, one per node (or a single one), untyped.
+class ReplicatedArray {
+public:
+    bool Placed() const { return !copies_.empty(); }
+    size_t Copies() const { return copies_.size(); }
+    const SnapshotRegion& Copy(size_t i) const { return *copies_[i]; }
+    void Clear() { copies_.clear(); }
+
+protected:
+    void place(const void* src, size_t bytes, const SnapshotPlacement& placement);
+    const void* local() const;
+
+    std::vector<std::unique_ptr<SnapshotRegion>> copies_;
+};
+
+template <class T>
+class Replicated : public ReplicatedArray {
+public:
+    void Place(const std::vector<T>& master, const SnapshotPlacement& placement) {
+        place(master.data(), master.size() * sizeof(T), placement);
+    }
+    // The calling thread's node's copy; `master`'s data while not placed.
+    // Fetch once per query, or per chunk of a parallel one.
+    const T* Local(const std::vector<T>& master) const {
+        return Placed() ? static_cast<const T*>(local()) : master.data();
+    }
+};
+
+// dTLB read misses and time over `reads` random 8-byte reads of `data`.
+struct TlbProbe {
+    bool   counted = false;         // false: no PMU access, only the timing is real
+    double misses_per_1k = 0;
+    double ns_per_read = 0;
+};
+TlbProbe ProbeRandomReads(const void* data, size_t bytes, size_t reads = 2000000);
+
+// "numa" / "thp" / "explicit" / "mlock" words, comma separated
+SnapshotPlacement ParseSnapshotPlacement(const std::string& spec);
@@ -0,0 +1,354 @@
+﻿#include "source_bundle.h"
+#include "crc32.h"
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+
+static constexpr size_t kChunk = 64 * 1024;
+
+// ---------------- Little-endian helpers ----------------
+static void write_le16(std::string& out, uint16_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+static void write_le32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>((value >> 8) & 0xFF));
+    out.push_back(static_cast<char>((value >> 16) & 0xFF));
+    out.push_back(static_cast<char>((value >> 24) & 0xFF));
+}
+
+// ---------------- ZipStreamWriter ----------------
+ZipStreamWriter::ZipStreamWriter(Sink sink) : sink_(std::move(sink)) {}
+
+bool ZipStreamWriter::emit(const char* data, size_t n) {
+    if (n == 0) return true;
+    written_ += n;
+    return sink_(data, n);
+}
+
+bool ZipStreamWriter::emit(const std::string& bytes) {
+    return emit(bytes.data(), bytes.size());
+}
+
+bool ZipStreamWriter::AddFile(const std::string& name, const std::string& path, bool deflate) {
+    return deflate ? addDeflated(name, path) : addStored(name, path);
+}
+
+bool ZipStreamWriter::addStored(const std::string& name, const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<char> buf(kChunk);
+
+    // pass 1: checksum, so the local header can carry the real values
+    uint32_t crc = 0;
+    uint64_t size = 0;
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+        crc = Crc32Update(crc, buf.data(), static_cast<size_t>(in.gcount()));
+        size += static_cast<uint64_t>(in.gcount());
+    }
+    if (size > 0xFFFFFFFFu) return false;  // no ZIP64
+
+    const uint32_t offset = static_cast<uint32_t>(written_);
+    std::string header;
+    write_le32(header, 0x04034b50);
+    write_le16(header, 20);
+    write_le16(header, 0);
+    write_le16(header, 0);
+    write_le16(header, 0);
+    write_le16(header, 0);
+    write_le32(header, crc);
+    write_le32(header, static_cast<uint32_t>(size));
+    write_le32(header, static_cast<uint32_t>(size));
+    write_le16(header, static_cast<uint16_t>(name.size()));
+    write_le16(header, 0);
+    header.append(name);
+    if (!emit(header)) return false;
+
+    // pass 2: copy
+    in.clear();
+    in.seekg(0);
+    uint64_t copied = 0;
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+        if (!emit(buf.data(), static_cast<size_t>(in.gcount()))) return false;
+        copied += static_cast<uint64_t>(in.gcount());
+    }
+    if (copied != size) return false;  // file changed between passes
+
+    const uint32_t size32 = static_cast<uint32_t>(size);
+    entries_.push_back({ name, 0, 0, crc, size32, size32, offset });
+    return true;
+}
+
+bool ZipStreamWriter::addDeflated(const std::string& name, const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    const uint32_t offset = static_cast<uint32_t>(written_);
+    const uint16_t flags = 0x0008;  // sizes and CRC follow in a data descriptor
+    std::string header;
+    write_le32(header, 0x04034b50);
+    write_le16(header, 20);
+    write_le16(header, flags);
+    write_le16(header, 8);
+    write_le16(header, 0);
+    write_le16(header, 0);
+    write_le32(header, 0);
+    write_le32(header, 0);
+    write_le32(header, 0);
+    write_le16(header, static_cast<uint16_t>(name.size()));
+    write_le16(header, 0);
+    header.append(name);
+    if (!emit(header)) return false;
+
+    z_stream zs{};
+    // negative windowBits: raw deflate, as ZIP expects
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+    std::vector<char> inbuf(kChunk), outbuf(kChunk);
+    uint32_t crc = 0;
+    bool ok = true;
+    int flush = Z_NO_FLUSH;
+    do {
+        in.read(inbuf.data(), inbuf.size());
+        const size_t got = static_cast<size_t>(in.gcount());
+        crc = Crc32Update(crc, inbuf.data(), got);
+        flush = in ? Z_NO_FLUSH : Z_FINISH;
+        zs.next_in = reinterpret_cast<Bytef*>(inbuf.data());
+        zs.avail_in = static_cast<uInt>(got);
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(outbuf.data());
+            zs.avail_out = static_cast<uInt>(outbuf.size());
+            deflate(&zs, flush);
+            ok = emit(outbuf.data(), outbuf.size() - zs.avail_out);
+        } while (ok && zs.avail_out == 0);
+    } while (ok && flush != Z_FINISH);
+    const uint64_t compressed = zs.total_out;
+    const uint64_t size = zs.total_in;
+    deflateEnd(&zs);
+    if (!ok || size > 0xFFFFFFFFu || compressed > 0xFFFFFFFFu) return false;
+
+    std::string descriptor;
+    write_le32(descriptor, 0x08074b50);
+    write_le32(descriptor, crc);
+    write_le32(descriptor, static_cast<uint32_t>(compressed));
+    write_le32(descriptor, static_cast<uint32_t>(size));
+    if (!emit(descriptor)) return false;
+
+    entries_.push_back({ name, flags, 8, crc, static_cast<uint32_t>(compressed), static_cast<uint32_t>(size), offset });
+    return true;
+}
+
+bool ZipStreamWriter::Finish() {
+    const uint32_t central_dir_offset = static_cast<uint32_t>(written_);
+    std::string central_dir;
+    for (const auto& entry : entries_) {
+        write_le32(central_dir, 0x02014b50);
+        write_le16(central_dir, 20);
+        write_le16(central_dir, 20);
+        write_le16(central_dir, entry.flags);
+        write_le16(central_dir, entry.method);
+        write_le16(central_dir, 0);
+        write_le16(central_dir, 0);
+        write_le32(central_dir, entry.crc);
+        write_le32(central_dir, entry.compressed);
+        write_le32(central_dir, entry.size);
+        write_le16(central_dir, static_cast<uint16_t>(entry.name.size()));
+        write_le16(central_dir, 0);
+        write_le16(central_dir, 0);
+        write_le16(central_dir, 0);
+        write_le16(central_dir, 0);
+        write_le32(central_dir, 0);
+        write_le32(central_dir, entry.offset);
+        central_dir.append(entry.name);
+    }
+
+    std::string end;
+    write_le32(end, 0x06054b50);
+    write_le16(end, 0);
+    write_le16(end, 0);
+    write_le16(end, static_cast<uint16_t>(entries_.size()));
+    write_le16(end, static_cast<uint16_t>(entries_.size()));
+    write_le32(end, static_cast<uint32_t>(central_dir.size()));
+    write_le32(end, central_dir_offset);
+    write_le16(end, 0);
+    return emit(central_dir) && emit(end);
+}
+
+// ---------------- SourceBundle ----------------
+SourceBundle::SourceBundle(std::vector<std::string> zip_files, std::vector<std::string> listing_files)
+    : SourceBundle(std::move(zip_files), std::move(listing_files), Options{}) {}
+
+SourceBundle::SourceBundle(std::vector<std::string> zip_files, std::vector<std::string> listing_files, Options opts)
+    : zip_files_(std::move(zip_files)), listing_files_(std::move(listing_files)), opts_(std::move(opts)) {
+    if (opts_.spill_dir.empty()) {
+        std::error_code ec;
+        opts_.spill_dir = std::filesystem::temp_directory_path(ec).string();
+        if (ec) opts_.spill_dir = ".";
+    }
+}
+
+SourceBundle::~SourceBundle() {
+    for (const auto& slot : zip_) {
+        if (slot.artifact && !slot.artifact->body) std::remove(slot.artifact->path.c_str());
+    }
+}
+
+// Size and mtime of every file, hashed (FNV-1a). A missing file hashes as a
+// sentinel and clears *complete.
+std::string SourceBundle::signature(const std::vector<std::string>& files, uint64_t* total, bool* complete) {
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&h](uint64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            h ^= (v >> (8 * i)) & 0xFF;
+            h *= 1099511628211ULL;
+        }
+    };
+    uint64_t sum = 0;
+    bool all = true;
+    for (const auto& path : files) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            all = false;
+            mix(~0ULL);
+            continue;
+        }
+        mix(static_cast<uint64_t>(st.st_size));
+        mix(static_cast<uint64_t>(st.st_mtime));
+        sum += static_cast<uint64_t>(st.st_size);
+    }
+    if (total) *total = sum;
+    if (complete) *complete = all;
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+}
+
+std::shared_ptr<const SourceBundle::Artifact> SourceBundle::buildZip(bool deflate, const std::string& sig,
+    uint64_t input_bytes) {
+    auto a = std::make_shared<Artifact>();
+    a->etag = "\"src-" + sig + (deflate ? "-deflate\"" : "\"");
+
+    if (input_bytes <= opts_.in_memory_max) {
+        auto body = std::make_shared<std::string>();
+        ZipStreamWriter zip([&body](const char* data, size_t n) { body->append(data, n); return true; });
+        for (const auto& f : zip_files_) if (!zip.AddFile(f, f, deflate)) return nullptr;
+        if (!zip.Finish()) return nullptr;
+        a->size = body->size();
+        a->body = std::move(body);
+        return a;
+    }
+
+    // too large to keep resident: write next to a temp name, then rename into place
+    const std::string path = (std::filesystem::path(opts_.spill_dir) /
+        ("airdb-source-" + sig + (deflate ? "-deflate" : "") + ".zip")).string();
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return nullptr;
+        ZipStreamWriter zip([&out](const char* data, size_t n) {
+            out.write(data, static_cast<std::streamsize>(n));
+            return static_cast<bool>(out);
+            });
+        bool ok = true;
+        for (const auto& f : zip_files_) if (ok) ok = zip.AddFile(f, f, deflate);
+        if (!ok || !zip.Finish() || !out.flush()) {
+            out.close();
+            std::remove(tmp.c_str());
+            return nullptr;
+        }
+        a->size = zip.BytesWritten();
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::remove(tmp.c_str());
+        return nullptr;
+    }
+    a->path = path;
+    return a;
+}
+
+std::shared_ptr<const SourceBundle::Artifact> SourceBundle::buildListing(const std::string& sig) {
+    auto body = std::make_shared<std::string>();
+    std::string& out = *body;
+
+    out += "=================================================\n";
+    out += "  Air Travel Database - Complete Source Code\n";
+    out += "  CIS 22C Capstone Project\n";
+    out += "=================================================\n\n";
+
+    std::vector<char> buf(kChunk);
+    for (const auto& filename : listing_files_) {
+        out += "\n\n";
+        out += "╔════════════════════════════════════════════════╗\n";
+        out += "║  FILE: " + filename;
+        if (filename.length() < 38) out.append(38 - filename.length(), ' ');
+        out += "║\n";
+        out += "╚════════════════════════════════════════════════╝\n\n";
+
+        const size_t before = out.size();
+        std::ifstream in(filename, std::ios::binary);
+        while (in && (in.read(buf.data(), buf.size()) || in.gcount() > 0))
+            out.append(buf.data(), static_cast<size_t>(in.gcount()));
+        if (out.size() > before) out += "\n";
+        else out += "// [File not found or could not be read]\n";
+    }
+
+    out += "\n\n=================================================\n";
+    out += "  End of Source Code\n";
+    out += "=================================================\n";
+
+    auto a = std::make_shared<Artifact>();
+    a->size = body->size();
+    a->body = std::move(body);
+    a->etag = "\"listing-" + sig + "\"";
+    return a;
+}
+
+std::shared_ptr<const SourceBundle::Artifact> SourceBundle::Zip(bool deflate) {
+    uint64_t total = 0;
+    bool complete = false;
+    const std::string sig = signature(zip_files_, &total, &complete);
+    if (!complete) return nullptr;
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    Slot& slot = zip_[deflate ? 1 : 0];
+    if (slot.artifact && slot.key == sig) {
+        ++stats_.hits;
+        return slot.artifact;
+    }
+    auto built = buildZip(deflate, sig, total);
+    if (!built) return nullptr;
+    ++stats_.zip_builds;
+    // a replaced spill file may still be in flight; it is unlinked, not truncated
+    if (slot.artifact && !slot.artifact->body && slot.artifact->path != built->path)
+        std::remove(slot.artifact->path.c_str());
+    slot.key = sig;
+    slot.artifact = std::move(built);
+    return slot.artifact;
+}
+
+std::shared_ptr<const SourceBundle::Artifact> SourceBundle::Listing() {
+    // missing files are rendered as a note, so they only need to be part of the key
+    const std::string sig = signature(listing_files_);
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (listing_.artifact && listing_.key == sig) {
+        ++stats_.hits;
+        return listing_.artifact;
+    }
+    ++stats_.listing_builds;
+    listing_.key = sig;
+    listing_.artifact = buildListing(sig);
+    return listing_.artifact;
+}
+
+SourceBundle::Stats SourceBundle::GetStats() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return stats_;
+}
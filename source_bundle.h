@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Writes a ZIP archive front to back through a sink, reading each file in
+// fixed-size chunks, so memory stays bounded whatever the bundle size.
+// Stored entries are checksummed in a first pass and keep their sizes in
+// the local header; deflated entries are compressed on the fly and use a
+// trailing data descriptor.
+class ZipStreamWriter {
+public:
+    using Sink = std::function<bool(const char* data, size_t n)>;
+
+    explicit ZipStreamWriter(Sink sink);
+
+    // Appends `path` under `name`; false when it can't be read or the sink fails.
+    bool AddFile(const std::string& name, const std::string& path, bool deflate = false);
+    // Writes the central directory and end record.
+    bool Finish();
+
+    uint64_t BytesWritten() const { return written_; }
+
+private:
+    struct CentralEntry {
+        std::string name;
+        uint16_t flags;
+        uint16_t method;
+        uint32_t crc;
+        uint32_t compressed;
+        uint32_t size;
+        uint32_t offset;
+    };
+
+    bool emit(const std::string& bytes);
+    bool emit(const char* data, size_t n);
+    bool addStored(const std::string& name, const std::string& path);
+    bool addDeflated(const std::string& name, const std::string& path);
+
+    Sink sink_;
+    uint64_t written_ = 0;
+    std::vector<CentralEntry> entries_;
+};
+
+// The downloadable source artifacts (/download/source ZIP and the
+// /api/source-code listing), rebuilt only when a file's size or mtime
+// changes. Archives larger than in_memory_max are spilled to a file under
+// spill_dir and served from disk instead of being held in memory.
+class SourceBundle {
+public:
+    struct Options {
+        size_t in_memory_max = 8u << 20;
+        std::string spill_dir;  // empty: the system temp directory
+    };
+
+    struct Artifact {
+        std::shared_ptr<const std::string> body; // null when spilled
+        std::string path;                        // spill file when body is null
+        uint64_t size = 0;
+        std::string etag;
+    };
+
+    SourceBundle(std::vector<std::string> zip_files, std::vector<std::string> listing_files);
+    SourceBundle(std::vector<std::string> zip_files, std::vector<std::string> listing_files, Options opts);
+    ~SourceBundle();
+
+    // null when one of the files is missing
+    std::shared_ptr<const Artifact> Zip(bool deflate);
+    std::shared_ptr<const Artifact> Listing();
+
+    struct Stats {
+        uint64_t zip_builds = 0;
+        uint64_t listing_builds = 0;
+        uint64_t hits = 0;
+    };
+    Stats GetStats() const;
+
+private:
+    struct Slot {
+        std::string key;   // signature of the inputs it was built from
+        std::shared_ptr<const Artifact> artifact;
+    };
+
+    static std::string signature(const std::vector<std::string>& files, uint64_t* total = nullptr,
+        bool* complete = nullptr);
+    std::shared_ptr<const Artifact> buildZip(bool deflate, const std::string& sig, uint64_t input_bytes);
+    std::shared_ptr<const Artifact> buildListing(const std::string& sig);
+
+    std::vector<std::string> zip_files_;
+    std::vector<std::string> listing_files_;
+    Options opts_;
+
+    mutable std::mutex mtx_;
+    Slot zip_[2];       // stored, deflated
+    Slot listing_;
+    Stats stats_;
+};
@@ -0,0 +1,173 @@
+﻿#include "static_assets.h"
+#include "compress.h"
+#include "response_cache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+// ---------------- Helpers ----------------
+static bool statFile(const std::string& path, size_t& size, time_t& mtime) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = static_cast<size_t>(st.st_size);
+    mtime = st.st_mtime;
+    return true;
+}
+
+static bool readWhole(const std::string& path, size_t size, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.resize(size);
+    in.read(&out[0], static_cast<std::streamsize>(size));
+    out.resize(static_cast<size_t>(in.gcount()));
+    return true;
+}
+
+// FNV-1a; only used to bust browser caches, not as a security hash.
+static std::string contentHash(const char* data, size_t n) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+}
+
+static std::string fileHash(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    uint64_t h = 1469598103934665603ULL;
+    char buf[65536];
+    while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+        for (std::streamsize i = 0; i < in.gcount(); ++i) {
+            h ^= static_cast<unsigned char>(buf[i]);
+            h *= 1099511628211ULL;
+        }
+    }
+    char out[17];
+    std::snprintf(out, sizeof(out), "%016llx", static_cast<unsigned long long>(h));
+    return out;
+}
+
+static void replaceAll(std::string& s, const std::string& from, const std::string& to) {
+    for (size_t pos = s.find(from); pos != std::string::npos; pos = s.find(from, pos + to.size()))
+        s.replace(pos, from.size(), to);
+}
+
+// ---------------- StaticAssets ----------------
+StaticAssets::StaticAssets() : StaticAssets(Options{}) {}
+
+StaticAssets::StaticAssets(Options opts) : opts_(opts) {}
+
+void StaticAssets::Add(const std::string& url, const std::string& path, const std::string& content_type,
+    bool fingerprint_refs) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    entries_.push_back({ url, path, content_type, fingerprint_refs });
+}
+
+void StaticAssets::Load() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    reloadLocked();
+}
+
+// Plain assets first, so the ones that reference them see their final hashes.
+// A rewritten body differs from its file, so it always stays resident.
+void StaticAssets::reloadLocked() {
+    std::unordered_map<std::string, std::shared_ptr<const StaticAsset>> fresh;
+    size_t resident = 0;
+    size_t from_disk = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const auto& e : entries_) {
+            if (e.fingerprint_refs != (pass == 1)) continue;
+            auto a = std::make_shared<StaticAsset>();
+            a->url = e.url;
+            a->path = e.path;
+            a->content_type = e.content_type;
+            if (!statFile(e.path, a->size, a->mtime) || a->size == 0) continue;
+
+            if (a->size > opts_.gzip_max && !e.fingerprint_refs) {
+                a->hash = fileHash(e.path);
+            }
+            else {
+                std::string body;
+                if (!readWhole(e.path, a->size, body) || body.empty()) continue;
+                if (e.fingerprint_refs) {
+                    for (const auto& ref : fresh) {
+                        replaceAll(body, "\"" + ref.first + "\"",
+                            "\"" + ref.first + "?v=" + ref.second->hash + "\"");
+                    }
+                }
+                a->hash = contentHash(body.data(), body.size());
+                auto gz = GzipCompress(body);
+                if (!gz.empty() && gz.size() < body.size())
+                    a->gzip = std::make_shared<const std::string>(std::move(gz));
+                if (body.size() <= opts_.in_memory_max || e.fingerprint_refs)
+                    a->identity = std::make_shared<const std::string>(std::move(body));
+            }
+            resident += (a->identity ? a->identity->size() : 0) + (a->gzip ? a->gzip->size() : 0);
+            if (!a->identity) ++from_disk;
+            a->etag = "\"" + a->hash + "\"";
+            a->gzip_etag = "\"" + a->hash + "-gz\"";
+            fresh[e.url] = std::move(a);
+        }
+    }
+    assets_ = std::move(fresh);
+    next_check_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(opts_.recheck_ms);
+    std::cout << "Static assets: " << assets_.size() << " files, " << resident / 1024 << " KiB resident, "
+              << from_disk << " sent from disk\n";
+}
+
+bool StaticAssets::changedLocked() const {
+    for (const auto& e : entries_) {
+        size_t size = 0;
+        time_t mtime = 0;
+        const bool exists = statFile(e.path, size, mtime) && size > 0;
+        auto it = assets_.find(e.url);
+        if (it == assets_.end()) {
+            if (exists) return true;
+            continue;
+        }
+        if (!exists || size != it->second->size || mtime != it->second->mtime) return true;
+    }
+    return false;
+}
+
+std::shared_ptr<const StaticAsset> StaticAssets::Get(const std::string& url) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (opts_.recheck_ms > 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_check_) {
+            if (changedLocked()) reloadLocked();
+            else next_check_ = now + std::chrono::milliseconds(opts_.recheck_ms);
+        }
+    }
+    auto it = assets_.find(url);
+    return it == assets_.end() ? nullptr : it->second;
+}
+
+crow::response StaticAssets::Serve(const crow::request& req, const StaticAsset& asset) const {
+    const bool gz = asset.gzip && AcceptsEncoding(req.get_header_value("Accept-Encoding"), "gzip");
+    const std::string& etag = gz ? asset.gzip_etag : asset.etag;
+    const char* v = req.url_params.get("v");
+
+    crow::response res;
+    if (asset.gzip) res.add_header("Vary", "Accept-Encoding");
+    res.add_header("ETag", etag);
+    res.add_header("Cache-Control", v && asset.hash == v
+        ? "public, max-age=31536000, immutable" : "no-cache");
+    if (ResponseCacheMiddleware::ETagMatches(req.get_header_value("If-None-Match"), etag)) {
+        res.code = 304;
+        return res;
+    }
+    if (!gz && !asset.identity) {
+        res.set_static_file_info_unsafe(asset.path, asset.content_type);
+        return res;
+    }
+    res.add_header("Content-Type", asset.content_type);
+    if (gz) res.add_header("Content-Encoding", "gzip");
+    res.shared_body = gz ? asset.gzip : asset.identity;
+    return res;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "crow/http_request.h"
+#include "crow/http_response.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A front-end file as it is served: the gzip body in memory, and the identity
+// body in memory too unless it is large enough to go out through sendfile.
+struct StaticAsset {
+    std::string url;
+    std::string path;
+    std::string content_type;
+    std::shared_ptr<const std::string> identity; // null when served from disk
+    std::shared_ptr<const std::string> gzip;     // null when not worth it
+    std::string hash;       // content hash, used as ?v= fingerprint
+    std::string etag;
+    std::string gzip_etag;
+    size_t      size = 0;
+    time_t      mtime = 0;
+};
+
+// Loads the front-end files once, keeps them in memory and answers
+// conditional requests. Files are re-read when their mtime or size changes
+// (checked at most every recheck_ms). Assets registered with
+// fingerprint_refs get every reference to another asset's URL rewritten to
+// "<url>?v=<hash>", and a request carrying the current ?v= is served with a
+// year-long immutable Cache-Control; anything else gets no-cache.
+class StaticAssets {
+public:
+    struct Options {
+        size_t in_memory_max = 8u << 10;  // larger identity bodies go through sendfile
+        size_t gzip_max = 8u << 20;       // larger files are not precompressed
+        int    recheck_ms = 1000;         // <= 0 disables the mtime watch
+    };
+
+    StaticAssets();
+    explicit StaticAssets(Options opts);
+
+    void Add(const std::string& url, const std::string& path, const std::string& content_type,
+        bool fingerprint_refs = false);
+
+    // Reads every registered file; call after the Add()s.
+    void Load();
+
+    // Current version of an asset, null when its file is missing or empty.
+    std::shared_ptr<const StaticAsset> Get(const std::string& url);
+
+    crow::response Serve(const crow::request& req, const StaticAsset& asset) const;
+
+private:
+    struct Entry {
+        std::string url;
+        std::string path;
+        std::string content_type;
+        bool        fingerprint_refs = false;
+    };
+
+    void reloadLocked();
+    bool changedLocked() const;
+
+    Options opts_;
+    std::mutex mtx_;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, std::shared_ptr<const StaticAsset>> assets_;
+    std::chrono::steady_clock::time_point next_check_;
+};
@@ -0,0 +1,142 @@
+﻿#include "suggest_channel.h"
+#include "crow/json.h"
+
+#include <algorithm>
+
+// ---------------- sessions ----------------
+// Guarded by the channel mutex. `busy` is set while the session is queued or
+// one of its queries runs, which keeps its queries serial.
+struct SuggestChannel::Session {
+    crow::websocket::connection* conn = nullptr;  // null once closed
+    uint64_t     latest = 0;       // highest sequence number received
+    bool         has_pending = false;
+    SuggestQuery pending;
+    bool         busy = false;
+};
+
+static std::shared_ptr<SuggestChannel::Session>* session_of(crow::websocket::connection& conn) {
+    return static_cast<std::shared_ptr<SuggestChannel::Session>*>(conn.userdata());
+}
+
+static std::string error_reply(uint64_t seq, const std::string& msg) {
+    crow::json::wvalue out;
+    out["seq"] = seq;
+    out["error"] = msg;
+    return out.dump();
+}
+
+// ---------------- channel ----------------
+SuggestChannel::SuggestChannel(Runner run, unsigned workers) : run_(std::move(run)) {
+    for (unsigned i = 0; i < std::max(1u, workers); ++i) workers_.emplace_back([this] { work(); });
+}
+
+SuggestChannel::~SuggestChannel() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+void SuggestChannel::Open(crow::websocket::connection& conn) {
+    auto s = std::make_shared<Session>();
+    s->conn = &conn;
+    conn.userdata(new std::shared_ptr<Session>(s));
+    std::lock_guard<std::mutex> lk(mtx_);
+    ++stats_.sessions_open;
+    ++stats_.sessions_total;
+}
+
+void SuggestChannel::Close(crow::websocket::connection& conn) {
+    auto* holder = session_of(conn);
+    if (!holder) return;
+    {
+        // a worker holding mtx_ may be sending on conn; after this it won't
+        std::lock_guard<std::mutex> lk(mtx_);
+        (*holder)->conn = nullptr;
+        (*holder)->has_pending = false;
+        --stats_.sessions_open;
+    }
+    conn.userdata(nullptr);
+    delete holder;
+}
+
+void SuggestChannel::Message(crow::websocket::connection& conn, const std::string& text) {
+    auto* holder = session_of(conn);
+    if (!holder) return;
+
+    SuggestQuery q;
+    auto msg = crow::json::load(text);
+    const bool object = msg && msg.t() == crow::json::type::Object;
+    const bool has_seq = object && msg.has("seq") && msg["seq"].t() == crow::json::type::Number &&
+        msg["seq"].nt() != crow::json::num_type::Floating_point && msg["seq"].i() > 0;
+    bool ok = has_seq && msg.has("q") && msg["q"].t() == crow::json::type::String;
+    if (ok) {
+        q.seq = static_cast<uint64_t>(msg["seq"].i());
+        q.q = msg["q"].s();
+        q.kind = msg.has("kind") && msg["kind"].t() == crow::json::type::String ? std::string(msg["kind"].s()) : "airport";
+        if (msg.has("limit") && msg["limit"].t() == crow::json::type::Number &&
+            msg["limit"].nt() != crow::json::num_type::Floating_point)
+            q.limit = static_cast<size_t>(std::max<int64_t>(1, std::min<int64_t>(100, msg["limit"].i())));
+        ok = q.kind == "airport" || q.kind == "airline";
+    }
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    ++stats_.received;
+    Session& s = **holder;
+    if (!ok || q.seq <= s.latest) {
+        ++stats_.rejected;
+        const uint64_t seq = has_seq ? static_cast<uint64_t>(msg["seq"].i()) : 0;
+        conn.send_text(error_reply(seq, ok ? "sequence number must increase" :
+            "expected {\"seq\": n > 0, \"kind\": \"airport\"|\"airline\", \"q\": text, \"limit\": n}"));
+        return;
+    }
+    s.latest = q.seq;
+    if (s.has_pending) ++stats_.superseded;
+    s.pending = std::move(q);
+    s.has_pending = true;
+    if (!s.busy) enqueue(*holder);
+}
+
+void SuggestChannel::enqueue(const std::shared_ptr<Session>& s) {
+    s->busy = true;
+    queue_.push_back(s);
+    cv_.notify_one();
+}
+
+void SuggestChannel::work() {
+    std::unique_lock<std::mutex> lk(mtx_);
+    for (;;) {
+        cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+        if (stop_) return;
+        auto s = std::move(queue_.front());
+        queue_.pop_front();
+        if (!s->has_pending) { s->busy = false; continue; }
+        SuggestQuery q = std::move(s->pending);
+        s->has_pending = false;
+
+        lk.unlock();
+        std::string items = run_(q);
+        lk.lock();
+
+        ++stats_.executed;
+        if (s->conn && s->latest == q.seq) {
+            std::string reply = "{\"seq\":" + std::to_string(q.seq) + ",\"items\":";
+            reply += items;
+            reply += '}';
+            s->conn->send_text(std::move(reply));  // queues the frame on the connection's io thread
+            ++stats_.sent;
+        }
+        else {
+            ++stats_.stale;
+        }
+        if (s->has_pending && s->conn) queue_.push_back(std::move(s));
+        else s->busy = false;
+    }
+}
+
+SuggestChannel::Stats SuggestChannel::GetStats() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return stats_;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "crow/websocket.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One autocomplete query as the client sent it:
+//   {"seq": 12, "kind": "airport" | "airline", "q": "lon", "limit": 10}
+struct SuggestQuery {
+    uint64_t    seq = 0;
+    std::string kind;
+    std::string q;
+    size_t      limit = 10;
+};
+
+// Autocomplete over WebSockets (/ws/suggest), one connection per input box.
+// Queries carry increasing sequence numbers; each connection keeps only its
+// newest query that has not started yet, so a burst of keystrokes arriving
+// while a query runs costs one more query, not one per keystroke. A result
+// that was overtaken by a newer query while it ran is not sent either. The
+// queries of one connection run one at a time, on the channel's workers
+// rather than the io threads. Replies are {"seq": 12, "items": [...]}, or
+// {"seq": 12, "error": "..."} for a malformed query.
+class SuggestChannel {
+public:
+    // Renders the items array for a query.
+    using Runner = std::function<std::string(const SuggestQuery&)>;
+
+    struct Stats {
+        uint64_t sessions_open = 0;
+        uint64_t sessions_total = 0;
+        uint64_t received = 0;
+        uint64_t executed = 0;
+        uint64_t superseded = 0;  // replaced by a newer query before running
+        uint64_t stale = 0;       // ran, but a newer query arrived meanwhile
+        uint64_t rejected = 0;    // malformed or out of sequence
+        uint64_t sent = 0;
+    };
+
+    explicit SuggestChannel(Runner run, unsigned workers = 2);
+    ~SuggestChannel();
+
+    // wire to the route's onopen / onmessage / onclose
+    void Open(crow::websocket::connection& conn);
+    void Message(crow::websocket::connection& conn, const std::string& text);
+    void Close(crow::websocket::connection& conn);
+
+    Stats GetStats() const;
+
+    struct Session;
+
+private:
+    void work();
+    void enqueue(const std::shared_ptr<Session>& s);  // requires mtx_
+
+    Runner run_;
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Session>> queue_;
+    bool stop_ = false;
+    Stats stats_;
+    std::vector<std::thread> workers_;
+};
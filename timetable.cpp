@@ -0,0 +1,239 @@
+﻿#include "timetable.h"
+#include "airdb.h"
+#include "deadline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <unordered_set>
+
+Timetable::Timetable(TimetableOptions opts) : opts_(opts) {}
+
+// ---------------- Generator ----------------
+static bool departsBefore(const Connection& a, const Connection& b) {
+    if (a.dep_time != b.dep_time) return a.dep_time < b.dep_time;
+    return a.arr_time < b.arr_time;
+}
+
+bool Timetable::stopFor(const AirTravelDB& db, const std::string& iata, StopInfo& out) {
+    auto ap = db.GetAirportByIATA(iata);
+    auto it = stop_by_iata_.find(iata);
+    if (it == stop_by_iata_.end()) {
+        if (stop_iata_.size() >= std::numeric_limits<uint16_t>::max()) return false;
+        if (!ap) return false;
+        it = stop_by_iata_.emplace(iata, static_cast<uint16_t>(stop_iata_.size())).first;
+        stop_iata_.push_back(iata);
+        stop_tz_.push_back(ap->tz_offset);
+    }
+    if (!ap) return false;
+    out = { it->second, ap->latitude, ap->longitude, stop_tz_[it->second] };
+    return true;
+}
+
+void Timetable::addRoute(const AirTravelDB& db, uint32_t i, std::vector<Connection>& out) {
+    const auto& r = db.GetAllRoutes()[i];
+    if (r.stops != 0) return;
+    StopInfo src, dst;
+    if (!stopFor(db, r.src_iata, src) || !stopFor(db, r.dst_iata, dst) || src.stop == dst.stop) return;
+    route_airline_[i] = r.airline_iata;
+
+    double km = db.CalculateDistanceKm(src.lat, src.lon, dst.lat, dst.lon);
+    int daily = km <= opts_.short_haul_km ? opts_.short_haul_daily
+        : km <= opts_.medium_haul_km ? opts_.medium_haul_daily
+        : opts_.long_haul_daily;
+    if (daily <= 0) return;
+    // block time rounded up to 5 minutes
+    int block = opts_.taxi_min + static_cast<int>(std::ceil(km / opts_.cruise_kmh * 60.0));
+    block = (block + 4) / 5 * 5;
+
+    // deterministic per-route jitter so carriers on a pair don't all leave at once
+    const int window = std::max(0, opts_.last_departure_min - opts_.first_departure_min);
+    const int spacing = daily > 1 ? window / (daily - 1) : window;
+    const int jitter_range = std::max(1, std::min(spacing, 60) / 5);
+    const int jitter = static_cast<int>((i * 2654435761u) >> 16) % jitter_range * 5;
+    const int tz_min = static_cast<int>(std::lround(src.tz * 60.0));
+
+    for (int day = 0; day < opts_.days; ++day) {
+        for (int k = 0; k < daily; ++k) {
+            int local = opts_.first_departure_min + (daily > 1 ? k * spacing : window / 2) + jitter;
+            if (daily > 1 && k == daily - 1) local -= jitter; // keep the last one inside the window
+            Connection c;
+            c.dep_time = day * 1440 + local - tz_min;
+            c.arr_time = c.dep_time + block;
+            c.dep_stop = src.stop;
+            c.arr_stop = dst.stop;
+            c.route = i;
+            out.push_back(c);
+        }
+    }
+}
+
+void Timetable::Build(const AirTravelDB& db) {
+    snapshot_.Clear();
+    connections_.clear();
+    stop_iata_.clear(); stop_tz_.clear(); stop_by_iata_.clear();
+
+    const auto& routes = db.GetAllRoutes();
+    route_airline_.assign(routes.size(), std::string{});
+    for (uint32_t i = 0; i < routes.size(); ++i) addRoute(db, i, connections_);
+
+    std::sort(connections_.begin(), connections_.end(), departsBefore);
+    connections_.shrink_to_fit();
+
+    snapshot_.Place(connections_, placement_);
+
+    std::cout << "Timetable: " << connections_.size() << " connections over " << opts_.days
+        << " days, " << stop_iata_.size() << " stops\n";
+}
+
+void Timetable::Update(const Timetable& prev, const AirTravelDB& db, const std::vector<uint32_t>& prev_route,
+    const std::vector<std::string>& moved) {
+    opts_ = prev.opts_;
+    placement_ = prev.placement_;
+    snapshot_.Clear();
+    connections_.clear();
+    // stops keep their numbers; new ones are appended
+    stop_iata_ = prev.stop_iata_;
+    stop_tz_ = prev.stop_tz_;
+    stop_by_iata_ = prev.stop_by_iata_;
+    const std::unordered_set<std::string> touched(moved.begin(), moved.end());
+    for (const auto& iata : moved) {
+        auto it = stop_by_iata_.find(iata);
+        auto ap = db.GetAirportByIATA(iata);
+        if (it != stop_by_iata_.end() && ap) stop_tz_[it->second] = ap->tz_offset;
+    }
+
+    // carried[old index] = new index of a route whose connections stay as they were
+    const auto& routes = db.GetAllRoutes();
+    route_airline_.assign(routes.size(), std::string{});
+    std::vector<uint32_t> carried(prev.route_airline_.size(), kNewRoute);
+    std::vector<Connection> fresh;
+    size_t regenerated = 0;
+    for (uint32_t i = 0; i < routes.size(); ++i) {
+        const uint32_t p = prev_route[i];
+        if (p != kNewRoute && !touched.count(routes[i].src_iata) && !touched.count(routes[i].dst_iata)) {
+            carried[p] = i;
+            route_airline_[i] = prev.route_airline_[p];
+        }
+        else {
+            addRoute(db, i, fresh);
+            ++regenerated;
+        }
+    }
+    std::sort(fresh.begin(), fresh.end(), departsBefore);
+
+    // one merge pass: the carried connections are in order already
+    connections_.reserve(prev.connections_.size() + fresh.size());
+    size_t f = 0;
+    for (Connection c : prev.connections_) {
+        const uint32_t i = carried[c.route];
+        if (i == kNewRoute) continue;
+        c.route = i;
+        while (f < fresh.size() && departsBefore(fresh[f], c)) connections_.push_back(fresh[f++]);
+        connections_.push_back(c);
+    }
+    connections_.insert(connections_.end(), fresh.begin() + static_cast<std::ptrdiff_t>(f), fresh.end());
+    connections_.shrink_to_fit();
+
+    snapshot_.Place(connections_, placement_);
+
+    std::cout << "Timetable: " << connections_.size() << " connections over " << opts_.days
+        << " days, " << stop_iata_.size() << " stops (" << regenerated << " routes regenerated)\n";
+}
+
+void Timetable::PlaceSnapshot(const SnapshotPlacement& placement) {
+    placement_ = placement;
+    snapshot_.Place(connections_, placement_);
+}
+
+// ---------------- Connection scan ----------------
+Itinerary Timetable::EarliestArrival(const std::vector<std::string>& from,
+    const std::vector<std::string>& to, int32_t depart_utc, int min_connection_min, Deadline* deadline) const {
+    Itinerary out;
+    const int mct = min_connection_min < 0 ? opts_.min_connection_min : min_connection_min;
+    constexpr int32_t kInf = std::numeric_limits<int32_t>::max();
+    constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+    const size_t n = stop_iata_.size();
+    std::vector<int32_t>  arrival(n, kInf);  // earliest arrival at stop
+    std::vector<int32_t>  ready(n, kInf);    // earliest departure (arrival + MCT)
+    std::vector<uint32_t> in_conn(n, kNone);
+    std::vector<char>     is_target(n, 0);
+
+    bool any_source = false, any_target = false;
+    for (const auto& code : from) {
+        auto it = stop_by_iata_.find(code);
+        if (it == stop_by_iata_.end()) continue;
+        arrival[it->second] = depart_utc;
+        ready[it->second] = depart_utc;
+        any_source = true;
+    }
+    for (const auto& code : to) {
+        auto it = stop_by_iata_.find(code);
+        if (it == stop_by_iata_.end()) continue;
+        is_target[it->second] = 1;
+        any_target = true;
+    }
+    if (!any_source || !any_target) return out;
+
+    // this thread's node's copy
+    const Connection* conns = snapshot_.Local(connections_);
+    const Connection* conns_end = conns + connections_.size();
+    auto first = std::lower_bound(conns, conns_end, depart_utc,
+        [](const Connection& c, int32_t t) { return c.dep_time < t; });
+
+    int32_t best = kInf;
+    uint16_t best_stop = 0;
+    for (auto it = first; it != conns_end; ++it) {
+        const Connection& c = *it;
+        // nothing departing after the best arrival can improve it
+        if (c.dep_time >= best) break;
+        if (deadline && deadline->Expired()) break;
+        ++out.scanned;
+        if (ready[c.dep_stop] > c.dep_time || c.arr_time >= arrival[c.arr_stop]) continue;
+        arrival[c.arr_stop] = c.arr_time;
+        ready[c.arr_stop] = c.arr_time + mct;
+        in_conn[c.arr_stop] = static_cast<uint32_t>(it - conns);
+        if (is_target[c.arr_stop] && c.arr_time < best) {
+            best = c.arr_time;
+            best_stop = c.arr_stop;
+        }
+    }
+    if (best == kInf) return out;
+
+    for (uint32_t stop = best_stop; in_conn[stop] != kNone;) {
+        const Connection& c = conns[in_conn[stop]];
+        ItineraryLeg leg;
+        leg.src_iata = stop_iata_[c.dep_stop];
+        leg.dst_iata = stop_iata_[c.arr_stop];
+        leg.airline_iata = route_airline_[c.route];
+        leg.dep_time = c.dep_time;
+        leg.arr_time = c.arr_time;
+        leg.src_tz = stop_tz_[c.dep_stop];
+        leg.dst_tz = stop_tz_[c.arr_stop];
+        out.legs.push_back(std::move(leg));
+        stop = c.dep_stop;
+    }
+    std::reverse(out.legs.begin(), out.legs.end());
+    out.found = true;
+    out.arrival = best;
+    out.departure = out.legs.empty() ? depart_utc : out.legs.front().dep_time;
+    return out;
+}
+
+double Timetable::TzOffset(const std::string& iata) const {
+    auto it = stop_by_iata_.find(iata);
+    return it == stop_by_iata_.end() ? 0.0 : stop_tz_[it->second];
+}
+
+std::string Timetable::FormatLocal(int32_t utc_min, double tz_offset, int* day) {
+    int32_t local = utc_min + static_cast<int32_t>(std::lround(tz_offset * 60.0));
+    int32_t d = local >= 0 ? local / 1440 : -((-local + 1439) / 1440);
+    int32_t m = local - d * 1440;
+    if (day) *day = d;
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%02d:%02d", m / 60, m % 60);
+    return buf;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "snapshot_memory.h"
+
+class AirTravelDB;
+class Deadline;
+
+// routes.dat has no schedules, so the timetable is synthetic: every nonstop
+// route is expanded into daily departures spread over the local operating day.
+struct TimetableOptions {
+    int days = 7;                  // service days to generate (day 0 .. days-1)
+    int short_haul_daily = 4;      // departures per day, <= short_haul_km
+    int medium_haul_daily = 2;     // departures per day, <= medium_haul_km
+    int long_haul_daily = 1;
+    double short_haul_km = 1000.0;
+    double medium_haul_km = 4000.0;
+    int first_departure_min = 6 * 60;  // local time of the first departure
+    int last_departure_min = 22 * 60;  // local time of the last departure
+    int taxi_min = 30;             // added to every block time
+    double cruise_kmh = 800.0;
+    int min_connection_min = 45;   // default minimum connection time
+};
+
+// One timetabled flight, packed to 16 bytes so four share a cache line.
+// Times are minutes since day 0 00:00 UTC.
+struct Connection {
+    int32_t  dep_time;
+    int32_t  arr_time;
+    uint16_t dep_stop;
+    uint16_t arr_stop;
+    uint32_t route;   // index into AirTravelDB::GetAllRoutes()
+};
+static_assert(sizeof(Connection) == 16, "Connection must stay 16 bytes");
+
+struct ItineraryLeg {
+    std::string src_iata;
+    std::string dst_iata;
+    std::string airline_iata;
+    int32_t     dep_time = 0;  // UTC minutes
+    int32_t     arr_time = 0;
+    double      src_tz = 0.0;  // hours, for local rendering
+    double      dst_tz = 0.0;
+};
+
+struct Itinerary {
+    bool    found = false;
+    int32_t departure = 0;     // UTC minutes of the first leg
+    int32_t arrival = 0;       // UTC minutes at the target
+    size_t  scanned = 0;       // connections visited by the scan
+    std::vector<ItineraryLeg> legs;
+};
+
+// Connection Scan Algorithm over a departure-sorted connection array.
+// Immutable after Build(), so queries can run concurrently.
+class Timetable {
+public:
+    explicit Timetable(TimetableOptions opts = {});
+
+    void Build(const AirTravelDB& db);
+
+    // Builds the timetable of `db` from `prev`, the one of the version it
+    // was derived from, instead of from scratch. prev_route[i] is the index
+    // route i had there (kNewRoute for an added or replaced row); `moved`
+    // lists the airports whose position or UTC offset changed, or that are
+    // new. Only the routes these touch are generated again; the others keep
+    // their connections, merged back in departure order.
+    static constexpr uint32_t kNewRoute = 0xffffffffu;
+    void Update(const Timetable& prev, const AirTravelDB& db, const std::vector<uint32_t>& prev_route,
+        const std::vector<std::string>& moved);
+
+    // Copies the connection array as `placement` says (see
+    // AirTravelDB::PlaceSnapshot); Build() places the new array the same
+    // way. Not thread-safe: call before serving.
+    void PlaceSnapshot(const SnapshotPlacement& placement);
+    const ReplicatedArray& SnapshotArray() const { return snapshot_; }
+    // the unplaced connection array, for comparison
+    const void* ConnectionData() const { return connections_.data(); }
+
+    // Earliest arrival at any of `to` leaving any of `from` no earlier than
+    // depart_utc. min_connection_min < 0 uses the configured default. When
+    // `deadline` fires the scan stops early: the best itinerary found so far
+    // is real, but a later connection might have arrived sooner.
+    Itinerary EarliestArrival(const std::vector<std::string>& from,
+        const std::vector<std::string>& to,
+        int32_t depart_utc, int min_connection_min = -1, Deadline* deadline = nullptr) const;
+
+    size_t ConnectionCount() const { return connections_.size(); }
+    size_t StopCount() const { return stop_iata_.size(); }
+    const TimetableOptions& Options() const { return opts_; }
+
+    // UTC offset (hours) of a stop, 0 when unknown
+    double TzOffset(const std::string& iata) const;
+
+    // "HH:MM" local time and day number for a UTC minute value
+    static std::string FormatLocal(int32_t utc_min, double tz_offset, int* day = nullptr);
+
+private:
+    struct StopInfo { uint16_t stop; double lat, lon, tz; };
+    bool stopFor(const AirTravelDB& db, const std::string& iata, StopInfo& out);
+    // appends the connections of route i
+    void addRoute(const AirTravelDB& db, uint32_t i, std::vector<Connection>& out);
+
+    TimetableOptions opts_;
+    std::vector<Connection>  connections_;
+    Replicated<Connection>   snapshot_;
+    SnapshotPlacement        placement_;
+    std::vector<std::string> stop_iata_;
+    std::vector<double>      stop_tz_;
+    std::unordered_map<std::string, uint16_t> stop_by_iata_;
+    std::vector<std::string> route_airline_; // airline code per routes.dat row
+};